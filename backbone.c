@@ -0,0 +1,210 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "canon.h"
+#include "backbone.h"
+
+/* Number of remembered dead positions. The table is direct-mapped, and
+ * only used if it can be allocated: the searches are correct without
+ * it.
+ */
+#define BACKBONE_CACHE_SIZE	16384
+
+struct backbone {
+	const struct cdok_puzzle	*puzzle;
+	const struct cdok_strategy	*strategy;
+	cdok_set_t			*possible;
+	cdok_set_t			allowed[CDOK_CELLS];
+	uint8_t				values[CDOK_CELLS];
+	struct cdok_fingerprint		*dead;
+	struct cdok_backbone_stats	stats;
+};
+
+/* Mark the values of a solution as possible. */
+static void record(struct backbone *b)
+{
+	int i;
+
+	for (i = 0; i < CDOK_CELLS; i++)
+		if (b->values[i])
+			b->possible[i] |= CDOK_SET_SINGLE(b->values[i]);
+
+	b->stats.solutions++;
+}
+
+/* Look up a position among the dead ones. Dead positions are only ever
+ * added while the allowed sets are narrowed, so an entry stays true.
+ */
+static struct cdok_fingerprint *lookup(struct backbone *b,
+				       struct cdok_fingerprint *fp)
+{
+	cdok_fingerprint_bytes(b->values, CDOK_CELLS, fp);
+	if (!fp->hi && !fp->lo)
+		fp->lo = 1;
+
+	return &b->dead[fp->lo & (BACKBONE_CACHE_SIZE - 1)];
+}
+
+/* Search for a solution extending the current position, trying values
+ * not yet seen in the branching cell first, since a solution using one
+ * of them settles a later query too. Returns 1 if one was found.
+ */
+static int search(struct backbone *b)
+{
+	const int size = b->puzzle->size;
+	cdok_set_t candidates[CDOK_CELLS];
+	struct cdok_fingerprint fp;
+	struct cdok_fingerprint *e = NULL;
+	uint8_t order[CDOK_SIZE];
+	uint8_t sorted[CDOK_SIZE];
+	cdok_pos_t cell;
+	int count;
+	int n = 0;
+	int i;
+
+	b->stats.nodes++;
+
+	if (cdok_solver_candidates(b->puzzle, b->strategy, b->values,
+				   b->allowed, candidates) < 0)
+		return 0;
+
+	cell = b->strategy->steps[CDOK_STEP_SELECT]->fn.select
+		(b->values, candidates, size);
+	if (cell < 0) {
+		record(b);
+		return 1;
+	}
+
+	if (!candidates[cell])
+		return 0;
+
+	if (b->dead) {
+		e = lookup(b, &fp);
+		if (e->hi == fp.hi && e->lo == fp.lo) {
+			b->stats.hits++;
+			return 0;
+		}
+	}
+
+	count = b->strategy->steps[CDOK_STEP_ORDER]->fn.order
+		(candidates[cell], size, order);
+
+	for (i = 0; i < count; i++)
+		if (!(b->possible[cell] & CDOK_SET_SINGLE(order[i])))
+			sorted[n++] = order[i];
+	for (i = 0; i < count; i++)
+		if (b->possible[cell] & CDOK_SET_SINGLE(order[i]))
+			sorted[n++] = order[i];
+
+	for (i = 0; i < n; i++) {
+		int r;
+
+		b->values[cell] = sorted[i];
+		r = search(b);
+		b->values[cell] = 0;
+
+		if (r)
+			return 1;
+	}
+
+	/* Look again: the slot may have been reused while branching. */
+	if (b->dead) {
+		e = &b->dead[fp.lo & (BACKBONE_CACHE_SIZE - 1)];
+		*e = fp;
+	}
+
+	return 0;
+}
+
+int cdok_backbone(const struct cdok_puzzle *puz,
+		  const struct cdok_strategy *strategy,
+		  cdok_set_t *possible, struct cdok_backbone_stats *stats)
+{
+	struct cdok_strategy def;
+	struct backbone b;
+	int r = 0;
+	int x, y;
+
+	if (!strategy) {
+		cdok_strategy_init(&def);
+		strategy = &def;
+	}
+
+	memset(possible, 0, CDOK_CELLS * sizeof(possible[0]));
+
+	b.puzzle = puz;
+	b.strategy = strategy;
+	b.possible = possible;
+	b.dead = calloc(BACKBONE_CACHE_SIZE, sizeof(b.dead[0]));
+	memset(&b.stats, 0, sizeof(b.stats));
+	memcpy(b.values, puz->values, sizeof(b.values));
+
+	/* Every value in a solution survives propagation from the start. */
+	if (cdok_solver_candidates(puz, strategy, b.values, NULL,
+				   b.allowed) < 0 || !search(&b)) {
+		r = -1;
+		goto out;
+	}
+
+	for (y = 0; y < puz->size; y++)
+		for (x = 0; x < puz->size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+			cdok_set_t todo;
+
+			if (puz->values[c])
+				continue;
+
+			while ((todo = b.allowed[c] & ~possible[c])) {
+				const cdok_set_t s = todo & -todo;
+
+				b.stats.queries++;
+				b.values[c] = __builtin_ctz(s) + 1;
+				if (!search(&b)) {
+					b.allowed[c] &= ~s;
+					b.stats.refuted++;
+				}
+				b.values[c] = 0;
+			}
+		}
+
+out:
+	if (stats)
+		*stats = b.stats;
+
+	free(b.dead);
+	return r;
+}
+
+int cdok_backbone_forced(const struct cdok_puzzle *puz,
+			 const cdok_set_t *possible)
+{
+	int count = 0;
+	int x, y;
+
+	for (y = 0; y < puz->size; y++)
+		for (x = 0; x < puz->size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+			const cdok_set_t s = possible[c];
+
+			if (!puz->values[c] && s && !(s & (s - 1)))
+				count++;
+		}
+
+	return count;
+}
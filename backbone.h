@@ -0,0 +1,70 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef BACKBONE_H_
+#define BACKBONE_H_
+
+/* Backbones. A puzzle with more than one solution may still fix the
+ * values of many of its cells. The backbone gives, for each cell, the
+ * set of values it takes in some solution: a cell with a single value
+ * is forced, and the others show where the puzzle needs another
+ * constraint.
+ *
+ * Each cell is settled by asking, one value at a time, for a solution
+ * in which it takes a value not yet seen there. Every solution found
+ * answers the same question for all the other cells at once, and each
+ * value ruled out is kept out of every later search. Positions found
+ * to have no solution are remembered, since ruling out more values
+ * can't give them one.
+ */
+
+#include <stdint.h>
+#include "cdok.h"
+#include "solver.h"
+
+/* Backbone statistics:
+ *
+ *    queries:   searches for a solution with a given value in a cell
+ *    solutions: solutions found
+ *    refuted:   values ruled out by a failed search
+ *    nodes:     positions visited, over all searches
+ *    hits:      positions known to have no solution
+ */
+struct cdok_backbone_stats {
+	uint64_t	queries;
+	uint64_t	solutions;
+	uint64_t	refuted;
+	uint64_t	nodes;
+	uint64_t	hits;
+};
+
+/* Find the backbone of a puzzle, using the given strategy (NULL for the
+ * default). The set of values for each cell is written to possible:
+ * given cells have their own value, and cells outside the grid have
+ * none. The stats may be NULL.
+ *
+ * Returns 0 if the puzzle is solvable, or -1 if it isn't, in which case
+ * every set is empty.
+ */
+int cdok_backbone(const struct cdok_puzzle *puz,
+		  const struct cdok_strategy *strategy,
+		  cdok_set_t *possible, struct cdok_backbone_stats *stats);
+
+/* Count the empty cells of a puzzle which the backbone forces. */
+int cdok_backbone_forced(const struct cdok_puzzle *puz,
+			 const cdok_set_t *possible);
+
+#endif
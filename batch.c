@@ -0,0 +1,462 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "queue.h"
+#include "batch.h"
+
+/* Number of jobs in flight per worker thread. */
+#define JOBS_PER_THREAD		4
+
+typedef enum {
+	STAGE_READ = 0,
+	STAGE_PARSE,
+	STAGE_PROCESS,
+	STAGE_RENDER,
+	STAGE_COUNT
+} stage_t;
+
+static const char *const stage_names[STAGE_COUNT] = {
+	[STAGE_READ]	= "read",
+	[STAGE_PARSE]	= "parse",
+	[STAGE_PROCESS]	= "solve",
+	[STAGE_RENDER]	= "render"
+};
+
+/* Per-stage state. The input queue carries jobs, and a NULL job tells
+ * one worker thread to stop. When the last thread of a stage stops, it
+ * stops the threads of the next stage in the same way.
+ *
+ * The busy time and item counts are updated atomically and are used
+ * only for reporting.
+ */
+struct stage {
+	struct queue		queue;
+	int			threads;
+	int			running;
+	uint64_t		busy_ns;
+	unsigned long		items;
+};
+
+struct batch {
+	const struct batch_ops	*ops;
+	void			*arg;
+	batch_flags_t		flags;
+	FILE			*out;
+	int			abort;
+
+	struct batch_job	*jobs;
+	unsigned int		num_jobs;
+	struct queue		free_jobs;
+	struct stage		stages[STAGE_COUNT];
+
+	/* Reordering window, indexed by job index modulo the number of
+	 * jobs. Entries are filled by render threads and emptied by
+	 * whichever thread holds the write lock.
+	 */
+	struct batch_job	**reorder;
+	unsigned long		next_write;
+	pthread_mutex_t		write_lock;
+};
+
+struct stage_thread {
+	struct batch		*batch;
+	stage_t			stage;
+	pthread_t		tid;
+};
+
+static uint64_t clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+int batch_job_append(struct batch_job *job, const char *text, size_t len)
+{
+	if (job->text_len + len + 1 > job->text_size) {
+		size_t size = job->text_size ? job->text_size : 256;
+		char *n;
+
+		while (job->text_len + len + 1 > size)
+			size <<= 1;
+
+		n = realloc(job->text, size);
+		if (!n)
+			return -1;
+
+		job->text = n;
+		job->text_size = size;
+	}
+
+	memcpy(job->text + job->text_len, text, len);
+	job->text_len += len;
+	job->text[job->text_len] = 0;
+
+	return 0;
+}
+
+static void write_job(struct batch *b, struct batch_job *j)
+{
+	if (j->out_len)
+		fwrite(j->out_buf, 1, j->out_len, b->out);
+}
+
+/* Write rendered jobs in input order. The job is placed in the
+ * reordering window, and then we try to become the writer. If another
+ * thread is already writing, it'll pick up our job -- this is
+ * guaranteed by the recheck after it releases the lock.
+ */
+static void emit_ordered(struct batch *b, struct batch_job *j)
+{
+	__atomic_store_n(&b->reorder[j->index % b->num_jobs], j,
+			 __ATOMIC_SEQ_CST);
+
+	for (;;) {
+		unsigned long next;
+
+		if (pthread_mutex_trylock(&b->write_lock))
+			return;
+
+		for (;;) {
+			struct batch_job **s =
+				&b->reorder[b->next_write % b->num_jobs];
+			struct batch_job *w =
+				__atomic_load_n(s, __ATOMIC_ACQUIRE);
+
+			if (!w)
+				break;
+
+			__atomic_store_n(s, NULL, __ATOMIC_RELAXED);
+			write_job(b, w);
+			__atomic_store_n(&b->next_write, b->next_write + 1,
+					 __ATOMIC_SEQ_CST);
+			queue_push(&b->free_jobs, w);
+		}
+
+		pthread_mutex_unlock(&b->write_lock);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		next = __atomic_load_n(&b->next_write, __ATOMIC_SEQ_CST);
+		if (!__atomic_load_n(&b->reorder[next % b->num_jobs],
+				     __ATOMIC_SEQ_CST))
+			return;
+	}
+}
+
+static void emit_unordered(struct batch *b, struct batch_job *j)
+{
+	pthread_mutex_lock(&b->write_lock);
+	write_job(b, j);
+	pthread_mutex_unlock(&b->write_lock);
+
+	queue_push(&b->free_jobs, j);
+}
+
+/* Run one job through the given stage and pass it on. */
+static void run_stage(struct batch *b, stage_t stage, struct batch_job *j)
+{
+	switch (stage) {
+	case STAGE_PARSE:
+		b->ops->parse(b->arg, j);
+		queue_push(&b->stages[STAGE_PROCESS].queue, j);
+		break;
+
+	case STAGE_PROCESS:
+		if (j->valid)
+			b->ops->process(b->arg, j);
+		queue_push(&b->stages[STAGE_RENDER].queue, j);
+		break;
+
+	case STAGE_RENDER:
+		fseeko(j->out, 0, SEEK_SET);
+		b->ops->render(b->arg, j, j->out);
+		fflush(j->out);
+		j->out_len = ftello(j->out);
+
+		if (b->flags & BATCH_UNORDERED)
+			emit_unordered(b, j);
+		else
+			emit_ordered(b, j);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void *stage_worker(void *arg)
+{
+	struct stage_thread *t = arg;
+	struct batch *b = t->batch;
+	struct stage *s = &b->stages[t->stage];
+
+	for (;;) {
+		struct batch_job *j = queue_pop(&s->queue);
+		uint64_t start;
+
+		if (!j)
+			break;
+
+		start = clock_ns();
+		run_stage(b, t->stage, j);
+		__atomic_add_fetch(&s->busy_ns, clock_ns() - start,
+				   __ATOMIC_RELAXED);
+		__atomic_add_fetch(&s->items, 1, __ATOMIC_RELAXED);
+	}
+
+	if (!__atomic_sub_fetch(&s->running, 1, __ATOMIC_SEQ_CST) &&
+	    t->stage + 1 < STAGE_COUNT &&
+	    !__atomic_load_n(&b->abort, __ATOMIC_SEQ_CST)) {
+		struct stage *n = &b->stages[t->stage + 1];
+		int i;
+
+		for (i = 0; i < n->threads; i++)
+			queue_push(&n->queue, NULL);
+	}
+
+	return NULL;
+}
+
+/* Read jobs until the input is exhausted, then stop the parsers. */
+static int read_jobs(struct batch *b)
+{
+	struct stage *s = &b->stages[STAGE_READ];
+	unsigned long index = 0;
+	int ret = 0;
+	int i;
+
+	for (;;) {
+		struct batch_job *j = queue_pop(&b->free_jobs);
+		uint64_t start = clock_ns();
+		int r;
+
+		j->index = index;
+		j->text_len = 0;
+		j->valid = 0;
+		j->result = 0;
+		j->diff = 0;
+		j->time_us = 0;
+
+		r = b->ops->read(b->arg, j);
+		s->busy_ns += clock_ns() - start;
+
+		if (r <= 0) {
+			queue_push(&b->free_jobs, j);
+			ret = r;
+			break;
+		}
+
+		s->items++;
+		index++;
+		queue_push(&b->stages[STAGE_PARSE].queue, j);
+	}
+
+	for (i = 0; i < b->stages[STAGE_PARSE].threads; i++)
+		queue_push(&b->stages[STAGE_PARSE].queue, NULL);
+
+	return ret;
+}
+
+static void print_stats(const struct batch *b, uint64_t wall_ns)
+{
+	int i;
+
+	fprintf(stderr, "%-8s %8s %10s %10s %8s\n",
+		"Stage", "Threads", "Items", "Busy (s)", "Util");
+
+	for (i = 0; i < STAGE_COUNT; i++) {
+		const struct stage *s = &b->stages[i];
+		double busy = s->busy_ns / 1e9;
+		double util = wall_ns ?
+			(double)s->busy_ns / wall_ns / s->threads : 0;
+
+		fprintf(stderr, "%-8s %8d %10lu %10.3f %7.1f%%\n",
+			stage_names[i], s->threads, s->items, busy,
+			util * 100.0);
+	}
+
+	fprintf(stderr, "Wall time: %.3f s\n", wall_ns / 1e9);
+}
+
+static int init_batch(struct batch *b, unsigned int max_threads)
+{
+	unsigned int i;
+
+	b->jobs = calloc(b->num_jobs, sizeof(b->jobs[0]));
+	b->reorder = calloc(b->num_jobs, sizeof(b->reorder[0]));
+	if (!b->jobs || !b->reorder)
+		return -1;
+
+	if (queue_init(&b->free_jobs, b->num_jobs) < 0)
+		return -1;
+
+	for (i = 0; i < b->num_jobs; i++) {
+		struct batch_job *j = &b->jobs[i];
+
+		j->out = open_memstream(&j->out_buf, &j->out_size);
+		if (!j->out)
+			return -1;
+
+		queue_push(&b->free_jobs, j);
+	}
+
+	for (i = STAGE_PARSE; i < STAGE_COUNT; i++)
+		if (queue_init(&b->stages[i].queue,
+			       b->num_jobs + max_threads) < 0)
+			return -1;
+
+	return 0;
+}
+
+static void destroy_batch(struct batch *b)
+{
+	unsigned int i;
+
+	for (i = STAGE_PARSE; i < STAGE_COUNT; i++)
+		if (b->stages[i].queue.slots)
+			queue_destroy(&b->stages[i].queue);
+
+	if (b->free_jobs.slots)
+		queue_destroy(&b->free_jobs);
+
+	if (b->jobs)
+		for (i = 0; i < b->num_jobs; i++) {
+			struct batch_job *j = &b->jobs[i];
+
+			if (j->out)
+				fclose(j->out);
+			free(j->out_buf);
+			free(j->text);
+		}
+
+	free(b->jobs);
+	free(b->reorder);
+}
+
+/* Start the worker threads for every stage. If we fail part way, the
+ * threads which did start are stopped directly, and the usual
+ * stage-to-stage shutdown is disabled.
+ */
+static int start_threads(struct batch *b, struct stage_thread *threads,
+			 int *started)
+{
+	int i;
+
+	*started = 0;
+
+	for (i = STAGE_PARSE; i < STAGE_COUNT; i++) {
+		struct stage *s = &b->stages[i];
+		int k;
+
+		s->running = s->threads;
+
+		for (k = 0; k < s->threads; k++) {
+			struct stage_thread *t = &threads[*started];
+
+			t->batch = b;
+			t->stage = i;
+			if (pthread_create(&t->tid, NULL, stage_worker, t))
+				goto fail;
+
+			(*started)++;
+		}
+	}
+
+	return 0;
+
+fail:
+	__atomic_store_n(&b->abort, 1, __ATOMIC_SEQ_CST);
+	for (i = 0; i < *started; i++)
+		queue_push(&b->stages[threads[i].stage].queue, NULL);
+
+	return -1;
+}
+
+int batch_run(const struct batch_ops *ops, void *arg,
+	      const struct batch_config *cfg, FILE *out)
+{
+	struct stage_thread *threads = NULL;
+	struct batch b;
+	uint64_t start = clock_ns();
+	int total = 0;
+	int started = 0;
+	int max = 1;
+	int ret = -1;
+	int i;
+
+	memset(&b, 0, sizeof(b));
+	b.ops = ops;
+	b.arg = arg;
+	b.flags = cfg->flags;
+	b.out = out;
+	pthread_mutex_init(&b.write_lock, NULL);
+
+	b.stages[STAGE_READ].threads = 1;
+	b.stages[STAGE_PARSE].threads = cfg->parse_threads;
+	b.stages[STAGE_PROCESS].threads = cfg->process_threads;
+	b.stages[STAGE_RENDER].threads = cfg->render_threads;
+
+	if (b.stages[STAGE_PROCESS].threads <= 0) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+		b.stages[STAGE_PROCESS].threads = n > 0 ? n : 1;
+	}
+
+	for (i = STAGE_PARSE; i < STAGE_COUNT; i++) {
+		if (b.stages[i].threads <= 0)
+			b.stages[i].threads = 1;
+
+		if (b.stages[i].threads > max)
+			max = b.stages[i].threads;
+
+		total += b.stages[i].threads;
+	}
+
+	b.num_jobs = total * JOBS_PER_THREAD;
+	threads = calloc(total, sizeof(threads[0]));
+
+	if (!threads || init_batch(&b, max) < 0) {
+		fprintf(stderr, "batch: out of memory\n");
+		goto out;
+	}
+
+	if (start_threads(&b, threads, &started) < 0) {
+		fprintf(stderr, "batch: can't start worker threads\n");
+	} else {
+		ret = read_jobs(&b);
+	}
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i].tid, NULL);
+
+	if (cfg->flags & BATCH_STATS)
+		print_stats(&b, clock_ns() - start);
+
+out:
+	destroy_batch(&b);
+	pthread_mutex_destroy(&b.write_lock);
+	free(threads);
+
+	return ret;
+}
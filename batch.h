@@ -0,0 +1,133 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+/* Batch processing. Puzzles pass through a pipeline of stages:
+ *
+ *    read:    split the input into puzzle texts (calling thread only)
+ *    parse:   turn each text into a puzzle structure
+ *    process: solve the puzzle
+ *    render:  format the results into a per-job output buffer
+ *
+ * Each of the last three stages is served by its own pool of threads,
+ * and stages are connected by bounded lock-free queues (see queue.h).
+ * Rendered jobs are written either in input order, using a reordering
+ * window, or in order of completion.
+ *
+ * A fixed number of jobs are in flight at any time. When they're all
+ * in use, the reader stalls until the oldest has been written, so a
+ * slow stage applies backpressure to the stages before it rather than
+ * letting memory grow without limit.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "cdok.h"
+#include "solver.h"
+#include "verify.h"
+#include "rating.h"
+
+struct batch_job {
+	/* Position of this job in the input, starting from 0 */
+	unsigned long		index;
+
+	/* Raw text, filled in by the reader via batch_job_append() */
+	char			*text;
+	size_t			text_len;
+	size_t			text_size;
+
+	/* Set by the parser. If the puzzle is not valid, it's passed
+	 * straight to the renderer without being processed.
+	 */
+	int			valid;
+	struct cdok_puzzle	puz;
+
+	/* Set by the processing function */
+	uint8_t			solution[CDOK_CELLS];
+	int			result;
+	int			diff;
+	uint64_t		count;
+	cdok_set_t		possible[CDOK_CELLS];
+	struct cdok_rating	rating;
+	uint64_t		time_us;
+	struct cdok_solve_stats	stats;
+	struct cdok_violation	violation;
+
+	/* Private to the batch runner */
+	FILE			*out;
+	char			*out_buf;
+	size_t			out_size;
+	size_t			out_len;
+};
+
+/* Append text to a job. Returns 0 on success or -1 if memory couldn't
+ * be allocated.
+ */
+int batch_job_append(struct batch_job *job, const char *text, size_t len);
+
+/* Batch callbacks. All are given the same user argument.
+ *
+ *    read:    fill in the text of the next job (index is already set).
+ *             Returns 1 if a job was read, 0 at the end of input or -1
+ *             if an unrecoverable error occurs. Called only from the
+ *             thread which called batch_run().
+ *    parse:   set up the puzzle from the job text and set the valid
+ *             flag.
+ *    process: handle a valid job.
+ *    render:  write the results of a job to the given stream. The
+ *             text is buffered and later written to the batch output.
+ *
+ * All but the read callback are called concurrently from worker
+ * threads.
+ */
+struct batch_ops {
+	int		(*read)(void *arg, struct batch_job *job);
+	void		(*parse)(void *arg, struct batch_job *job);
+	void		(*process)(void *arg, struct batch_job *job);
+	void		(*render)(void *arg, const struct batch_job *job,
+				  FILE *out);
+};
+
+typedef enum {
+	BATCH_ORDERED		= 0x00,
+	BATCH_UNORDERED		= 0x01,
+	BATCH_STATS		= 0x02
+} batch_flags_t;
+
+/* Pipeline configuration. A thread count of 0 for the processing stage
+ * means one thread per online CPU. The parse and render stages default
+ * to a single thread each.
+ *
+ * If BATCH_STATS is given, per-stage utilization is reported on
+ * stderr when the batch completes.
+ */
+struct batch_config {
+	int			parse_threads;
+	int			process_threads;
+	int			render_threads;
+	batch_flags_t		flags;
+};
+
+/* Run a batch to completion, writing rendered output to the given
+ * stream. Returns 0 on success or -1 if reading failed or resources
+ * couldn't be allocated.
+ */
+int batch_run(const struct batch_ops *ops, void *arg,
+	      const struct batch_config *cfg, FILE *out);
+
+#endif
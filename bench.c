@@ -0,0 +1,617 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "solver.h"
+#include "printer.h"
+#include "bench.h"
+
+static const char *const op_names[BENCH_OPS] = {
+	[BENCH_GEN_GRID]	= "gen-grid",
+	[BENCH_GENERATE]	= "generate",
+	[BENCH_SOLVE]		= "solve",
+	[BENCH_FORMAT]		= "format",
+	[BENCH_SPEC]		= "spec"
+};
+
+const char *bench_op_name(bench_op_t op)
+{
+	return op_names[op];
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* 64-bit FNV-1a, used to checksum the output of each operation. */
+#define CHECKSUM_INIT	0xcbf29ce484222325ULL
+
+static uint64_t checksum_add(uint64_t h, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+static uint64_t checksum_int(uint64_t h, int v)
+{
+	const int32_t x = v;
+
+	return checksum_add(h, &x, sizeof(x));
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	const uint64_t x = *(const uint64_t *)a;
+	const uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of a sorted array. */
+static uint64_t percentile(const uint64_t *v, unsigned int n, int p)
+{
+	unsigned int rank = ((uint64_t)n * p + 99) / 100;
+
+	if (rank < 1)
+		rank = 1;
+
+	return v[rank - 1];
+}
+
+/* Summarize a set of latencies. The array is sorted in place. */
+static void summarize(struct bench_result *r, int size, bench_op_t op,
+		      uint64_t *lat, unsigned int n, uint64_t checksum)
+{
+	double var = 0.0;
+	unsigned int i;
+
+	memset(r, 0, sizeof(*r));
+	r->size = size;
+	r->op = op;
+	r->count = n;
+	r->checksum = checksum;
+
+	if (!n)
+		return;
+
+	for (i = 0; i < n; i++)
+		r->total_ns += lat[i];
+
+	r->mean_ns = (double)r->total_ns / n;
+	for (i = 0; i < n; i++) {
+		const double d = lat[i] - r->mean_ns;
+
+		var += d * d;
+	}
+
+	if (n > 1)
+		r->stddev_ns = sqrt(var / (n - 1));
+
+	qsort(lat, n, sizeof(lat[0]), cmp_u64);
+	r->p50_ns = percentile(lat, n, 50);
+	r->p95_ns = percentile(lat, n, 95);
+	r->p99_ns = percentile(lat, n, 99);
+	r->max_ns = lat[n - 1];
+}
+
+int bench_run(const struct bench_config *cfg, int size,
+	      const struct cdok_puzzle *corpus, int corpus_count,
+	      struct bench_result *results)
+{
+	struct cdok_puzzle *generated;
+	struct cdok_glyphs glyphs;
+	struct cdok_gen gen;
+	uint64_t *lat;
+	uint64_t sum;
+	uint64_t nodes = 0;
+	char *buf;
+	int n = cfg->count;
+	int calls;
+	int i;
+
+	/* A given corpus is run through as many times as it takes to
+	 * make at least the configured number of calls.
+	 */
+	if (corpus) {
+		calls = (cfg->count + corpus_count - 1) / corpus_count *
+			corpus_count;
+		if (calls > n)
+			n = calls;
+	} else {
+		calls = cfg->count;
+	}
+
+	generated = malloc(sizeof(generated[0]) * cfg->count);
+	lat = malloc(sizeof(lat[0]) * n);
+	buf = malloc(CDOK_FORMAT_MAX);
+
+	if (!generated || !lat || !buf) {
+		free(generated);
+		free(lat);
+		free(buf);
+		return -1;
+	}
+
+	/* Grid generation. The grids are kept as solutions for the
+	 * generate benchmark.
+	 */
+	cdok_gen_init(&gen, cfg->seed + size);
+	sum = CHECKSUM_INIT;
+	for (i = 0; i < cfg->count; i++) {
+		const uint64_t start = now_ns();
+
+		cdok_init_puzzle(&generated[i], size);
+		cdok_generate_grid(&gen, generated[i].values, size);
+		lat[i] = now_ns() - start;
+
+		sum = checksum_add(sum, generated[i].values, CDOK_CELLS);
+	}
+	summarize(&results[BENCH_GEN_GRID], size, BENCH_GEN_GRID,
+		  lat, cfg->count, sum);
+
+	sum = CHECKSUM_INIT;
+	for (i = 0; i < cfg->count; i++) {
+		uint8_t solution[CDOK_CELLS];
+		uint64_t start;
+		int diff;
+		int len;
+
+		memcpy(solution, generated[i].values, sizeof(solution));
+		start = now_ns();
+		diff = cdok_generate(&gen, &generated[i], solution, size,
+				     cfg->flags, cfg->iterations, 0, 0);
+		lat[i] = now_ns() - start;
+
+		len = cdok_render_spec(&generated[i], generated[i].values,
+				       buf, CDOK_FORMAT_MAX);
+		sum = checksum_add(sum, buf, len);
+		sum = checksum_int(sum, diff);
+	}
+	summarize(&results[BENCH_GENERATE], size, BENCH_GENERATE,
+		  lat, cfg->count, sum);
+
+	if (!corpus) {
+		corpus = generated;
+		corpus_count = cfg->count;
+	}
+
+	/* The remaining operations are timed on the corpus */
+
+	sum = CHECKSUM_INIT;
+	for (i = 0; i < calls; i++) {
+		uint8_t solution[CDOK_CELLS];
+		const uint64_t start = now_ns();
+		int diff = 0;
+		int r;
+
+		r = cdok_solve_strategy(&corpus[i % corpus_count],
+					cfg->strategy, solution, &diff, NULL);
+		lat[i] = now_ns() - start;
+
+		sum = checksum_int(sum, r);
+		sum = checksum_int(sum, diff);
+		if (r >= 0)
+			sum = checksum_add(sum, solution, CDOK_CELLS);
+	}
+	summarize(&results[BENCH_SOLVE], size, BENCH_SOLVE,
+		  lat, calls, sum);
+
+	/* Node counts come from a separate, untimed pass, since
+	 * collecting statistics slows the solver down.
+	 */
+	for (i = 0; i < corpus_count; i++) {
+		struct cdok_solve_stats st;
+
+		cdok_solve_strategy(&corpus[i], cfg->strategy,
+				    NULL, NULL, &st);
+		nodes += st.nodes;
+	}
+	results[BENCH_SOLVE].nodes = nodes;
+
+	if (cfg->strategy && !cdok_strategy_is_default(cfg->strategy))
+		cdok_strategy_name(cfg->strategy,
+				   results[BENCH_SOLVE].strategy,
+				   sizeof(results[BENCH_SOLVE].strategy));
+
+	cdok_glyphs_init(&glyphs, &cdok_template_ascii);
+	sum = CHECKSUM_INIT;
+	for (i = 0; i < calls; i++) {
+		const struct cdok_puzzle *puz = &corpus[i % corpus_count];
+		const uint64_t start = now_ns();
+		int len;
+
+		len = cdok_render_puzzle(&glyphs, puz, puz->values,
+					 buf, CDOK_FORMAT_MAX);
+		lat[i] = now_ns() - start;
+
+		sum = checksum_add(sum, buf, len);
+	}
+	summarize(&results[BENCH_FORMAT], size, BENCH_FORMAT,
+		  lat, calls, sum);
+
+	sum = CHECKSUM_INIT;
+	for (i = 0; i < calls; i++) {
+		const struct cdok_puzzle *puz = &corpus[i % corpus_count];
+		const uint64_t start = now_ns();
+		int len;
+
+		len = cdok_render_spec(puz, puz->values,
+				       buf, CDOK_FORMAT_MAX);
+		lat[i] = now_ns() - start;
+
+		sum = checksum_add(sum, buf, len);
+	}
+	summarize(&results[BENCH_SPEC], size, BENCH_SPEC,
+		  lat, calls, sum);
+
+	free(generated);
+	free(lat);
+	free(buf);
+	return 0;
+}
+
+static double ops_per_sec(const struct bench_result *r)
+{
+	if (!r->total_ns)
+		return 0.0;
+
+	return r->count * 1e9 / r->total_ns;
+}
+
+void bench_print(FILE *out, const struct bench_result *r, int count,
+		 int header)
+{
+	int i;
+
+	if (header)
+		fprintf(out, "%4s  %-8s  %6s  %10s  %10s  %10s  %10s  %10s\n",
+			"size", "op", "count", "ops/s", "p50 (us)",
+			"p95 (us)", "p99 (us)", "max (us)");
+
+	for (i = 0; i < count; i++)
+		fprintf(out, "%4d  %-8s  %6u  %10.1f  %10.1f  %10.1f  "
+			"%10.1f  %10.1f\n",
+			r[i].size, op_names[r[i].op], r[i].count,
+			ops_per_sec(&r[i]),
+			r[i].p50_ns / 1000.0, r[i].p95_ns / 1000.0,
+			r[i].p99_ns / 1000.0, r[i].max_ns / 1000.0);
+}
+
+void bench_report(struct cdok_json *j, const char *key,
+		  const struct bench_result *r)
+{
+	const char *name = op_names[r->op];
+	char sum[17];
+
+	cdok_json_begin_object(j, key);
+	cdok_json_string(j, "op", name, strlen(name));
+	cdok_json_int(j, "count", r->count);
+	cdok_json_double(j, "ops_per_sec", ops_per_sec(r));
+	cdok_json_int(j, "total_ns", r->total_ns);
+	cdok_json_int(j, "p50_ns", r->p50_ns);
+	cdok_json_int(j, "p95_ns", r->p95_ns);
+	cdok_json_int(j, "p99_ns", r->p99_ns);
+	cdok_json_int(j, "max_ns", r->max_ns);
+	cdok_json_double(j, "mean_ns", r->mean_ns);
+	cdok_json_double(j, "stddev_ns", r->stddev_ns);
+	cdok_json_int(j, "nodes", r->nodes);
+
+	snprintf(sum, sizeof(sum), "%016llx",
+		 (unsigned long long)r->checksum);
+	cdok_json_string(j, "checksum", sum, strlen(sum));
+
+	if (r->strategy[0])
+		cdok_json_string(j, "strategy", r->strategy,
+				 strlen(r->strategy));
+
+	cdok_json_end_object(j);
+}
+
+/************************************************************************
+ * Loading and comparing results
+ *
+ * Only records written by bench_report() need to be understood, so
+ * fields are found by looking for their keys, which are all distinct.
+ */
+
+static const char *find_key(const char *line, const char *key)
+{
+	char pattern[32];
+	const char *p;
+
+	snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+	p = strstr(line, pattern);
+
+	return p ? p + strlen(pattern) : NULL;
+}
+
+static int load_record(const char *line, struct bench_result *r)
+{
+	const char *p;
+	int i;
+
+	if (!strstr(line, "\"command\":\"bench\""))
+		return -1;
+
+	memset(r, 0, sizeof(*r));
+
+	p = find_key(line, "op");
+	if (!p || *p != '"')
+		return -1;
+
+	p++;
+	for (i = 0; i < BENCH_OPS; i++) {
+		const size_t len = strlen(op_names[i]);
+
+		if (!strncmp(p, op_names[i], len) && p[len] == '"')
+			break;
+	}
+
+	if (i >= BENCH_OPS)
+		return -1;
+	r->op = i;
+
+#define FIELD(key, conv)			\
+	do {					\
+		p = find_key(line, key);	\
+		if (!p)				\
+			return -1;		\
+		conv;				\
+	} while (0)
+
+	FIELD("size", r->size = atoi(p));
+	FIELD("count", r->count = strtoul(p, NULL, 10));
+	FIELD("total_ns", r->total_ns = strtoull(p, NULL, 10));
+	FIELD("p50_ns", r->p50_ns = strtoull(p, NULL, 10));
+	FIELD("p95_ns", r->p95_ns = strtoull(p, NULL, 10));
+	FIELD("p99_ns", r->p99_ns = strtoull(p, NULL, 10));
+	FIELD("max_ns", r->max_ns = strtoull(p, NULL, 10));
+	FIELD("mean_ns", r->mean_ns = strtod(p, NULL));
+	FIELD("stddev_ns", r->stddev_ns = strtod(p, NULL));
+	FIELD("nodes", r->nodes = strtoull(p, NULL, 10));
+	FIELD("checksum", r->checksum = strtoull(p + 1, NULL, 16));
+
+#undef FIELD
+
+	/* Strategy names need no escaping */
+	p = find_key(line, "strategy");
+	if (p && *p == '"') {
+		const size_t len = strcspn(p + 1, "\"");
+
+		if (len >= sizeof(r->strategy))
+			return -1;
+
+		memcpy(r->strategy, p + 1, len);
+		r->strategy[len] = 0;
+	}
+
+	return 0;
+}
+
+int bench_load(FILE *in, struct bench_result *r, int max)
+{
+	char *line = NULL;
+	size_t line_size = 0;
+	int count = 0;
+
+	while (count < max && getline(&line, &line_size, in) >= 0)
+		if (!load_record(line, &r[count]))
+			count++;
+
+	free(line);
+
+	if (ferror(in))
+		return -1;
+
+	return count;
+}
+
+/* Continued fraction for the regularized incomplete beta function
+ * (modified Lentz's method).
+ */
+static double beta_cf(double a, double b, double x)
+{
+	const double tiny = 1e-300;
+	double c = 1.0;
+	double d = 1.0 - (a + b) * x / (a + 1.0);
+	double h;
+	int m;
+
+	if (fabs(d) < tiny)
+		d = tiny;
+	d = 1.0 / d;
+	h = d;
+
+	for (m = 1; m <= 200; m++) {
+		const int m2 = 2 * m;
+		double aa = m * (b - m) * x / ((a + m2 - 1) * (a + m2));
+		double del;
+
+		d = 1.0 + aa * d;
+		if (fabs(d) < tiny)
+			d = tiny;
+		c = 1.0 + aa / c;
+		if (fabs(c) < tiny)
+			c = tiny;
+		d = 1.0 / d;
+		h *= d * c;
+
+		aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1));
+		d = 1.0 + aa * d;
+		if (fabs(d) < tiny)
+			d = tiny;
+		c = 1.0 + aa / c;
+		if (fabs(c) < tiny)
+			c = tiny;
+		d = 1.0 / d;
+		del = d * c;
+		h *= del;
+
+		if (fabs(del - 1.0) < 1e-12)
+			break;
+	}
+
+	return h;
+}
+
+static double incomplete_beta(double a, double b, double x)
+{
+	double front;
+
+	if (x <= 0.0)
+		return 0.0;
+	if (x >= 1.0)
+		return 1.0;
+
+	front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) +
+		    a * log(x) + b * log(1.0 - x));
+
+	if (x < (a + 1.0) / (a + b + 2.0))
+		return front * beta_cf(a, b, x) / a;
+
+	return 1.0 - front * beta_cf(b, a, 1.0 - x) / b;
+}
+
+/* One-sided Welch's t-test: the probability of seeing a mean at least
+ * this much greater than the baseline's if there were no slowdown.
+ */
+static double welch_p(const struct bench_result *base,
+		      const struct bench_result *r)
+{
+	const double vb = base->stddev_ns * base->stddev_ns / base->count;
+	const double vr = r->stddev_ns * r->stddev_ns / r->count;
+	const double diff = r->mean_ns - base->mean_ns;
+	double t;
+	double df;
+
+	if (base->count < 2 || r->count < 2)
+		return 1.0;
+
+	if (vb + vr <= 0.0)
+		return diff > 0.0 ? 0.0 : 1.0;
+
+	t = diff / sqrt(vb + vr);
+	df = (vb + vr) * (vb + vr) /
+		(vb * vb / (base->count - 1) + vr * vr / (r->count - 1));
+
+	if (t <= 0.0)
+		return 1.0 - 0.5 * incomplete_beta(df / 2.0, 0.5,
+						   df / (df + t * t));
+
+	return 0.5 * incomplete_beta(df / 2.0, 0.5, df / (df + t * t));
+}
+
+int bench_compare(FILE *out, const struct bench_result *base, int base_count,
+		  const struct bench_result *r, int count)
+{
+	int regressions = 0;
+	int i;
+
+	fprintf(out, "%4s  %-8s  %10s  %10s  %8s  %8s  %s\n",
+		"size", "op", "base (us)", "new (us)", "change", "p",
+		"status");
+
+	for (i = 0; i < count; i++) {
+		const struct bench_result *b = NULL;
+		int ab;
+		double change;
+		double p;
+		int j;
+
+		for (j = 0; j < base_count; j++)
+			if (base[j].size == r[i].size &&
+			    base[j].op == r[i].op) {
+				b = &base[j];
+				break;
+			}
+
+		if (!b) {
+			fprintf(out, "%4d  %-8s  %10s  %10.1f  %8s  %8s  "
+				"no baseline\n", r[i].size, op_names[r[i].op],
+				"-", r[i].mean_ns / 1000.0, "-", "-");
+			continue;
+		}
+
+		ab = strcmp(b->strategy, r[i].strategy) != 0;
+		change = b->mean_ns > 0.0 ?
+			r[i].mean_ns / b->mean_ns - 1.0 : 0.0;
+		p = welch_p(b, &r[i]);
+
+		fprintf(out, "%4d  %-8s  %10.1f  %10.1f  %+7.1f%%  %8.4f  ",
+			r[i].size, op_names[r[i].op], b->mean_ns / 1000.0,
+			r[i].mean_ns / 1000.0, change * 100.0, p);
+
+		/* Timings vary between runs by more than the spread
+		 * within one run shows, so they're only a warning.
+		 */
+		if (p < BENCH_ALPHA && change >= BENCH_MIN_CHANGE) {
+			fprintf(out, "slower");
+		} else if (welch_p(&r[i], b) < BENCH_ALPHA &&
+			   change <= -BENCH_MIN_CHANGE) {
+			fprintf(out, "faster");
+		} else {
+			fprintf(out, "ok");
+		}
+
+		if (ab) {
+			fprintf(out, ", strategy %s -> %s",
+				b->strategy[0] ? b->strategy : "default",
+				r[i].strategy[0] ? r[i].strategy : "default");
+		}
+
+		if (b->count != r[i].count) {
+			fprintf(out, ", count changed (%u -> %u)",
+				b->count, r[i].count);
+		} else if (b->checksum != r[i].checksum) {
+			fprintf(out, ab ? ", output changed" :
+				", OUTPUT CHANGED");
+			if (!ab)
+				regressions++;
+		}
+
+		if (r[i].nodes > b->nodes) {
+			fprintf(out, ab ? ", more nodes (%llu -> %llu)" :
+				", MORE NODES (%llu -> %llu)",
+				(unsigned long long)b->nodes,
+				(unsigned long long)r[i].nodes);
+			if (!ab)
+				regressions++;
+		} else if (r[i].nodes < b->nodes) {
+			fprintf(out, ", fewer nodes (%llu -> %llu)",
+				(unsigned long long)b->nodes,
+				(unsigned long long)r[i].nodes);
+		}
+
+		fputc('\n', out);
+	}
+
+	return regressions;
+}
@@ -0,0 +1,144 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+/* Benchmarks. For each grid size, a corpus of puzzles is generated from
+ * a fixed seed (or supplied by the caller), and the core operations are
+ * timed separately, one call at a time:
+ *
+ *    gen-grid: cdok_generate_grid()
+ *    generate: cdok_generate(), hardening a generated grid
+ *    solve:    cdok_solve() on each puzzle in the corpus
+ *    format:   cdok_render_puzzle() with the ASCII template
+ *    spec:     cdok_render_spec()
+ *
+ * Given the same seed and parameters, the same work is done on every
+ * run, so results from different builds can be compared directly.
+ * Besides timings, each result carries figures which don't depend on
+ * timing at all: the number of search nodes visited by the solver, and
+ * a checksum of everything the operation produced. A change in either
+ * means that the algorithm or its output has changed.
+ *
+ * The solve benchmark may use a solver strategy other than the default
+ * (see solver.h), for A/B comparisons between strategies.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "cdok.h"
+#include "generator.h"
+#include "solver.h"
+#include "json.h"
+
+typedef enum {
+	BENCH_GEN_GRID,
+	BENCH_GENERATE,
+	BENCH_SOLVE,
+	BENCH_FORMAT,
+	BENCH_SPEC,
+	BENCH_OPS
+} bench_op_t;
+
+/* Benchmark parameters:
+ *
+ *     seed:       seed for grid and puzzle generation
+ *     count:      number of calls timed for each operation
+ *     iterations: hardening iterations for generated puzzles
+ *     flags:      generator flags
+ *     strategy:   solver strategy for the solve benchmark (NULL for
+ *                 the default)
+ */
+struct bench_config {
+	uint64_t			seed;
+	int				count;
+	int				iterations;
+	cdok_flags_t			flags;
+	const struct cdok_strategy	*strategy;
+};
+
+/* Results for one operation. Latencies are in nanoseconds. The node
+ * count is the total over all puzzles solved, and is zero for other
+ * operations. The strategy is named only for a solve benchmark which
+ * didn't use the default, and is empty otherwise.
+ */
+struct bench_result {
+	int		size;
+	bench_op_t	op;
+	unsigned int	count;
+	uint64_t	total_ns;
+	uint64_t	p50_ns;
+	uint64_t	p95_ns;
+	uint64_t	p99_ns;
+	uint64_t	max_ns;
+	double		mean_ns;
+	double		stddev_ns;
+	uint64_t	nodes;
+	uint64_t	checksum;
+	char		strategy[CDOK_STRATEGY_NAME_MAX];
+};
+
+/* Name of an operation, as listed above. */
+const char *bench_op_name(bench_op_t op);
+
+/* Run every benchmark for the given size, filling in one result per
+ * operation. If corpus is NULL, the puzzles produced by the generate
+ * benchmark are used to time the solver and printers. Otherwise, the
+ * given puzzles are used, and must all be of the given size. They're
+ * run through repeatedly if there are fewer than the configured count.
+ * Returns 0 on success or -1 if memory couldn't be allocated.
+ */
+int bench_run(const struct bench_config *cfg, int size,
+	      const struct cdok_puzzle *corpus, int corpus_count,
+	      struct bench_result *results);
+
+/* Write a table of results, with a header if requested. */
+void bench_print(FILE *out, const struct bench_result *r, int count,
+		 int header);
+
+/* Write a result as a JSON object. */
+void bench_report(struct cdok_json *j, const char *key,
+		  const struct bench_result *r);
+
+/* Load results previously written as NDJSON bench records. Lines which
+ * aren't bench records are skipped. Returns the number of results
+ * loaded (at most max), or -1 on error.
+ */
+int bench_load(FILE *in, struct bench_result *r, int max);
+
+/* Compare results with a baseline, writing a report. Each operation is
+ * matched with the baseline result for the same size and operation.
+ *
+ * Any increase in node count and any change of checksum is a
+ * regression. These are exact, except between results for different
+ * solver strategies, where they're only reported.
+ *
+ * A slowdown is reported as a warning if a one-sided Welch t-test
+ * finds it significant at the BENCH_ALPHA level and the mean is at
+ * least BENCH_MIN_CHANGE slower. It isn't counted as a regression: the
+ * test uses only the spread within each run, and timings drift between
+ * runs by more than that, even on the same idle machine.
+ *
+ * Returns the number of regressions.
+ */
+#define BENCH_ALPHA		0.01
+#define BENCH_MIN_CHANGE	0.10
+
+int bench_compare(FILE *out, const struct bench_result *base, int base_count,
+		  const struct bench_result *r, int count);
+
+#endif
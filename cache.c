@@ -0,0 +1,479 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "solver.h"
+#include "cache.h"
+
+#define NONE			UINT32_MAX
+
+/* Transform of an entry with no solution stored */
+#define NO_SOLUTION		0xff
+
+#define CACHE_MAGIC		"CDOKCACH"
+#define CACHE_VERSION		2
+
+/* On-disk format: a header, followed by records from least to most
+ * recently used, in host byte order. Version 2 records keep a
+ * difficulty for each orientation, with diff_mask marking those known,
+ * and the orientation of the stored solution, or NO_SOLUTION. Files of
+ * other versions aren't loaded.
+ */
+struct cache_file_header {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	record_size;
+	uint32_t	count;
+	uint32_t	reserved;
+};
+
+struct cache_record {
+	struct cdok_fingerprint	fp;
+	int8_t			result;
+	uint8_t			size;
+	uint8_t			diff_mask;
+	uint8_t			sol_transform;
+	int32_t			diff[CDOK_TRANSFORMS];
+	uint8_t			solution[CDOK_CELLS];
+};
+
+int cache_init(struct cache *c, unsigned int capacity)
+{
+	uint32_t nb = 1;
+	uint32_t i;
+
+	memset(c, 0, sizeof(*c));
+
+	if (!capacity)
+		capacity = 1;
+
+	while (nb < capacity)
+		nb <<= 1;
+
+	c->entries = malloc(capacity * sizeof(c->entries[0]));
+	c->buckets = malloc(nb * sizeof(c->buckets[0]));
+	if (!c->entries || !c->buckets) {
+		free(c->entries);
+		free(c->buckets);
+		return -1;
+	}
+
+	for (i = 0; i < nb; i++)
+		c->buckets[i] = NONE;
+
+	c->bucket_mask = nb - 1;
+	c->capacity = capacity;
+	c->head = NONE;
+	c->tail = NONE;
+	c->stats.capacity = capacity;
+
+	if (pthread_mutex_init(&c->lock, NULL)) {
+		free(c->entries);
+		free(c->buckets);
+		return -1;
+	}
+
+	return 0;
+}
+
+void cache_destroy(struct cache *c)
+{
+	free(c->entries);
+	free(c->buckets);
+	pthread_mutex_destroy(&c->lock);
+}
+
+/************************************************************************
+ * Hash table and LRU list. All of these must be called with the lock
+ * held.
+ */
+
+static uint32_t *bucket_of(struct cache *c, const struct cdok_fingerprint *fp)
+{
+	return &c->buckets[fp->lo & c->bucket_mask];
+}
+
+static uint32_t find(struct cache *c, const struct cdok_fingerprint *fp)
+{
+	uint32_t i = *bucket_of(c, fp);
+
+	while (i != NONE) {
+		const struct cache_entry *e = &c->entries[i];
+
+		if (e->fp.hi == fp->hi && e->fp.lo == fp->lo)
+			return i;
+
+		i = e->chain;
+	}
+
+	return NONE;
+}
+
+static void unchain(struct cache *c, uint32_t i)
+{
+	uint32_t *p = bucket_of(c, &c->entries[i].fp);
+
+	while (*p != i)
+		p = &c->entries[*p].chain;
+
+	*p = c->entries[i].chain;
+}
+
+static void lru_unlink(struct cache *c, uint32_t i)
+{
+	struct cache_entry *e = &c->entries[i];
+
+	if (e->prev != NONE)
+		c->entries[e->prev].next = e->next;
+	else
+		c->head = e->next;
+
+	if (e->next != NONE)
+		c->entries[e->next].prev = e->prev;
+	else
+		c->tail = e->prev;
+}
+
+static void lru_push(struct cache *c, uint32_t i)
+{
+	struct cache_entry *e = &c->entries[i];
+
+	e->prev = NONE;
+	e->next = c->head;
+
+	if (c->head != NONE)
+		c->entries[c->head].prev = i;
+	else
+		c->tail = i;
+
+	c->head = i;
+}
+
+/* Find or allocate the entry for a fingerprint, making it the most
+ * recently used. New entries have an empty difficulty mask and no
+ * solution.
+ */
+static struct cache_entry *obtain(struct cache *c,
+				  const struct cdok_fingerprint *fp)
+{
+	uint32_t i = find(c, fp);
+	struct cache_entry *e;
+
+	if (i != NONE) {
+		lru_unlink(c, i);
+		lru_push(c, i);
+		return &c->entries[i];
+	}
+
+	if (c->count < c->capacity) {
+		i = c->count++;
+	} else {
+		i = c->tail;
+		lru_unlink(c, i);
+		unchain(c, i);
+		c->stats.evictions++;
+	}
+
+	e = &c->entries[i];
+	memset(e, 0, sizeof(*e));
+	e->sol_transform = NO_SOLUTION;
+	e->fp = *fp;
+	e->chain = *bucket_of(c, fp);
+	*bucket_of(c, fp) = i;
+	lru_push(c, i);
+	c->stats.inserts++;
+
+	return e;
+}
+
+/************************************************************************
+ * Lookup and insertion
+ */
+
+/* Look up the result for a puzzle in orientation t. If the puzzle
+ * isn't uniquely solvable, the solution depends on orientation, so it
+ * must have been found in the same one.
+ */
+static int lookup(struct cache *c, const struct cdok_fingerprint *fp,
+		  int t, int *result, int *diff, uint8_t *solution)
+{
+	struct cache_entry *e;
+	uint32_t i;
+
+	c->stats.lookups++;
+
+	i = find(c, fp);
+	if (i == NONE)
+		return -1;
+
+	e = &c->entries[i];
+	if (e->result >= 0 &&
+	    (!(e->diff_mask & (1 << t)) ||
+	     (solution && (e->sol_transform == NO_SOLUTION ||
+			   (e->result > 0 && e->sol_transform != t)))))
+		return -1;
+
+	lru_unlink(c, i);
+	lru_push(c, i);
+	c->stats.hits++;
+
+	*result = e->result;
+	if (e->result >= 0) {
+		if (diff)
+			*diff = e->diff[t];
+		if (solution)
+			cdok_untransform_grid(t, e->size, e->solution,
+					      solution);
+	}
+
+	return 0;
+}
+
+static void insert(struct cache *c, const struct cdok_fingerprint *fp,
+		   int t, int size, int result, int diff,
+		   const uint8_t *solution)
+{
+	struct cache_entry *e = obtain(c, fp);
+
+	e->result = result;
+	e->size = size;
+
+	if (result < 0)
+		return;
+
+	e->diff[t] = diff;
+	e->diff_mask |= 1 << t;
+
+	if (!result || e->sol_transform != t) {
+		cdok_transform_grid(t, size, solution, e->solution);
+		e->sol_transform = t;
+	}
+}
+
+int cache_solve(struct cache *c, const struct cdok_puzzle *puz,
+		uint8_t *solution, int *diff)
+{
+	struct cdok_fingerprint fp;
+	uint8_t sol[CDOK_CELLS];
+	int d = 0;
+	int hit;
+	int r;
+	int t;
+
+	if (!c)
+		return cdok_solve(puz, solution, diff);
+
+	t = cdok_fingerprint(puz, &fp);
+
+	pthread_mutex_lock(&c->lock);
+	hit = !lookup(c, &fp, t, &r, diff, solution);
+	pthread_mutex_unlock(&c->lock);
+
+	if (hit)
+		return r;
+
+	r = cdok_solve(puz, sol, &d);
+
+	pthread_mutex_lock(&c->lock);
+	insert(c, &fp, t, puz->size, r, d, sol);
+	pthread_mutex_unlock(&c->lock);
+
+	if (r >= 0) {
+		if (solution)
+			memcpy(solution, sol, sizeof(sol));
+		if (diff)
+			*diff = d;
+	}
+
+	return r;
+}
+
+/************************************************************************
+ * Persistence
+ */
+
+int cache_load(struct cache *c, const char *path)
+{
+	struct cache_file_header h;
+	FILE *in = fopen(path, "rb");
+	uint32_t i;
+
+	if (!in) {
+		if (errno == ENOENT)
+			return 0;
+
+		fprintf(stderr, "Can't open %s for reading: %s\n",
+			path, strerror(errno));
+		return -1;
+	}
+
+	if (fread(&h, sizeof(h), 1, in) != 1 ||
+	    memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) ||
+	    h.version != CACHE_VERSION ||
+	    h.record_size != sizeof(struct cache_record)) {
+		fprintf(stderr, "%s: not a compatible cache file\n", path);
+		fclose(in);
+		return -1;
+	}
+
+	pthread_mutex_lock(&c->lock);
+
+	for (i = 0; i < h.count; i++) {
+		struct cache_record r;
+		struct cache_entry *e;
+
+		if (fread(&r, sizeof(r), 1, in) != 1)
+			break;
+
+		if (r.size < 1 || r.size > CDOK_SIZE ||
+		    (r.sol_transform >= CDOK_TRANSFORMS &&
+		     r.sol_transform != NO_SOLUTION))
+			break;
+
+		e = obtain(c, &r.fp);
+		e->result = r.result;
+		e->size = r.size;
+		e->diff_mask = r.diff_mask;
+		e->sol_transform = r.sol_transform;
+		memcpy(e->diff, r.diff, sizeof(e->diff));
+		memcpy(e->solution, r.solution, sizeof(e->solution));
+	}
+
+	/* Statistics cover this run only */
+	memset(&c->stats, 0, sizeof(c->stats));
+	c->stats.capacity = c->capacity;
+
+	pthread_mutex_unlock(&c->lock);
+
+	if (i < h.count) {
+		fprintf(stderr, "%s: truncated or corrupt cache file\n",
+			path);
+		fclose(in);
+		return -1;
+	}
+
+	fclose(in);
+	return 0;
+}
+
+int cache_save(struct cache *c, const char *path)
+{
+	struct cache_file_header h;
+	char *tmp = malloc(strlen(path) + 5);
+	FILE *out;
+	uint32_t i;
+
+	if (!tmp) {
+		fprintf(stderr, "Out of memory saving cache\n");
+		return -1;
+	}
+
+	sprintf(tmp, "%s.tmp", path);
+	out = fopen(tmp, "wb");
+	if (!out) {
+		fprintf(stderr, "Can't open %s for writing: %s\n",
+			tmp, strerror(errno));
+		free(tmp);
+		return -1;
+	}
+
+	pthread_mutex_lock(&c->lock);
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+	h.version = CACHE_VERSION;
+	h.record_size = sizeof(struct cache_record);
+	h.count = c->count;
+	fwrite(&h, sizeof(h), 1, out);
+
+	for (i = c->tail; i != NONE; i = c->entries[i].prev) {
+		const struct cache_entry *e = &c->entries[i];
+		struct cache_record r;
+
+		memset(&r, 0, sizeof(r));
+		r.fp = e->fp;
+		r.result = e->result;
+		r.size = e->size;
+		r.diff_mask = e->diff_mask;
+		r.sol_transform = e->sol_transform;
+		memcpy(r.diff, e->diff, sizeof(r.diff));
+		memcpy(r.solution, e->solution, sizeof(r.solution));
+		fwrite(&r, sizeof(r), 1, out);
+	}
+
+	pthread_mutex_unlock(&c->lock);
+
+	if (ferror(out)) {
+		fprintf(stderr, "IO error writing %s: %s\n",
+			tmp, strerror(errno));
+		fclose(out);
+		goto fail;
+	}
+
+	if (fclose(out) < 0) {
+		fprintf(stderr, "Error on closing %s: %s\n",
+			tmp, strerror(errno));
+		goto fail;
+	}
+
+	if (rename(tmp, path) < 0) {
+		fprintf(stderr, "Can't rename %s to %s: %s\n",
+			tmp, path, strerror(errno));
+		goto fail;
+	}
+
+	free(tmp);
+	return 0;
+
+fail:
+	remove(tmp);
+	free(tmp);
+	return -1;
+}
+
+/************************************************************************
+ * Statistics
+ */
+
+void cache_get_stats(struct cache *c, struct cache_stats *st)
+{
+	pthread_mutex_lock(&c->lock);
+	*st = c->stats;
+	st->count = c->count;
+	pthread_mutex_unlock(&c->lock);
+}
+
+void cache_report(struct cache *c, struct cdok_json *j, const char *key)
+{
+	struct cache_stats st;
+
+	cache_get_stats(c, &st);
+
+	cdok_json_begin_object(j, key);
+	cdok_json_int(j, "capacity", st.capacity);
+	cdok_json_int(j, "entries", st.count);
+	cdok_json_int(j, "lookups", st.lookups);
+	cdok_json_int(j, "hits", st.hits);
+	cdok_json_double(j, "hit_ratio", st.lookups ?
+			 (double)st.hits / st.lookups : 0.0);
+	cdok_json_int(j, "inserts", st.inserts);
+	cdok_json_int(j, "evictions", st.evictions);
+	cdok_json_end_object(j);
+}
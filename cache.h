@@ -0,0 +1,105 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef CACHE_H_
+#define CACHE_H_
+
+/* Cache of solver results. Entries are keyed by the fingerprint of the
+ * puzzle's canonical form (see canon.h), so that a rotated or reflected
+ * copy of a puzzle shares an entry with the original.
+ *
+ * Uniqueness and the solution don't depend on the puzzle's orientation,
+ * and the solution is stored in canonical orientation. Difficulty
+ * does, since the solver explores cells in scan order, so it's stored
+ * separately for each transform. A lookup hits only if the difficulty
+ * for the requested orientation is known, which means that cached
+ * results are always identical to those cdok_solve() would give.
+ *
+ * The cache holds a fixed number of entries. When it's full, the least
+ * recently used entry is evicted. It may be shared between threads.
+ */
+
+#include <pthread.h>
+#include "cdok.h"
+#include "canon.h"
+#include "json.h"
+
+struct cache_entry {
+	struct cdok_fingerprint	fp;
+	int8_t			result;
+	uint8_t			size;
+	uint8_t			diff_mask;
+	uint8_t			sol_transform;
+	int32_t			diff[CDOK_TRANSFORMS];
+	uint8_t			solution[CDOK_CELLS];
+
+	/* Hash chain and LRU list links */
+	uint32_t		chain;
+	uint32_t		prev;
+	uint32_t		next;
+};
+
+struct cache_stats {
+	unsigned long		lookups;
+	unsigned long		hits;
+	unsigned long		inserts;
+	unsigned long		evictions;
+	unsigned int		count;
+	unsigned int		capacity;
+};
+
+struct cache {
+	pthread_mutex_t		lock;
+	struct cache_entry	*entries;
+	uint32_t		*buckets;
+	uint32_t		bucket_mask;
+	uint32_t		capacity;
+	uint32_t		count;
+	uint32_t		head;
+	uint32_t		tail;
+	struct cache_stats	stats;
+};
+
+/* Default number of entries. */
+#define CACHE_DEFAULT_SIZE	16384
+
+/* Create an empty cache. Returns 0 on success or -1 on error. */
+int cache_init(struct cache *c, unsigned int capacity);
+void cache_destroy(struct cache *c);
+
+/* Solve a puzzle, as for cdok_solve(), using cached results where
+ * possible. If c is NULL, the puzzle is always solved.
+ */
+int cache_solve(struct cache *c, const struct cdok_puzzle *puz,
+		uint8_t *solution, int *diff);
+
+/* Load entries saved by cache_save(). A missing file is treated as an
+ * empty cache. Files from other versions of the format are refused.
+ * Returns 0 on success or -1 on error.
+ */
+int cache_load(struct cache *c, const char *path);
+
+/* Save the contents of the cache to a file, replacing it atomically.
+ * Returns 0 on success or -1 on error.
+ */
+int cache_save(struct cache *c, const char *path);
+
+void cache_get_stats(struct cache *c, struct cache_stats *st);
+
+/* Write statistics as a JSON object under the given key. */
+void cache_report(struct cache *c, struct cdok_json *j, const char *key);
+
+#endif
@@ -0,0 +1,341 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef CAGE_H_
+#define CAGE_H_
+
+/* Cage (group) analysis kernels. These are the innermost functions of
+ * the solver: given a group's type, target and the values already
+ * placed in it, they find the set of values which might fill its
+ * remaining cells. Sets are bitmasks, as for cdok_set_t.
+ *
+ * Every kernel is sound: a value which can appear in some completion of
+ * the group is always in the returned set. The set may also contain
+ * values which can't, since rows and columns aren't considered.
+ *
+ * The kernels are defined here, as inline functions, so that they can
+ * be inlined into the solver's search loop. They're exposed so that they
+ * can be benchmarked and checked against alternative implementations
+ * (see kbench.c).
+ */
+
+#include <stdint.h>
+#include "cdok.h"
+
+/* When a file is built with CAGE_CAPTURE defined, its copy of the
+ * kernels reports their arguments to these functions, which must be
+ * supplied by the program. The benchmark uses this to collect arguments
+ * from real solves.
+ */
+void cage_capture_group(const struct cdok_group *g,
+			const uint8_t *values, int max);
+void cage_capture_addends(int target, int n, int max);
+void cage_capture_factors(int target, int n, int max);
+
+#ifdef CAGE_CAPTURE
+#define CAGE_CAPTURE_GROUP(g, values, max) \
+	cage_capture_group(g, values, max)
+#define CAGE_CAPTURE_ADDENDS(target, n, max) \
+	cage_capture_addends(target, n, max)
+#define CAGE_CAPTURE_FACTORS(target, n, max) \
+	cage_capture_factors(target, n, max)
+#else
+#define CAGE_CAPTURE_GROUP(g, values, max)	do { } while (0)
+#define CAGE_CAPTURE_ADDENDS(target, n, max)	do { } while (0)
+#define CAGE_CAPTURE_FACTORS(target, n, max)	do { } while (0)
+#endif
+
+/* If N addends in the range [1..max] are used to make the target sum,
+ * what is the set of possible addends?
+ */
+static inline cdok_set_t cdok_addends_for(int target, int n, int max)
+{
+	int a_min;
+	int a_max;
+
+	CAGE_CAPTURE_ADDENDS(target, n, max);
+
+	if (target < 1 || n < 1)
+		return 0;
+
+	if (n == 1) {
+		if (target >= 1 && target <= max)
+			return CDOK_SET_SINGLE(target);
+
+		return 0;
+	}
+
+	a_min = target - max * (n - 1);
+	if (a_min < 1)
+		a_min = 1;
+
+	a_max = target - (n - 1);
+	if (a_max > max)
+		a_max = max;
+
+	if (a_min > a_max)
+		return 0;
+
+	return CDOK_SET_RANGE(a_min, a_max);
+}
+
+/* If N factors in the range [1..max] are used to make the target
+ * product, what is the set of possible factors?
+ */
+static inline cdok_set_t cdok_factors_for(int target, int n, int max)
+{
+	cdok_set_t out = 0;
+	int i;
+
+	CAGE_CAPTURE_FACTORS(target, n, max);
+
+	if (target < 1 || n < 1)
+		return 0;
+
+	if (n == 1) {
+		if (target >= 1 && target <= max)
+			return CDOK_SET_SINGLE(target);
+
+		return 0;
+	}
+
+	for (i = 1; i * i <= target && i <= max; i++)
+		if (!(target % i)) {
+			int j = target / i;
+
+			out |= CDOK_SET_SINGLE(i);
+			if (j <= max)
+				out |= CDOK_SET_SINGLE(j);
+		}
+
+	return out;
+}
+
+/* Find the set of possible missing values in the partially-filled sum
+ * group.
+ */
+static inline cdok_set_t cdok_sum_candidates(int target, int size,
+					     const uint8_t *members,
+					     int nm, int max)
+{
+	int partial_sum = 0;
+	int i;
+
+	for (i = 0; i < nm; i++)
+		partial_sum += members[i];
+
+	return cdok_addends_for(target - partial_sum, size - nm, max);
+}
+
+/* Find the set of possible missing values in the partially-filled
+ * difference group.
+ */
+static inline cdok_set_t cdok_difference_candidates(int target, int size,
+						    const uint8_t *members,
+						    int nm, int max)
+{
+	cdok_set_t out = 0;
+	int partial_sum = 0;
+	int max_m = -1;
+	int i;
+
+	for (i = 0; i < nm; i++) {
+		if (members[i] > max_m)
+			max_m = members[i];
+
+		partial_sum += members[i];
+	}
+
+	/* It may be that the sum is already present, and we have only
+	 * to fill the box with addends.
+	 */
+	if (nm >= 1)
+		out |= cdok_addends_for(max_m * 2 - partial_sum - target,
+					size - nm, max);
+
+	/* Or perhaps the sum is missing. Then we need to consider two
+	 * sub-cases: where *only* the sum is missing, or a sum and one
+	 * or more addends.
+	 */
+	if (nm + 1 == size) {
+		int sum = target + partial_sum;
+
+		if (sum <= max)
+			out |= CDOK_SET_SINGLE(sum);
+	} else {
+		int min_sum = target + partial_sum + (size - nm - 1);
+		int i;
+
+		for (i = min_sum; i <= max; i++) {
+			cdok_set_t terms_for_sum =
+				cdok_addends_for(i - partial_sum - target,
+						 size - nm - 1, max);
+
+			if (terms_for_sum)
+				out |= terms_for_sum | CDOK_SET_SINGLE(i);
+		}
+	}
+
+	return out;
+}
+
+/* Find the set of possible missing values in the partially-filled
+ * product group.
+ */
+static inline cdok_set_t cdok_product_candidates(int target, int size,
+						 const uint8_t *members,
+						 int nm, int max)
+{
+	int partial_product = 1;
+	int i;
+
+	for (i = 0; i < nm; i++)
+		partial_product *= members[i];
+
+	if (target % partial_product)
+		return 0;
+
+	return cdok_factors_for(target / partial_product, size - nm, max);
+}
+
+/* Find the set of possible missing values in the partially-filled
+ * ratio group.
+ */
+static inline cdok_set_t cdok_ratio_candidates(int target, int size,
+					       const uint8_t *members,
+					       int nm, int max)
+{
+	cdok_set_t out = 0;
+	int partial_product = 1;
+	int max_m = -1;
+	int i;
+
+	for (i = 0; i < nm; i++) {
+		partial_product *= members[i];
+
+		if (members[i] > max_m)
+			max_m = members[i];
+	}
+
+	/* Perhaps we're missing only factors, and the product is already
+	 * present.
+	 */
+	if (nm >= 1 && !((max_m * max_m) % (partial_product * target)))
+		out |= cdok_factors_for((max_m * max_m) /
+					(partial_product * target),
+					size - nm, max);
+
+	/* Perhaps the product is missing. Then there are two sub-cases: only
+	 * the product is missing, or the product and one or more factors.
+	 */
+	if (nm + 1 == size) {
+		int product = partial_product * target;
+
+		if (product <= max)
+			out |= CDOK_SET_SINGLE(product);
+	} else {
+		int min_product = partial_product * target;
+		int i;
+
+		for (i = 1; i * min_product <= max; i++) {
+			cdok_set_t terms_for_product =
+				cdok_factors_for(i, size - nm - 1, max);
+
+			if (terms_for_product)
+				out |= terms_for_product |
+					CDOK_SET_SINGLE(i * min_product);
+		}
+	}
+
+	return out;
+}
+
+/* Examine the given group with the current set of grid values and
+ * determine the set of values which might fill the remaining empty
+ * cells.
+ */
+static inline cdok_set_t cdok_group_candidates(const struct cdok_group *g,
+					       const uint8_t *values, int max)
+{
+	uint8_t members[CDOK_GROUP_SIZE];
+	unsigned int count = 0;
+	int i;
+
+	CAGE_CAPTURE_GROUP(g, values, max);
+
+	for (i = 0; i < g->size; i++) {
+		uint8_t v = values[g->members[i]];
+
+		if (v)
+			members[count++] = v;
+	}
+
+	switch (g->type) {
+	case CDOK_SUM:
+		return cdok_sum_candidates(g->target, g->size,
+					   members, count, max);
+
+	case CDOK_DIFFERENCE:
+		return cdok_difference_candidates(g->target, g->size,
+						  members, count, max);
+
+	case CDOK_PRODUCT:
+		return cdok_product_candidates(g->target, g->size,
+					       members, count, max);
+
+	case CDOK_RATIO:
+		return cdok_ratio_candidates(g->target, g->size,
+					     members, count, max);
+	}
+
+	return 0;
+}
+
+static inline int cdok_group_satisfied(const struct cdok_group *g,
+				       const uint8_t *values)
+{
+	uint64_t product = 1;
+	int sum = 0;
+	int max = 0;
+	unsigned int i;
+
+	for (i = 0; i < g->size; i++) {
+		const int v = values[g->members[i]];
+
+		sum += v;
+		product *= v;
+		if (v > max)
+			max = v;
+	}
+
+	switch (g->type) {
+	case CDOK_SUM:
+		return sum == g->target;
+
+	case CDOK_DIFFERENCE:
+		return max * 2 - sum == g->target;
+
+	case CDOK_PRODUCT:
+		return product == (uint64_t)g->target;
+
+	case CDOK_RATIO:
+		return (uint64_t)max * max == product * g->target;
+	}
+
+	return 0;
+}
+
+#endif
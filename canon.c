@@ -0,0 +1,412 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "canon.h"
+
+cdok_pos_t cdok_transform_pos(int t, int size, cdok_pos_t c)
+{
+	int x = CDOK_POS_X(c);
+	int y = CDOK_POS_Y(c);
+
+	if (t & 1) {
+		const int tmp = x;
+
+		x = y;
+		y = tmp;
+	}
+
+	if (t & 2)
+		x = size - 1 - x;
+
+	if (t & 4)
+		y = size - 1 - y;
+
+	return CDOK_POS(x, y);
+}
+
+/* Find the position which transform t maps to c. */
+static cdok_pos_t inverse_pos(int t, int size, cdok_pos_t c)
+{
+	int x = CDOK_POS_X(c);
+	int y = CDOK_POS_Y(c);
+
+	if (t & 4)
+		y = size - 1 - y;
+
+	if (t & 2)
+		x = size - 1 - x;
+
+	if (t & 1)
+		return CDOK_POS(y, x);
+
+	return CDOK_POS(x, y);
+}
+
+void cdok_transform_grid(int t, int size, const uint8_t *in, uint8_t *out)
+{
+	int x, y;
+
+	memset(out, 0, CDOK_CELLS);
+
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+
+			out[cdok_transform_pos(t, size, c)] = in[c];
+		}
+}
+
+void cdok_untransform_grid(int t, int size, const uint8_t *in,
+			   uint8_t *out)
+{
+	int x, y;
+
+	memset(out, 0, CDOK_CELLS);
+
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+
+			out[c] = in[cdok_transform_pos(t, size, c)];
+		}
+}
+
+void cdok_transform_puzzle(int t, const struct cdok_puzzle *in,
+			   struct cdok_puzzle *out)
+{
+	int x, y;
+	int i;
+
+	cdok_init_puzzle(out, in->size);
+
+	for (i = 0; i < CDOK_GROUPS; i++) {
+		out->groups[i].type = in->groups[i].type;
+		out->groups[i].target = in->groups[i].target;
+	}
+
+	/* Visit cells of the new puzzle in scan order, so that group
+	 * members are listed in the same order the parser would give.
+	 */
+	for (y = 0; y < in->size; y++)
+		for (x = 0; x < in->size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+			const cdok_pos_t src = inverse_pos(t, in->size, c);
+			const uint8_t g = in->group_map[src];
+
+			out->values[c] = in->values[src];
+
+			if (g != CDOK_GROUP_NONE) {
+				struct cdok_group *grp = &out->groups[g];
+
+				grp->members[grp->size++] = c;
+				out->group_map[c] = g;
+			}
+		}
+}
+
+/* Encode a puzzle under transform t. Cells are encoded in scan order as
+ * either a given value, or 0x20 plus the group's index in order of
+ * first appearance. The groups follow, in the same order, as a type and
+ * a big-endian target.
+ *
+ * If best is given, encoding is abandoned as soon as it's clear that
+ * the result won't be less than best, and -1 is returned. Otherwise,
+ * the length is returned.
+ */
+static int encode(const struct cdok_puzzle *puz, int t,
+		  const uint8_t *best, uint8_t *buf)
+{
+	uint8_t relabel[CDOK_GROUPS];
+	uint8_t order[CDOK_GROUPS];
+	const int size = puz->size;
+	int decided = !best;
+	int ng = 0;
+	int cells_end;
+	int k = 0;
+	int x, y;
+	int i;
+
+	memset(relabel, CDOK_GROUP_NONE, sizeof(relabel));
+	buf[k++] = size;
+
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++) {
+			const cdok_pos_t src =
+				inverse_pos(t, size, CDOK_POS(x, y));
+			const uint8_t g = puz->group_map[src];
+			uint8_t b = puz->values[src];
+
+			if (g != CDOK_GROUP_NONE) {
+				if (relabel[g] == CDOK_GROUP_NONE) {
+					relabel[g] = ng;
+					order[ng++] = g;
+				}
+
+				b = 0x20 + relabel[g];
+			}
+
+			if (!decided) {
+				if (b > best[k])
+					return -1;
+				if (b < best[k])
+					decided = 1;
+			}
+
+			buf[k++] = b;
+		}
+
+	cells_end = k;
+
+	for (i = 0; i < ng; i++) {
+		const struct cdok_group *g = &puz->groups[order[i]];
+		const uint32_t target = g->target;
+
+		buf[k++] = g->type;
+		buf[k++] = target >> 24;
+		buf[k++] = target >> 16;
+		buf[k++] = target >> 8;
+		buf[k++] = target;
+	}
+
+	/* Cells are the same, so the group lists are the same length */
+	if (!decided && memcmp(buf + cells_end, best + cells_end,
+			       k - cells_end) >= 0)
+		return -1;
+
+	return k;
+}
+
+int cdok_canonicalize(const struct cdok_puzzle *puz, struct cdok_canon *c)
+{
+	uint8_t buf[CDOK_CANON_MAX];
+	int best_t = 0;
+	int t;
+
+	c->len = encode(puz, 0, NULL, c->data);
+
+	for (t = 1; t < CDOK_TRANSFORMS; t++) {
+		const int len = encode(puz, t, c->data, buf);
+
+		if (len >= 0) {
+			memcpy(c->data, buf, len);
+			best_t = t;
+		}
+	}
+
+	return best_t;
+}
+
+/* MurmurHash3, x64 128-bit variant (Austin Appleby, public domain). */
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+
+	return k;
+}
+
+static inline uint64_t load64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static const uint64_t murmur_c1 = 0x87c37b91114253d5ULL;
+static const uint64_t murmur_c2 = 0x4cf5ad432745937fULL;
+
+static inline uint64_t mix_k1(uint64_t k1)
+{
+	k1 *= murmur_c1;
+	k1 = rotl64(k1, 31);
+	return k1 * murmur_c2;
+}
+
+static inline uint64_t mix_k2(uint64_t k2)
+{
+	k2 *= murmur_c2;
+	k2 = rotl64(k2, 33);
+	return k2 * murmur_c1;
+}
+
+static void murmur3_128(const uint8_t *data, int len,
+			struct cdok_fingerprint *fp)
+{
+	const int nblocks = len / 16;
+	const uint8_t *tail = data + nblocks * 16;
+	uint64_t h1 = 0;
+	uint64_t h2 = 0;
+	uint64_t k1 = 0;
+	uint64_t k2 = 0;
+	int i;
+
+	for (i = 0; i < nblocks; i++) {
+		h1 ^= mix_k1(load64(data + i * 16));
+		h1 = rotl64(h1, 27) + h2;
+		h1 = h1 * 5 + 0x52dce729;
+
+		h2 ^= mix_k2(load64(data + i * 16 + 8));
+		h2 = rotl64(h2, 31) + h1;
+		h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	for (i = (len & 15) - 1; i >= 8; i--)
+		k2 = (k2 << 8) | tail[i];
+	for (; i >= 0; i--)
+		k1 = (k1 << 8) | tail[i];
+
+	if (len & 15) {
+		h2 ^= mix_k2(k2);
+		h1 ^= mix_k1(k1);
+	}
+
+	h1 ^= len;
+	h2 ^= len;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+
+	fp->hi = h1;
+	fp->lo = h2;
+}
+
+void cdok_canon_fingerprint(const struct cdok_canon *c,
+			    struct cdok_fingerprint *fp)
+{
+	murmur3_128(c->data, c->len, fp);
+}
+
+void cdok_fingerprint_bytes(const uint8_t *data, int len,
+			    struct cdok_fingerprint *fp)
+{
+	murmur3_128(data, len, fp);
+}
+
+int cdok_fingerprint(const struct cdok_puzzle *puz,
+		     struct cdok_fingerprint *fp)
+{
+	struct cdok_canon c;
+	const int t = cdok_canonicalize(puz, &c);
+
+	cdok_canon_fingerprint(&c, fp);
+	return t;
+}
+
+#define FPSET_INITIAL		1024
+
+int cdok_fpset_init(struct cdok_fpset *s)
+{
+	s->slots = calloc(FPSET_INITIAL, sizeof(s->slots[0]));
+	if (!s->slots)
+		return -1;
+
+	s->mask = FPSET_INITIAL - 1;
+	s->count = 0;
+
+	return 0;
+}
+
+void cdok_fpset_destroy(struct cdok_fpset *s)
+{
+	free(s->slots);
+}
+
+/* The all-zero fingerprint marks an empty slot, so it's stored as a
+ * (very slightly) different value.
+ */
+static void slot_key(const struct cdok_fingerprint *fp,
+		     struct cdok_fingerprint *key)
+{
+	*key = *fp;
+	if (!key->hi && !key->lo)
+		key->lo = 1;
+}
+
+static struct cdok_fingerprint *find_slot(struct cdok_fingerprint *slots,
+					  size_t mask,
+					  const struct cdok_fingerprint *key)
+{
+	size_t i = key->lo & mask;
+
+	for (;;) {
+		struct cdok_fingerprint *s = &slots[i];
+
+		if ((!s->hi && !s->lo) ||
+		    (s->hi == key->hi && s->lo == key->lo))
+			return s;
+
+		i = (i + 1) & mask;
+	}
+}
+
+static int grow(struct cdok_fpset *s)
+{
+	const size_t new_mask = s->mask * 2 + 1;
+	struct cdok_fingerprint *n = calloc(new_mask + 1, sizeof(n[0]));
+	size_t i;
+
+	if (!n)
+		return -1;
+
+	for (i = 0; i <= s->mask; i++) {
+		const struct cdok_fingerprint *f = &s->slots[i];
+
+		if (f->hi || f->lo)
+			*find_slot(n, new_mask, f) = *f;
+	}
+
+	free(s->slots);
+	s->slots = n;
+	s->mask = new_mask;
+
+	return 0;
+}
+
+int cdok_fpset_add(struct cdok_fpset *s, const struct cdok_fingerprint *fp)
+{
+	struct cdok_fingerprint key;
+	struct cdok_fingerprint *slot;
+
+	slot_key(fp, &key);
+	slot = find_slot(s->slots, s->mask, &key);
+
+	if (slot->hi || slot->lo)
+		return 0;
+
+	*slot = key;
+	s->count++;
+
+	/* Keep the load factor at or below one half */
+	if (s->count * 2 > s->mask + 1 && grow(s) < 0)
+		return -1;
+
+	return 1;
+}
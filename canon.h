@@ -0,0 +1,105 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef CANON_H_
+#define CANON_H_
+
+/* Canonical forms. Rotating or reflecting a puzzle, or renaming its
+ * groups, gives what is really the same puzzle. Each puzzle is encoded
+ * under every one of the eight symmetries of the square, with groups
+ * named in order of first appearance, and the lexicographically least
+ * encoding is taken as the canonical form. Two puzzles have the same
+ * canonical form exactly when one is a transform of the other.
+ *
+ * Transforms are numbered 0 to 7. Transform t maps the cell (x, y) by
+ * first transposing it if bit 0 is set, then mirroring the x
+ * coordinate if bit 1 is set, then mirroring y if bit 2 is set.
+ * Transform 0 is the identity.
+ */
+
+#include <stdint.h>
+#include "cdok.h"
+
+#define CDOK_TRANSFORMS		8
+
+/* Canonical encoding: the size, followed by one byte per cell and five
+ * bytes per group.
+ */
+#define CDOK_CANON_MAX		(1 + CDOK_CELLS + CDOK_GROUPS * 5)
+
+struct cdok_canon {
+	int		len;
+	uint8_t		data[CDOK_CANON_MAX];
+};
+
+/* 128-bit fingerprint of a canonical form. */
+struct cdok_fingerprint {
+	uint64_t	hi;
+	uint64_t	lo;
+};
+
+/* Map a position in a grid of the given size under transform t. */
+cdok_pos_t cdok_transform_pos(int t, int size, cdok_pos_t c);
+
+/* Transform a grid of values. cdok_untransform_grid() performs the
+ * inverse transform.
+ */
+void cdok_transform_grid(int t, int size, const uint8_t *in, uint8_t *out);
+void cdok_untransform_grid(int t, int size, const uint8_t *in,
+			   uint8_t *out);
+
+/* Transform a puzzle. Groups keep their names. */
+void cdok_transform_puzzle(int t, const struct cdok_puzzle *in,
+			   struct cdok_puzzle *out);
+
+/* Compute the canonical form of a puzzle. Returns the transform which
+ * takes the puzzle to its canonical orientation. If more than one
+ * transform does so (the puzzle is symmetric), the lowest is returned.
+ */
+int cdok_canonicalize(const struct cdok_puzzle *puz, struct cdok_canon *c);
+
+/* Compute the fingerprint of a canonical form. */
+void cdok_canon_fingerprint(const struct cdok_canon *c,
+			    struct cdok_fingerprint *fp);
+
+/* Fingerprint any other string of bytes, using the same hash. */
+void cdok_fingerprint_bytes(const uint8_t *data, int len,
+			    struct cdok_fingerprint *fp);
+
+/* Canonicalize a puzzle and compute its fingerprint in one step.
+ * Returns the transform, as for cdok_canonicalize().
+ */
+int cdok_fingerprint(const struct cdok_puzzle *puz,
+		     struct cdok_fingerprint *fp);
+
+/* A set of fingerprints, implemented as an open-addressed hash table
+ * which grows as needed.
+ */
+struct cdok_fpset {
+	struct cdok_fingerprint	*slots;
+	size_t			mask;
+	size_t			count;
+};
+
+int cdok_fpset_init(struct cdok_fpset *s);
+void cdok_fpset_destroy(struct cdok_fpset *s);
+
+/* Add a fingerprint to the set. Returns 1 if it was added, 0 if it was
+ * already present, or -1 if memory couldn't be allocated.
+ */
+int cdok_fpset_add(struct cdok_fpset *s, const struct cdok_fingerprint *fp);
+
+#endif
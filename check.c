@@ -0,0 +1,399 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Checks for the library's stateful APIs. Each check describes what it
+ * expects, and any which fail are reported. The program exits with an
+ * error if there were failures. Run with "make check".
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cdok.h"
+#include "solver.h"
+#include "generator.h"
+#include "session.h"
+#include "edit.h"
+
+static int checks;
+static int failures;
+
+#define CHECK(cond)	check((cond), #cond, __LINE__)
+
+static void check(int ok, const char *what, int line)
+{
+	checks++;
+
+	if (!ok) {
+		fprintf(stderr, "check.c:%d: failed: %s\n", line, what);
+		failures++;
+	}
+}
+
+/* Generate a puzzle of the given size from a fixed seed. */
+static void make_puzzle(struct cdok_puzzle *puz, uint8_t *solution,
+			int size, uint64_t seed)
+{
+	struct cdok_gen gen;
+
+	cdok_gen_init(&gen, seed);
+	memset(solution, 0, CDOK_CELLS);
+	cdok_generate_grid(&gen, solution, size);
+	cdok_generate(&gen, puz, solution, size, CDOK_FLAGS_NONE, 5, 0, 0);
+}
+
+static int same_grid(int size, const uint8_t *a, const uint8_t *b)
+{
+	int y;
+
+	for (y = 0; y < size; y++)
+		if (memcmp(a + CDOK_POS(0, y), b + CDOK_POS(0, y), size))
+			return 0;
+
+	return 1;
+}
+
+/* Find the first cell in scan order which isn't given. */
+static cdok_pos_t first_free(const struct cdok_puzzle *puz)
+{
+	int x, y;
+
+	for (y = 0; y < puz->size; y++)
+		for (x = 0; x < puz->size; x++)
+			if (!puz->values[CDOK_POS(x, y)])
+				return CDOK_POS(x, y);
+
+	return -1;
+}
+
+/* Find another cell which isn't given, in the same row (or column) as
+ * the given cell.
+ */
+static cdok_pos_t find_free(const struct cdok_puzzle *puz, cdok_pos_t from,
+			    int same_column)
+{
+	int i;
+
+	for (i = 0; i < puz->size; i++) {
+		const cdok_pos_t c = same_column ?
+			CDOK_POS(CDOK_POS_X(from), i) :
+			CDOK_POS(i, CDOK_POS_Y(from));
+
+		if (c != from && !puz->values[c])
+			return c;
+	}
+
+	return -1;
+}
+
+/************************************************************************
+ * Play sessions
+ */
+
+static void check_session_moves(const struct cdok_puzzle *puz,
+				const uint8_t *solution)
+{
+	struct cdok_session s;
+	const int size = puz->size;
+	const cdok_pos_t a = first_free(puz);
+	cdok_pos_t b;
+	unsigned int filled;
+	int r;
+
+	CHECK(!cdok_session_init(&s, puz, NULL));
+	CHECK(same_grid(size, s.solution, solution));
+	CHECK(a >= 0);
+	filled = s.filled;
+
+	/* A right value, then a clash with it in its row. The clashing
+	 * cell may also clash with a given in its own column.
+	 */
+	r = cdok_session_set(&s, a, solution[a]);
+	CHECK(r >= 0 && !(r & (CDOK_MOVE_ROW_CONFLICT |
+			       CDOK_MOVE_COL_CONFLICT | CDOK_MOVE_WRONG)));
+	CHECK(s.values[a] == solution[a] && s.filled == filled + 1);
+
+	b = find_free(puz, a, 0);
+	CHECK(b >= 0);
+	r = cdok_session_set(&s, b, solution[a]);
+	CHECK(r >= 0 && (r & CDOK_MOVE_ROW_CONFLICT) &&
+	      (r & CDOK_MOVE_WRONG));
+	CHECK(s.conflicts && s.wrong == 1);
+
+	CHECK(!cdok_session_clear(&s, b));
+	CHECK(!s.values[b] && !s.conflicts && !s.wrong);
+	CHECK(s.filled == filled + 1);
+
+	/* ... and in its column */
+	b = find_free(puz, a, 1);
+	CHECK(b >= 0);
+	r = cdok_session_set(&s, b, solution[a]);
+	CHECK(r >= 0 && (r & CDOK_MOVE_COL_CONFLICT) &&
+	      (r & CDOK_MOVE_WRONG));
+
+	/* Replacing a value takes the old one out */
+	r = cdok_session_set(&s, b, solution[b]);
+	CHECK(r >= 0 && !(r & (CDOK_MOVE_ROW_CONFLICT |
+			       CDOK_MOVE_COL_CONFLICT | CDOK_MOVE_WRONG)));
+	CHECK(!s.conflicts && !s.wrong && s.filled == filled + 2);
+
+	/* Moves which aren't allowed change nothing */
+	CHECK(cdok_session_set(&s, a, 0) < 0);
+	CHECK(cdok_session_set(&s, a, size + 1) < 0);
+	CHECK(cdok_session_set(&s, CDOK_POS(size, 0), 1) < 0);
+	CHECK(cdok_session_clear(&s, CDOK_POS(0, size)) < 0);
+	CHECK(s.values[a] == solution[a] && s.filled == filled + 2);
+}
+
+/* Follow hints from an empty grid with one mistake in it. Every hint
+ * must be right, and following them must solve the puzzle.
+ */
+static void check_session_hints(const struct cdok_puzzle *puz)
+{
+	struct cdok_session s;
+	struct cdok_hint h;
+	const cdok_pos_t a = first_free(puz);
+	int steps = 0;
+	int r = 0;
+
+	CHECK(!cdok_session_init(&s, puz, NULL));
+	CHECK(cdok_session_set(&s, a, s.solution[a] % puz->size + 1) >= 0);
+
+	CHECK(!cdok_session_hint(&s, &h));
+	CHECK(h.reason == CDOK_HINT_MISTAKE && h.cell == a);
+
+	while (!cdok_session_hint(&s, &h) && steps++ < CDOK_CELLS) {
+		if (h.reason == CDOK_HINT_MISTAKE) {
+			CHECK(s.values[h.cell] &&
+			      s.values[h.cell] != s.solution[h.cell]);
+			CHECK(!cdok_session_clear(&s, h.cell));
+			continue;
+		}
+
+		CHECK(!s.values[h.cell]);
+		CHECK(h.value == s.solution[h.cell]);
+		r = cdok_session_set(&s, h.cell, h.value);
+		CHECK(r >= 0 && !(r & CDOK_MOVE_WRONG));
+	}
+
+	CHECK(cdok_session_solved(&s));
+	CHECK(r & CDOK_MOVE_SOLVED);
+}
+
+static void check_session_save(const struct cdok_puzzle *puz)
+{
+	struct cdok_session s;
+	struct cdok_session t;
+	struct cdok_hint hs;
+	struct cdok_hint ht;
+	uint8_t buf[CDOK_SESSION_SAVE_MAX];
+	const int size = puz->size;
+	size_t len;
+	int i;
+
+	/* A partly solved grid, with a mistake */
+	CHECK(!cdok_session_init(&s, puz, NULL));
+	for (i = 0; i < size; i++) {
+		const cdok_pos_t c = CDOK_POS(i, i);
+
+		if (!puz->values[c])
+			cdok_session_set(&s, c, s.solution[c]);
+	}
+	i = first_free(puz);
+	cdok_session_set(&s, i, s.solution[i] % size + 1);
+
+	len = cdok_session_save(&s, buf, sizeof(buf));
+	CHECK(len > 0);
+	CHECK(!cdok_session_save(&s, buf, len - 1));
+	len = cdok_session_save(&s, buf, sizeof(buf));
+
+	memset(&t, 0, sizeof(t));
+	CHECK(!cdok_session_load(&t, buf, len));
+	CHECK(t.puzzle.size == s.puzzle.size);
+	CHECK(!memcmp(t.puzzle.values, s.puzzle.values, CDOK_CELLS));
+	CHECK(!memcmp(t.puzzle.group_map, s.puzzle.group_map, CDOK_CELLS));
+	CHECK(!memcmp(t.solution, s.solution, CDOK_CELLS));
+	CHECK(!memcmp(t.values, s.values, CDOK_CELLS));
+	CHECK(!memcmp(t.row_count, s.row_count, sizeof(s.row_count)));
+	CHECK(!memcmp(t.col_count, s.col_count, sizeof(s.col_count)));
+	CHECK(!memcmp(t.group_filled, s.group_filled,
+		      sizeof(s.group_filled)));
+	CHECK(t.filled == s.filled && t.conflicts == s.conflicts &&
+	      t.wrong == s.wrong && t.moves == s.moves);
+
+	CHECK(!cdok_session_hint(&s, &hs));
+	CHECK(!cdok_session_hint(&t, &ht));
+	CHECK(hs.reason == ht.reason && hs.cell == ht.cell &&
+	      hs.value == ht.value);
+
+	/* Damaged data is refused */
+	CHECK(cdok_session_load(&t, buf, len - 1) < 0);
+	buf[0] ^= 0xff;
+	CHECK(cdok_session_load(&t, buf, len) < 0);
+}
+
+static void check_session(void)
+{
+	static const int sizes[] = {4, 6, 9};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		struct cdok_puzzle puz;
+		uint8_t solution[CDOK_CELLS];
+
+		make_puzzle(&puz, solution, sizes[i], i + 1);
+		check_session_moves(&puz, solution);
+		check_session_hints(&puz);
+		check_session_save(&puz);
+	}
+}
+
+/************************************************************************
+ * Editing sessions
+ */
+
+/* Build a group by hand in an empty puzzle, and break and mend it. */
+static void check_edit_groups(void)
+{
+	struct cdok_puzzle puz;
+	struct cdok_edit e;
+	uint8_t g;
+	int i;
+
+	cdok_init_puzzle(&puz, 4);
+	cdok_edit_init(&e, &puz);
+	CHECK(!e.problem_groups && e.status == CDOK_EDIT_UNKNOWN);
+
+	g = cdok_edit_free_group(&e);
+	CHECK(g != CDOK_GROUP_NONE);
+	CHECK(!cdok_edit_add(&e, g, CDOK_POS(0, 0)));
+	CHECK(e.problems[g] == (CDOK_EDIT_NO_TYPE | CDOK_EDIT_NO_TARGET |
+				CDOK_EDIT_SINGLE));
+	CHECK(e.problem_groups == 1 && e.status == CDOK_EDIT_INVALID);
+	CHECK(cdok_edit_free_group(&e) != g);
+
+	CHECK(!cdok_edit_add(&e, g, CDOK_POS(1, 0)));
+	CHECK(!cdok_edit_add(&e, g, CDOK_POS(2, 0)));
+	CHECK(!cdok_edit_set_type(&e, g, CDOK_PRODUCT));
+	CHECK(!cdok_edit_set_target(&e, g, 0));
+	CHECK(e.problems[g] == CDOK_EDIT_ZERO_TARGET);
+	CHECK(!cdok_edit_set_target(&e, g, 6));
+	CHECK(!e.problems[g] && !e.problem_groups);
+	CHECK(e.status == CDOK_EDIT_UNKNOWN);
+	CHECK(e.puzzle.group_map[CDOK_POS(1, 0)] == g);
+
+	/* Taking out the middle cell splits the group */
+	CHECK(!cdok_edit_remove(&e, CDOK_POS(1, 0)));
+	CHECK(e.problems[g] == CDOK_EDIT_SPLIT);
+	CHECK(e.status == CDOK_EDIT_INVALID);
+	CHECK(e.puzzle.group_map[CDOK_POS(1, 0)] == CDOK_GROUP_NONE);
+	CHECK(!cdok_edit_add(&e, g, CDOK_POS(1, 1)));
+	CHECK(e.problems[g] == CDOK_EDIT_SPLIT);
+	CHECK(!cdok_edit_add(&e, g, CDOK_POS(1, 0)));
+	CHECK(!e.problems[g] && e.status == CDOK_EDIT_UNKNOWN);
+
+	/* Moving a cell to another group takes it out of this one */
+	CHECK(!cdok_edit_add(&e, g + 1, CDOK_POS(1, 1)));
+	CHECK(e.puzzle.groups[g].size == 3);
+	CHECK(e.problems[g + 1] & CDOK_EDIT_SINGLE);
+	CHECK(!cdok_edit_remove(&e, CDOK_POS(1, 1)));
+	CHECK(!e.puzzle.groups[g + 1].size && !e.problems[g + 1]);
+
+	/* Edits which aren't allowed */
+	CHECK(cdok_edit_add(&e, g, CDOK_POS(4, 0)) < 0);
+	CHECK(cdok_edit_add(&e, CDOK_GROUPS, CDOK_POS(3, 3)) < 0);
+	CHECK(cdok_edit_remove(&e, CDOK_POS(3, 3)) < 0);
+	CHECK(cdok_edit_set_type(&e, g + 1, CDOK_SUM) < 0);
+	CHECK(cdok_edit_set_target(&e, g, -1) < 0);
+
+	for (i = 0; i < CDOK_GROUP_SIZE; i++)
+		CHECK(!cdok_edit_add(&e, g + 2, CDOK_POS(i % 4, 2 + i / 4)));
+	CHECK(cdok_edit_add(&e, g + 2, CDOK_POS(3, 1)) < 0);
+}
+
+/* Check results are remembered, and checks overtaken by edits are
+ * rejected.
+ */
+static void check_edit_checks(void)
+{
+	struct cdok_puzzle puz;
+	struct cdok_edit e;
+	struct cdok_edit_check chk;
+	uint8_t solution[CDOK_CELLS];
+	cdok_pos_t c;
+	uint8_t g;
+	int target;
+	int diff;
+
+	make_puzzle(&puz, solution, 5, 4);
+	cdok_edit_init(&e, &puz);
+	CHECK(e.status == CDOK_EDIT_UNKNOWN);
+	CHECK(cdok_edit_check(&e) == CDOK_EDIT_UNIQUE);
+	CHECK(e.have_solution && same_grid(5, e.solution, solution));
+	diff = e.diff;
+
+	/* Changing a target breaks the solution, and changing it back
+	 * finds the result remembered.
+	 */
+	c = first_free(&puz);
+	g = puz.group_map[c];
+	CHECK(g != CDOK_GROUP_NONE);
+	target = puz.groups[g].target;
+
+	CHECK(!cdok_edit_set_target(&e, g, target + 1));
+	CHECK(e.status == CDOK_EDIT_UNKNOWN);
+	CHECK(!cdok_edit_set_target(&e, g, target));
+	CHECK(e.status == CDOK_EDIT_SOLVABLE);
+	CHECK(!cdok_edit_begin(&e, &chk));
+	CHECK(e.status == CDOK_EDIT_UNIQUE && e.diff == diff);
+
+	/* An edit made before a check runs makes it stale */
+	CHECK(!cdok_edit_set_target(&e, g, target + 1));
+	CHECK(cdok_edit_begin(&e, &chk) == 1);
+	CHECK(!cdok_edit_set_target(&e, g, target + 2));
+	cdok_edit_run(&chk);
+	CHECK(cdok_edit_finish(&e, &chk) < 0);
+	CHECK(e.status == CDOK_EDIT_UNKNOWN);
+
+	/* So does one made after it runs, but its result is kept */
+	CHECK(!cdok_edit_set_target(&e, g, target + 1));
+	CHECK(cdok_edit_begin(&e, &chk) == 1);
+	CHECK(cdok_edit_run(&chk) != CDOK_SOLVE_CANCELLED);
+	CHECK(!cdok_edit_set_target(&e, g, target));
+	CHECK(cdok_edit_finish(&e, &chk) < 0);
+	CHECK(e.status == CDOK_EDIT_SOLVABLE);
+	CHECK(!cdok_edit_begin(&e, &chk));
+	CHECK(e.status == CDOK_EDIT_UNIQUE);
+
+	CHECK(!cdok_edit_set_target(&e, g, target + 1));
+	CHECK(!cdok_edit_begin(&e, &chk));
+	CHECK(e.status != CDOK_EDIT_UNKNOWN);
+}
+
+static void check_edit(void)
+{
+	check_edit_groups();
+	check_edit_checks();
+}
+
+int main(void)
+{
+	check_session();
+	check_edit();
+
+	printf("%d checks, %d failed\n", checks, failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,467 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cage.h"
+#include "canon.h"
+#include "count.h"
+
+/* Number of remembered component counts. The cache is direct-mapped:
+ * a new count replaces whatever was in its slot.
+ */
+#define COUNT_CACHE_SIZE	65536
+
+/* Longest component key: three bytes per cell, and for each group, its
+ * index and the values of its members.
+ */
+#define COUNT_KEY_MAX		(CDOK_CELLS * 3 + \
+				 CDOK_GROUPS * (1 + CDOK_GROUP_SIZE))
+
+struct count_entry {
+	struct cdok_fingerprint	fp;
+	uint64_t		count;
+};
+
+struct counter {
+	const struct cdok_puzzle	*puzzle;
+	struct count_entry		*cache;
+	int				saturated;
+	struct cdok_count_stats		stats;
+	uint8_t				key[COUNT_KEY_MAX];
+};
+
+/************************************************************************
+ * Arithmetic
+ */
+
+static uint64_t sat_add(struct counter *ct, uint64_t a, uint64_t b)
+{
+	uint64_t r;
+
+	if (__builtin_add_overflow(a, b, &r)) {
+		ct->saturated = 1;
+		return UINT64_MAX;
+	}
+
+	return r;
+}
+
+static uint64_t sat_mul(struct counter *ct, uint64_t a, uint64_t b)
+{
+	uint64_t r;
+
+	if (__builtin_mul_overflow(a, b, &r)) {
+		ct->saturated = 1;
+		return UINT64_MAX;
+	}
+
+	return r;
+}
+
+/************************************************************************
+ * Propagation
+ */
+
+static int group_is_open(const struct cdok_group *g, const uint8_t *values)
+{
+	int i;
+
+	for (i = 0; i < g->size; i++)
+		if (!values[g->members[i]])
+			return 1;
+
+	return 0;
+}
+
+/* Narrow the candidates of each empty cell by its row, column and
+ * group, and fill cells left with a single candidate, until nothing
+ * more changes. Candidates are only ever narrowed, never recomputed, so
+ * that they depend only on the values placed since they were last
+ * looked at. Returns -1 if the position has no solution.
+ */
+static int propagate(const struct cdok_puzzle *puz, uint8_t *values,
+		     cdok_set_t *cand)
+{
+	const int size = puz->size;
+
+	for (;;) {
+		cdok_set_t rows[CDOK_SIZE] = {0};
+		cdok_set_t cols[CDOK_SIZE] = {0};
+		int filled = 0;
+		int x, y;
+		int i;
+
+		for (y = 0; y < size; y++)
+			for (x = 0; x < size; x++) {
+				const int v = values[CDOK_POS(x, y)];
+
+				if (v) {
+					rows[y] |= CDOK_SET_SINGLE(v);
+					cols[x] |= CDOK_SET_SINGLE(v);
+				}
+			}
+
+		for (i = 0; i < CDOK_GROUPS; i++) {
+			const struct cdok_group *g = &puz->groups[i];
+			cdok_set_t s;
+			int j;
+
+			if (!g->size)
+				continue;
+
+			if (!group_is_open(g, values)) {
+				if (!cdok_group_satisfied(g, values))
+					return -1;
+				continue;
+			}
+
+			s = cdok_group_candidates(g, values, size);
+			for (j = 0; j < g->size; j++)
+				cand[g->members[j]] &= s;
+		}
+
+		for (y = 0; y < size; y++)
+			for (x = 0; x < size; x++) {
+				const cdok_pos_t c = CDOK_POS(x, y);
+				cdok_set_t s;
+
+				if (values[c])
+					continue;
+
+				s = cand[c] & ~(rows[y] | cols[x]);
+				if (!s)
+					return -1;
+
+				cand[c] = s;
+				if (s & (s - 1))
+					continue;
+
+				/* A single: the value can't already have
+				 * been placed by another single.
+				 */
+				values[c] = __builtin_ctz(s) + 1;
+				rows[y] |= s;
+				cols[x] |= s;
+				filled = 1;
+			}
+
+		if (!filled)
+			return 0;
+	}
+}
+
+/* Check that no row or column repeats a given value. */
+static int givens_ok(const struct cdok_puzzle *puz)
+{
+	cdok_set_t rows[CDOK_SIZE] = {0};
+	cdok_set_t cols[CDOK_SIZE] = {0};
+	int x, y;
+
+	for (y = 0; y < puz->size; y++)
+		for (x = 0; x < puz->size; x++) {
+			const int v = puz->values[CDOK_POS(x, y)];
+			cdok_set_t s;
+
+			if (!v)
+				continue;
+
+			s = CDOK_SET_SINGLE(v);
+			if ((rows[y] | cols[x]) & s)
+				return 0;
+
+			rows[y] |= s;
+			cols[x] |= s;
+		}
+
+	return 1;
+}
+
+/************************************************************************
+ * Components
+ */
+
+static uint64_t count_cells(struct counter *ct, const uint8_t *values,
+			    const cdok_set_t *cand,
+			    const uint8_t *cells, int n);
+
+/* Build the key for a component, and look it up. Returns the slot. */
+static struct count_entry *lookup(struct counter *ct, const uint8_t *values,
+				  const cdok_set_t *cand,
+				  const uint8_t *cells, int n,
+				  struct cdok_fingerprint *fp)
+{
+	const struct cdok_puzzle *puz = ct->puzzle;
+	uint64_t seen = 0;
+	struct count_entry *e;
+	int len = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		ct->key[len++] = cells[i];
+		ct->key[len++] = cand[cells[i]];
+		ct->key[len++] = cand[cells[i]] >> 8;
+	}
+
+	for (i = 0; i < n; i++) {
+		const uint8_t g = puz->group_map[cells[i]];
+		const struct cdok_group *grp;
+		int j;
+
+		if (g == CDOK_GROUP_NONE || (seen & (1ULL << g)))
+			continue;
+
+		seen |= 1ULL << g;
+		grp = &puz->groups[g];
+		ct->key[len++] = g;
+		for (j = 0; j < grp->size; j++)
+			ct->key[len++] = values[grp->members[j]];
+	}
+
+	cdok_fingerprint_bytes(ct->key, len, fp);
+	if (!fp->hi && !fp->lo)
+		fp->lo = 1;
+
+	e = &ct->cache[fp->lo & (COUNT_CACHE_SIZE - 1)];
+	ct->stats.lookups++;
+	return e;
+}
+
+/* Count the solutions of a component, by branching on its cell with the
+ * fewest candidates.
+ */
+static uint64_t count_component(struct counter *ct, const uint8_t *values,
+				const cdok_set_t *cand,
+				const uint8_t *cells, int n)
+{
+	struct cdok_fingerprint fp;
+	struct count_entry *e = lookup(ct, values, cand, cells, n, &fp);
+	uint64_t total = 0;
+	cdok_pos_t best = cells[0];
+	cdok_set_t s;
+	int i;
+
+	if (e->fp.hi == fp.hi && e->fp.lo == fp.lo) {
+		ct->stats.hits++;
+		return e->count;
+	}
+
+	ct->stats.nodes++;
+
+	for (i = 1; i < n; i++)
+		if (__builtin_popcount(cand[cells[i]]) <
+		    __builtin_popcount(cand[best]))
+			best = cells[i];
+
+	for (s = cand[best]; s; s &= s - 1) {
+		uint8_t next_values[CDOK_CELLS];
+		cdok_set_t next_cand[CDOK_CELLS];
+
+		memcpy(next_values, values, sizeof(next_values));
+		memcpy(next_cand, cand, sizeof(next_cand));
+		next_values[best] = __builtin_ctz(s) + 1;
+
+		if (propagate(ct->puzzle, next_values, next_cand) < 0)
+			continue;
+
+		total = sat_add(ct, total,
+				count_cells(ct, next_values, next_cand,
+					    cells, n));
+	}
+
+	/* Look again: the slot may have been reused while branching. */
+	e = &ct->cache[fp.lo & (COUNT_CACHE_SIZE - 1)];
+	e->fp = fp;
+	e->count = total;
+
+	return total;
+}
+
+static uint8_t find_root(uint8_t *parent, uint8_t c)
+{
+	while (parent[c] != c) {
+		parent[c] = parent[parent[c]];
+		c = parent[c];
+	}
+
+	return c;
+}
+
+static void join(uint8_t *parent, uint8_t a, uint8_t b)
+{
+	a = find_root(parent, a);
+	b = find_root(parent, b);
+
+	if (a != b)
+		parent[b] = a;
+}
+
+/* Count the solutions over the empty cells among those given, which
+ * must be in ascending order. The empty cells are split into
+ * components, and the counts of each are multiplied.
+ */
+static uint64_t count_cells(struct counter *ct, const uint8_t *values,
+			    const cdok_set_t *cand,
+			    const uint8_t *cells, int n)
+{
+	const struct cdok_puzzle *puz = ct->puzzle;
+	uint8_t parent[CDOK_CELLS];
+	uint8_t row_last[CDOK_SIZE][CDOK_SIZE];
+	uint8_t row_count[CDOK_SIZE] = {0};
+	uint8_t col_last[CDOK_SIZE][CDOK_SIZE];
+	uint8_t col_count[CDOK_SIZE] = {0};
+	uint8_t group_first[CDOK_GROUPS];
+	uint8_t empty[CDOK_CELLS];
+	int16_t comp_of[CDOK_CELLS];
+	int16_t comp_size[CDOK_CELLS] = {0};
+	uint8_t sorted[CDOK_CELLS];
+	uint64_t product = 1;
+	int m = 0;
+	int comps = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (!values[cells[i]])
+			empty[m++] = cells[i];
+
+	if (!m)
+		return 1;
+
+	memset(group_first, CDOK_GROUP_NONE, sizeof(group_first));
+
+	/* Join cells which share a group, or share a row or column and
+	 * have a candidate in common.
+	 */
+	for (i = 0; i < m; i++) {
+		const uint8_t c = empty[i];
+		const int x = CDOK_POS_X(c);
+		const int y = CDOK_POS_Y(c);
+		const uint8_t g = puz->group_map[c];
+		int j;
+
+		parent[c] = c;
+
+		for (j = 0; j < row_count[y]; j++)
+			if (cand[row_last[y][j]] & cand[c])
+				join(parent, row_last[y][j], c);
+
+		for (j = 0; j < col_count[x]; j++)
+			if (cand[col_last[x][j]] & cand[c])
+				join(parent, col_last[x][j], c);
+
+		row_last[y][row_count[y]++] = c;
+		col_last[x][col_count[x]++] = c;
+
+		if (g != CDOK_GROUP_NONE) {
+			if (group_first[g] == CDOK_GROUP_NONE)
+				group_first[g] = c;
+			else
+				join(parent, group_first[g], c);
+		}
+	}
+
+	/* Number the components by their first cells, and sort the cells
+	 * by component, keeping them in ascending order within each.
+	 */
+	for (i = 0; i < m; i++)
+		comp_of[empty[i]] = -1;
+
+	for (i = 0; i < m; i++) {
+		const uint8_t r = find_root(parent, empty[i]);
+
+		if (comp_of[r] < 0)
+			comp_of[r] = comps++;
+
+		comp_size[comp_of[r]]++;
+	}
+
+	if (comps > 1)
+		ct->stats.splits++;
+
+	for (i = 1; i < comps; i++)
+		comp_size[i] += comp_size[i - 1];
+
+	for (i = m - 1; i >= 0; i--) {
+		const int k = comp_of[find_root(parent, empty[i])];
+
+		sorted[--comp_size[k]] = empty[i];
+	}
+
+	/* comp_size[k] is now the start of component k */
+	for (i = 0; i < comps && product; i++) {
+		const int start = comp_size[i];
+		const int end = i + 1 < comps ? comp_size[i + 1] : m;
+
+		product = sat_mul(ct, product,
+				  count_component(ct, values, cand,
+						  sorted + start,
+						  end - start));
+	}
+
+	return product;
+}
+
+int cdok_count(const struct cdok_puzzle *puz, uint64_t *count,
+	       struct cdok_count_stats *stats)
+{
+	struct counter *ct;
+	uint8_t values[CDOK_CELLS];
+	cdok_set_t cand[CDOK_CELLS];
+	uint8_t cells[CDOK_CELLS];
+	int n = 0;
+	int x, y;
+	int r;
+
+	ct = malloc(sizeof(*ct));
+	if (!ct)
+		return -1;
+
+	ct->cache = calloc(COUNT_CACHE_SIZE, sizeof(ct->cache[0]));
+	if (!ct->cache) {
+		free(ct);
+		return -1;
+	}
+
+	ct->puzzle = puz;
+	ct->saturated = 0;
+	memset(&ct->stats, 0, sizeof(ct->stats));
+
+	memcpy(values, puz->values, sizeof(values));
+	memset(cand, 0, sizeof(cand));
+	for (y = 0; y < puz->size; y++)
+		for (x = 0; x < puz->size; x++) {
+			cand[CDOK_POS(x, y)] = CDOK_SET_ONES(puz->size);
+			cells[n++] = CDOK_POS(x, y);
+		}
+
+	if (!givens_ok(puz) || propagate(puz, values, cand) < 0)
+		*count = 0;
+	else
+		*count = count_cells(ct, values, cand, cells, n);
+
+	r = ct->saturated;
+	if (r)
+		*count = UINT64_MAX;
+
+	if (stats)
+		*stats = ct->stats;
+
+	free(ct->cache);
+	free(ct);
+
+	return r;
+}
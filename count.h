@@ -0,0 +1,64 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef COUNT_H_
+#define COUNT_H_
+
+/* Solution counting. Enumerating solutions one by one takes time in
+ * proportion to their number, which for a loosely constrained puzzle
+ * may be millions. The counter instead works on the residual problem:
+ * the empty cells left after filling every cell with a single
+ * candidate, and their candidates.
+ *
+ * Two empty cells affect one another only if they share a group, or
+ * share a row or column and have a candidate in common. The empty cells
+ * fall into components which don't affect one another, and the number
+ * of solutions is the product of the counts for each component. A
+ * component is counted by branching on its most constrained cell, and
+ * splitting what's left again.
+ *
+ * Counts are remembered for each component, keyed by a fingerprint of
+ * its cells, their candidates and the values already placed in its
+ * groups. Together these determine the count. A component which turns
+ * up again under a different branch, because the branch didn't touch
+ * it, is counted only once.
+ */
+
+#include <stdint.h>
+#include "cdok.h"
+
+/* Counter statistics:
+ *
+ *    nodes:   components counted by branching
+ *    splits:  positions which fell into more than one component
+ *    lookups: components looked up in the cache
+ *    hits:    components found there
+ */
+struct cdok_count_stats {
+	uint64_t	nodes;
+	uint64_t	splits;
+	uint64_t	lookups;
+	uint64_t	hits;
+};
+
+/* Count the solutions of a puzzle. The stats may be NULL. Returns 0 if
+ * the count is exact, 1 if there are too many to count, in which case
+ * the count is UINT64_MAX, or -1 if memory couldn't be allocated.
+ */
+int cdok_count(const struct cdok_puzzle *puz, uint64_t *count,
+	       struct cdok_count_stats *stats);
+
+#endif
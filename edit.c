@@ -0,0 +1,380 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "solver.h"
+#include "verify.h"
+#include "edit.h"
+
+/************************************************************************
+ * Group problems
+ */
+
+/* Are two cells next to each other? */
+static int adjacent(cdok_pos_t a, cdok_pos_t b)
+{
+	const int dx = CDOK_POS_X(a) - CDOK_POS_X(b);
+	const int dy = CDOK_POS_Y(a) - CDOK_POS_Y(b);
+
+	return dx * dx + dy * dy == 1;
+}
+
+/* Is a group a single region? Starting from its first member, keep
+ * adding members next to one already reached until no more can be. A
+ * group has so few members that this is quicker than a flood fill of
+ * the map.
+ */
+static int group_contiguous(const struct cdok_group *g)
+{
+	unsigned int reached = 1;
+	unsigned int all = (1 << g->size) - 1;
+	int grown;
+
+	do {
+		int i;
+
+		grown = 0;
+		for (i = 1; i < g->size; i++) {
+			int j;
+
+			if (reached & (1 << i))
+				continue;
+
+			for (j = 0; j < g->size; j++)
+				if ((reached & (1 << j)) &&
+				    adjacent(g->members[i], g->members[j])) {
+					reached |= 1 << i;
+					grown = 1;
+					break;
+				}
+		}
+	} while (grown && reached != all);
+
+	return reached == all;
+}
+
+static uint8_t group_problems(const struct cdok_group *g)
+{
+	uint8_t p = 0;
+
+	if (!g->size)
+		return 0;
+
+	if (!g->type)
+		p |= CDOK_EDIT_NO_TYPE;
+
+	if (g->target < 0)
+		p |= CDOK_EDIT_NO_TARGET;
+	else if ((g->type == CDOK_RATIO || g->type == CDOK_PRODUCT) &&
+		 !g->target)
+		p |= CDOK_EDIT_ZERO_TARGET;
+
+	if (g->size < 2)
+		p |= CDOK_EDIT_SINGLE;
+	else if (!group_contiguous(g))
+		p |= CDOK_EDIT_SPLIT;
+
+	return p;
+}
+
+/* Recheck a group after it's been changed. */
+static void update_group(struct cdok_edit *e, uint8_t g)
+{
+	const uint8_t p = group_problems(&e->puzzle.groups[g]);
+
+	if (p && !e->problems[g])
+		e->problem_groups++;
+	else if (!p && e->problems[g])
+		e->problem_groups--;
+
+	e->problems[g] = p;
+}
+
+/************************************************************************
+ * Status
+ */
+
+/* Take a solver result as the status. */
+static void take_result(struct cdok_edit *e, int result, int diff,
+			const uint8_t *solution)
+{
+	if (result < 0) {
+		e->status = CDOK_EDIT_UNSOLVABLE;
+		return;
+	}
+
+	e->status = result ? CDOK_EDIT_AMBIGUOUS : CDOK_EDIT_UNIQUE;
+	e->diff = diff;
+	memcpy(e->solution, solution, sizeof(e->solution));
+	e->have_solution = 1;
+}
+
+/* Note that the puzzle has changed. Any check in progress is cancelled
+ * by the change of generation. If the last solution found still fits,
+ * the puzzle is at least solvable.
+ */
+static void edited(struct cdok_edit *e)
+{
+	__atomic_add_fetch(&e->generation, 1, __ATOMIC_RELEASE);
+
+	if (e->problem_groups)
+		e->status = CDOK_EDIT_INVALID;
+	else if (e->have_solution && !cdok_verify(&e->puzzle, e->solution,
+						  NULL))
+		e->status = CDOK_EDIT_SOLVABLE;
+	else
+		e->status = CDOK_EDIT_UNKNOWN;
+}
+
+static const struct cdok_edit_memo *memo_find(const struct cdok_edit *e,
+					      const struct cdok_fingerprint *fp,
+					      uint8_t transform)
+{
+	unsigned int i;
+
+	for (i = 0; i < e->memo_count; i++) {
+		const struct cdok_edit_memo *m = &e->memo[i];
+
+		if (m->fp.hi == fp->hi && m->fp.lo == fp->lo &&
+		    m->transform == transform)
+			return m;
+	}
+
+	return NULL;
+}
+
+/* Remember a result, replacing the oldest when the memo is full. */
+static void memo_add(struct cdok_edit *e, const struct cdok_edit_check *chk)
+{
+	struct cdok_edit_memo *m;
+
+	if (memo_find(e, &chk->fp, chk->transform))
+		return;
+
+	m = &e->memo[e->memo_next];
+	e->memo_next = (e->memo_next + 1) % CDOK_EDIT_MEMO;
+	if (e->memo_count < CDOK_EDIT_MEMO)
+		e->memo_count++;
+
+	m->fp = chk->fp;
+	m->transform = chk->transform;
+	m->result = chk->result;
+	m->diff = chk->diff;
+	if (chk->result >= 0)
+		memcpy(m->solution, chk->solution, sizeof(m->solution));
+}
+
+/************************************************************************
+ * Edits
+ */
+
+void cdok_edit_init(struct cdok_edit *e, const struct cdok_puzzle *puz)
+{
+	int i;
+
+	memset(e, 0, sizeof(*e));
+	memcpy(&e->puzzle, puz, sizeof(e->puzzle));
+
+	for (i = 0; i < CDOK_GROUPS; i++)
+		update_group(e, i);
+
+	e->status = e->problem_groups ?
+		CDOK_EDIT_INVALID : CDOK_EDIT_UNKNOWN;
+}
+
+static int in_grid(const struct cdok_puzzle *puz, cdok_pos_t c)
+{
+	return c >= 0 && c < CDOK_CELLS &&
+		CDOK_POS_X(c) < puz->size && CDOK_POS_Y(c) < puz->size;
+}
+
+/* Take a cell out of its group. A group left with no members is reset to
+ * the unused state.
+ */
+static void take_out(struct cdok_edit *e, cdok_pos_t c)
+{
+	const uint8_t g = e->puzzle.group_map[c];
+	struct cdok_group *grp = &e->puzzle.groups[g];
+	int i = 0;
+
+	while (grp->members[i] != c)
+		i++;
+
+	grp->size--;
+	memmove(grp->members + i, grp->members + i + 1,
+		(grp->size - i) * sizeof(grp->members[0]));
+	e->puzzle.group_map[c] = CDOK_GROUP_NONE;
+
+	if (!grp->size) {
+		grp->type = 0;
+		grp->target = -1;
+	}
+
+	update_group(e, g);
+}
+
+int cdok_edit_add(struct cdok_edit *e, uint8_t g, cdok_pos_t c)
+{
+	struct cdok_group *grp;
+
+	if (!in_grid(&e->puzzle, c) || g >= CDOK_GROUPS)
+		return -1;
+
+	if (e->puzzle.group_map[c] == g)
+		return 0;
+
+	grp = &e->puzzle.groups[g];
+	if (grp->size >= CDOK_GROUP_SIZE)
+		return -1;
+
+	if (e->puzzle.group_map[c] != CDOK_GROUP_NONE)
+		take_out(e, c);
+
+	grp->members[grp->size++] = c;
+	e->puzzle.group_map[c] = g;
+	update_group(e, g);
+
+	edited(e);
+	return 0;
+}
+
+int cdok_edit_remove(struct cdok_edit *e, cdok_pos_t c)
+{
+	if (!in_grid(&e->puzzle, c) ||
+	    e->puzzle.group_map[c] == CDOK_GROUP_NONE)
+		return -1;
+
+	take_out(e, c);
+	edited(e);
+	return 0;
+}
+
+int cdok_edit_set_type(struct cdok_edit *e, uint8_t g, cdok_gtype_t type)
+{
+	if (g >= CDOK_GROUPS || !e->puzzle.groups[g].size)
+		return -1;
+
+	switch (type) {
+	case CDOK_SUM:
+	case CDOK_DIFFERENCE:
+	case CDOK_PRODUCT:
+	case CDOK_RATIO:
+		break;
+
+	default:
+		return -1;
+	}
+
+	e->puzzle.groups[g].type = type;
+	update_group(e, g);
+	edited(e);
+	return 0;
+}
+
+int cdok_edit_set_target(struct cdok_edit *e, uint8_t g, int target)
+{
+	if (g >= CDOK_GROUPS || !e->puzzle.groups[g].size || target < 0)
+		return -1;
+
+	e->puzzle.groups[g].target = target;
+	update_group(e, g);
+	edited(e);
+	return 0;
+}
+
+uint8_t cdok_edit_free_group(const struct cdok_edit *e)
+{
+	int i;
+
+	for (i = 0; i < CDOK_GROUPS; i++)
+		if (!e->puzzle.groups[i].size)
+			return i;
+
+	return CDOK_GROUP_NONE;
+}
+
+/************************************************************************
+ * Checks
+ */
+
+int cdok_edit_begin(struct cdok_edit *e, struct cdok_edit_check *chk)
+{
+	const struct cdok_edit_memo *m;
+
+	if (e->status != CDOK_EDIT_UNKNOWN && e->status != CDOK_EDIT_SOLVABLE)
+		return 0;
+
+	memcpy(&chk->puzzle, &e->puzzle, sizeof(chk->puzzle));
+	chk->generation = &e->generation;
+	chk->started = e->generation;
+	chk->transform = cdok_fingerprint(&chk->puzzle, &chk->fp);
+	chk->result = CDOK_SOLVE_CANCELLED;
+
+	m = memo_find(e, &chk->fp, chk->transform);
+	if (m) {
+		take_result(e, m->result, m->diff, m->solution);
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Has the session been edited since the check began? */
+static int superseded(void *arg)
+{
+	const struct cdok_edit_check *chk = arg;
+
+	return __atomic_load_n(chk->generation, __ATOMIC_ACQUIRE) !=
+		chk->started;
+}
+
+int cdok_edit_run(struct cdok_edit_check *chk)
+{
+	chk->result = cdok_solve_cancellable(&chk->puzzle, NULL,
+					     chk->solution, &chk->diff, NULL,
+					     superseded, chk);
+	return chk->result;
+}
+
+int cdok_edit_finish(struct cdok_edit *e, const struct cdok_edit_check *chk)
+{
+	if (chk->result == CDOK_SOLVE_CANCELLED)
+		return -1;
+
+	/* A stale result is still right for the puzzle it was run on, which
+	 * may well come back.
+	 */
+	memo_add(e, chk);
+
+	if (chk->started != e->generation)
+		return -1;
+
+	take_result(e, chk->result, chk->diff, chk->solution);
+	return 0;
+}
+
+cdok_edit_status_t cdok_edit_check(struct cdok_edit *e)
+{
+	struct cdok_edit_check chk;
+
+	if (cdok_edit_begin(e, &chk)) {
+		cdok_edit_run(&chk);
+		cdok_edit_finish(e, &chk);
+	}
+
+	return e->status;
+}
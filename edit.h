@@ -0,0 +1,175 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef EDIT_H_
+#define EDIT_H_
+
+/* Editing sessions. An editing session holds a puzzle being authored
+ * and accepts edits to its groups: moving a cell into a group or out of
+ * one, and setting a group's type and target. The group map is kept up
+ * to date as cells move, and each edit rechecks only the groups it
+ * touches, so that problems such as a group split in two are known at
+ * all times without looking at the rest of the puzzle.
+ *
+ * Uniqueness and difficulty are found by checks, which run the solver
+ * and may be slow. The session remembers the results of recent checks,
+ * keyed by the puzzle's fingerprint, so that undoing an edit or
+ * dragging a boundary back and forth doesn't solve the same puzzle
+ * again. After an edit, the last solution found is also tried against
+ * the new puzzle: if it still fits, the puzzle is known to be solvable
+ * straight away, and only its uniqueness is left to check.
+ *
+ * Every edit advances the session's generation. A check takes a copy of
+ * the puzzle and may run on another thread while editing continues. It
+ * is cancelled as soon as a later edit supersedes it, and its result is
+ * only reported if no edit has been made in the meantime. Edits and the
+ * begin/finish calls must come from one thread (or be serialized by the
+ * caller): only cdok_edit_run() may be called concurrently with them.
+ *
+ * A session is a self-contained structure with no pointers, and may be
+ * copied freely.
+ */
+
+#include <stdint.h>
+#include "cdok.h"
+#include "canon.h"
+
+/* Problems which prevent a group from being solved. */
+#define CDOK_EDIT_NO_TYPE	0x01
+#define CDOK_EDIT_NO_TARGET	0x02
+#define CDOK_EDIT_ZERO_TARGET	0x04
+#define CDOK_EDIT_SINGLE	0x08
+#define CDOK_EDIT_SPLIT		0x10
+
+/* What's known about the puzzle:
+ *
+ *    INVALID:    some group has a problem, so it can't be checked
+ *    UNKNOWN:    it hasn't been checked since the last edit
+ *    SOLVABLE:   it has a solution, but uniqueness isn't known yet
+ *    UNSOLVABLE: it has no solution
+ *    UNIQUE:     it has a unique solution
+ *    AMBIGUOUS:  it has more than one solution
+ */
+typedef enum {
+	CDOK_EDIT_INVALID,
+	CDOK_EDIT_UNKNOWN,
+	CDOK_EDIT_SOLVABLE,
+	CDOK_EDIT_UNSOLVABLE,
+	CDOK_EDIT_UNIQUE,
+	CDOK_EDIT_AMBIGUOUS
+} cdok_edit_status_t;
+
+/* Remembered check results. */
+#define CDOK_EDIT_MEMO		32
+
+struct cdok_edit_memo {
+	struct cdok_fingerprint	fp;
+	uint8_t			transform;
+	int8_t			result;
+	int			diff;
+	uint8_t			solution[CDOK_CELLS];
+};
+
+/* The session. The status, difficulty and solution describe the puzzle
+ * as it currently stands. The solution is valid for every status from
+ * SOLVABLE on, except UNSOLVABLE, and the difficulty for UNIQUE and
+ * AMBIGUOUS. The problems array holds CDOK_EDIT_* flags for each group,
+ * and problem_groups counts the groups with any.
+ */
+struct cdok_edit {
+	struct cdok_puzzle	puzzle;
+	unsigned int		generation;
+	uint8_t			problems[CDOK_GROUPS];
+	unsigned int		problem_groups;
+
+	cdok_edit_status_t	status;
+	int			diff;
+	uint8_t			solution[CDOK_CELLS];
+	int			have_solution;
+
+	struct cdok_edit_memo	memo[CDOK_EDIT_MEMO];
+	unsigned int		memo_count;
+	unsigned int		memo_next;
+};
+
+/* Start a session with a copy of a puzzle. The puzzle may be anything
+ * satisfying the basic invariants of cdok.h apart from those on groups:
+ * groups with problems are allowed, and are reported.
+ */
+void cdok_edit_init(struct cdok_edit *e, const struct cdok_puzzle *puz);
+
+/* Move a cell into a group, taking it out of any group it's in. If the
+ * group is unused, this starts a new one, with no type or target.
+ * Returns 0 on success, or -1 if the cell is outside the grid, the group
+ * index is out of range, or the group is full.
+ */
+int cdok_edit_add(struct cdok_edit *e, uint8_t g, cdok_pos_t c);
+
+/* Take a cell out of its group. When the last cell is removed, the group
+ * becomes unused. Returns 0 on success, or -1 if the cell is outside the
+ * grid or isn't in a group.
+ */
+int cdok_edit_remove(struct cdok_edit *e, cdok_pos_t c);
+
+/* Change a group's type or target. Returns 0 on success, or -1 if the
+ * group is unused, or the type or target is invalid.
+ */
+int cdok_edit_set_type(struct cdok_edit *e, uint8_t g, cdok_gtype_t type);
+int cdok_edit_set_target(struct cdok_edit *e, uint8_t g, int target);
+
+/* Find an unused group, for starting a new one. Returns its index, or
+ * CDOK_GROUP_NONE if all are in use.
+ */
+uint8_t cdok_edit_free_group(const struct cdok_edit *e);
+
+/* A check in progress. This holds a copy of the puzzle, so that it can
+ * be solved while the session is edited.
+ */
+struct cdok_edit_check {
+	struct cdok_puzzle	puzzle;
+	const unsigned int	*generation;
+	unsigned int		started;
+	struct cdok_fingerprint	fp;
+	uint8_t			transform;
+	int			result;
+	int			diff;
+	uint8_t			solution[CDOK_CELLS];
+};
+
+/* Start a check. Returns 1 if one is needed, in which case it should be
+ * run and then finished. Returns 0 if the status is already known (or
+ * the puzzle is invalid), in which case there's nothing more to do.
+ */
+int cdok_edit_begin(struct cdok_edit *e, struct cdok_edit_check *chk);
+
+/* Run a check. The session must not be freed or moved while this runs,
+ * but may be edited. Returns the solver's result, or
+ * CDOK_SOLVE_CANCELLED if an edit was made before it was done.
+ */
+int cdok_edit_run(struct cdok_edit_check *chk);
+
+/* Finish a check, remembering its result. Returns 0 if the result was
+ * taken as the session's status, or -1 if the check is stale: it was
+ * cancelled, or the puzzle has been edited since it began.
+ */
+int cdok_edit_finish(struct cdok_edit *e, const struct cdok_edit_check *chk);
+
+/* Check the puzzle from start to finish on the calling thread. Returns
+ * the new status.
+ */
+cdok_edit_status_t cdok_edit_check(struct cdok_edit *e);
+
+#endif
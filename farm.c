@@ -0,0 +1,809 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "canon.h"
+#include "parser.h"
+#include "printer.h"
+#include "verify.h"
+#include "library.h"
+#include "net.h"
+#include "server.h"
+#include "farm.h"
+
+/* Bands are seeded this far apart, just as puzzles within a band are
+ * seeded SERVICE_SEED_STEP apart.
+ */
+#define BAND_SEED_STEP		0xd1b54a32d192ed03ULL
+
+/* Connections are retried quietly for a while, since local workers may
+ * still be starting up.
+ */
+#define CONNECT_TRIES		20
+#define CONNECT_DELAY_US	100000
+
+#define MAX_REPLY		(64 << 20)
+
+/* A puzzle returned by a worker, ready to be added to the library. */
+struct result {
+	unsigned int		number;
+	struct cdok_lib_record	record;
+	struct cdok_fingerprint	fp;
+};
+
+typedef enum {
+	SHARD_WAITING,
+	SHARD_RUNNING,
+	SHARD_DONE
+} shard_state_t;
+
+/* Shard i of a band covers puzzle numbers [i * shard_size,
+ * (i + 1) * shard_size). Results are kept until every earlier shard
+ * has been merged.
+ */
+struct worker;
+
+struct shard {
+	shard_state_t		state;
+	int			attempts;
+	const struct worker	*failed_by;
+	struct result		*results;
+	int			count;
+};
+
+struct farm {
+	const struct farm_config	*cfg;
+	pthread_mutex_t			lock;
+	pthread_cond_t			cond;
+
+	struct cdok_fpset		seen;
+	struct cdok_lib_builder		builder;
+	int				live_workers;
+	int				failed;
+
+	/* The band being filled */
+	const struct farm_band		*band;
+	uint64_t			band_seed;
+	struct shard			*shards;
+	unsigned int			shard_count;
+	unsigned int			shard_cap;
+	uint64_t			tries;
+	unsigned int			shard_max;
+	unsigned int			merged;
+	unsigned int			have;
+	int				done;
+	unsigned long			duplicates;
+	unsigned long			retries;
+};
+
+struct worker {
+	struct farm		*farm;
+	const char		*addr;
+	int			fd;
+	int			failures;
+	int			dropped;
+	int			started;
+	char			*buf;
+	size_t			buf_size;
+	pthread_t		tid;
+};
+
+/* Local worker processes, with their sockets in a private directory */
+struct local {
+	char			dir[32];
+	char			paths[FARM_MAX_WORKERS][48];
+	pid_t			pids[FARM_MAX_WORKERS];
+	int			count;
+};
+
+int farm_parse_band(struct farm_band *b,
+		    const struct service_params *defaults, const char *text)
+{
+	b->params = *defaults;
+	b->count = 0;
+
+	while (*text) {
+		size_t len = strcspn(text, ", \t\n");
+		char word[64];
+
+		if (len >= sizeof(word))
+			return -1;
+
+		memcpy(word, text, len);
+		word[len] = 0;
+		text += len;
+		if (*text)
+			text++;
+
+		if (!len)
+			continue;
+
+		/* The count here is the band's, not a shard's, and seeds
+		 * are chosen by the farm.
+		 */
+		if (!strncmp(word, "count=", 6)) {
+			char *end;
+			unsigned long v = strtoul(word + 6, &end, 10);
+
+			if (*end || end == word + 6 || !v ||
+			    v > UINT32_MAX / FARM_BAND_TRIES)
+				return -1;
+
+			b->count = v;
+		} else if (!strncmp(word, "seed=", 5) ||
+			   service_parse_params(&b->params, word) < 0) {
+			return -1;
+		}
+	}
+
+	if (b->params.iterations > SERVICE_ITERATIONS_MAX)
+		return -1;
+
+	return b->count ? 0 : -1;
+}
+
+/* Find a key in a reply, returning a pointer to the text after it. */
+static const char *find_key(const char *text, const char *key)
+{
+	const char *p = strstr(text, key);
+
+	return p ? p + strlen(key) : NULL;
+}
+
+/* Read the rest of a JSON string, as written by json.c. */
+static const char *get_string(const char *p, char *buf, int max, int *len)
+{
+	int n = 0;
+
+	while (*p != '"') {
+		int c = *(p++);
+
+		if (!c)
+			return NULL;
+
+		if (c == '\\') {
+			int i;
+
+			switch (c = *(p++)) {
+			case 'n':
+				c = '\n';
+				break;
+
+			case 't':
+				c = '\t';
+				break;
+
+			case 'r':
+				c = '\r';
+				break;
+
+			case '"':
+			case '\\':
+			case '/':
+				break;
+
+			case 'u':
+				c = 0;
+				for (i = 0; i < 4; i++) {
+					int d = *(p++);
+
+					if (d >= '0' && d <= '9')
+						d -= '0';
+					else if (d >= 'a' && d <= 'f')
+						d -= 'a' - 10;
+					else if (d >= 'A' && d <= 'F')
+						d -= 'A' - 10;
+					else
+						return NULL;
+
+					c = (c << 4) | d;
+				}
+
+				if (c > 0x7f)
+					return NULL;
+				break;
+
+			default:
+				return NULL;
+			}
+		}
+
+		if (n >= max)
+			return NULL;
+
+		buf[n++] = c;
+	}
+
+	*len = n;
+	return p + 1;
+}
+
+/* Read a grid, written as an array of rows. */
+static const char *get_grid(const char *p, int size, uint8_t *grid)
+{
+	int i = 0;
+
+	memset(grid, 0, CDOK_CELLS);
+
+	while (i < size * size) {
+		char *end;
+		long v;
+
+		if (*p == '[' || *p == ']' || *p == ',') {
+			p++;
+			continue;
+		}
+
+		v = strtol(p, &end, 10);
+		if (end == p || v < 1 || v > size)
+			return NULL;
+
+		grid[CDOK_POS(i % size, i / size)] = v;
+		p = end;
+		i++;
+	}
+
+	return p;
+}
+
+/* Check a shard reply and convert its puzzles. Every puzzle must be of
+ * the band's size and difficulty, with numbers in order and within the
+ * shard, and must come with a correct solution. Returns NULL on
+ * success, or a description of what's wrong with the reply.
+ */
+static const char *parse_reply(const struct farm_band *band, int shard_size,
+			       const char *text, struct result *results,
+			       int *count)
+{
+	const int size = band->params.size;
+	const char *p;
+	long last = -1;
+	int n = 0;
+
+	if (strstr(text, "\"error\":"))
+		return "worker reported an error";
+
+	p = find_key(text, "\"puzzles\":[");
+	if (!p)
+		return "no puzzles";
+
+	while ((p = find_key(p, "\"number\":"))) {
+		struct result *r = &results[n];
+		uint8_t solution[CDOK_CELLS];
+		char spec[CDOK_SPEC_MAX];
+		struct cdok_puzzle puz;
+		int spec_len;
+		char *end;
+		long k;
+		long diff;
+
+		k = strtol(p, &end, 10);
+		if (end == p || k <= last || k >= shard_size)
+			return "bad puzzle number";
+		last = k;
+
+		p = find_key(end, "\"spec\":\"");
+		if (!p || !(p = get_string(p, spec, sizeof(spec), &spec_len)))
+			return "bad spec";
+
+		p = find_key(p, "\"solution\":");
+		if (!p || !(p = get_grid(p, size, solution)))
+			return "bad solution";
+
+		p = find_key(p, "\"difficulty\":");
+		if (!p)
+			return "missing difficulty";
+
+		diff = strtol(p, &end, 10);
+		if (end == p || diff < band->params.min_diff)
+			return "bad difficulty";
+		p = end;
+
+		if (cdok_parse_spec(&puz, spec, spec_len, NULL) < 0 ||
+		    puz.size != size)
+			return "bad puzzle";
+
+		if (cdok_verify(&puz, solution, NULL) < 0)
+			return "wrong solution";
+
+		r->number = k;
+		cdok_lib_encode(&r->record, &puz, solution, diff);
+		cdok_fingerprint(&puz, &r->fp);
+		n++;
+	}
+
+	*count = n;
+	return NULL;
+}
+
+static int connect_worker(const char *addr)
+{
+	int i;
+
+	for (i = 0; i < CONNECT_TRIES; i++) {
+		int fd = net_connect(addr);
+		int err = errno;
+
+		if (fd >= 0)
+			return fd;
+
+		usleep(CONNECT_DELAY_US);
+		errno = err;
+	}
+
+	return -1;
+}
+
+static void disconnect(struct worker *w)
+{
+	close(w->fd);
+	w->fd = -1;
+}
+
+/* Have a worker run a shard of the current band. Called without the
+ * lock held: the band doesn't change while workers are running.
+ * Returns 0 on success or -1 after printing a warning.
+ */
+static int run_shard(struct worker *w, unsigned int index,
+		     struct result **results, int *count)
+{
+	const struct farm *f = w->farm;
+	const struct service_params *p = &f->band->params;
+	const int shard_size = f->cfg->shard_size;
+	const uint64_t first = (uint64_t)index * shard_size;
+	const char *err;
+	char req[256];
+	int len;
+
+	if (w->fd < 0) {
+		w->fd = connect_worker(w->addr);
+		if (w->fd < 0) {
+			fprintf(stderr, "farm: can't connect to %s: %s\n",
+				w->addr, strerror(errno));
+			return -1;
+		}
+	}
+
+	len = snprintf(req, sizeof(req),
+		       "shard size=%d iterations=%d limit=%d target=%d "
+		       "two-cell=%d seed=%llu count=%d min-diff=%d",
+		       p->size, p->iterations, p->limit, p->target,
+		       !!(p->flags & CDOK_FLAGS_TWO_CELL),
+		       (unsigned long long)(f->band_seed +
+					    first * SERVICE_SEED_STEP),
+		       shard_size, p->min_diff);
+
+	if (net_write_frame(w->fd, req, len) < 0 ||
+	    net_read_frame(w->fd, &w->buf, &w->buf_size, MAX_REPLY) < 0) {
+		fprintf(stderr, "farm: lost connection to %s\n", w->addr);
+		disconnect(w);
+		return -1;
+	}
+
+	*results = malloc(shard_size * sizeof(**results));
+	if (!*results) {
+		fprintf(stderr, "farm: out of memory\n");
+		return -1;
+	}
+
+	err = parse_reply(f->band, shard_size, w->buf, *results, count);
+	if (err) {
+		fprintf(stderr, "farm: bad reply from %s: %s\n",
+			w->addr, err);
+		free(*results);
+		disconnect(w);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Choose a shard for a worker to run: the earliest one waiting to be
+ * retried, or else a new one. A shard isn't given back to the worker
+ * which last failed it while there are others to try. Returns 1 if a
+ * shard was found, 0 if there's nothing to do for now, or -1 if memory
+ * couldn't be allocated.
+ */
+static int next_shard(struct farm *f, const struct worker *w,
+		      unsigned int *index)
+{
+	unsigned int i;
+
+	for (i = f->merged; i < f->shard_count; i++) {
+		const struct shard *s = &f->shards[i];
+
+		if (s->state == SHARD_WAITING &&
+		    (s->failed_by != w || f->live_workers < 2)) {
+			*index = i;
+			return 1;
+		}
+	}
+
+	if (f->shard_count >= f->shard_max)
+		return 0;
+
+	if (f->shard_count >= f->shard_cap) {
+		unsigned int cap = f->shard_cap ? f->shard_cap * 2 : 64;
+		struct shard *s = realloc(f->shards, cap * sizeof(*s));
+
+		if (!s)
+			return -1;
+
+		f->shards = s;
+		f->shard_cap = cap;
+	}
+
+	memset(&f->shards[f->shard_count], 0, sizeof(f->shards[0]));
+	*index = f->shard_count++;
+	return 1;
+}
+
+/* Add the results of finished shards to the library, in shard order,
+ * for as long as the next shard is finished. Returns 0 on success or
+ * -1 if memory couldn't be allocated.
+ */
+static int merge(struct farm *f)
+{
+	while (!f->done && f->merged < f->shard_count &&
+	       f->shards[f->merged].state == SHARD_DONE) {
+		const uint64_t first = (uint64_t)f->merged * f->cfg->shard_size;
+		struct shard *s = &f->shards[f->merged++];
+		int i;
+
+		for (i = 0; i < s->count && f->have < f->band->count; i++) {
+			const struct result *r = &s->results[i];
+			int added;
+
+			if (first + r->number >= f->tries)
+				break;
+
+			added = cdok_fpset_add(&f->seen, &r->fp);
+
+			if (added < 0 || (added &&
+			    cdok_lib_builder_add(&f->builder, &r->record) < 0))
+				return -1;
+
+			if (added)
+				f->have++;
+			else
+				f->duplicates++;
+		}
+
+		free(s->results);
+		s->results = NULL;
+
+		if (f->have >= f->band->count || f->merged >= f->shard_max)
+			f->done = 1;
+	}
+
+	return 0;
+}
+
+/* Record a failed shard, to be handed out again, and drop the worker
+ * if it has failed too often. Returns -1 if the worker was dropped.
+ * Called with the lock held.
+ */
+static int shard_failed(struct worker *w, unsigned int index)
+{
+	struct farm *f = w->farm;
+	struct shard *s = &f->shards[index];
+
+	s->state = SHARD_WAITING;
+	s->failed_by = w;
+	f->retries++;
+
+	if (s->attempts >= FARM_SHARD_ATTEMPTS && !f->done) {
+		fprintf(stderr, "farm: shard %u failed %d times, giving up\n",
+			index, s->attempts);
+		f->failed = 1;
+	}
+
+	if (++w->failures < FARM_WORKER_FAILURES)
+		return 0;
+
+	fprintf(stderr, "farm: dropping worker %s\n", w->addr);
+	w->dropped = 1;
+	if (w->fd >= 0)
+		disconnect(w);
+
+	if (!--f->live_workers) {
+		fprintf(stderr, "farm: no workers left\n");
+		f->failed = 1;
+	}
+
+	return -1;
+}
+
+static void *worker_main(void *arg)
+{
+	struct worker *w = arg;
+	struct farm *f = w->farm;
+
+	pthread_mutex_lock(&f->lock);
+
+	while (!f->done && !f->failed) {
+		struct result *results = NULL;
+		unsigned int index;
+		int count = 0;
+		int r = next_shard(f, w, &index);
+
+		if (r < 0) {
+			fprintf(stderr, "farm: out of memory\n");
+			f->failed = 1;
+			break;
+		}
+
+		if (!r) {
+			pthread_cond_wait(&f->cond, &f->lock);
+			continue;
+		}
+
+		f->shards[index].state = SHARD_RUNNING;
+		f->shards[index].attempts++;
+		pthread_mutex_unlock(&f->lock);
+
+		r = run_shard(w, index, &results, &count);
+
+		pthread_mutex_lock(&f->lock);
+		pthread_cond_broadcast(&f->cond);
+
+		if (r < 0) {
+			if (shard_failed(w, index) < 0)
+				break;
+			continue;
+		}
+
+		w->failures = 0;
+		f->shards[index].state = SHARD_DONE;
+		f->shards[index].results = results;
+		f->shards[index].count = count;
+
+		if (merge(f) < 0) {
+			fprintf(stderr, "farm: out of memory\n");
+			f->failed = 1;
+		}
+	}
+
+	pthread_cond_broadcast(&f->cond);
+	pthread_mutex_unlock(&f->lock);
+	return NULL;
+}
+
+/* Fill one band. Returns 0 if the band was filled, 1 if it fell short,
+ * or -1 if the farm failed.
+ */
+static int run_band(struct farm *f, struct worker *workers, int count,
+		    int index)
+{
+	const struct farm_config *cfg = f->cfg;
+	const struct farm_band *b = &cfg->bands[index];
+	unsigned int i;
+	int j;
+
+	f->band = b;
+	f->band_seed = cfg->seed + index * BAND_SEED_STEP;
+	f->shard_count = 0;
+	f->tries = (uint64_t)b->count * FARM_BAND_TRIES;
+	f->shard_max = (f->tries + cfg->shard_size - 1) / cfg->shard_size;
+	f->merged = 0;
+	f->have = 0;
+	f->done = 0;
+	f->duplicates = 0;
+	f->retries = 0;
+
+	for (j = 0; j < count; j++) {
+		struct worker *w = &workers[j];
+
+		w->started = 0;
+		if (w->dropped)
+			continue;
+
+		if (pthread_create(&w->tid, NULL, worker_main, w)) {
+			fprintf(stderr, "farm: can't start worker thread\n");
+			pthread_mutex_lock(&f->lock);
+			f->failed = 1;
+			pthread_cond_broadcast(&f->cond);
+			pthread_mutex_unlock(&f->lock);
+			break;
+		}
+
+		w->started = 1;
+	}
+
+	for (j = 0; j < count; j++)
+		if (workers[j].started)
+			pthread_join(workers[j].tid, NULL);
+
+	for (i = 0; i < f->shard_count; i++)
+		free(f->shards[i].results);
+
+	fprintf(stderr, "Band %d (size %d): %u of %u puzzles, %u shards, "
+		"%lu duplicates, %lu retries\n",
+		index + 1, b->params.size, f->have, b->count, f->merged,
+		f->duplicates, f->retries);
+
+	if (f->failed)
+		return -1;
+
+	return f->have < b->count;
+}
+
+/* Start local workers. Each is a single-threaded server with no pools
+ * or cache, in a child process. This happens before any threads are
+ * started.
+ */
+static int start_local(struct local *l, const struct farm_config *cfg)
+{
+	int i;
+
+	l->count = 0;
+	strcpy(l->dir, "/tmp/cdok-farm-XXXXXX");
+	if (!mkdtemp(l->dir)) {
+		fprintf(stderr, "farm: can't create %s: %s\n",
+			l->dir, strerror(errno));
+		return -1;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < cfg->local_workers; i++) {
+		pid_t pid;
+
+		snprintf(l->paths[i], sizeof(l->paths[i]), "%s/worker-%d",
+			 l->dir, i);
+
+		pid = fork();
+		if (pid < 0) {
+			fprintf(stderr, "farm: fork: %s\n", strerror(errno));
+			return -1;
+		}
+
+		if (!pid) {
+			struct server_config sc;
+
+			memset(&sc, 0, sizeof(sc));
+			sc.path = l->paths[i];
+			sc.threads = 1;
+			sc.seed = cfg->seed + i;
+			sc.defaults = cfg->defaults;
+			_exit(server_run(&sc) < 0 ? 1 : 0);
+		}
+
+		l->pids[l->count++] = pid;
+	}
+
+	return 0;
+}
+
+/* Local workers have nothing worth saving, so they're simply killed. */
+static void stop_local(struct local *l)
+{
+	int i;
+
+	for (i = 0; i < l->count; i++)
+		kill(l->pids[i], SIGKILL);
+
+	for (i = 0; i < l->count; i++) {
+		waitpid(l->pids[i], NULL, 0);
+		unlink(l->paths[i]);
+	}
+
+	rmdir(l->dir);
+}
+
+int farm_run(const struct farm_config *cfg)
+{
+	struct worker workers[FARM_MAX_WORKERS];
+	struct local local;
+	struct farm f;
+	int count = 0;
+	int short_bands = 0;
+	int r = 0;
+	int i;
+
+	if (cfg->worker_count + cfg->local_workers > FARM_MAX_WORKERS) {
+		fprintf(stderr, "farm: too many workers (maximum %d)\n",
+			FARM_MAX_WORKERS);
+		return -1;
+	}
+
+	if (cfg->worker_count + cfg->local_workers < 1) {
+		fprintf(stderr, "farm: no workers\n");
+		return -1;
+	}
+
+	memset(&f, 0, sizeof(f));
+	f.cfg = cfg;
+
+	if (cdok_fpset_init(&f.seen) < 0) {
+		fprintf(stderr, "farm: out of memory\n");
+		return -1;
+	}
+
+	local.count = 0;
+	if (cfg->local_workers && start_local(&local, cfg) < 0) {
+		stop_local(&local);
+		cdok_fpset_destroy(&f.seen);
+		return -1;
+	}
+
+	memset(workers, 0, sizeof(workers));
+	for (i = 0; i < cfg->worker_count; i++)
+		workers[count++].addr = cfg->workers[i];
+	for (i = 0; i < local.count; i++)
+		workers[count++].addr = local.paths[i];
+
+	for (i = 0; i < count; i++) {
+		workers[i].farm = &f;
+		workers[i].fd = -1;
+	}
+
+	f.live_workers = count;
+	pthread_mutex_init(&f.lock, NULL);
+	pthread_cond_init(&f.cond, NULL);
+	cdok_lib_builder_init(&f.builder);
+
+	for (i = 0; i < cfg->band_count; i++) {
+		r = run_band(&f, workers, count, i);
+		if (r < 0)
+			break;
+
+		short_bands += r;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (workers[i].fd >= 0)
+			close(workers[i].fd);
+		free(workers[i].buf);
+	}
+
+	if (cfg->local_workers)
+		stop_local(&local);
+
+	if (r >= 0) {
+		struct cdok_lib_error err;
+		char msg[512];
+
+		r = cdok_lib_builder_write(&f.builder, cfg->out_file, &err);
+		if (r < 0) {
+			fprintf(stderr, "%s\n",
+				cdok_lib_error_text(&err, cfg->out_file,
+						    msg, sizeof(msg)));
+		} else if (short_bands) {
+			fprintf(stderr, "farm: %d band%s not filled\n",
+				short_bands, short_bands > 1 ? "s" : "");
+			r = -1;
+		}
+	}
+
+	free(f.shards);
+	cdok_lib_builder_destroy(&f.builder);
+	cdok_fpset_destroy(&f.seen);
+	pthread_cond_destroy(&f.cond);
+	pthread_mutex_destroy(&f.lock);
+
+	return r;
+}
@@ -0,0 +1,94 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef FARM_H_
+#define FARM_H_
+
+/* Generation farm. A farm job is a list of bands, each asking for a
+ * number of puzzles of one kind: a size, generator parameters and a
+ * minimum difficulty. The coordinator splits each band into shards,
+ * runs of consecutively numbered puzzles, and hands them out one at a
+ * time to workers, which are ordinary cdok servers (see service.h)
+ * listening on local sockets or elsewhere on the network.
+ *
+ * Every puzzle is generated from its own seed, which depends only on
+ * the farm seed, the band and the puzzle's number. Puzzles are taken in
+ * order of number, skipping any which duplicate an earlier puzzle (up
+ * to symmetry), until the band is full, and bands are filled in order.
+ * The library produced is therefore the same whichever workers run the
+ * shards, however many of them there are, and whatever the shard size.
+ *
+ * A shard which fails (the worker can't be reached, disconnects or
+ * sends a bad reply) is handed out again, up to FARM_SHARD_ATTEMPTS
+ * times. A worker which fails FARM_WORKER_FAILURES times in a row is
+ * dropped, and the farm gives up if no workers remain.
+ */
+
+#include <stdint.h>
+#include "service.h"
+
+#define FARM_MAX_WORKERS	64
+#define FARM_SHARD_SIZE		8
+#define FARM_SHARD_ATTEMPTS	3
+#define FARM_WORKER_FAILURES	3
+
+/* A band gives up after trying this many puzzles per puzzle wanted,
+ * so that an unreachable min-diff doesn't run forever.
+ */
+#define FARM_BAND_TRIES		100
+
+struct farm_band {
+	struct service_params	params;
+	unsigned int		count;
+};
+
+/* Parse a band, given as a list of request parameters (see service.h)
+ * separated by commas, such as "size=9,count=200,min-diff=500". The
+ * count is the number of puzzles wanted, and is required. Parameters
+ * not given take the values in defaults. Returns 0 on success or -1 if
+ * the band isn't valid.
+ */
+int farm_parse_band(struct farm_band *b,
+		    const struct service_params *defaults, const char *text);
+
+/* Farm configuration. Workers are given by address (see net.h). In
+ * addition, local_workers worker processes are started on this machine,
+ * each with a single thread, and stopped when the farm finishes.
+ * defaults gives the parameters used by local workers for anything not
+ * given in a request.
+ */
+struct farm_config {
+	const char			*const *workers;
+	int				worker_count;
+	int				local_workers;
+	const struct service_params	*defaults;
+
+	const struct farm_band		*bands;
+	int				band_count;
+	uint64_t			seed;
+	int				shard_size;
+
+	const char			*out_file;
+};
+
+/* Run a farm job, writing the puzzles to a library file (see
+ * library.h) and a summary of each band to stderr. Returns 0 if every
+ * band was filled, or -1 otherwise. A library is still written if
+ * bands fall short, but not if workers fail.
+ */
+int farm_run(const struct farm_config *cfg);
+
+#endif
@@ -21,12 +21,35 @@
 #include "solver.h"
 #include "generator.h"
 
+/************************************************************************
+ * Random number generation
+ *
+ * The generator uses SplitMix64, which is fast, has a single word of
+ * state and passes the usual statistical tests. Any seed is acceptable.
+ */
+
+void cdok_gen_init(struct cdok_gen *gen, uint64_t seed)
+{
+	gen->rng = seed;
+	gen->trace = NULL;
+}
+
+uint32_t cdok_gen_random(struct cdok_gen *gen)
+{
+	uint64_t z = (gen->rng += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return (z ^ (z >> 31)) >> 32;
+}
+
 /************************************************************************
  * Puzzle generator: grid generation
  */
 
 /* Generate a random permutation of the numbers [1..size] */
-static void gen_permutation(int size, uint8_t *values)
+static void gen_permutation(struct cdok_gen *gen, int size, uint8_t *values)
 {
 	int i;
 
@@ -34,7 +57,7 @@ static void gen_permutation(int size, uint8_t *values)
 		values[i] = i + 1;
 
 	for (i = size - 1; i >= 1; i--) {
-		int src = random() % (i + 1);
+		int src = cdok_gen_random(gen) % (i + 1);
 		int tmp = values[i];
 
 		values[i] = values[src];
@@ -48,6 +71,7 @@ static void gen_permutation(int size, uint8_t *values)
  * need to backtrack and try again.
  */
 struct fill_context {
+	struct cdok_gen	*gen;
 	int		size;
 	uint8_t		*grid;
 	cdok_set_t	rows_used[CDOK_SIZE];
@@ -69,7 +93,7 @@ static int fill_grid(struct fill_context *ctx, int x, int y)
 	if (y >= ctx->size)
 		return 0;
 
-	gen_permutation(ctx->size, choices);
+	gen_permutation(ctx->gen, ctx->size, choices);
 
 	used = ctx->rows_used[y] | ctx->cols_used[x];
 	c = CDOK_POS(x, y);
@@ -96,19 +120,21 @@ static int fill_grid(struct fill_context *ctx, int x, int y)
 }
 
 /* Generate a random valid solution grid. */
-void cdok_generate_grid(uint8_t *values, int size)
+void cdok_generate_grid(struct cdok_gen *gen, uint8_t *values, int size)
 {
 	struct fill_context ctx;
 	uint8_t top_row[CDOK_SIZE];
+	const uint64_t start = gen->trace ? cdok_trace_now() : 0;
 	int i;
 
 	memset(values, 0, CDOK_CELLS * sizeof(values[0]));
 
 	memset(&ctx, 0, sizeof(ctx));
+	ctx.gen = gen;
 	ctx.size = size;
 	ctx.grid = values;
 
-	gen_permutation(size, top_row);
+	gen_permutation(gen, size, top_row);
 	for (i = 0; i < size; i++) {
 		values[CDOK_POS(i, 0)] = top_row[i];
 		ctx.cols_used[i] = CDOK_SET_SINGLE(top_row[i]);
@@ -116,6 +142,10 @@ void cdok_generate_grid(uint8_t *values, int size)
 
 	if (fill_grid(&ctx, 0, 1) < 0)
 		abort();
+
+	if (gen->trace)
+		cdok_trace_span(gen->trace, "grid fill", start,
+				"size", size, NULL, 0);
 }
 
 /************************************************************************
@@ -254,24 +284,28 @@ static int group_update_target(struct cdok_puzzle *puz, int grp,
  */
 
 /* Choose a cell at random. */
-static cdok_pos_t choose_cell(int size)
+static cdok_pos_t choose_cell(struct cdok_gen *gen, int size)
 {
-	return CDOK_POS(random() % size, random() % size);
+	int x = cdok_gen_random(gen) % size;
+	int y = cdok_gen_random(gen) % size;
+
+	return CDOK_POS(x, y);
 }
 
 /* Randomly choose one of the given cell's four neighbours. */
-static cdok_pos_t choose_neighbour(int size, cdok_pos_t c)
+static cdok_pos_t choose_neighbour(struct cdok_gen *gen, int size,
+				   cdok_pos_t c)
 {
 	int x = CDOK_POS_X(c);
 	int y = CDOK_POS_Y(c);
 	int xn = x + 1, yn = y + 1;
 
-	if (xn >= size || (x && (random() & 1)))
+	if (xn >= size || (x && (cdok_gen_random(gen) & 1)))
 		xn = x - 1;
-	if (yn >= size || (y && (random() & 1)))
+	if (yn >= size || (y && (cdok_gen_random(gen) & 1)))
 		yn = y - 1;
 
-	if (random() & 1)
+	if (cdok_gen_random(gen) & 1)
 		return CDOK_POS(xn, y);
 
 	return CDOK_POS(x, yn);
@@ -315,7 +349,8 @@ static void cut_islands(struct cdok_puzzle *puz, int grp,
 /* Randomly alter the type of the given group. Guaranteed to set a type
  * which is valid for the group's values.
  */
-static void mut_alter_type(struct cdok_puzzle *puz, int grp,
+static void mut_alter_type(struct cdok_gen *gen,
+			   struct cdok_puzzle *puz, int grp,
 			   const uint8_t *solution, cdok_flags_t f)
 {
 	cdok_gtype_t types[] = {
@@ -327,7 +362,7 @@ static void mut_alter_type(struct cdok_puzzle *puz, int grp,
 	int i;
 
 	for (i = 3; i >= 1; i--) {
-		int j = random() % (i + 1);
+		int j = cdok_gen_random(gen) % (i + 1);
 		int tmp = types[i];
 
 		types[i] = types[j];
@@ -345,7 +380,8 @@ static void mut_alter_type(struct cdok_puzzle *puz, int grp,
  * be destroyed and/or pruned to maintain geometry constraints. The
  * group type may also be altered if necessary.
  */
-static void mut_remove_cell(struct cdok_puzzle *puz, cdok_pos_t c,
+static void mut_remove_cell(struct cdok_gen *gen,
+			    struct cdok_puzzle *puz, cdok_pos_t c,
 			    const uint8_t *solution, cdok_flags_t f)
 {
 	int grp = puz->group_map[c];
@@ -362,7 +398,7 @@ static void mut_remove_cell(struct cdok_puzzle *puz, cdok_pos_t c,
 	cut_islands(puz, grp, solution);
 
 	if (group_update_target(puz, grp, solution, f) < 0)
-		mut_alter_type(puz, grp, solution, f);
+		mut_alter_type(gen, puz, grp, solution, f);
 }
 
 /* Join the given cell (c) so that it belongs to the same group as its
@@ -372,7 +408,7 @@ static void mut_remove_cell(struct cdok_puzzle *puz, cdok_pos_t c,
  * Adjustments are made to both groups if necessary to preserve geometry
  * and type/target constraints.
  */
-static void mut_join_cells(struct cdok_puzzle *puz,
+static void mut_join_cells(struct cdok_gen *gen, struct cdok_puzzle *puz,
 			   cdok_pos_t c, cdok_pos_t n,
 			   const uint8_t *solution,
 			   cdok_flags_t f)
@@ -384,13 +420,13 @@ static void mut_join_cells(struct cdok_puzzle *puz,
 		if (ngrp == cgrp)
 			return;
 
-		mut_remove_cell(puz, c, solution, f);
+		mut_remove_cell(gen, puz, c, solution, f);
 	}
 
 	if (ngrp != CDOK_GROUP_NONE) {
 		group_add(puz, ngrp, c);
 		if (group_update_target(puz, ngrp, solution, f) < 0)
-			mut_alter_type(puz, ngrp, solution, f);
+			mut_alter_type(gen, puz, ngrp, solution, f);
 	} else {
 		int g = group_alloc(puz);
 
@@ -399,7 +435,7 @@ static void mut_join_cells(struct cdok_puzzle *puz,
 
 		group_add(puz, g, c);
 		group_add(puz, g, n);
-		mut_alter_type(puz, g, solution, f);
+		mut_alter_type(gen, puz, g, solution, f);
 	}
 }
 
@@ -436,8 +472,12 @@ static void normalize_labels(struct cdok_puzzle *puz)
  * invariant-preserving changes to the puzzle in sequence. After each
  * change, we check to see if there's a unique solution. If so, and the
  * puzzle has become more difficult, save it.
+ *
+ * When tracing, each mutation and solve is recorded as a span, followed
+ * by a marker saying whether the change was kept.
  */
-static int harden(struct cdok_puzzle *puz, const uint8_t *solution,
+static int harden(struct cdok_gen *gen,
+		  struct cdok_puzzle *puz, const uint8_t *solution,
 		  int best_score_in, cdok_flags_t fl, int limit)
 {
 	int best_score = best_score_in;
@@ -447,18 +487,38 @@ static int harden(struct cdok_puzzle *puz, const uint8_t *solution,
 	memcpy(&work, puz, sizeof(work));
 
 	for (i = 0; i < 10; i++) {
-		cdok_pos_t c = choose_cell(puz->size);
-		cdok_pos_t cn = choose_neighbour(puz->size, c);
+		cdok_pos_t c = choose_cell(gen, puz->size);
+		cdok_pos_t cn = choose_neighbour(gen, puz->size, c);
+		uint64_t start = gen->trace ? cdok_trace_now() : 0;
 		int score = 0;
 		int r;
 
-		mut_join_cells(&work, c, cn, solution, fl);
+		mut_join_cells(gen, &work, c, cn, solution, fl);
+
+		if (gen->trace) {
+			cdok_trace_span(gen->trace, "mutation", start,
+					"cell", c, "neighbour", cn);
+			start = cdok_trace_now();
+		}
+
 		r = cdok_solve(&work, NULL, &score);
 
+		if (gen->trace)
+			cdok_trace_span(gen->trace, "solve", start,
+					"result", r, "score", score);
+
 		if (!r && (score > best_score) &&
 		    (limit <= 0 || score <= limit)) {
 			memcpy(puz, &work, sizeof(*puz));
 			best_score = score;
+
+			if (gen->trace)
+				cdok_trace_instant(gen->trace, "accept",
+						   "score", score, NULL, 0);
+		} else if (gen->trace) {
+			cdok_trace_instant(gen->trace, "reject",
+					   "score", r ? -1 : score,
+					   "best", best_score);
 		}
 	}
 
@@ -468,10 +528,11 @@ static int harden(struct cdok_puzzle *puz, const uint8_t *solution,
 /* Create a puzzle with the given solution and harden it until we reach
  * the maximum iteration count or the difficulty threshold.
  */
-int cdok_generate(struct cdok_puzzle *puz,
+int cdok_generate(struct cdok_gen *gen, struct cdok_puzzle *puz,
 		  const uint8_t *solution, int size,
 		  cdok_flags_t fl, int iterations, int limit, int target)
 {
+	const uint64_t start = gen->trace ? cdok_trace_now() : 0;
 	int best_score = 0;
 	int i;
 
@@ -482,13 +543,25 @@ int cdok_generate(struct cdok_puzzle *puz,
 	memcpy(puz->values, solution, sizeof(puz->values));
 
 	for (i = 0; i < iterations; i++) {
+		const uint64_t iter_start =
+			gen->trace ? cdok_trace_now() : 0;
+
 		if (target > 0 && best_score >= target)
 			break;
 
-		best_score = harden(puz, solution, best_score, fl,
+		best_score = harden(gen, puz, solution, best_score, fl,
 				    limit);
+
+		if (gen->trace)
+			cdok_trace_span(gen->trace, "harden", iter_start,
+					"iteration", i, "best", best_score);
 	}
 
 	normalize_labels(puz);
+
+	if (gen->trace)
+		cdok_trace_span(gen->trace, "generate", start,
+				"iterations", i, "difficulty", best_score);
+
 	return best_score;
 }
@@ -17,8 +17,33 @@
 #ifndef GENERATOR_H_
 #define GENERATOR_H_
 
+#include "cdok.h"
+#include "trace.h"
+
+/* Generator state. This holds the state of the pseudo-random number
+ * generator used for every choice made while generating grids and
+ * puzzles. A given seed always produces the same sequence of puzzles.
+ *
+ * Generator states are independent of one another, so threads which
+ * each have their own may generate puzzles concurrently.
+ *
+ * If a trace is attached, the generator records a timeline of its work
+ * (grid fills, hardening iterations, mutations and solver calls). The
+ * trace is NULL by default, which disables tracing.
+ */
+struct cdok_gen {
+	uint64_t		rng;
+	struct cdok_trace	*trace;
+};
+
+/* Initialize generator state from a seed. Tracing is disabled. */
+void cdok_gen_init(struct cdok_gen *gen, uint64_t seed);
+
+/* Return the next 32-bit pseudo-random number. */
+uint32_t cdok_gen_random(struct cdok_gen *gen);
+
 /* Generate a valid solution grid. */
-void cdok_generate_grid(uint8_t *values, int size);
+void cdok_generate_grid(struct cdok_gen *gen, uint8_t *values, int size);
 
 /* Generator flags. Difference and ratio groups may be of arbitrary
  * size, but some definitions of Calcudoku limit them to two cells
@@ -39,7 +64,7 @@ typedef enum {
  *
  * The difficulty of the new puzzle is returned.
  */
-int cdok_generate(struct cdok_puzzle *puz,
+int cdok_generate(struct cdok_gen *gen, struct cdok_puzzle *puz,
 		  const uint8_t *solution, int size,
 		  cdok_flags_t fl, int iterations, int limit, int target);
 
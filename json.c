@@ -0,0 +1,199 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "printer.h"
+#include "json.h"
+
+void cdok_json_init(struct cdok_json *j, FILE *out)
+{
+	j->out = out;
+	j->depth = 0;
+	j->need_comma = 0;
+}
+
+/* Write raw string contents, with escapes. */
+static void write_escaped(FILE *out, const char *text, int len)
+{
+	static const char hex[] = "0123456789abcdef";
+	int start = 0;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		const unsigned char c = text[i];
+
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+
+		if (i > start)
+			fwrite(text + start, 1, i - start, out);
+		start = i + 1;
+
+		switch (c) {
+		case '"':
+			fputs("\\\"", out);
+			break;
+
+		case '\\':
+			fputs("\\\\", out);
+			break;
+
+		case '\n':
+			fputs("\\n", out);
+			break;
+
+		case '\t':
+			fputs("\\t", out);
+			break;
+
+		case '\r':
+			fputs("\\r", out);
+			break;
+
+		default:
+			fputs("\\u00", out);
+			putc(hex[c >> 4], out);
+			putc(hex[c & 0xf], out);
+			break;
+		}
+	}
+
+	if (i > start)
+		fwrite(text + start, 1, i - start, out);
+}
+
+/* Emit the separator and key (if any) which precede a value. */
+static void begin_value(struct cdok_json *j, const char *key)
+{
+	const uint32_t bit = 1u << j->depth;
+
+	if (j->need_comma & bit)
+		putc(',', j->out);
+	j->need_comma |= bit;
+
+	if (key) {
+		putc('"', j->out);
+		write_escaped(j->out, key, strlen(key));
+		fputs("\":", j->out);
+	}
+}
+
+static void open_nested(struct cdok_json *j, const char *key, char c)
+{
+	begin_value(j, key);
+	putc(c, j->out);
+
+	if (j->depth + 1 < CDOK_JSON_DEPTH)
+		j->depth++;
+	j->need_comma &= ~(1u << j->depth);
+}
+
+static void close_nested(struct cdok_json *j, char c)
+{
+	putc(c, j->out);
+
+	if (j->depth > 0)
+		j->depth--;
+}
+
+void cdok_json_begin_object(struct cdok_json *j, const char *key)
+{
+	open_nested(j, key, '{');
+}
+
+void cdok_json_end_object(struct cdok_json *j)
+{
+	close_nested(j, '}');
+}
+
+void cdok_json_begin_array(struct cdok_json *j, const char *key)
+{
+	open_nested(j, key, '[');
+}
+
+void cdok_json_end_array(struct cdok_json *j)
+{
+	close_nested(j, ']');
+}
+
+void cdok_json_int(struct cdok_json *j, const char *key, long long v)
+{
+	begin_value(j, key);
+	fprintf(j->out, "%lld", v);
+}
+
+void cdok_json_double(struct cdok_json *j, const char *key, double v)
+{
+	begin_value(j, key);
+	fprintf(j->out, "%.6g", v);
+}
+
+void cdok_json_bool(struct cdok_json *j, const char *key, int v)
+{
+	begin_value(j, key);
+	fputs(v ? "true" : "false", j->out);
+}
+
+void cdok_json_null(struct cdok_json *j, const char *key)
+{
+	begin_value(j, key);
+	fputs("null", j->out);
+}
+
+void cdok_json_string(struct cdok_json *j, const char *key,
+		      const char *text, int len)
+{
+	begin_value(j, key);
+	putc('"', j->out);
+	write_escaped(j->out, text, len);
+	putc('"', j->out);
+}
+
+void cdok_json_spec(struct cdok_json *j, const char *key,
+		    const struct cdok_puzzle *puz)
+{
+	char buf[CDOK_SPEC_MAX];
+	int len = cdok_render_spec(puz, puz->values, buf, sizeof(buf));
+
+	cdok_json_string(j, key, buf, len);
+}
+
+void cdok_json_grid(struct cdok_json *j, const char *key,
+		    int size, const uint8_t *values)
+{
+	int y;
+
+	cdok_json_begin_array(j, key);
+
+	for (y = 0; y < size; y++) {
+		int x;
+
+		cdok_json_begin_array(j, NULL);
+		for (x = 0; x < size; x++)
+			cdok_json_int(j, NULL, values[CDOK_POS(x, y)]);
+		cdok_json_end_array(j);
+	}
+
+	cdok_json_end_array(j);
+}
+
+void cdok_json_end_record(struct cdok_json *j)
+{
+	putc('\n', j->out);
+	j->depth = 0;
+	j->need_comma = 0;
+}
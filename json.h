@@ -0,0 +1,74 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef JSON_H_
+#define JSON_H_
+
+/* Streaming JSON writer. Values are written directly to the output
+ * stream as they are given, with no intermediate buffering beyond that
+ * done by stdio. The writer keeps track of nesting and inserts commas
+ * where necessary, but it doesn't otherwise check the structure of the
+ * output.
+ *
+ * Each value-producing function takes a key. The key must be given for
+ * values which are members of an object and must be NULL for values
+ * which are array elements or top-level values.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "cdok.h"
+
+#define CDOK_JSON_DEPTH		32
+
+struct cdok_json {
+	FILE		*out;
+	int		depth;
+	uint32_t	need_comma;
+};
+
+void cdok_json_init(struct cdok_json *j, FILE *out);
+
+void cdok_json_begin_object(struct cdok_json *j, const char *key);
+void cdok_json_end_object(struct cdok_json *j);
+void cdok_json_begin_array(struct cdok_json *j, const char *key);
+void cdok_json_end_array(struct cdok_json *j);
+
+void cdok_json_int(struct cdok_json *j, const char *key, long long v);
+void cdok_json_double(struct cdok_json *j, const char *key, double v);
+void cdok_json_bool(struct cdok_json *j, const char *key, int v);
+void cdok_json_null(struct cdok_json *j, const char *key);
+
+/* Write a string value of the given length, escaping as necessary. */
+void cdok_json_string(struct cdok_json *j, const char *key,
+		      const char *text, int len);
+
+/* Write a puzzle spec as a single string, in the format accepted by
+ * the parser.
+ */
+void cdok_json_spec(struct cdok_json *j, const char *key,
+		    const struct cdok_puzzle *puz);
+
+/* Write a grid of values as an array of rows. */
+void cdok_json_grid(struct cdok_json *j, const char *key,
+		    int size, const uint8_t *values);
+
+/* Finish a top-level value. For NDJSON output, this writes the newline
+ * which separates records.
+ */
+void cdok_json_end_record(struct cdok_json *j);
+
+#endif
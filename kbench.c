@@ -0,0 +1,699 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Microbenchmark for the cage analysis kernels (see cage.h).
+ *
+ * Puzzles are generated from a fixed seed and solved with a copy of the
+ * solver whose kernels capture every call's arguments. The kernels named
+ * here are this file's own copy, the reference, which doesn't. The captured arguments
+ * are then replayed through each implementation of the kernels, giving
+ * the time per call for each kernel and grid size.
+ *
+ * Before timing, every implementation is cross-checked against the
+ * reference on the captured arguments and on an exhaustive sweep of
+ * small arguments, and the reference is checked for soundness against
+ * a brute-force enumeration of small groups. Any difference is reported
+ * and makes the program exit with an error.
+ *
+ * To try an alternative implementation, add it to the impls table.
+ * Kernels which it doesn't provide may be left NULL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "cdok.h"
+#include "solver.h"
+#include "generator.h"
+#include "cage.h"
+
+typedef cdok_set_t (*candidates_fn)(int target, int size,
+				    const uint8_t *members, int nm, int max);
+typedef cdok_set_t (*set_fn)(int target, int n, int max);
+
+typedef enum {
+	K_SUM,
+	K_DIFFERENCE,
+	K_PRODUCT,
+	K_RATIO,
+	K_ADDENDS,
+	K_FACTORS,
+	K_COUNT
+} kernel_t;
+
+static const char *const kernel_names[K_COUNT] = {
+	[K_SUM]		= "sum",
+	[K_DIFFERENCE]	= "difference",
+	[K_PRODUCT]	= "product",
+	[K_RATIO]	= "ratio",
+	[K_ADDENDS]	= "addends",
+	[K_FACTORS]	= "factors"
+};
+
+/************************************************************************
+ * Implementations
+ */
+
+struct kernel_impl {
+	const char	*name;
+	candidates_fn	candidates[K_ADDENDS];
+	set_fn		addends;
+	set_fn		factors;
+};
+
+/* Table-driven addends and factors. Results are looked up where the
+ * arguments are within the tables, and computed otherwise. For two or
+ * more factors, the set doesn't depend on the number of factors.
+ */
+#define TABLE_SUM_MAX		(CDOK_SIZE * CDOK_GROUP_SIZE)
+#define TABLE_PRODUCT_MAX	4096
+
+static cdok_set_t addends_table[CDOK_SIZE + 1][CDOK_GROUP_SIZE + 1]
+	[TABLE_SUM_MAX + 1];
+static cdok_set_t factors_table[CDOK_SIZE + 1][TABLE_PRODUCT_MAX + 1];
+
+static void table_init(void)
+{
+	int max;
+
+	for (max = 1; max <= CDOK_SIZE; max++) {
+		int n;
+		int t;
+
+		for (n = 0; n <= CDOK_GROUP_SIZE; n++)
+			for (t = 0; t <= TABLE_SUM_MAX; t++)
+				addends_table[max][n][t] =
+					cdok_addends_for(t, n, max);
+
+		for (t = 0; t <= TABLE_PRODUCT_MAX; t++)
+			factors_table[max][t] = cdok_factors_for(t, 2, max);
+	}
+}
+
+static cdok_set_t table_addends_for(int target, int n, int max)
+{
+	if (target < 1 || n < 1)
+		return 0;
+
+	if (target > TABLE_SUM_MAX || n > CDOK_GROUP_SIZE ||
+	    max > CDOK_SIZE)
+		return cdok_addends_for(target, n, max);
+
+	return addends_table[max][n][target];
+}
+
+static cdok_set_t table_factors_for(int target, int n, int max)
+{
+	if (target < 1 || n < 1)
+		return 0;
+
+	if (n == 1)
+		return target <= max ? CDOK_SET_SINGLE(target) : 0;
+
+	if (target > TABLE_PRODUCT_MAX || max > CDOK_SIZE)
+		return cdok_factors_for(target, n, max);
+
+	return factors_table[max][target];
+}
+
+static const struct kernel_impl impls[] = {
+	{
+		.name = "reference",
+		.candidates = {
+			[K_SUM]		= cdok_sum_candidates,
+			[K_DIFFERENCE]	= cdok_difference_candidates,
+			[K_PRODUCT]	= cdok_product_candidates,
+			[K_RATIO]	= cdok_ratio_candidates
+		},
+		.addends = cdok_addends_for,
+		.factors = cdok_factors_for
+	},
+	{
+		.name = "table",
+		.addends = table_addends_for,
+		.factors = table_factors_for
+	}
+};
+
+#define IMPL_COUNT	((int)(sizeof(impls) / sizeof(impls[0])))
+
+static set_fn impl_set_fn(const struct kernel_impl *im, kernel_t k)
+{
+	return k == K_ADDENDS ? im->addends : im->factors;
+}
+
+static int impl_has(const struct kernel_impl *im, kernel_t k)
+{
+	if (k < K_ADDENDS)
+		return im->candidates[k] != NULL;
+
+	return impl_set_fn(im, k) != NULL;
+}
+
+/************************************************************************
+ * Argument capture
+ *
+ * Calls are sampled uniformly from all calls made during the solves,
+ * up to a fixed number per kernel (reservoir sampling).
+ */
+
+#define SAMPLE_MAX	(1 << 18)
+
+struct kcall {
+	int32_t		target;
+	uint8_t		size;
+	uint8_t		nm;
+	uint8_t		max;
+	uint8_t		members[CDOK_GROUP_SIZE];
+};
+
+struct sample {
+	struct kcall	calls[SAMPLE_MAX];
+	unsigned int	count;
+	uint64_t	seen;
+};
+
+static struct sample samples[K_COUNT];
+static struct cdok_gen sample_gen;
+static int capturing;
+
+static void sample_add(kernel_t k, const struct kcall *c)
+{
+	struct sample *s = &samples[k];
+	uint64_t r;
+
+	if (s->count < SAMPLE_MAX) {
+		s->calls[s->count++] = *c;
+		s->seen++;
+		return;
+	}
+
+	r = ((uint64_t)cdok_gen_random(&sample_gen) << 32) |
+		cdok_gen_random(&sample_gen);
+	r %= ++s->seen;
+
+	if (r < SAMPLE_MAX)
+		s->calls[r] = *c;
+}
+
+void cage_capture_group(const struct cdok_group *g,
+			const uint8_t *values, int max)
+{
+	struct kcall c;
+	int i;
+
+	if (!capturing)
+		return;
+
+	memset(&c, 0, sizeof(c));
+	c.target = g->target;
+	c.size = g->size;
+	c.max = max;
+
+	for (i = 0; i < g->size; i++) {
+		const uint8_t v = values[g->members[i]];
+
+		if (v)
+			c.members[c.nm++] = v;
+	}
+
+	switch (g->type) {
+	case CDOK_SUM:		sample_add(K_SUM, &c); break;
+	case CDOK_DIFFERENCE:	sample_add(K_DIFFERENCE, &c); break;
+	case CDOK_PRODUCT:	sample_add(K_PRODUCT, &c); break;
+	case CDOK_RATIO:	sample_add(K_RATIO, &c); break;
+	}
+}
+
+static void capture_set(kernel_t k, int target, int n, int max)
+{
+	struct kcall c;
+
+	if (!capturing)
+		return;
+
+	memset(&c, 0, sizeof(c));
+	c.target = target;
+	c.size = n;
+	c.max = max;
+	sample_add(k, &c);
+}
+
+void cage_capture_addends(int target, int n, int max)
+{
+	capture_set(K_ADDENDS, target, n, max);
+}
+
+void cage_capture_factors(int target, int n, int max)
+{
+	capture_set(K_FACTORS, target, n, max);
+}
+
+/* Generate puzzles of the given size and capture the kernel calls made
+ * while solving them. Calls made by the generator itself aren't
+ * captured.
+ */
+static void capture(int size, int count, int iterations, uint64_t seed)
+{
+	struct cdok_gen gen;
+	int i;
+
+	memset(samples, 0, sizeof(samples));
+	cdok_gen_init(&gen, seed + size);
+	cdok_gen_init(&sample_gen, seed);
+
+	for (i = 0; i < count; i++) {
+		struct cdok_puzzle puz;
+		uint8_t solution[CDOK_CELLS];
+
+		cdok_generate_grid(&gen, solution, size);
+		cdok_generate(&gen, &puz, solution, size, CDOK_FLAGS_NONE,
+			      iterations, 0, 0);
+
+		capturing = 1;
+		cdok_solve(&puz, NULL, NULL);
+		capturing = 0;
+	}
+}
+
+/************************************************************************
+ * Checking
+ */
+
+static int report_mismatch(const struct kernel_impl *im, kernel_t k,
+			   const struct kcall *c, cdok_set_t want,
+			   cdok_set_t got)
+{
+	int i;
+
+	printf("MISMATCH: %s %s(target=%d, %s=%d, max=%d",
+	       im->name, kernel_names[k], c->target,
+	       k < K_ADDENDS ? "size" : "n", c->size, c->max);
+
+	if (k < K_ADDENDS) {
+		printf(", members=[");
+		for (i = 0; i < c->nm; i++)
+			printf("%s%d", i ? "," : "", c->members[i]);
+		printf("]");
+	}
+
+	printf("): expected 0x%04x, got 0x%04x\n", want, got);
+	return -1;
+}
+
+static cdok_set_t call_kernel(const struct kernel_impl *im, kernel_t k,
+			      const struct kcall *c)
+{
+	if (k < K_ADDENDS)
+		return im->candidates[k](c->target, c->size, c->members,
+					 c->nm, c->max);
+
+	return impl_set_fn(im, k)(c->target, c->size, c->max);
+}
+
+/* Compare an implementation with the reference on one call. */
+static int check_call(const struct kernel_impl *im, kernel_t k,
+		      const struct kcall *c)
+{
+	const cdok_set_t want = call_kernel(&impls[0], k, c);
+	const cdok_set_t got = call_kernel(im, k, c);
+
+	if (want != got)
+		return report_mismatch(im, k, c, want, got);
+
+	return 0;
+}
+
+/* Check every implementation against the reference on the captured
+ * calls, and on every addends/factors call with small arguments.
+ */
+static int cross_check(void)
+{
+	int failures = 0;
+	int i;
+
+	for (i = 1; i < IMPL_COUNT; i++) {
+		const struct kernel_impl *im = &impls[i];
+		kernel_t k;
+
+		for (k = 0; k < K_COUNT; k++) {
+			const struct sample *s = &samples[k];
+			unsigned int j;
+
+			if (!impl_has(im, k))
+				continue;
+
+			for (j = 0; j < s->count && failures < 10; j++)
+				if (check_call(im, k, &s->calls[j]) < 0)
+					failures++;
+		}
+
+		for (k = K_ADDENDS; k <= K_FACTORS; k++) {
+			const int t_max = k == K_ADDENDS ?
+				TABLE_SUM_MAX + 2 : TABLE_PRODUCT_MAX + 2;
+			struct kcall c;
+
+			if (!impl_has(im, k))
+				continue;
+
+			memset(&c, 0, sizeof(c));
+			for (c.max = 1; c.max <= CDOK_SIZE; c.max++)
+				for (c.size = 0; c.size <= CDOK_GROUP_SIZE + 1;
+				     c.size++)
+					for (c.target = -1; c.target <= t_max &&
+					     failures < 10; c.target++)
+						if (check_call(im, k, &c) < 0)
+							failures++;
+		}
+	}
+
+	return failures ? -1 : 0;
+}
+
+/* Brute-force soundness check. For small groups of each type, every
+ * partial assignment is completed in every possible way, and the values
+ * used by each completion must be among the reference kernel's
+ * candidates for the group's target.
+ */
+#define BRUTE_SIZE	4
+#define BRUTE_MAX	6
+#define BRUTE_TARGETS	1297	/* BRUTE_MAX ^ BRUTE_SIZE + 1 */
+
+/* Find the target a complete group of the given type would have, or -1
+ * if the values can't form such a group.
+ */
+static int group_target(kernel_t k, const uint8_t *v, int n)
+{
+	int sum = 0;
+	int product = 1;
+	int largest = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		sum += v[i];
+		product *= v[i];
+		if (v[i] > largest)
+			largest = v[i];
+	}
+
+	switch (k) {
+	case K_SUM:
+		return sum;
+
+	case K_DIFFERENCE:
+		if (largest * 2 - sum < 0)
+			return -1;
+		return largest * 2 - sum;
+
+	case K_PRODUCT:
+		return product;
+
+	case K_RATIO:
+		if ((largest * largest) % product)
+			return -1;
+		return (largest * largest) / product;
+
+	default:
+		break;
+	}
+
+	return -1;
+}
+
+static int soundness_check(void)
+{
+	static cdok_set_t possible[BRUTE_TARGETS];
+	int failures = 0;
+	kernel_t k;
+
+	for (k = K_SUM; k < K_ADDENDS; k++) {
+		struct kcall c;
+
+		memset(&c, 0, sizeof(c));
+
+		for (c.max = 1; c.max <= BRUTE_MAX; c.max++)
+		for (c.size = 1; c.size <= BRUTE_SIZE; c.size++)
+		for (c.nm = 0; c.nm < c.size; c.nm++) {
+			int members = 1;
+			int m;
+			int i;
+
+			for (i = 0; i < c.nm; i++)
+				members *= c.max;
+
+			/* Each partial assignment */
+			for (m = 0; m < members; m++) {
+				const int free = c.size - c.nm;
+				uint8_t v[BRUTE_SIZE];
+				int completions = 1;
+				int x = m;
+				int t;
+
+				for (i = 0; i < c.nm; i++) {
+					c.members[i] = x % c.max + 1;
+					x /= c.max;
+				}
+
+				memcpy(v, c.members, c.nm);
+				memset(possible, 0, sizeof(possible));
+
+				for (i = 0; i < free; i++)
+					completions *= c.max;
+
+				/* Each completion */
+				for (x = 0; x < completions; x++) {
+					cdok_set_t used = 0;
+					int y = x;
+
+					for (i = c.nm; i < c.size; i++) {
+						v[i] = y % c.max + 1;
+						y /= c.max;
+						used |= CDOK_SET_SINGLE(v[i]);
+					}
+
+					t = group_target(k, v, c.size);
+					if (t >= 0)
+						possible[t] |= used;
+				}
+
+				for (t = 0; t < BRUTE_TARGETS; t++) {
+					cdok_set_t got;
+
+					if (!possible[t])
+						continue;
+
+					c.target = t;
+					got = call_kernel(&impls[0], k, &c);
+
+					if ((got & possible[t]) != possible[t] &&
+					    failures++ < 10)
+						report_mismatch(&impls[0], k,
+								&c, possible[t],
+								got);
+				}
+			}
+		}
+	}
+
+	return failures ? -1 : 0;
+}
+
+/************************************************************************
+ * Timing
+ */
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static volatile cdok_set_t sink;
+
+/* Replay the captured calls through one kernel, enough times to make
+ * about the given number of calls, and return the time per call in
+ * nanoseconds. Calls are made through a function pointer, which costs
+ * the same for every implementation.
+ */
+static double time_kernel(const struct kernel_impl *im, kernel_t k,
+			  long calls)
+{
+	const struct sample *s = &samples[k];
+	const int rounds = calls / s->count + 1;
+	cdok_set_t acc = 0;
+	uint64_t start;
+	unsigned int j;
+	int r;
+
+	start = now_ns();
+
+	if (k < K_ADDENDS) {
+		const candidates_fn f = im->candidates[k];
+
+		for (r = 0; r < rounds; r++)
+			for (j = 0; j < s->count; j++) {
+				const struct kcall *c = &s->calls[j];
+
+				acc ^= f(c->target, c->size, c->members,
+					 c->nm, c->max);
+			}
+	} else {
+		const set_fn f = impl_set_fn(im, k);
+
+		for (r = 0; r < rounds; r++)
+			for (j = 0; j < s->count; j++) {
+				const struct kcall *c = &s->calls[j];
+
+				acc ^= f(c->target, c->size, c->max);
+			}
+	}
+
+	sink = acc;
+	return (double)(now_ns() - start) / ((double)rounds * s->count);
+}
+
+/************************************************************************
+ * Main program
+ */
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s [options] [size ...]\n"
+"\n"
+"Time the cage analysis kernels on arguments captured from solving\n"
+"generated puzzles of each size (default 4 6 8 9), after checking\n"
+"every implementation against the reference.\n"
+"\n"
+"Options are:\n"
+"    -n count     Puzzles generated and solved per size (default 20).\n"
+"    -w num       Hardening iterations per puzzle (default 10).\n"
+"    -c calls     Calls timed per kernel (default 4000000).\n"
+"    -S seed      Seed for puzzle generation (default 1).\n"
+"    -h           Show this text.\n",
+	       progname);
+}
+
+int main(int argc, char **argv)
+{
+	static const int default_sizes[] = {4, 6, 8, 9};
+	int sizes[CDOK_SIZE];
+	int size_count = 0;
+	int count = 20;
+	int iterations = 10;
+	long calls = 4000000;
+	uint64_t seed = 1;
+	int failed = 0;
+	int i;
+	int o;
+
+	while ((o = getopt(argc, argv, "n:w:c:S:h")) >= 0)
+		switch (o) {
+		case 'n':
+			count = atoi(optarg);
+			break;
+
+		case 'w':
+			iterations = atoi(optarg);
+			break;
+
+		case 'c':
+			calls = atol(optarg);
+			break;
+
+		case 'S':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+
+		case 'h':
+			usage(argv[0]);
+			return 0;
+
+		default:
+			return -1;
+		}
+
+	for (i = optind; i < argc; i++) {
+		const int s = atoi(argv[i]);
+
+		if (s < 2 || s > CDOK_SIZE || size_count >= CDOK_SIZE) {
+			fprintf(stderr, "Invalid grid size: %s\n", argv[i]);
+			return -1;
+		}
+
+		sizes[size_count++] = s;
+	}
+
+	if (!size_count)
+		for (i = 0; i < (int)(sizeof(default_sizes) /
+				      sizeof(default_sizes[0])); i++)
+			sizes[size_count++] = default_sizes[i];
+
+	if (count < 1 || calls < 1) {
+		fprintf(stderr, "Invalid count\n");
+		return -1;
+	}
+
+	table_init();
+
+	if (soundness_check() < 0) {
+		printf("Soundness check FAILED\n");
+		failed = 1;
+	}
+
+	printf("%4s  %-10s  %8s", "size", "kernel", "calls");
+	for (i = 0; i < IMPL_COUNT; i++)
+		printf("  %10s", impls[i].name);
+	printf("   (ns/call)\n");
+
+	for (i = 0; i < size_count; i++) {
+		kernel_t k;
+
+		capture(sizes[i], count, iterations, seed);
+
+		if (cross_check() < 0) {
+			printf("Cross-check FAILED for size %d\n", sizes[i]);
+			failed = 1;
+		}
+
+		for (k = 0; k < K_COUNT; k++) {
+			int j;
+
+			if (!samples[k].count)
+				continue;
+
+			printf("%4d  %-10s  %8llu", sizes[i], kernel_names[k],
+			       (unsigned long long)samples[k].seen);
+
+			for (j = 0; j < IMPL_COUNT; j++)
+				if (impl_has(&impls[j], k))
+					printf("  %10.2f",
+					       time_kernel(&impls[j], k,
+							   calls));
+				else
+					printf("  %10s", "-");
+
+			printf("\n");
+			fflush(stdout);
+		}
+	}
+
+	return failed ? 1 : 0;
+}
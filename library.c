@@ -0,0 +1,499 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "library.h"
+
+/* Records start on a cache-line boundary. */
+#define RECORD_ALIGN		64
+
+/* Record an error. Returns -1, for use in return statements. */
+static int set_error(struct cdok_lib_error *err, cdok_lib_error_t code,
+		     int sys_errno)
+{
+	if (err) {
+		err->code = code;
+		err->sys_errno = sys_errno;
+	}
+
+	return -1;
+}
+
+const char *cdok_lib_error_text(const struct cdok_lib_error *e,
+				const char *path, char *buf, int max)
+{
+	const char *sys = strerror(e->sys_errno);
+
+	switch (e->code) {
+	case CDOK_LIB_OK:
+		snprintf(buf, max, "No error");
+		break;
+
+	case CDOK_LIB_TOO_MANY:
+		snprintf(buf, max, "Too many puzzles for a library");
+		break;
+
+	case CDOK_LIB_OPEN_READ:
+		snprintf(buf, max, "Can't open %s for reading: %s", path, sys);
+		break;
+
+	case CDOK_LIB_OPEN_WRITE:
+		snprintf(buf, max, "Can't open %s for writing: %s", path, sys);
+		break;
+
+	case CDOK_LIB_STAT:
+		snprintf(buf, max, "Can't stat %s: %s", path, sys);
+		break;
+
+	case CDOK_LIB_MAP:
+		snprintf(buf, max, "Can't map %s: %s", path, sys);
+		break;
+
+	case CDOK_LIB_WRITE:
+		snprintf(buf, max, "IO error writing %s: %s", path, sys);
+		break;
+
+	case CDOK_LIB_CLOSE:
+		snprintf(buf, max, "Error on closing %s: %s", path, sys);
+		break;
+
+	case CDOK_LIB_NOT_LIBRARY:
+		snprintf(buf, max, "%s: not a puzzle library", path);
+		break;
+
+	case CDOK_LIB_INCOMPATIBLE:
+		snprintf(buf, max, "%s: not a puzzle library, or an "
+			 "incompatible one", path);
+		break;
+	}
+
+	return buf;
+}
+
+static int is_two_cell(const struct cdok_puzzle *puz)
+{
+	int i;
+
+	for (i = 0; i < CDOK_GROUPS; i++) {
+		const struct cdok_group *g = &puz->groups[i];
+
+		if ((g->type == CDOK_DIFFERENCE || g->type == CDOK_RATIO) &&
+		    g->size > 2)
+			return 0;
+	}
+
+	return 1;
+}
+
+void cdok_lib_encode(struct cdok_lib_record *r,
+		     const struct cdok_puzzle *puz,
+		     const uint8_t *solution, int diff)
+{
+	int i;
+
+	memset(r, 0, sizeof(*r));
+	r->diff = diff;
+	r->size = puz->size;
+	r->flags = is_two_cell(puz) ? CDOK_LIB_TWO_CELL : 0;
+
+	for (i = 0; i < CDOK_GROUPS; i++) {
+		r->targets[i] = puz->groups[i].target;
+		r->types[i] = puz->groups[i].type;
+	}
+
+	for (i = 0; i < CDOK_CELLS; i++) {
+		if (puz->group_map[i] != CDOK_GROUP_NONE)
+			r->cells[i] = CDOK_LIB_GROUP | puz->group_map[i];
+		else
+			r->cells[i] = puz->values[i];
+	}
+
+	memcpy(r->solution, solution, sizeof(r->solution));
+}
+
+int cdok_lib_decode(const struct cdok_lib_record *r,
+		    struct cdok_puzzle *puz)
+{
+	int x, y;
+	int i;
+
+	if (r->size < 1 || r->size > CDOK_SIZE)
+		return -1;
+
+	cdok_init_puzzle(puz, r->size);
+
+	for (i = 0; i < CDOK_GROUPS; i++) {
+		puz->groups[i].target = r->targets[i];
+		puz->groups[i].type = r->types[i];
+	}
+
+	/* Members are added in scan order, as the parser does */
+	for (y = 0; y < r->size; y++)
+		for (x = 0; x < r->size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+			const uint8_t v = r->cells[c];
+			const int gi = v & CDOK_LIB_GROUP_MASK;
+
+			if (r->solution[c] < 1 || r->solution[c] > r->size)
+				return -1;
+
+			if (v & CDOK_LIB_GROUP) {
+				struct cdok_group *g;
+
+				if (gi >= CDOK_GROUPS)
+					return -1;
+
+				g = &puz->groups[gi];
+				if (g->size >= CDOK_GROUP_SIZE)
+					return -1;
+
+				g->members[g->size++] = c;
+				puz->group_map[c] = gi;
+			} else if (v > r->size) {
+				return -1;
+			} else {
+				puz->values[c] = v;
+			}
+		}
+
+	return 0;
+}
+
+void cdok_lib_builder_init(struct cdok_lib_builder *b)
+{
+	memset(b, 0, sizeof(*b));
+}
+
+void cdok_lib_builder_destroy(struct cdok_lib_builder *b)
+{
+	free(b->records);
+}
+
+int cdok_lib_builder_add(struct cdok_lib_builder *b,
+			 const struct cdok_lib_record *r)
+{
+	if (b->count >= b->capacity) {
+		size_t cap = b->capacity ? b->capacity * 2 : 256;
+		struct cdok_lib_record *n =
+			realloc(b->records, cap * sizeof(*n));
+
+		if (!n)
+			return -1;
+
+		b->records = n;
+		b->capacity = cap;
+	}
+
+	memcpy(&b->records[b->count++], r, sizeof(*r));
+	return 0;
+}
+
+static int record_bucket(const struct cdok_lib_record *r)
+{
+	return CDOK_LIB_BUCKET(r->size, r->flags & CDOK_LIB_TWO_CELL);
+}
+
+/* Order by bucket, then difficulty. Ties are broken by content so that
+ * the file doesn't depend on the order in which records were added.
+ */
+static int record_cmp(const void *a, const void *b)
+{
+	const struct cdok_lib_record *ra = a;
+	const struct cdok_lib_record *rb = b;
+	const int ba = record_bucket(ra);
+	const int bb = record_bucket(rb);
+
+	if (ba != bb)
+		return ba < bb ? -1 : 1;
+
+	if (ra->diff != rb->diff)
+		return ra->diff < rb->diff ? -1 : 1;
+
+	return memcmp(ra, rb, sizeof(*ra));
+}
+
+static void build_header(struct cdok_lib_header *h,
+			 const struct cdok_lib_builder *b)
+{
+	size_t i;
+
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, CDOK_LIB_MAGIC, sizeof(h->magic));
+	h->version = CDOK_LIB_VERSION;
+	h->byte_order = CDOK_LIB_BYTE_ORDER;
+	h->record_size = sizeof(struct cdok_lib_record);
+	h->record_count = b->count;
+	h->diff_offset = sizeof(*h);
+	h->record_offset = (h->diff_offset + b->count * sizeof(int32_t) +
+			    RECORD_ALIGN - 1) & ~(uint64_t)(RECORD_ALIGN - 1);
+
+	for (i = 0; i < b->count; i++) {
+		const struct cdok_lib_record *r = &b->records[i];
+		struct cdok_lib_bucket *k = &h->buckets[record_bucket(r)];
+
+		if (!k->count) {
+			k->first = i;
+			k->min_diff = r->diff;
+		}
+
+		k->max_diff = r->diff;
+		k->count++;
+	}
+}
+
+int cdok_lib_builder_write(struct cdok_lib_builder *b, const char *path,
+			   struct cdok_lib_error *err)
+{
+	static const char zeros[RECORD_ALIGN];
+	struct cdok_lib_header h;
+	FILE *out;
+	size_t pad;
+	size_t i;
+
+	if (b->count > UINT32_MAX)
+		return set_error(err, CDOK_LIB_TOO_MANY, 0);
+
+	qsort(b->records, b->count, sizeof(b->records[0]), record_cmp);
+	build_header(&h, b);
+
+	out = fopen(path, "wb");
+	if (!out)
+		return set_error(err, CDOK_LIB_OPEN_WRITE, errno);
+
+	fwrite(&h, sizeof(h), 1, out);
+
+	for (i = 0; i < b->count; i++)
+		fwrite(&b->records[i].diff, sizeof(int32_t), 1, out);
+
+	pad = h.record_offset - h.diff_offset - b->count * sizeof(int32_t);
+	fwrite(zeros, 1, pad, out);
+	fwrite(b->records, sizeof(b->records[0]), b->count, out);
+
+	if (ferror(out)) {
+		const int e = errno;
+
+		fclose(out);
+		return set_error(err, CDOK_LIB_WRITE, e);
+	}
+
+	if (fclose(out) < 0)
+		return set_error(err, CDOK_LIB_CLOSE, errno);
+
+	return 0;
+}
+
+/* Check that the header describes a library which fits in a file of
+ * the given length.
+ */
+static int check_header(const struct cdok_lib_header *h, size_t len)
+{
+	int i;
+
+	if (memcmp(h->magic, CDOK_LIB_MAGIC, sizeof(h->magic)))
+		return -1;
+
+	if (h->version != CDOK_LIB_VERSION ||
+	    h->byte_order != CDOK_LIB_BYTE_ORDER ||
+	    h->record_size != sizeof(struct cdok_lib_record))
+		return -1;
+
+	if (h->diff_offset < sizeof(*h) || h->diff_offset % sizeof(int32_t) ||
+	    h->diff_offset + (uint64_t)h->record_count * sizeof(int32_t) >
+	    h->record_offset || h->record_offset % RECORD_ALIGN ||
+	    h->record_offset + (uint64_t)h->record_count * h->record_size >
+	    len)
+		return -1;
+
+	for (i = 0; i < CDOK_LIB_BUCKETS; i++) {
+		const struct cdok_lib_bucket *k = &h->buckets[i];
+
+		if ((uint64_t)k->first + k->count > h->record_count)
+			return -1;
+	}
+
+	return 0;
+}
+
+int cdok_lib_open(struct cdok_lib *lib, const char *path,
+		  struct cdok_lib_error *err)
+{
+	struct stat st;
+	int fd;
+
+	memset(lib, 0, sizeof(*lib));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return set_error(err, CDOK_LIB_OPEN_READ, errno);
+
+	if (fstat(fd, &st) < 0) {
+		const int e = errno;
+
+		close(fd);
+		return set_error(err, CDOK_LIB_STAT, e);
+	}
+
+	if (st.st_size < (off_t)sizeof(struct cdok_lib_header)) {
+		close(fd);
+		return set_error(err, CDOK_LIB_NOT_LIBRARY, 0);
+	}
+
+	lib->map_len = st.st_size;
+	lib->map = mmap(NULL, lib->map_len, PROT_READ, MAP_SHARED, fd, 0);
+	if (lib->map == MAP_FAILED) {
+		const int e = errno;
+
+		close(fd);
+		lib->map = NULL;
+		return set_error(err, CDOK_LIB_MAP, e);
+	}
+
+	close(fd);
+
+	lib->header = lib->map;
+	if (check_header(lib->header, lib->map_len) < 0) {
+		cdok_lib_close(lib);
+		return set_error(err, CDOK_LIB_INCOMPATIBLE, 0);
+	}
+
+	lib->diffs = (const int32_t *)
+		((const char *)lib->map + lib->header->diff_offset);
+	lib->records = (const struct cdok_lib_record *)
+		((const char *)lib->map + lib->header->record_offset);
+
+	/* Picks touch records at random */
+	madvise(lib->map, lib->map_len, MADV_RANDOM);
+
+	return 0;
+}
+
+void cdok_lib_close(struct cdok_lib *lib)
+{
+	if (lib->map)
+		munmap(lib->map, lib->map_len);
+
+	memset(lib, 0, sizeof(*lib));
+}
+
+/* Find the first index in [lo, hi) whose difficulty is greater than
+ * (or, if inclusive, at least) the given value.
+ */
+static uint32_t diff_bound(const int32_t *diffs, uint32_t lo, uint32_t hi,
+			   int value, int inclusive)
+{
+	while (lo < hi) {
+		const uint32_t mid = lo + ((hi - lo) >> 1);
+
+		if (diffs[mid] < value || (!inclusive && diffs[mid] == value))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Find the range of records within a bucket which fall into the given
+ * difficulty band.
+ */
+static void bucket_range(const struct cdok_lib *lib, int b,
+			 int min_diff, int max_diff,
+			 uint32_t *first, uint32_t *count)
+{
+	const struct cdok_lib_bucket *k = &lib->header->buckets[b];
+	uint32_t lo = k->first;
+	uint32_t hi = k->first + k->count;
+
+	if (!k->count || (max_diff > 0 && max_diff < min_diff) ||
+	    k->max_diff < min_diff ||
+	    (max_diff > 0 && k->min_diff > max_diff)) {
+		*first = 0;
+		*count = 0;
+		return;
+	}
+
+	lo = diff_bound(lib->diffs, lo, hi, min_diff, 1);
+	if (max_diff > 0)
+		hi = diff_bound(lib->diffs, lo, hi, max_diff, 0);
+
+	*first = lo;
+	*count = hi - lo;
+}
+
+unsigned int cdok_lib_count(const struct cdok_lib *lib, int size,
+			    cdok_flags_t flags, int min_diff, int max_diff)
+{
+	uint32_t first, count;
+	unsigned int total = 0;
+
+	if (size < 1 || size > CDOK_SIZE)
+		return 0;
+
+	bucket_range(lib, CDOK_LIB_BUCKET(size, 1), min_diff, max_diff,
+		     &first, &count);
+	total += count;
+
+	if (!(flags & CDOK_FLAGS_TWO_CELL)) {
+		bucket_range(lib, CDOK_LIB_BUCKET(size, 0),
+			     min_diff, max_diff, &first, &count);
+		total += count;
+	}
+
+	return total;
+}
+
+const struct cdok_lib_record *cdok_lib_pick(const struct cdok_lib *lib,
+					    int size, cdok_flags_t flags,
+					    int min_diff, int max_diff,
+					    struct cdok_gen *gen)
+{
+	uint32_t first[2], count[2];
+	uint64_t n;
+
+	if (size < 1 || size > CDOK_SIZE)
+		return NULL;
+
+	/* Without the two-cell restriction, puzzles may come from
+	 * either bucket.
+	 */
+	bucket_range(lib, CDOK_LIB_BUCKET(size, 1), min_diff, max_diff,
+		     &first[1], &count[1]);
+
+	if (flags & CDOK_FLAGS_TWO_CELL)
+		count[0] = 0;
+	else
+		bucket_range(lib, CDOK_LIB_BUCKET(size, 0),
+			     min_diff, max_diff, &first[0], &count[0]);
+
+	if (!count[0] && !count[1])
+		return NULL;
+
+	n = (((uint64_t)cdok_gen_random(gen) << 32) |
+	     cdok_gen_random(gen)) % ((uint64_t)count[0] + count[1]);
+
+	if (n < count[0])
+		return &lib->records[first[0] + n];
+
+	return &lib->records[first[1] + n - count[0]];
+}
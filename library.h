@@ -0,0 +1,183 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBRARY_H_
+#define LIBRARY_H_
+
+/* Puzzle libraries. A library is a single file of pre-solved puzzles,
+ * laid out so that it can be mapped into memory and used directly,
+ * without any parsing.
+ *
+ * The file begins with a header, which includes an index of buckets,
+ * one for each combination of puzzle size and two-cell flag. Each
+ * bucket refers to a contiguous run of records, sorted by difficulty.
+ * The difficulties of all records are also kept in a separate, dense
+ * array, so that the range of records within a difficulty band can be
+ * found by binary search without touching the records themselves.
+ *
+ * Libraries are written in host byte order. A marker in the header
+ * allows files from a machine of different byte order to be rejected.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cdok.h"
+#include "generator.h"
+
+#define CDOK_LIB_MAGIC		"CDOKLIB"
+#define CDOK_LIB_VERSION	1
+#define CDOK_LIB_BYTE_ORDER	0x01020304
+
+/* Buckets are indexed by size and two-cell flag. */
+#define CDOK_LIB_BUCKETS	((CDOK_SIZE + 1) * 2)
+#define CDOK_LIB_BUCKET(size, two_cell)	(((size) << 1) | !!(two_cell))
+
+struct cdok_lib_bucket {
+	uint32_t	first;
+	uint32_t	count;
+	int32_t		min_diff;
+	int32_t		max_diff;
+};
+
+struct cdok_lib_header {
+	char			magic[8];
+	uint32_t		version;
+	uint32_t		byte_order;
+	uint32_t		record_size;
+	uint32_t		record_count;
+	uint64_t		diff_offset;
+	uint64_t		record_offset;
+	struct cdok_lib_bucket	buckets[CDOK_LIB_BUCKETS];
+};
+
+/* Record flags. CDOK_LIB_TWO_CELL is set if every difference and
+ * ratio group in the puzzle has exactly two cells.
+ */
+#define CDOK_LIB_TWO_CELL	0x01
+
+/* Each cell is encoded as either a given value, or a group index with
+ * CDOK_LIB_GROUP set. Cells outside the grid are zero. Group types and
+ * targets are stored exactly as in struct cdok_puzzle.
+ */
+#define CDOK_LIB_GROUP		0x40
+#define CDOK_LIB_GROUP_MASK	0x3f
+
+struct cdok_lib_record {
+	int32_t		diff;
+	uint8_t		size;
+	uint8_t		flags;
+	uint8_t		reserved[2];
+	int32_t		targets[CDOK_GROUPS];
+	uint8_t		types[CDOK_GROUPS];
+	uint8_t		cells[CDOK_CELLS];
+	uint8_t		solution[CDOK_CELLS];
+};
+
+/* Convert a puzzle with a unique solution to a record and back.
+ * Records come from files, so decoding checks that the size, cell
+ * values, solution and group membership are in range. Returns 0 on
+ * success or -1 if the record is corrupt.
+ */
+void cdok_lib_encode(struct cdok_lib_record *r,
+		     const struct cdok_puzzle *puz,
+		     const uint8_t *solution, int diff);
+int cdok_lib_decode(const struct cdok_lib_record *r,
+		    struct cdok_puzzle *puz);
+
+/* Library errors. The library module never writes to stderr: functions
+ * which can fail take an error structure (which may be NULL) and record
+ * the reason there, along with errno for system call failures.
+ */
+typedef enum {
+	CDOK_LIB_OK = 0,
+	CDOK_LIB_TOO_MANY,
+	CDOK_LIB_OPEN_READ,		/* sys_errno */
+	CDOK_LIB_OPEN_WRITE,		/* sys_errno */
+	CDOK_LIB_STAT,			/* sys_errno */
+	CDOK_LIB_MAP,			/* sys_errno */
+	CDOK_LIB_WRITE,			/* sys_errno */
+	CDOK_LIB_CLOSE,			/* sys_errno */
+	CDOK_LIB_NOT_LIBRARY,
+	CDOK_LIB_INCOMPATIBLE
+} cdok_lib_error_t;
+
+struct cdok_lib_error {
+	cdok_lib_error_t	code;
+	int			sys_errno;
+};
+
+/* Describe an error in words, naming the given file. The message is
+ * truncated if the buffer is too small. Returns the buffer.
+ */
+const char *cdok_lib_error_text(const struct cdok_lib_error *e,
+				const char *path, char *buf, int max);
+
+/* A library under construction. Records are accumulated in memory and
+ * sorted when the library is written.
+ */
+struct cdok_lib_builder {
+	struct cdok_lib_record	*records;
+	size_t			count;
+	size_t			capacity;
+};
+
+void cdok_lib_builder_init(struct cdok_lib_builder *b);
+void cdok_lib_builder_destroy(struct cdok_lib_builder *b);
+
+/* Add a record. Returns 0 on success or -1 if out of memory. */
+int cdok_lib_builder_add(struct cdok_lib_builder *b,
+			 const struct cdok_lib_record *r);
+
+/* Write the library to the given file. Returns 0 on success or -1 with
+ * the reason in err (if non-NULL).
+ */
+int cdok_lib_builder_write(struct cdok_lib_builder *b, const char *path,
+			   struct cdok_lib_error *err);
+
+/* A library mapped from a file. */
+struct cdok_lib {
+	void				*map;
+	size_t				map_len;
+	const struct cdok_lib_header	*header;
+	const int32_t			*diffs;
+	const struct cdok_lib_record	*records;
+};
+
+/* Map a library file. Returns 0 on success or -1, with the reason in
+ * err (if non-NULL), if the file can't be opened or isn't a valid
+ * library.
+ */
+int cdok_lib_open(struct cdok_lib *lib, const char *path,
+		  struct cdok_lib_error *err);
+void cdok_lib_close(struct cdok_lib *lib);
+
+/* Count the records of the given size with difficulty between min_diff
+ * and max_diff inclusive. A max_diff of 0 means no upper limit. If
+ * CDOK_FLAGS_TWO_CELL is given, only two-cell puzzles are counted.
+ */
+unsigned int cdok_lib_count(const struct cdok_lib *lib, int size,
+			    cdok_flags_t flags, int min_diff, int max_diff);
+
+/* Choose a record at random from those which cdok_lib_count() would
+ * count. Returns a pointer into the mapped file, or NULL if there are
+ * no matching records.
+ */
+const struct cdok_lib_record *cdok_lib_pick(const struct cdok_lib *lib,
+					    int size, cdok_flags_t flags,
+					    int min_diff, int max_diff,
+					    struct cdok_gen *gen);
+
+#endif
@@ -17,8 +17,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #include <time.h>
 #include <sys/types.h>
@@ -31,23 +33,91 @@
 #include "printer.h"
 #include "solver.h"
 #include "generator.h"
+#include "json.h"
+#include "report.h"
+#include "service.h"
+#include "server.h"
+#include "pool.h"
+#include "batch.h"
+#include "library.h"
+#include "canon.h"
+#include "cache.h"
+#include "bench.h"
+#include "verify.h"
+#include "count.h"
+#include "backbone.h"
+#include "rating.h"
+#include "farm.h"
 
 #define OPT_FLAG_UNICODE	0x01
 #define OPT_FLAG_TWO_CELL	0x02
+#define OPT_FLAG_BATCH		0x04
+#define OPT_FLAG_UNORDERED	0x08
+#define OPT_FLAG_STAGE_STATS	0x10
+#define OPT_FLAG_CACHE_STATS	0x20
+#define OPT_FLAG_SOLVE_STATS	0x40
+#define OPT_FLAG_ALL		0x80
+#define OPT_FLAG_COUNT		0x100
+#define OPT_FLAG_BACKBONE	0x200
+#define OPT_FLAG_RATE		0x400
+
+typedef enum {
+	FORMAT_TEXT,
+	FORMAT_NDJSON
+} format_t;
 
 struct command;
 
 struct options {
 	int			flags;
+	format_t		format;
 	int			gen_size;
 	int			gen_iterations;
 	int			gen_limit;
 	int			gen_target;
+	int			min_diff;
+	int			threads;
+	int			parse_threads;
+	int			render_threads;
+	uint64_t		seed;
+	int			have_seed;
 	const char		*in_file;
 	const char		*out_file;
+	const char		*socket_path;
+	int			pool_depth;
+	const char		*pools[POOL_MAX];
+	int			pool_count;
+	const char		*workers[FARM_MAX_WORKERS];
+	int			worker_count;
+	int			shard_size;
+	const char		*cache_file;
+	int			cache_size;
+	const char		*trace_file;
+	int			trace_sample;
+	int			bench_count;
+	const char		*compare_file;
+	uint64_t		solution_limit;
+	struct cdok_strategy	strategy;
 	const struct command	*command;
+	char			**args;
+	int			arg_count;
 };
 
+static void print_parse_error(const struct cdok_parse_error *e)
+{
+	char msg[128];
+
+	fprintf(stderr, "%s\n", cdok_parse_error_text(e, msg, sizeof(msg)));
+}
+
+static void print_lib_error(const struct cdok_lib_error *e, const char *path)
+{
+	char msg[512];
+
+	fprintf(stderr, "%s\n",
+		cdok_lib_error_text(e, path, msg, sizeof(msg)));
+}
+
 static int read_puzzle(const char *fname, struct cdok_puzzle *puz)
 {
 	struct cdok_parser parse;
@@ -67,6 +137,7 @@ static int read_puzzle(const char *fname, struct cdok_puzzle *puz)
 	cdok_parser_init(&parse, puz);
 	while ((len = fread(buf, 1, sizeof(buf), in)) > 0)
 		if (cdok_parser_push(&parse, puz, buf, len) < 0) {
+			print_parse_error(&parse.error);
 			if (fname)
 				fclose(in);
 			return -1;
@@ -83,7 +154,12 @@ static int read_puzzle(const char *fname, struct cdok_puzzle *puz)
 	if (fname)
 		fclose(in);
 
-	return cdok_parser_end(&parse, puz);
+	if (cdok_parser_end(&parse, puz) < 0) {
+		print_parse_error(&parse.error);
+		return -1;
+	}
+
+	return 0;
 }
 
 static FILE *open_output(const char *fname)
@@ -99,166 +175,2264 @@ static FILE *open_output(const char *fname)
 		}
 	}
 
-	return out;
+	return out;
+}
+
+static int close_output(const char *fname, FILE *out)
+{
+	if (fname) {
+		if (fclose(out) < 0) {
+			fprintf(stderr, "Error on closing %s: %s\n",
+				fname, strerror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Set up the result cache, if one was asked for. Returns a pointer to
+ * the given cache structure, or NULL if caching is disabled or the cache
+ * couldn't be created.
+ */
+static struct cache *open_cache(const struct options *opt, struct cache *c)
+{
+	if (!opt->cache_file && !opt->cache_size)
+		return NULL;
+
+	if (cache_init(c, opt->cache_size ? opt->cache_size :
+		       CACHE_DEFAULT_SIZE) < 0) {
+		fprintf(stderr, "Can't create result cache\n");
+		return NULL;
+	}
+
+	if (opt->cache_file && cache_load(c, opt->cache_file) < 0)
+		fprintf(stderr, "warning: starting with an empty cache\n");
+
+	return c;
+}
+
+static int close_cache(const struct options *opt, struct cache *c)
+{
+	int r = 0;
+
+	if (!c)
+		return 0;
+
+	if (opt->flags & OPT_FLAG_CACHE_STATS) {
+		struct cache_stats st;
+
+		cache_get_stats(c, &st);
+		fprintf(stderr, "Cache: %lu lookups, %lu hits (%.1f%%), "
+			"%lu inserts, %lu evictions, %u/%u entries\n",
+			st.lookups, st.hits, st.lookups ?
+			st.hits * 100.0 / st.lookups : 0.0,
+			st.inserts, st.evictions, st.count, st.capacity);
+	}
+
+	if (opt->cache_file)
+		r = cache_save(c, opt->cache_file);
+
+	cache_destroy(c);
+	return r;
+}
+
+/* Start a timeline trace, if one was asked for. Returns a pointer to the
+ * given trace structure, or NULL if tracing is disabled. If the trace
+ * file can't be created, *err is set.
+ */
+static struct cdok_trace *open_trace(const struct options *opt,
+				     struct cdok_trace *t, int *err)
+{
+	FILE *out;
+
+	*err = 0;
+	if (!opt->trace_file)
+		return NULL;
+
+	out = fopen(opt->trace_file, "w");
+	if (!out) {
+		fprintf(stderr, "Can't open %s for writing: %s\n",
+			opt->trace_file, strerror(errno));
+		*err = 1;
+		return NULL;
+	}
+
+	if (cdok_trace_open(t, out) < 0) {
+		fprintf(stderr, "Can't start trace\n");
+		fclose(out);
+		*err = 1;
+		return NULL;
+	}
+
+	return t;
+}
+
+static int close_trace(const struct options *opt, struct cdok_trace *t)
+{
+	FILE *out;
+
+	if (!t)
+		return 0;
+
+	out = t->out;
+	cdok_trace_close(t);
+
+	if (fclose(out) < 0) {
+		fprintf(stderr, "Error writing %s: %s\n",
+			opt->trace_file, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+static void write_puzzle(FILE *out, int flags,
+			 const struct cdok_puzzle *puz, const uint8_t *values)
+{
+	char buf[CDOK_SPEC_MAX + 1 + CDOK_FORMAT_MAX];
+	struct cdok_glyphs g;
+	int len;
+
+	cdok_glyphs_init(&g, (flags & OPT_FLAG_UNICODE) ?
+			 &cdok_template_unicode : &cdok_template_ascii);
+
+	len = cdok_render_spec(puz, values, buf, CDOK_SPEC_MAX);
+	buf[len++] = '\n';
+	len += cdok_render_puzzle(&g, puz, values, buf + len,
+				  sizeof(buf) - len);
+
+	fwrite(buf, 1, len, out);
+}
+
+static void write_summary(FILE *out, int ret, int diff)
+{
+	if (ret)
+		fprintf(out, "Solution is not unique.\n");
+	else
+		fprintf(out, "Solution is unique. Difficulty: %d\n", diff);
+}
+
+static void write_stats(FILE *out, const struct cdok_solve_stats *st)
+{
+	static const char *const group_names[CDOK_STATS_GROUP_TYPES] = {
+		[CDOK_STATS_SUM]	= "Sum",
+		[CDOK_STATS_DIFFERENCE]	= "Difference",
+		[CDOK_STATS_PRODUCT]	= "Product",
+		[CDOK_STATS_RATIO]	= "Ratio"
+	};
+	int i;
+
+	fprintf(out, "Search statistics:\n");
+	fprintf(out, "    Nodes:           %llu\n",
+		(unsigned long long)st->nodes);
+	fprintf(out, "    Backtracks:      %llu\n",
+		(unsigned long long)st->backtracks);
+	fprintf(out, "    Maximum depth:   %u\n", st->max_depth);
+	fprintf(out, "    Branching:      ");
+
+	for (i = 0; i <= CDOK_SIZE; i++)
+		if (st->branches[i])
+			fprintf(out, " %d:%llu", i,
+				(unsigned long long)st->branches[i]);
+
+	fprintf(out, "\n    Group analysis:\n");
+
+	for (i = 0; i < CDOK_STATS_GROUP_TYPES; i++)
+		if (st->group_calls[i])
+			fprintf(out, "        %-12s %10llu calls %10.3f ms\n",
+				group_names[i],
+				(unsigned long long)st->group_calls[i],
+				st->group_ns[i] / 1e6);
+
+	fprintf(out, "    Propagation:     %.3f ms\n", st->propagate_ns / 1e6);
+	fprintf(out, "    Search:          %.3f ms\n", st->search_ns / 1e6);
+}
+
+static int cmd_print(const struct options *opt)
+{
+	struct cdok_puzzle puz;
+	FILE *out;
+
+	if (read_puzzle(opt->in_file, &puz) < 0)
+		return -1;
+
+	out = open_output(opt->out_file);
+	if (!out)
+		return -1;
+
+	if (opt->format == FORMAT_NDJSON) {
+		struct cdok_json j;
+
+		report_begin(&j, out, "print", puz.size);
+		cdok_json_spec(&j, "spec", &puz);
+		cdok_json_end_object(&j);
+		cdok_json_end_record(&j);
+	} else {
+		write_puzzle(out, opt->flags, &puz, puz.values);
+	}
+
+	return close_output(opt->out_file, out);
+}
+
+/* Statistics describe a real search, and difficulty scores depend on
+ * the strategy, so the cache is only used for plain default solves.
+ */
+static int solve_uncached(const struct options *opt)
+{
+	return (opt->flags & OPT_FLAG_SOLVE_STATS) ||
+		!cdok_strategy_is_default(&opt->strategy);
+}
+
+/* Batch solving. The input is a sequence of puzzle specs separated by
+ * blank lines. Each is parsed, solved and rendered independently by the
+ * batch pipeline.
+ */
+struct solve_batch {
+	const struct options	*opt;
+	int			want_solution;
+	int			want_stats;
+	int			want_count;
+	int			want_backbone;
+	int			want_rating;
+	int			uncached;
+	struct cache		*cache;
+	FILE			*in;
+	char			*line;
+	size_t			line_size;
+	unsigned long		failures;
+	char			expect[128];
+};
+
+static int is_blank(const char *text)
+{
+	while (*text) {
+		if (!isspace(*text))
+			return 0;
+		text++;
+	}
+
+	return 1;
+}
+
+/* Append the lines of the next puzzle spec to a job's text, beginning
+ * at offset start, up to a blank line. Blank lines before the spec are
+ * skipped. Lines beginning with '#' are comments, except that the last
+ * "# expect" line seen is kept for the benchmark (see cmd_bench()).
+ * Returns 1 if a spec was read, 0 at the end of input, or -1 on error.
+ */
+static int read_spec(struct solve_batch *sb, struct batch_job *job,
+		     size_t start)
+{
+	ssize_t len;
+
+	while ((len = getline(&sb->line, &sb->line_size, sb->in)) >= 0) {
+		if (sb->line[0] == '#') {
+			if (!strncmp(sb->line, "# expect ", 9))
+				snprintf(sb->expect, sizeof(sb->expect),
+					 "%s", sb->line + 9);
+			continue;
+		}
+
+		if (is_blank(sb->line)) {
+			if (job->text_len > start)
+				return 1;
+
+			continue;
+		}
+
+		if (batch_job_append(job, sb->line, len) < 0) {
+			fprintf(stderr, "Out of memory reading puzzles\n");
+			return -1;
+		}
+	}
+
+	if (ferror(sb->in)) {
+		fprintf(stderr, "IO error reading %s: %s\n",
+			sb->opt->in_file, strerror(errno));
+		return -1;
+	}
+
+	return job->text_len > start ? 1 : 0;
+}
+
+static int solve_batch_read(void *arg, struct batch_job *job)
+{
+	return read_spec(arg, job, 0);
+}
+
+static void solve_batch_parse(void *arg, struct batch_job *job)
+{
+	struct cdok_parse_error err;
+
+	job->valid = cdok_parse_spec(&job->puz, job->text, job->text_len,
+				     &err) >= 0;
+
+	if (!job->valid) {
+		print_parse_error(&err);
+		fprintf(stderr, "Puzzle %lu: invalid puzzle spec\n",
+			job->index + 1);
+	}
+}
+
+static void solve_batch_process(void *arg, struct batch_job *job)
+{
+	struct solve_batch *sb = arg;
+	uint64_t start = report_time_us();
+
+	if (sb->want_count)
+		job->result = cdok_count(&job->puz, &job->count, NULL);
+	else if (sb->want_backbone)
+		job->result = cdok_backbone(&job->puz, &sb->opt->strategy,
+					    job->possible, NULL);
+	else if (sb->want_rating)
+		job->result = cdok_rate(&job->puz, &job->rating);
+	else if (sb->uncached)
+		job->result = cdok_solve_strategy(&job->puz,
+						  &sb->opt->strategy,
+						  job->solution, &job->diff,
+						  sb->want_stats ?
+						  &job->stats : NULL);
+	else
+		job->result = cache_solve(sb->cache, &job->puz,
+					  sb->want_solution ?
+					  job->solution : NULL, &job->diff);
+
+	job->time_us = report_time_us() - start;
+}
+
+static void write_count(FILE *out, int r, uint64_t count)
+{
+	fprintf(out, "Solutions: %s%llu\n", r > 0 ? "at least " : "",
+		(unsigned long long)count);
+}
+
+static void count_batch_render(struct solve_batch *sb,
+			       const struct batch_job *job, FILE *out)
+{
+	if (!job->valid || job->result < 0 || !job->count)
+		__atomic_add_fetch(&sb->failures, 1, __ATOMIC_RELAXED);
+
+	if (sb->opt->format == FORMAT_NDJSON) {
+		if (!job->valid)
+			report_error(out, "examine", job->index,
+				     "invalid puzzle spec");
+		else if (job->result < 0)
+			report_error(out, "examine", job->index,
+				     "out of memory");
+		else
+			report_solutions(out, "examine", job->index,
+					 &job->puz, job->count, !job->result,
+					 job->time_us);
+		return;
+	}
+
+	fprintf(out, "Puzzle %lu:\n", job->index + 1);
+
+	if (!job->valid)
+		fprintf(out, "Invalid puzzle spec.\n");
+	else if (job->result < 0)
+		fprintf(out, "Out of memory.\n");
+	else if (!job->count)
+		fprintf(out, "Puzzle is not solvable.\n");
+	else
+		write_count(out, job->result, job->count);
+
+	fprintf(out, "\n");
+}
+
+/* Write the backbone as a grid, each cell giving the values it can
+ * take, separated by '/'.
+ */
+static void write_backbone(FILE *out, const struct cdok_puzzle *puz,
+			   const cdok_set_t *possible)
+{
+	int empty = 0;
+	int x, y;
+
+	for (y = 0; y < puz->size; y++)
+		for (x = 0; x < puz->size; x++)
+			if (!puz->values[CDOK_POS(x, y)])
+				empty++;
+
+	fprintf(out, "Forced cells: %d of %d empty\n",
+		cdok_backbone_forced(puz, possible), empty);
+
+	for (y = 0; y < puz->size; y++) {
+		for (x = 0; x < puz->size; x++) {
+			cdok_set_t s = possible[CDOK_POS(x, y)];
+
+			if (x)
+				fputc('\t', out);
+
+			for (; s; s &= s - 1)
+				fprintf(out, "%d%s", __builtin_ctz(s) + 1,
+					(s & (s - 1)) ? "/" : "");
+		}
+
+		fputc('\n', out);
+	}
+}
+
+static void backbone_batch_render(struct solve_batch *sb,
+				  const struct batch_job *job, FILE *out)
+{
+	if (!job->valid || job->result < 0)
+		__atomic_add_fetch(&sb->failures, 1, __ATOMIC_RELAXED);
+
+	if (sb->opt->format == FORMAT_NDJSON) {
+		if (job->valid)
+			report_backbone(out, "examine", job->index, &job->puz,
+					job->possible, job->result,
+					job->time_us);
+		else
+			report_error(out, "examine", job->index,
+				     "invalid puzzle spec");
+		return;
+	}
+
+	fprintf(out, "Puzzle %lu:\n", job->index + 1);
+
+	if (!job->valid)
+		fprintf(out, "Invalid puzzle spec.\n");
+	else if (job->result < 0)
+		fprintf(out, "Puzzle is not solvable.\n");
+	else
+		write_backbone(out, &job->puz, job->possible);
+
+	fprintf(out, "\n");
+}
+
+static void write_rating(FILE *out, const struct cdok_rating *rating, int r)
+{
+	int i;
+
+	if (r)
+		fprintf(out, "Needs guessing after %u steps, with %u cells "
+			"left.\n", rating->steps, rating->unsolved);
+	else
+		fprintf(out, "Hardest technique: %s\n"
+			"Steps: %u\n", cdok_technique_name(rating->hardest),
+			rating->steps);
+
+	for (i = CDOK_TECH_SINGLE; i < CDOK_TECH_GUESS; i++)
+		if (rating->uses[i])
+			fprintf(out, "    %-12s %u\n",
+				cdok_technique_name(i), rating->uses[i]);
+}
+
+static void rating_batch_render(struct solve_batch *sb,
+				const struct batch_job *job, FILE *out)
+{
+	if (!job->valid || job->result < 0)
+		__atomic_add_fetch(&sb->failures, 1, __ATOMIC_RELAXED);
+
+	if (sb->opt->format == FORMAT_NDJSON) {
+		if (job->valid)
+			report_rating(out, "examine", job->index, &job->puz,
+				      &job->rating, job->result, job->time_us);
+		else
+			report_error(out, "examine", job->index,
+				     "invalid puzzle spec");
+		return;
+	}
+
+	fprintf(out, "Puzzle %lu:\n", job->index + 1);
+
+	if (!job->valid)
+		fprintf(out, "Invalid puzzle spec.\n");
+	else if (job->result < 0)
+		fprintf(out, "Puzzle is not solvable.\n");
+	else
+		write_rating(out, &job->rating, job->result);
+
+	fprintf(out, "\n");
+}
+
+static void solve_batch_render(void *arg, const struct batch_job *job,
+			       FILE *out)
+{
+	struct solve_batch *sb = arg;
+
+	if (sb->want_count) {
+		count_batch_render(sb, job, out);
+		return;
+	}
+
+	if (sb->want_backbone) {
+		backbone_batch_render(sb, job, out);
+		return;
+	}
+
+	if (sb->want_rating) {
+		rating_batch_render(sb, job, out);
+		return;
+	}
+
+	if (!job->valid || job->result < 0)
+		__atomic_add_fetch(&sb->failures, 1, __ATOMIC_RELAXED);
+
+	if (sb->opt->format == FORMAT_NDJSON) {
+		if (job->valid) {
+			report_solve(out, sb->want_solution ?
+				     "solve" : "examine", job->index,
+				     &job->puz, sb->want_solution ?
+				     job->solution : NULL,
+				     sb->want_stats ? &job->stats : NULL,
+				     job->result, job->diff, job->time_us);
+		} else {
+			report_error(out, sb->want_solution ?
+				     "solve" : "examine", job->index,
+				     "invalid puzzle spec");
+		}
+
+		return;
+	}
+
+	fprintf(out, "Puzzle %lu:\n", job->index + 1);
+
+	if (!job->valid) {
+		fprintf(out, "Invalid puzzle spec.\n");
+	} else if (job->result < 0) {
+		fprintf(out, "Puzzle is not solvable.\n");
+	} else {
+		if (sb->want_solution) {
+			write_puzzle(out, sb->opt->flags,
+				     &job->puz, job->solution);
+			fprintf(out, "\n");
+		}
+
+		write_summary(out, job->result, job->diff);
+	}
+
+	if (job->valid && sb->want_stats)
+		write_stats(out, &job->stats);
+
+	fprintf(out, "\n");
+}
+
+static const struct batch_ops solve_batch_ops = {
+	.read		= solve_batch_read,
+	.parse		= solve_batch_parse,
+	.process	= solve_batch_process,
+	.render		= solve_batch_render
+};
+
+static int do_solve_batch(const struct options *opt, int want_solution)
+{
+	struct solve_batch sb;
+	struct batch_config cfg;
+	struct cache cache;
+	FILE *out;
+	int r;
+
+	memset(&sb, 0, sizeof(sb));
+	sb.opt = opt;
+	sb.want_solution = want_solution;
+	sb.want_stats = opt->flags & OPT_FLAG_SOLVE_STATS;
+	sb.want_count = !want_solution && (opt->flags & OPT_FLAG_COUNT);
+	sb.want_backbone = !want_solution && (opt->flags & OPT_FLAG_BACKBONE);
+	sb.want_rating = !want_solution && (opt->flags & OPT_FLAG_RATE);
+	sb.uncached = sb.want_count || sb.want_backbone || sb.want_rating ||
+		solve_uncached(opt);
+	sb.in = stdin;
+
+	if (opt->in_file) {
+		sb.in = fopen(opt->in_file, "r");
+		if (!sb.in) {
+			fprintf(stderr, "Can't open %s for reading: %s\n",
+				opt->in_file, strerror(errno));
+			return -1;
+		}
+	}
+
+	out = open_output(opt->out_file);
+	if (!out) {
+		if (opt->in_file)
+			fclose(sb.in);
+		return -1;
+	}
+
+	sb.cache = sb.uncached ? NULL : open_cache(opt, &cache);
+
+	cfg.parse_threads = opt->parse_threads;
+	cfg.process_threads = opt->threads;
+	cfg.render_threads = opt->render_threads;
+	cfg.flags = BATCH_ORDERED;
+
+	if (opt->flags & OPT_FLAG_UNORDERED)
+		cfg.flags |= BATCH_UNORDERED;
+	if (opt->flags & OPT_FLAG_STAGE_STATS)
+		cfg.flags |= BATCH_STATS;
+
+	r = batch_run(&solve_batch_ops, &sb, &cfg, out);
+
+	free(sb.line);
+	if (opt->in_file)
+		fclose(sb.in);
+
+	if (close_cache(opt, sb.cache) < 0)
+		r = -1;
+
+	if (close_output(opt->out_file, out) < 0 || r < 0)
+		return -1;
+
+	return sb.failures ? -1 : 0;
+}
+
+/* Count the solutions of a single puzzle (examine --count-solutions).
+ * The count doesn't depend on the strategy, and isn't cached.
+ */
+static int do_count(const struct options *opt)
+{
+	struct cdok_puzzle puz;
+	uint64_t count;
+	uint64_t start, elapsed;
+	FILE *out;
+	int r;
+
+	if (read_puzzle(opt->in_file, &puz) < 0)
+		return -1;
+
+	start = report_time_us();
+	r = cdok_count(&puz, &count, NULL);
+	elapsed = report_time_us() - start;
+
+	if (r < 0) {
+		fprintf(stderr, "Out of memory counting solutions\n");
+		return -1;
+	}
+
+	if (opt->format == FORMAT_NDJSON) {
+		out = open_output(opt->out_file);
+		if (!out)
+			return -1;
+
+		report_solutions(out, "examine", -1, &puz, count, !r, elapsed);
+
+		if (close_output(opt->out_file, out) < 0)
+			return -1;
+
+		return count ? 0 : -1;
+	}
+
+	if (!count) {
+		fprintf(stderr, "Puzzle is not solvable\n");
+		return -1;
+	}
+
+	out = open_output(opt->out_file);
+	if (!out)
+		return -1;
+
+	write_count(out, r, count);
+	return close_output(opt->out_file, out);
+}
+
+/* Find the backbone of a single puzzle (examine --backbone). */
+static int do_backbone(const struct options *opt)
+{
+	struct cdok_puzzle puz;
+	cdok_set_t possible[CDOK_CELLS];
+	uint64_t start, elapsed;
+	FILE *out;
+	int r;
+
+	if (read_puzzle(opt->in_file, &puz) < 0)
+		return -1;
+
+	start = report_time_us();
+	r = cdok_backbone(&puz, &opt->strategy, possible, NULL);
+	elapsed = report_time_us() - start;
+
+	if (opt->format == FORMAT_NDJSON) {
+		out = open_output(opt->out_file);
+		if (!out)
+			return -1;
+
+		report_backbone(out, "examine", -1, &puz, possible, r,
+				elapsed);
+
+		if (close_output(opt->out_file, out) < 0)
+			return -1;
+
+		return r;
+	}
+
+	if (r < 0) {
+		fprintf(stderr, "Puzzle is not solvable\n");
+		return -1;
+	}
+
+	out = open_output(opt->out_file);
+	if (!out)
+		return -1;
+
+	write_backbone(out, &puz, possible);
+	return close_output(opt->out_file, out);
+}
+
+/* Rate a single puzzle by technique (examine --rate). */
+static int do_rate(const struct options *opt)
+{
+	struct cdok_puzzle puz;
+	struct cdok_rating rating;
+	uint64_t start, elapsed;
+	FILE *out;
+	int r;
+
+	if (read_puzzle(opt->in_file, &puz) < 0)
+		return -1;
+
+	start = report_time_us();
+	r = cdok_rate(&puz, &rating);
+	elapsed = report_time_us() - start;
+
+	if (opt->format == FORMAT_NDJSON) {
+		out = open_output(opt->out_file);
+		if (!out)
+			return -1;
+
+		report_rating(out, "examine", -1, &puz, &rating, r, elapsed);
+
+		if (close_output(opt->out_file, out) < 0)
+			return -1;
+
+		return r < 0 ? -1 : 0;
+	}
+
+	if (r < 0) {
+		fprintf(stderr, "Puzzle is not solvable\n");
+		return -1;
+	}
+
+	out = open_output(opt->out_file);
+	if (!out)
+		return -1;
+
+	write_rating(out, &rating, r);
+	return close_output(opt->out_file, out);
+}
+
+static int do_solve(const struct options *opt, int want_solution)
+{
+	struct cdok_puzzle puz;
+	uint8_t solution[CDOK_CELLS];
+	struct cdok_solve_stats stats;
+	const int want_stats = opt->flags & OPT_FLAG_SOLVE_STATS;
+	const int uncached = solve_uncached(opt);
+	struct cache cache;
+	struct cache *c;
+	FILE *out;
+	uint64_t start, elapsed;
+	int diff = 0;
+	int r;
+
+	if (opt->flags & OPT_FLAG_BATCH)
+		return do_solve_batch(opt, want_solution);
+
+	if (read_puzzle(opt->in_file, &puz) < 0)
+		return -1;
+
+	c = uncached ? NULL : open_cache(opt, &cache);
+	start = report_time_us();
+
+	if (uncached)
+		r = cdok_solve_strategy(&puz, &opt->strategy, solution, &diff,
+					want_stats ? &stats : NULL);
+	else
+		r = cache_solve(c, &puz, want_solution ? solution : NULL,
+				&diff);
+
+	elapsed = report_time_us() - start;
+
+	if (close_cache(opt, c) < 0)
+		return -1;
+
+	if (opt->format == FORMAT_NDJSON) {
+		out = open_output(opt->out_file);
+		if (!out)
+			return -1;
+
+		report_solve(out, want_solution ? "solve" : "examine", -1,
+			     &puz, want_solution ? solution : NULL,
+			     want_stats ? &stats : NULL, r, diff, elapsed);
+
+		if (close_output(opt->out_file, out) < 0)
+			return -1;
+
+		return r < 0 ? -1 : 0;
+	}
+
+	if (r < 0) {
+		fprintf(stderr, "Puzzle is not solvable\n");
+		if (want_stats)
+			write_stats(stderr, &stats);
+		return -1;
+	}
+
+	out = open_output(opt->out_file);
+	if (!out)
+		return -1;
+
+	if (want_solution) {
+		write_puzzle(out, opt->flags, &puz, solution);
+		fprintf(out, "\n");
+	}
+
+	write_summary(out, r, diff);
+	if (want_stats)
+		write_stats(out, &stats);
+
+	return close_output(opt->out_file, out);
+}
+
+/* Enumeration of every solution (solve --all). The search is split
+ * into subtrees, which are shared between threads. Solutions are
+ * written in the order a single search would find them: the thread
+ * working on the earliest unfinished subtree writes them as it goes,
+ * and the others hold up to ENUM_HOLD solutions for each subtree,
+ * waiting if they find more before its turn comes. Memory use doesn't
+ * depend on the number of solutions.
+ */
+#define ENUM_HOLD		16
+#define ENUM_SPLIT		8
+
+struct enum_subtree {
+	uint8_t			held[ENUM_HOLD][CDOK_CELLS];
+	int			held_count;
+	int			done;
+};
+
+struct enum_run {
+	const struct options		*opt;
+	const struct cdok_puzzle	*puz;
+	FILE				*out;
+	uint64_t			start;
+	uint8_t				(*positions)[CDOK_CELLS];
+	struct enum_subtree		*subtrees;
+	int				count;
+	int				next;
+	int				head;
+	uint64_t			written;
+	int				stop;
+	pthread_mutex_t			lock;
+	pthread_cond_t			cond;
+};
+
+struct enum_worker {
+	struct enum_run		*run;
+	pthread_t		thread;
+	int			index;
+};
+
+/* Write a solution. Called with the lock held. */
+static void enum_write(struct enum_run *run, const uint8_t *solution)
+{
+	const uint64_t limit = run->opt->solution_limit;
+
+	run->written++;
+
+	if (run->opt->format == FORMAT_NDJSON) {
+		report_solution(run->out, "solve", run->puz->size,
+				run->written, solution,
+				report_time_us() - run->start);
+	} else {
+		fprintf(run->out, "Solution %llu:\n",
+			(unsigned long long)run->written);
+		write_puzzle(run->out, run->opt->flags, run->puz, solution);
+		fprintf(run->out, "\n");
+	}
+
+	if (limit && run->written >= limit) {
+		__atomic_store_n(&run->stop, 1, __ATOMIC_RELAXED);
+		pthread_cond_broadcast(&run->cond);
+	}
+}
+
+/* Move the head past finished subtrees, writing the solutions held
+ * for each new head. Called with the lock held.
+ */
+static void enum_advance(struct enum_run *run)
+{
+	while (run->head < run->count && run->subtrees[run->head].done) {
+		struct enum_subtree *t;
+		int i;
+
+		if (++run->head >= run->count)
+			break;
+
+		t = &run->subtrees[run->head];
+		for (i = 0; i < t->held_count && !run->stop; i++)
+			enum_write(run, t->held[i]);
+
+		t->held_count = 0;
+	}
+
+	pthread_cond_broadcast(&run->cond);
+}
+
+static int enum_found(void *arg, const uint8_t *solution)
+{
+	struct enum_worker *w = arg;
+	struct enum_run *run = w->run;
+	struct enum_subtree *t = &run->subtrees[w->index];
+	int stop;
+
+	pthread_mutex_lock(&run->lock);
+
+	while (!run->stop && w->index != run->head &&
+	       t->held_count >= ENUM_HOLD)
+		pthread_cond_wait(&run->cond, &run->lock);
+
+	if (!run->stop) {
+		if (w->index == run->head)
+			enum_write(run, solution);
+		else
+			memcpy(t->held[t->held_count++], solution,
+			       CDOK_CELLS);
+	}
+
+	stop = run->stop;
+	pthread_mutex_unlock(&run->lock);
+
+	return stop;
+}
+
+/* Stop searching barren subtrees once the limit is reached. */
+static int enum_cancelled(void *arg)
+{
+	const struct enum_worker *w = arg;
+
+	return __atomic_load_n(&w->run->stop, __ATOMIC_RELAXED);
+}
+
+static void *enum_worker(void *arg)
+{
+	struct enum_worker *w = arg;
+	struct enum_run *run = w->run;
+
+	for (;;) {
+		pthread_mutex_lock(&run->lock);
+		if (run->stop || run->next >= run->count) {
+			pthread_mutex_unlock(&run->lock);
+			break;
+		}
+
+		w->index = run->next++;
+		pthread_mutex_unlock(&run->lock);
+
+		cdok_enumerate(run->puz, &run->opt->strategy,
+			       run->positions[w->index], 0,
+			       enum_found, enum_cancelled, w);
+
+		pthread_mutex_lock(&run->lock);
+		run->subtrees[w->index].done = 1;
+		enum_advance(run);
+		pthread_mutex_unlock(&run->lock);
+	}
+
+	return NULL;
+}
+
+/* Enumerate the subtrees using up to n threads. If no threads can be
+ * started, the work is done on this one.
+ */
+static void enum_run_threads(struct enum_run *run, int n)
+{
+	struct enum_worker *workers = calloc(n, sizeof(*workers));
+	int started = 0;
+	int i;
+
+	if (workers) {
+		for (i = 0; i < n; i++) {
+			workers[i].run = run;
+			if (pthread_create(&workers[i].thread, NULL,
+					   enum_worker, &workers[i]))
+				break;
+			started++;
+		}
+	}
+
+	if (!started) {
+		struct enum_worker w;
+
+		w.run = run;
+		enum_worker(&w);
+	}
+
+	for (i = 0; i < started; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	free(workers);
+}
+
+static int do_enumerate(const struct options *opt)
+{
+	struct cdok_puzzle puz;
+	struct enum_run run;
+	int threads = opt->threads;
+	int max;
+	FILE *out;
+	int r = 0;
+
+	if (opt->flags & OPT_FLAG_BATCH) {
+		fprintf(stderr, "--all can't be used in batch mode\n");
+		return -1;
+	}
+
+	if (read_puzzle(opt->in_file, &puz) < 0)
+		return -1;
+
+	if (threads <= 0) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+		threads = n > 0 ? n : 1;
+	}
+
+	memset(&run, 0, sizeof(run));
+	run.opt = opt;
+	run.puz = &puz;
+	run.start = report_time_us();
+
+	max = threads * ENUM_SPLIT * CDOK_SIZE;
+	run.positions = malloc(max * sizeof(*run.positions));
+	if (run.positions)
+		run.count = cdok_split(&puz, &opt->strategy,
+				       threads > 1 ? threads * ENUM_SPLIT : 1,
+				       run.positions, max);
+	if (run.positions && run.count >= 0)
+		run.subtrees = calloc(run.count + 1, sizeof(*run.subtrees));
+
+	if (!run.subtrees) {
+		fprintf(stderr, "Out of memory enumerating solutions\n");
+		free(run.positions);
+		return -1;
+	}
+
+	out = open_output(opt->out_file);
+	if (!out) {
+		free(run.positions);
+		free(run.subtrees);
+		return -1;
+	}
+
+	run.out = out;
+	pthread_mutex_init(&run.lock, NULL);
+	pthread_cond_init(&run.cond, NULL);
+
+	if (run.count)
+		enum_run_threads(&run, threads < run.count ?
+				 threads : run.count);
+
+	pthread_cond_destroy(&run.cond);
+	pthread_mutex_destroy(&run.lock);
+	free(run.positions);
+	free(run.subtrees);
+
+	if (opt->format == FORMAT_NDJSON) {
+		report_solutions(out, "solve", -1, &puz, run.written,
+				 !run.stop, report_time_us() - run.start);
+	} else if (run.written) {
+		fprintf(out, "Found %llu solution%s%s.\n",
+			(unsigned long long)run.written,
+			run.written == 1 ? "" : "s",
+			run.stop ? " (stopped at the limit)" : "");
+	} else {
+		fprintf(stderr, "Puzzle is not solvable\n");
+	}
+
+	if (!run.written)
+		r = -1;
+
+	if (close_output(opt->out_file, out) < 0)
+		r = -1;
+
+	return r;
+}
+
+static int cmd_solve(const struct options *opt)
+{
+	if (opt->flags & OPT_FLAG_ALL)
+		return do_enumerate(opt);
+
+	return do_solve(opt, 1);
+}
+
+static int cmd_examine(const struct options *opt)
+{
+	const int modes = opt->flags &
+		(OPT_FLAG_COUNT | OPT_FLAG_BACKBONE | OPT_FLAG_RATE);
+
+	if (modes & (modes - 1)) {
+		fprintf(stderr, "Only one of --count-solutions, --backbone "
+			"and --rate may be given\n");
+		return -1;
+	}
+
+	if (opt->flags & OPT_FLAG_BATCH)
+		return do_solve(opt, 0);
+
+	if (opt->flags & OPT_FLAG_COUNT)
+		return do_count(opt);
+
+	if (opt->flags & OPT_FLAG_BACKBONE)
+		return do_backbone(opt);
+
+	if (opt->flags & OPT_FLAG_RATE)
+		return do_rate(opt);
+
+	return do_solve(opt, 0);
+}
+
+/* Answer verification. The input is a sequence of pairs, each a puzzle
+ * spec followed by an answer grid (a spec with a value in every cell),
+ * separated by blank lines. Pairs are read as a single job, keeping
+ * the blank line between the two.
+ */
+static int verify_batch_read(void *arg, struct batch_job *job)
+{
+	int r = solve_batch_read(arg, job);
+
+	if (r <= 0)
+		return r;
+
+	if (batch_job_append(job, "\n", 1) < 0) {
+		fprintf(stderr, "Out of memory reading puzzles\n");
+		return -1;
+	}
+
+	return read_spec(arg, job, job->text_len) < 0 ? -1 : 1;
+}
+
+static void verify_batch_parse(void *arg, struct batch_job *job)
+{
+	const char *split = strstr(job->text, "\n\n");
+	struct cdok_parse_error err;
+	struct cdok_puzzle answer;
+
+	job->valid = 0;
+
+	if (cdok_parse_spec(&job->puz, job->text,
+			    split ? split - job->text + 1 : job->text_len,
+			    &err) < 0) {
+		print_parse_error(&err);
+		fprintf(stderr, "Puzzle %lu: invalid puzzle spec\n",
+			job->index + 1);
+		return;
+	}
+
+	if (!split || !split[2]) {
+		fprintf(stderr, "Puzzle %lu: no answer grid\n",
+			job->index + 1);
+		return;
+	}
+
+	if (cdok_parse_spec(&answer, split + 2, strlen(split + 2),
+			    &err) < 0) {
+		print_parse_error(&err);
+		fprintf(stderr, "Puzzle %lu: invalid answer grid\n",
+			job->index + 1);
+		return;
+	}
+
+	if (answer.size != job->puz.size) {
+		fprintf(stderr, "Puzzle %lu: answer grid is %dx%d, but the "
+			"puzzle is %dx%d\n", job->index + 1,
+			answer.size, answer.size,
+			job->puz.size, job->puz.size);
+		return;
+	}
+
+	memcpy(job->solution, answer.values, sizeof(job->solution));
+	job->valid = 1;
+}
+
+static void verify_batch_process(void *arg, struct batch_job *job)
+{
+	uint64_t start = report_time_us();
+
+	job->result = cdok_verify(&job->puz, job->solution, &job->violation);
+	job->time_us = report_time_us() - start;
+}
+
+static const char *const verify_messages[] = {
+	[CDOK_VERIFY_OK]	= "correct",
+	[CDOK_VERIFY_EMPTY]	= "missing value",
+	[CDOK_VERIFY_GIVEN]	= "doesn't match given value",
+	[CDOK_VERIFY_ROW]	= "value repeated in row",
+	[CDOK_VERIFY_COLUMN]	= "value repeated in column",
+	[CDOK_VERIFY_CAGE]	= "group target not met"
+};
+
+static void verify_batch_render(void *arg, const struct batch_job *job,
+				FILE *out)
+{
+	struct solve_batch *sb = arg;
+	const struct cdok_violation *v = &job->violation;
+
+	if (!job->valid || job->result < 0)
+		__atomic_add_fetch(&sb->failures, 1, __ATOMIC_RELAXED);
+
+	if (sb->opt->format == FORMAT_NDJSON) {
+		if (job->valid)
+			report_verify(out, "verify", job->index, &job->puz,
+				      v, job->time_us);
+		else
+			report_error(out, "verify", job->index,
+				     "invalid input");
+		return;
+	}
+
+	fprintf(out, "Puzzle %lu: ", job->index + 1);
+
+	if (!job->valid)
+		fprintf(out, "invalid input\n");
+	else if (v->rule == CDOK_VERIFY_OK)
+		fprintf(out, "correct\n");
+	else if (v->group != CDOK_GROUP_NONE)
+		fprintf(out, "wrong: %s (group %c)\n",
+			verify_messages[v->rule],
+			cdok_group_to_char(v->group));
+	else
+		fprintf(out, "wrong: %s at (%d, %d)\n",
+			verify_messages[v->rule],
+			CDOK_POS_X(v->cell), CDOK_POS_Y(v->cell));
+}
+
+static const struct batch_ops verify_batch_ops = {
+	.read		= verify_batch_read,
+	.parse		= verify_batch_parse,
+	.process	= verify_batch_process,
+	.render		= verify_batch_render
+};
+
+static int cmd_verify(const struct options *opt)
+{
+	struct solve_batch sb;
+	struct batch_config cfg;
+	FILE *out;
+	int r;
+
+	memset(&sb, 0, sizeof(sb));
+	sb.opt = opt;
+	sb.in = stdin;
+
+	if (opt->in_file) {
+		sb.in = fopen(opt->in_file, "r");
+		if (!sb.in) {
+			fprintf(stderr, "Can't open %s for reading: %s\n",
+				opt->in_file, strerror(errno));
+			return -1;
+		}
+	}
+
+	out = open_output(opt->out_file);
+	if (!out) {
+		if (opt->in_file)
+			fclose(sb.in);
+		return -1;
+	}
+
+	cfg.parse_threads = opt->parse_threads;
+	cfg.process_threads = opt->threads;
+	cfg.render_threads = opt->render_threads;
+	cfg.flags = BATCH_ORDERED;
+
+	if (opt->flags & OPT_FLAG_UNORDERED)
+		cfg.flags |= BATCH_UNORDERED;
+	if (opt->flags & OPT_FLAG_STAGE_STATS)
+		cfg.flags |= BATCH_STATS;
+
+	r = batch_run(&verify_batch_ops, &sb, &cfg, out);
+
+	free(sb.line);
+	if (opt->in_file)
+		fclose(sb.in);
+
+	if (close_output(opt->out_file, out) < 0 || r < 0)
+		return -1;
+
+	return sb.failures ? -1 : 0;
+}
+
+static int cmd_gen_grid(const struct options *opt)
+{
+	struct cdok_puzzle puz;
+	struct cdok_gen gen;
+	struct cdok_trace trace;
+	uint64_t start = report_time_us();
+	FILE *out;
+	int err;
+
+	cdok_gen_init(&gen, opt->seed);
+	gen.trace = open_trace(opt, &trace, &err);
+	if (err)
+		return -1;
+
+	cdok_init_puzzle(&puz, opt->gen_size);
+	cdok_generate_grid(&gen, puz.values, opt->gen_size);
+
+	if (close_trace(opt, gen.trace) < 0)
+		return -1;
+
+	out = open_output(opt->out_file);
+	if (!out)
+		return -1;
+
+	if (opt->format == FORMAT_NDJSON) {
+		struct cdok_json j;
+
+		report_begin(&j, out, "gen-grid", puz.size);
+		cdok_json_grid(&j, "solution", puz.size, puz.values);
+		report_end(&j, report_time_us() - start);
+	} else {
+		cdok_print_puzzle(&puz, puz.values, out);
+	}
+
+	return close_output(opt->out_file, out);
+}
+
+static int do_harden(const struct options *opt, const char *command,
+		     const uint8_t *solution, int size, uint64_t start,
+		     struct cdok_trace *trace)
+{
+	struct cdok_puzzle puz;
+	struct cdok_gen gen;
+	FILE *out;
+	int r;
+
+	cdok_gen_init(&gen, opt->seed);
+	gen.trace = trace;
+	r = cdok_generate(&gen, &puz, solution, size,
+			  (opt->flags & OPT_FLAG_TWO_CELL) ?
+			  CDOK_FLAGS_TWO_CELL : CDOK_FLAGS_NONE,
+			  opt->gen_iterations,
+			  opt->gen_limit,
+			  opt->gen_target);
+
+	if (close_trace(opt, trace) < 0)
+		return -1;
+
+	out = open_output(opt->out_file);
+	if (!out)
+		return -1;
+
+	if (opt->format == FORMAT_NDJSON) {
+		report_generate(out, command, &puz, solution, r,
+				report_time_us() - start);
+	} else {
+		write_puzzle(out, opt->flags, &puz, puz.values);
+		fprintf(out, "\nDifficulty: %d\n", r);
+	}
+
+	return close_output(opt->out_file, out);
+}
+
+static int cmd_harden(const struct options *opt)
+{
+	struct cdok_puzzle puz;
+	uint8_t solution[CDOK_CELLS];
+	struct cdok_trace trace;
+	struct cdok_trace *t;
+	uint64_t start;
+	int err;
+	int r;
+
+	if (read_puzzle(opt->in_file, &puz) < 0)
+		return -1;
+
+	start = report_time_us();
+	r = cdok_solve(&puz, solution, NULL);
+	if (r < 0) {
+		fprintf(stderr, "Puzzle is not solvable\n");
+		return -1;
+	}
+
+	if (r)
+		fprintf(stderr, "warning: input grid solution is "
+			"not unique\n");
+
+	t = open_trace(opt, &trace, &err);
+	if (err)
+		return -1;
+
+	return do_harden(opt, "harden", solution, puz.size, start, t);
+}
+
+static int cmd_generate(const struct options *opt)
+{
+	uint8_t solution[CDOK_CELLS];
+	struct cdok_gen gen;
+	struct cdok_trace trace;
+	uint64_t start = report_time_us();
+	int err;
+
+	/* The grid and the puzzle are each generated starting from the
+	 * given seed, so that "gen-grid" followed by "harden" with the
+	 * same seed gives the same result as "generate".
+	 */
+	cdok_gen_init(&gen, opt->seed);
+	gen.trace = open_trace(opt, &trace, &err);
+	if (err)
+		return -1;
+
+	cdok_generate_grid(&gen, solution, opt->gen_size);
+	return do_harden(opt, "generate", solution, opt->gen_size, start,
+			 gen.trace);
+}
+
+static void get_service_params(const struct options *opt,
+			       struct service_params *p)
+{
+	p->size = opt->gen_size;
+	p->iterations = opt->gen_iterations;
+	p->limit = opt->gen_limit;
+	p->target = opt->gen_target;
+	p->flags = (opt->flags & OPT_FLAG_TWO_CELL) ?
+		CDOK_FLAGS_TWO_CELL : CDOK_FLAGS_NONE;
+	p->strategy = opt->strategy;
+	p->seed = opt->seed;
+	p->have_seed = 0;
+	p->count = 1;
+	p->min_diff = opt->min_diff;
+}
+
+static int cmd_serve(const struct options *opt)
+{
+	struct service_params pools[POOL_MAX];
+	struct service_params p;
+	struct server_config cfg;
+	struct cache cache;
+	struct cdok_trace trace;
+	int err;
+	int i;
+	int r;
+
+	if (!opt->socket_path) {
+		fprintf(stderr, "You need to specify a socket path with "
+			"--socket.\n");
+		return -1;
+	}
+
+	get_service_params(opt, &p);
+
+	for (i = 0; i < opt->pool_count; i++) {
+		pools[i] = p;
+		if (service_parse_params(&pools[i], opt->pools[i]) < 0 ||
+		    pools[i].have_seed) {
+			fprintf(stderr, "Invalid pool parameters: %s\n",
+				opt->pools[i]);
+			return -1;
+		}
+	}
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.path = opt->socket_path;
+	cfg.threads = opt->threads;
+	cfg.seed = opt->seed;
+	cfg.defaults = &p;
+	cfg.pool_depth = opt->pool_depth;
+	cfg.pool_params = pools;
+	cfg.pool_count = opt->pool_count;
+	cfg.trace = open_trace(opt, &trace, &err);
+	cfg.trace_sample = opt->trace_sample;
+	if (err)
+		return -1;
+
+	cfg.cache = open_cache(opt, &cache);
+
+	r = server_run(&cfg);
+
+	if (close_cache(opt, cfg.cache) < 0)
+		r = -1;
+	if (close_trace(opt, cfg.trace) < 0)
+		r = -1;
+
+	return r;
+}
+
+/* Co-process mode: read one request per line and write one reply per
+ * line, flushing after each.
+ */
+static int cmd_repl(const struct options *opt)
+{
+	struct service_params p;
+	struct service_worker w;
+	struct cache cache;
+	struct cdok_trace trace;
+	FILE *in = stdin;
+	FILE *out;
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t len;
+	int err;
+	int r = 0;
+
+	if (opt->in_file) {
+		in = fopen(opt->in_file, "r");
+		if (!in) {
+			fprintf(stderr, "Can't open %s for reading: %s\n",
+				opt->in_file, strerror(errno));
+			return -1;
+		}
+	}
+
+	out = open_output(opt->out_file);
+	if (!out) {
+		if (opt->in_file)
+			fclose(in);
+		return -1;
+	}
+
+	get_service_params(opt, &p);
+	cdok_gen_init(&w.gen, opt->seed);
+	w.pools = NULL;
+	w.trace = open_trace(opt, &trace, &err);
+	w.trace_sample = opt->trace_sample;
+	w.trace_count = 0;
+	if (err) {
+		if (opt->in_file)
+			fclose(in);
+		close_output(opt->out_file, out);
+		return -1;
+	}
+
+	w.cache = open_cache(opt, &cache);
+
+	while ((len = getline(&line, &line_size, in)) >= 0) {
+		if (is_blank(line))
+			continue;
+
+		service_handle_line(&p, &w, line, len, out);
+		fflush(out);
+	}
+
+	free(line);
+	if (opt->in_file)
+		fclose(in);
+
+	if (close_output(opt->out_file, out) < 0)
+		r = -1;
+
+	if (close_trace(opt, w.trace) < 0)
+		r = -1;
+	if (close_cache(opt, w.cache) < 0)
+		r = -1;
+
+	return r;
+}
+
+/* Library building. Puzzles are read and solved by the batch pipeline,
+ * and those with unique solutions are collected for the library. The
+ * batch output carries only messages about rejected puzzles.
+ */
+struct library_build {
+	struct solve_batch		sb;
+	pthread_mutex_t			lock;
+	struct cdok_lib_builder		builder;
+	int				error;
+};
+
+static void library_build_render(void *arg, const struct batch_job *job,
+				 FILE *out)
+{
+	struct library_build *lb = arg;
+	struct cdok_lib_record r;
+
+	/* Invalid specs have already been reported by the parser */
+	if (!job->valid)
+		return;
+
+	if (job->result) {
+		fprintf(out, "Puzzle %lu: %s, skipped\n", job->index + 1,
+			job->result < 0 ? "not solvable" : "not unique");
+		return;
+	}
+
+	cdok_lib_encode(&r, &job->puz, job->solution, job->diff);
+
+	pthread_mutex_lock(&lb->lock);
+	if (cdok_lib_builder_add(&lb->builder, &r) < 0)
+		lb->error = 1;
+	pthread_mutex_unlock(&lb->lock);
+}
+
+static const struct batch_ops library_build_ops = {
+	.read		= solve_batch_read,
+	.parse		= solve_batch_parse,
+	.process	= solve_batch_process,
+	.render		= library_build_render
+};
+
+static int library_build(const struct options *opt)
+{
+	struct library_build lb;
+	struct batch_config cfg;
+	struct cdok_lib_error err;
+	int r;
+
+	if (!opt->out_file) {
+		fprintf(stderr, "You need to specify a library file "
+			"with -o.\n");
+		return -1;
+	}
+
+	memset(&lb, 0, sizeof(lb));
+	lb.sb.opt = opt;
+	lb.sb.want_solution = 1;
+	lb.sb.in = stdin;
+	pthread_mutex_init(&lb.lock, NULL);
+	cdok_lib_builder_init(&lb.builder);
+
+	if (opt->in_file) {
+		lb.sb.in = fopen(opt->in_file, "r");
+		if (!lb.sb.in) {
+			fprintf(stderr, "Can't open %s for reading: %s\n",
+				opt->in_file, strerror(errno));
+			return -1;
+		}
+	}
+
+	cfg.parse_threads = opt->parse_threads;
+	cfg.process_threads = opt->threads;
+	cfg.render_threads = opt->render_threads;
+	cfg.flags = BATCH_UNORDERED;
+
+	if (opt->flags & OPT_FLAG_STAGE_STATS)
+		cfg.flags |= BATCH_STATS;
+
+	r = batch_run(&library_build_ops, &lb, &cfg, stderr);
+
+	free(lb.sb.line);
+	if (opt->in_file)
+		fclose(lb.sb.in);
+
+	if (lb.error) {
+		fprintf(stderr, "Out of memory building library\n");
+		r = -1;
+	}
+
+	if (!r && cdok_lib_builder_write(&lb.builder, opt->out_file,
+					 &err) < 0) {
+		print_lib_error(&err, opt->out_file);
+		r = -1;
+	}
+
+	cdok_lib_builder_destroy(&lb.builder);
+	pthread_mutex_destroy(&lb.lock);
+
+	return r;
+}
+
+static int library_pick(const struct options *opt)
+{
+	const struct cdok_lib_record *r;
+	struct cdok_puzzle puz;
+	struct cdok_lib lib;
+	struct cdok_lib_error err;
+	struct cdok_gen gen;
+	uint64_t start = report_time_us();
+	FILE *out;
+
+	if (!opt->in_file) {
+		fprintf(stderr, "You need to specify a library file "
+			"with -i.\n");
+		return -1;
+	}
+
+	if (cdok_lib_open(&lib, opt->in_file, &err) < 0) {
+		print_lib_error(&err, opt->in_file);
+		return -1;
+	}
+
+	cdok_gen_init(&gen, opt->seed);
+	r = cdok_lib_pick(&lib, opt->gen_size,
+			  (opt->flags & OPT_FLAG_TWO_CELL) ?
+			  CDOK_FLAGS_TWO_CELL : CDOK_FLAGS_NONE,
+			  opt->min_diff, opt->gen_limit, &gen);
+	if (!r) {
+		fprintf(stderr, "No matching puzzles in library\n");
+		cdok_lib_close(&lib);
+		return -1;
+	}
+
+	if (cdok_lib_decode(r, &puz) < 0) {
+		fprintf(stderr, "%s: corrupt library record\n", opt->in_file);
+		cdok_lib_close(&lib);
+		return -1;
+	}
+
+	out = open_output(opt->out_file);
+	if (!out) {
+		cdok_lib_close(&lib);
+		return -1;
+	}
+
+	if (opt->format == FORMAT_NDJSON) {
+		report_generate(out, "pick", &puz, r->solution, r->diff,
+				report_time_us() - start);
+	} else {
+		write_puzzle(out, opt->flags, &puz, puz.values);
+		fprintf(out, "\nDifficulty: %d\n", r->diff);
+	}
+
+	cdok_lib_close(&lib);
+	return close_output(opt->out_file, out);
+}
+
+static int cmd_library(const struct options *opt)
+{
+	if (opt->arg_count >= 1 && !strcmp(opt->args[0], "build"))
+		return library_build(opt);
+
+	if (opt->arg_count >= 1 && !strcmp(opt->args[0], "pick"))
+		return library_pick(opt);
+
+	fprintf(stderr, "Usage: library build|pick. Try --help.\n");
+	return -1;
+}
+
+/* Copy puzzles from input to output, dropping any which are the same
+ * as an earlier puzzle up to rotation, reflection and renaming of
+ * groups. Puzzles are copied verbatim.
+ */
+static int cmd_dedupe(const struct options *opt)
+{
+	struct solve_batch sb;
+	struct batch_job job;
+	struct cdok_fpset set;
+	unsigned long kept = 0;
+	unsigned long dups = 0;
+	unsigned long invalid = 0;
+	FILE *out;
+	int r;
+
+	memset(&sb, 0, sizeof(sb));
+	memset(&job, 0, sizeof(job));
+	sb.opt = opt;
+	sb.in = stdin;
+
+	if (cdok_fpset_init(&set) < 0) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+
+	if (opt->in_file) {
+		sb.in = fopen(opt->in_file, "r");
+		if (!sb.in) {
+			fprintf(stderr, "Can't open %s for reading: %s\n",
+				opt->in_file, strerror(errno));
+			cdok_fpset_destroy(&set);
+			return -1;
+		}
+	}
+
+	out = open_output(opt->out_file);
+	if (!out) {
+		r = -1;
+		goto fail;
+	}
+
+	while ((r = solve_batch_read(&sb, &job)) > 0) {
+		struct cdok_fingerprint fp;
+
+		solve_batch_parse(&sb, &job);
+
+		if (!job.valid) {
+			invalid++;
+		} else {
+			cdok_fingerprint(&job.puz, &fp);
+			r = cdok_fpset_add(&set, &fp);
+			if (r < 0) {
+				fprintf(stderr, "Out of memory\n");
+				break;
+			}
+
+			if (r) {
+				if (kept++)
+					fputc('\n', out);
+				fwrite(job.text, 1, job.text_len, out);
+			} else {
+				dups++;
+			}
+		}
+
+		job.index++;
+		job.text_len = 0;
+	}
+
+	if (close_output(opt->out_file, out) < 0)
+		r = -1;
+
+	fprintf(stderr, "%lu puzzles kept, %lu duplicates removed\n",
+		kept, dups);
+
+fail:
+	free(job.text);
+	free(sb.line);
+	cdok_fpset_destroy(&set);
+	if (opt->in_file)
+		fclose(sb.in);
+
+	if (r < 0)
+		return -1;
+
+	return invalid ? -1 : 0;
 }
 
-static int close_output(const char *fname, FILE *out)
+/* Expected solver results for a corpus puzzle, as given by a comment
+ * line preceding it, such as:
+ *
+ *    # expect unique difficulty=831 nodes=57
+ *
+ * The first word is "unique", "multiple" or "unsolvable", and the
+ * difficulty and node count are optional.
+ */
+struct expect {
+	int		have;
+	int		result;
+	int		diff;
+	long		nodes;
+};
+
+static int parse_expect(const char *text, struct expect *e)
 {
-	if (fname) {
-		if (fclose(out) < 0) {
-			fprintf(stderr, "Error on closing %s: %s\n",
-				fname, strerror(errno));
+	char buf[128];
+	char *word;
+	char *save;
+
+	e->have = 0;
+	e->diff = -1;
+	e->nodes = -1;
+
+	snprintf(buf, sizeof(buf), "%s", text);
+	word = strtok_r(buf, " \t\r\n", &save);
+	if (!word)
+		return -1;
+
+	if (!strcmp(word, "unique"))
+		e->result = 0;
+	else if (!strcmp(word, "multiple"))
+		e->result = 1;
+	else if (!strcmp(word, "unsolvable"))
+		e->result = -1;
+	else
+		return -1;
+
+	while ((word = strtok_r(NULL, " \t\r\n", &save))) {
+		if (!strncmp(word, "difficulty=", 11))
+			e->diff = atoi(word + 11);
+		else if (!strncmp(word, "nodes=", 6))
+			e->nodes = atol(word + 6);
+		else
 			return -1;
-		}
 	}
 
+	e->have = 1;
 	return 0;
 }
 
-static void write_puzzle(FILE *out, int flags,
-			 const struct cdok_puzzle *puz, const uint8_t *values)
+static const char *result_name(int r)
 {
-	cdok_print_puzzle(puz, values, out);
-	fprintf(out, "\n");
+	if (r < 0)
+		return "unsolvable";
 
-	cdok_format_puzzle((flags & OPT_FLAG_UNICODE) ?
-			   &cdok_template_unicode : &cdok_template_ascii,
-			   puz, values, out);
+	return r ? "multiple" : "unique";
 }
 
-static void write_summary(FILE *out, int ret, int diff)
+/* Solve a corpus puzzle and check it against its expected results.
+ * Returns 0 if everything matches, or -1 if not. Expected difficulty
+ * and node counts are for the default strategy, so they're only checked
+ * when using it.
+ */
+static int check_expect(int index, const struct cdok_puzzle *puz,
+			const struct cdok_strategy *strategy,
+			const struct expect *e)
 {
-	if (ret)
-		fprintf(out, "Solution is not unique.\n");
-	else
-		fprintf(out, "Solution is unique. Difficulty: %d\n", diff);
-}
+	struct cdok_solve_stats st;
+	int diff = 0;
+	int r;
 
-static int cmd_print(const struct options *opt)
-{
-	struct cdok_puzzle puz;
-	FILE *out;
+	r = cdok_solve_strategy(puz, strategy, NULL, &diff, &st);
 
-	if (read_puzzle(opt->in_file, &puz) < 0)
+	if (r != e->result) {
+		fprintf(stderr, "Puzzle %d: expected %s, but it's %s\n",
+			index + 1, result_name(e->result), result_name(r));
 		return -1;
+	}
 
-	out = open_output(opt->out_file);
-	if (!out)
+	if (!cdok_strategy_is_default(strategy))
+		return 0;
+
+	if (r >= 0 && e->diff >= 0 && diff != e->diff) {
+		fprintf(stderr, "Puzzle %d: expected difficulty %d, got %d\n",
+			index + 1, e->diff, diff);
 		return -1;
+	}
 
-	write_puzzle(out, opt->flags, &puz, puz.values);
-	return close_output(opt->out_file, out);
+	if (e->nodes >= 0 && st.nodes != (uint64_t)e->nodes) {
+		fprintf(stderr, "Puzzle %d: expected %ld nodes, got %llu\n",
+			index + 1, e->nodes, (unsigned long long)st.nodes);
+		return -1;
+	}
+
+	return 0;
 }
 
-static int do_solve(const struct options *opt, int want_solution)
+/* A puzzle from a benchmark corpus. */
+struct corpus_entry {
+	struct cdok_puzzle	puz;
+	struct expect		expect;
+};
+
+/* Read every valid puzzle from the input file into a growing array,
+ * with its expected results, if given. Returns the number of puzzles
+ * read, or -1 on error.
+ */
+static int read_corpus(const struct options *opt, struct corpus_entry **out)
 {
-	struct cdok_puzzle puz;
-	uint8_t solution[CDOK_CELLS];
-	FILE *out;
-	int diff = 0;
+	struct solve_batch sb;
+	struct batch_job job;
+	struct corpus_entry *ent = NULL;
+	int count = 0;
+	int cap = 0;
 	int r;
 
-	if (read_puzzle(opt->in_file, &puz) < 0)
-		return -1;
+	memset(&sb, 0, sizeof(sb));
+	memset(&job, 0, sizeof(job));
+	sb.opt = opt;
 
-	r = cdok_solve(&puz, solution, &diff);
-	if (r < 0) {
-		fprintf(stderr, "Puzzle is not solvable\n");
+	sb.in = fopen(opt->in_file, "r");
+	if (!sb.in) {
+		fprintf(stderr, "Can't open %s for reading: %s\n",
+			opt->in_file, strerror(errno));
 		return -1;
 	}
 
-	out = open_output(opt->out_file);
-	if (!out)
-		return -1;
+	while ((r = solve_batch_read(&sb, &job)) > 0) {
+		solve_batch_parse(&sb, &job);
 
-	if (want_solution) {
-		write_puzzle(out, opt->flags, &puz, solution);
-		fprintf(out, "\n");
+		if (job.valid) {
+			struct corpus_entry *e;
+
+			if (count >= cap) {
+				struct corpus_entry *n;
+
+				cap = cap ? cap * 2 : 64;
+				n = realloc(ent, sizeof(ent[0]) * cap);
+				if (!n) {
+					fprintf(stderr, "Out of memory\n");
+					r = -1;
+					break;
+				}
+
+				ent = n;
+			}
+
+			e = &ent[count++];
+			e->puz = job.puz;
+			e->expect.have = 0;
+
+			if (sb.expect[0] &&
+			    parse_expect(sb.expect, &e->expect) < 0)
+				fprintf(stderr, "Puzzle %lu: invalid "
+					"expectation: %s", job.index + 1,
+					sb.expect);
+		}
+
+		sb.expect[0] = 0;
+		job.index++;
+		job.text_len = 0;
 	}
 
-	write_summary(out, r, diff);
+	free(job.text);
+	free(sb.line);
+	fclose(sb.in);
 
-	return close_output(opt->out_file, out);
-}
+	if (r < 0) {
+		free(ent);
+		return -1;
+	}
 
-static int cmd_solve(const struct options *opt)
-{
-	return do_solve(opt, 1);
+	*out = ent;
+	return count;
 }
 
-static int cmd_examine(const struct options *opt)
+/* Load baseline results for comparison. Returns the number of results
+ * loaded, or -1 on error.
+ */
+static int load_baseline(const char *fname, struct bench_result *r, int max)
 {
-	return do_solve(opt, 0);
+	FILE *in = fopen(fname, "r");
+	int count;
+
+	if (!in) {
+		fprintf(stderr, "Can't open %s for reading: %s\n",
+			fname, strerror(errno));
+		return -1;
+	}
+
+	count = bench_load(in, r, max);
+	fclose(in);
+
+	if (count < 0) {
+		fprintf(stderr, "IO error reading %s\n", fname);
+		return -1;
+	}
+
+	if (!count) {
+		fprintf(stderr, "No benchmark results in %s\n", fname);
+		return -1;
+	}
+
+	return count;
 }
 
-static int cmd_gen_grid(const struct options *opt)
+static int cmd_bench(const struct options *opt)
 {
-	struct cdok_puzzle puz;
+	static const int default_sizes[] = {4, 6, 8, 9};
+	static struct bench_result base[CDOK_SIZE * BENCH_OPS];
+	static struct bench_result all[CDOK_SIZE * BENCH_OPS];
+	struct bench_config cfg;
+	struct corpus_entry *corpus = NULL;
+	struct cdok_puzzle *subset = NULL;
+	int sizes[CDOK_SIZE];
+	int size_count = 0;
+	int corpus_count = 0;
+	int base_count = 0;
+	int all_count = 0;
 	FILE *out;
+	int i;
+	int r = 0;
+
+	/* Results are only comparable if the work is the same, so the
+	 * seed is fixed unless one is given.
+	 */
+	cfg.seed = opt->have_seed ? opt->seed : 1;
+	cfg.count = opt->bench_count ? opt->bench_count : 20;
+	cfg.iterations = opt->gen_iterations;
+	cfg.flags = (opt->flags & OPT_FLAG_TWO_CELL) ?
+		CDOK_FLAGS_TWO_CELL : CDOK_FLAGS_NONE;
+	cfg.strategy = &opt->strategy;
+
+	for (i = 0; i < opt->arg_count; i++) {
+		const int s = atoi(opt->args[i]);
+
+		if (s < 2 || s > CDOK_SIZE || size_count >= CDOK_SIZE) {
+			fprintf(stderr, "Invalid grid size: %s\n",
+				opt->args[i]);
+			return -1;
+		}
 
-	cdok_init_puzzle(&puz, opt->gen_size);
-	cdok_generate_grid(puz.values, opt->gen_size);
+		sizes[size_count++] = s;
+	}
+
+	if (opt->compare_file) {
+		base_count = load_baseline(opt->compare_file, base,
+					   CDOK_SIZE * BENCH_OPS);
+		if (base_count < 0)
+			return -1;
+	}
+
+	if (opt->in_file) {
+		int failed = 0;
+		int checked = 0;
+
+		corpus_count = read_corpus(opt, &corpus);
+		if (corpus_count < 0)
+			return -1;
+
+		if (!corpus_count) {
+			fprintf(stderr, "No puzzles in %s\n", opt->in_file);
+			return -1;
+		}
+
+		subset = malloc(sizeof(subset[0]) * corpus_count);
+		if (!subset) {
+			fprintf(stderr, "Out of memory\n");
+			free(corpus);
+			return -1;
+		}
+
+		for (i = 0; i < corpus_count; i++)
+			if (corpus[i].expect.have) {
+				checked++;
+				if (check_expect(i, &corpus[i].puz,
+						 &opt->strategy,
+						 &corpus[i].expect) < 0)
+					failed++;
+			}
+
+		if (checked)
+			fprintf(stderr, "%d of %d expectations met\n",
+				checked - failed, checked);
+		if (failed)
+			r = -1;
+
+		/* Without a list of sizes, use every size in the corpus */
+		if (!size_count)
+			for (i = 2; i <= CDOK_SIZE; i++) {
+				int j;
+
+				for (j = 0; j < corpus_count; j++)
+					if (corpus[j].puz.size == i)
+						break;
+
+				if (j < corpus_count)
+					sizes[size_count++] = i;
+			}
+	} else if (!size_count) {
+		for (i = 0; i < (int)(sizeof(default_sizes) /
+				      sizeof(default_sizes[0])); i++)
+			sizes[size_count++] = default_sizes[i];
+	}
 
 	out = open_output(opt->out_file);
-	if (!out)
+	if (!out) {
+		free(corpus);
+		free(subset);
 		return -1;
+	}
 
-	cdok_print_puzzle(&puz, puz.values, out);
-	return close_output(opt->out_file, out);
-}
+	for (i = 0; i < size_count; i++) {
+		struct bench_result *results = &all[all_count];
+		int n = 0;
+		int j;
+
+		if (corpus) {
+			for (j = 0; j < corpus_count; j++)
+				if (corpus[j].puz.size == sizes[i])
+					subset[n++] = corpus[j].puz;
+
+			if (!n) {
+				fprintf(stderr, "No puzzles of size %d in "
+					"%s\n", sizes[i], opt->in_file);
+				r = -1;
+				continue;
+			}
+		}
 
-static int do_harden(const struct options *opt,
-		     const uint8_t *solution, int size)
+		if (bench_run(&cfg, sizes[i], corpus ? subset : NULL, n,
+			      results) < 0) {
+			fprintf(stderr, "Out of memory\n");
+			r = -1;
+			break;
+		}
 
-{
-	struct cdok_puzzle puz;
-	FILE *out;
-	int r;
+		all_count += BENCH_OPS;
 
-	r = cdok_generate(&puz, solution, size,
-			  (opt->flags & OPT_FLAG_TWO_CELL) ?
-			  CDOK_FLAGS_TWO_CELL : CDOK_FLAGS_NONE,
-			  opt->gen_iterations,
-			  opt->gen_limit,
-			  opt->gen_target);
+		if (opt->format == FORMAT_NDJSON) {
+			for (j = 0; j < BENCH_OPS; j++) {
+				struct cdok_json js;
 
-	out = open_output(opt->out_file);
-	if (!out)
+				report_begin(&js, out, "bench", sizes[i]);
+				cdok_json_int(&js, "seed", cfg.seed);
+				cdok_json_int(&js, "iterations",
+					      cfg.iterations);
+				bench_report(&js, "bench", &results[j]);
+				report_end(&js, results[j].total_ns / 1000);
+			}
+		} else {
+			bench_print(out, results, BENCH_OPS, !i);
+		}
+
+		fflush(out);
+	}
+
+	/* The comparison goes with the results if they're text, and to
+	 * stderr otherwise, so that NDJSON results can serve as the next
+	 * baseline.
+	 */
+	if (opt->compare_file) {
+		FILE *report = opt->format == FORMAT_NDJSON ? stderr : out;
+		int regressions;
+
+		if (opt->format != FORMAT_NDJSON)
+			fputc('\n', report);
+
+		regressions = bench_compare(report, base, base_count,
+					    all, all_count);
+		fflush(report);
+
+		if (regressions) {
+			fprintf(stderr, "%d regression%s found\n",
+				regressions, regressions > 1 ? "s" : "");
+			r = -1;
+		}
+	}
+
+	free(corpus);
+	free(subset);
+
+	if (close_output(opt->out_file, out) < 0)
 		return -1;
 
-	write_puzzle(out, opt->flags, &puz, puz.values);
-	fprintf(out, "\nDifficulty: %d\n", r);
-	return close_output(opt->out_file, out);
+	return r;
 }
 
-static int cmd_harden(const struct options *opt)
+/* Generate puzzles for a library on a farm of workers. Each argument
+ * is a band (see farm.h), and generator options give the defaults for
+ * every band.
+ */
+static int cmd_farm(const struct options *opt)
 {
-	struct cdok_puzzle puz;
-	uint8_t solution[CDOK_CELLS];
+	struct service_params p;
+	struct farm_config cfg;
+	struct farm_band *bands;
+	int local = opt->threads;
 	int r;
+	int i;
 
-	if (read_puzzle(opt->in_file, &puz) < 0)
+	if (!opt->out_file) {
+		fprintf(stderr, "You need to specify a library file "
+			"with -o.\n");
 		return -1;
+	}
 
-	r = cdok_solve(&puz, solution, NULL);
-	if (r < 0) {
-		fprintf(stderr, "Puzzle is not solvable\n");
+	if (!opt->arg_count) {
+		fprintf(stderr, "You need to specify at least one band, such "
+			"as size=9,count=100. Try --help.\n");
 		return -1;
 	}
 
-	if (r)
-		fprintf(stderr, "warning: input grid solution is "
-			"not unique\n");
+	/* Without remote workers, run one local worker per CPU */
+	if (local <= 0 && !opt->worker_count) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
 
-	return do_harden(opt, solution, puz.size);
-}
+		local = n > 0 ? n : 1;
+	}
 
-static int cmd_generate(const struct options *opt)
-{
-	uint8_t solution[CDOK_CELLS];
+	bands = malloc(opt->arg_count * sizeof(bands[0]));
+	if (!bands) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+
+	get_service_params(opt, &p);
 
-	cdok_generate_grid(solution, opt->gen_size);
-	return do_harden(opt, solution, opt->gen_size);
+	for (i = 0; i < opt->arg_count; i++)
+		if (farm_parse_band(&bands[i], &p, opt->args[i]) < 0) {
+			fprintf(stderr, "Invalid band: %s\n", opt->args[i]);
+			free(bands);
+			return -1;
+		}
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.workers = opt->workers;
+	cfg.worker_count = opt->worker_count;
+	cfg.local_workers = local > 0 ? local : 0;
+	cfg.defaults = &p;
+	cfg.bands = bands;
+	cfg.band_count = opt->arg_count;
+	cfg.seed = opt->seed;
+	cfg.shard_size = opt->shard_size;
+	cfg.out_file = opt->out_file;
+
+	r = farm_run(&cfg);
+	free(bands);
+
+	return r;
 }
 
 struct command {
@@ -273,6 +2447,13 @@ static const struct command command_table[] = {
 	{"gen-grid",		cmd_gen_grid},
 	{"harden",		cmd_harden},
 	{"generate",		cmd_generate},
+	{"serve",		cmd_serve},
+	{"repl",		cmd_repl},
+	{"library",		cmd_library},
+	{"dedupe",		cmd_dedupe},
+	{"verify",		cmd_verify},
+	{"bench",		cmd_bench},
+	{"farm",		cmd_farm},
 	{NULL, NULL}
 };
 
@@ -297,6 +2478,10 @@ static const struct command *find_command(const char *name)
 
 static void usage(const char *progname)
 {
+	const struct cdok_component *c;
+	struct cdok_strategy def;
+
+	cdok_strategy_init(&def);
 	printf("Usage: %s [options] <command>\n"
 "\n"
 "Options are:\n"
@@ -308,6 +2493,76 @@ static void usage(const char *progname)
 "    -w num       Maximum generator iterations (default 20).\n"
 "    -m diff      Maximum puzzle difficulty (default 0, no limit).\n"
 "    -t diff      Threshold difficulty for early stop (default 0, none).\n"
+"    --min-diff diff\n"
+"                 Minimum difficulty for library pick and farm\n"
+"                 (default 0).\n"
+"    --format fmt Output format: text (default) or ndjson.\n"
+"    --seed num   Seed the generator (default is a random seed).\n"
+"    --socket addr\n"
+"                 Address for the serve command: a Unix-domain socket\n"
+"                 path, or host:port for TCP (unauthenticated, so only\n"
+"                 for trusted networks).\n"
+"    --worker addr\n"
+"                 Send farm shards to the server at the given address.\n"
+"                 May be given more than once.\n"
+"    --shard-size n\n"
+"                 Puzzles per farm shard (default 8).\n"
+"    --pool-depth n\n"
+"                 Puzzles kept ready per pool by serve (default 4, 0 to\n"
+"                 disable pools). Pools are only kept with two or more\n"
+"                 workers (-j).\n"
+"    --pool params\n"
+"                 Fill a pool from startup, for generate requests with the\n"
+"                 given parameters (e.g. size=8,target=2000). May be\n"
+"                 given more than once. Otherwise, only requests with the\n"
+"                 default parameters are pooled.\n"
+"    -b           Batch mode: solve/examine every puzzle in the input.\n"
+"                 Puzzles are separated by blank lines, and lines\n"
+"                 beginning with '#' are ignored.\n"
+"    -j threads   Batch solver threads (default 0, one per CPU).\n"
+"    --parsers n  Batch parser threads (default 1).\n"
+"    --writers n  Batch rendering threads (default 1).\n"
+"    --unordered  Write batch results in order of completion.\n"
+"    --stage-stats\n"
+"                 Report batch pipeline utilization on stderr.\n"
+"    --cache file Cache solve/examine results in the given file.\n"
+"    --cache-size n\n"
+"                 Cache up to n results (default 16384). Enables an\n"
+"                 in-memory cache if --cache isn't given.\n"
+"    --cache-stats\n"
+"                 Report cache hits and evictions on stderr.\n"
+"    --stats      Report search statistics for solve/examine.\n"
+"    --strategy s Solver strategy for solve, examine, serve and bench: a\n"
+"                 list of components, listed below, joined by '+'. Steps\n"
+"                 not named use the default (rc+cage+mrv+asc).\n"
+"    --all        Make solve find every solution of the puzzle (or up to\n"
+"                 --limit), writing each as it's found. The search is\n"
+"                 shared between -j threads, and solutions are written in\n"
+"                 the same order whatever the thread count.\n"
+"    --limit n    Stop after n solutions with --all (default 0, no limit).\n"
+"    --count-solutions\n"
+"                 Make examine count every solution of the puzzle exactly,\n"
+"                 rather than stopping at two. Independent parts of the\n"
+"                 grid are counted separately and cached.\n"
+"    --backbone   Make examine find the values each cell takes in some\n"
+"                 solution, showing which cells are forced and which\n"
+"                 are still free.\n"
+"    --rate       Make examine rate the puzzle by the hardest solving\n"
+"                 technique it needs (single, hidden, cage, pair,\n"
+"                 combination, line-sum), without backtracking, or\n"
+"                 report that it needs guessing.\n"
+"    --trace file Write a timeline of puzzle generation to the given file,\n"
+"                 in Chrome trace-event format (for chrome://tracing or\n"
+"                 Perfetto).\n"
+"    --count n    Calls timed per operation by bench (default 20).\n"
+"    --compare file\n"
+"                 Compare bench results with a baseline saved from an\n"
+"                 earlier run with --format ndjson. Fails if any\n"
+"                 operation's output or node count has changed, and\n"
+"                 warns of any which are significantly slower.\n"
+"    --trace-sample n\n"
+"                 When serving, trace one in every n generate requests\n"
+"                 per worker (default 1, every request).\n"
 "    --help       Show this text.\n"
 "    --version    Show version information.\n"
 "\n"
@@ -317,8 +2572,46 @@ static void usage(const char *progname)
 "    examine      Parse a grid spec and estimate difficulty.\n"
 "    gen-grid     Produce a valid solution grid.\n"
 "    harden       Read a solution grid or puzzle and produce a new puzzle.\n"
-"    generate     Produce a puzzle.\n",
+"    generate     Produce a puzzle.\n"
+"    serve        Answer solve/examine/generate requests on the socket\n"
+"                 given by --socket. -j sets the worker count, and\n"
+"                 generator options set defaults for requests. Idle\n"
+"                 workers keep pools of generated puzzles ready.\n"
+"    repl         Answer requests, one per line, on the input and\n"
+"                 output (stdin and stdout by default).\n"
+"    verify       Check answers: the input is a sequence of puzzle specs,\n"
+"                 each followed by an answer grid, separated by blank\n"
+"                 lines. Reports whether each answer is correct, or the\n"
+"                 first rule it breaks.\n"
+"    dedupe       Copy puzzles from input to output, dropping any which\n"
+"                 are rotations or reflections of earlier puzzles.\n"
+"    library build\n"
+"                 Solve every puzzle in the input and pack those with\n"
+"                 unique solutions into a library file given by -o.\n"
+"    library pick Choose a random puzzle from the library file given by\n"
+"                 -i, of size -s and difficulty between --min-diff and\n"
+"                 -m. With -T, only two-cell puzzles are chosen.\n"
+"    bench [size ...]\n"
+"                 Time grid generation, puzzle generation, solving and\n"
+"                 printing for each size (default 4 6 8 9), reporting\n"
+"                 throughput and latency percentiles. Puzzles are\n"
+"                 generated from --seed (default 1) with -w iterations,\n"
+"                 or read from -i, in which case each puzzle's\n"
+"                 \"# expect\" line is checked.\n"
+"    farm band ...\n"
+"                 Generate puzzles for a library file given by -o, on\n"
+"                 -j local worker processes (default one per CPU if no\n"
+"                 --worker is given) and any --worker servers. Each band\n"
+"                 asks for a number of puzzles, with request parameters\n"
+"                 such as size=9,count=200,min-diff=500; generator\n"
+"                 options give the defaults. Duplicates are dropped, and\n"
+"                 the library depends only on --seed and the bands.\n",
 	       progname);
+
+	printf("\nSolver strategy components:\n");
+	for (c = cdok_components; c->name; c++)
+		printf("    %-12s %s%s.\n", c->name, c->description,
+		       c == def.steps[c->step] ? " (default)" : "");
 }
 
 static void version(void)
@@ -345,6 +2638,32 @@ static int parse_options(int argc, char **argv, struct options *opt)
 	static const struct option longopts[] = {
 		{"help",	0, 0, 'H'},
 		{"version",	0, 0, 'V'},
+		{"format",	1, 0, 'F'},
+		{"unordered",	0, 0, 'U'},
+		{"parsers",	1, 0, 'P'},
+		{"writers",	1, 0, 'W'},
+		{"stage-stats",	0, 0, 'S'},
+		{"seed",	1, 0, 'R'},
+		{"socket",	1, 0, 'L'},
+		{"pool-depth",	1, 0, 'D'},
+		{"pool",	1, 0, 'O'},
+		{"min-diff",	1, 0, 'M'},
+		{"cache",	1, 0, 'C'},
+		{"cache-size",	1, 0, 'Z'},
+		{"cache-stats",	0, 0, 'A'},
+		{"stats",	0, 0, 'X'},
+		{"trace",	1, 0, 'G'},
+		{"trace-sample", 1, 0, 'Q'},
+		{"count",	1, 0, 'N'},
+		{"compare",	1, 0, 'K'},
+		{"strategy",	1, 0, 'Y'},
+		{"all",		0, 0, 'E'},
+		{"limit",	1, 0, 'I'},
+		{"count-solutions", 0, 0, 'B'},
+		{"backbone",	0, 0, 'J'},
+		{"rate",	0, 0, 'g'},
+		{"worker",	1, 0, 'k'},
+		{"shard-size",	1, 0, 'z'},
 		{NULL, 0, 0, 0}
 	};
 	int o;
@@ -352,8 +2671,11 @@ static int parse_options(int argc, char **argv, struct options *opt)
 	memset(opt, 0, sizeof(*opt));
 	opt->gen_iterations = 20;
 	opt->gen_size = 6;
+	opt->pool_depth = 4;
+	opt->shard_size = FARM_SHARD_SIZE;
+	cdok_strategy_init(&opt->strategy);
 
-	while ((o = getopt_long(argc, argv, "i:o:uTs:w:m:t:",
+	while ((o = getopt_long(argc, argv, "i:o:uTs:w:m:t:bj:",
 				longopts, NULL)) >= 0)
 		switch (o) {
 		case 'T':
@@ -381,10 +2703,157 @@ static int parse_options(int argc, char **argv, struct options *opt)
 			opt->gen_target = atoi(optarg);
 			break;
 
+		case 'M':
+			opt->min_diff = atoi(optarg);
+			break;
+
+		case 'C':
+			opt->cache_file = optarg;
+			break;
+
+		case 'Z':
+			opt->cache_size = atoi(optarg);
+			if (opt->cache_size < 0) {
+				fprintf(stderr, "Invalid cache size: %d\n",
+					opt->cache_size);
+				return -1;
+			}
+			break;
+
+		case 'A':
+			opt->flags |= OPT_FLAG_CACHE_STATS;
+			break;
+
+		case 'X':
+			opt->flags |= OPT_FLAG_SOLVE_STATS;
+			break;
+
+		case 'G':
+			opt->trace_file = optarg;
+			break;
+
+		case 'K':
+			opt->compare_file = optarg;
+			break;
+
+		case 'Y':
+			if (cdok_strategy_parse(&opt->strategy, optarg) < 0) {
+				fprintf(stderr, "Invalid solver strategy: "
+					"%s\n", optarg);
+				return -1;
+			}
+			break;
+
+		case 'E':
+			opt->flags |= OPT_FLAG_ALL;
+			break;
+
+		case 'B':
+			opt->flags |= OPT_FLAG_COUNT;
+			break;
+
+		case 'J':
+			opt->flags |= OPT_FLAG_BACKBONE;
+			break;
+
+		case 'g':
+			opt->flags |= OPT_FLAG_RATE;
+			break;
+
+		case 'I':
+			opt->solution_limit = strtoull(optarg, NULL, 0);
+			break;
+
+		case 'N':
+			opt->bench_count = atoi(optarg);
+			if (opt->bench_count < 1) {
+				fprintf(stderr, "Invalid count: %d\n",
+					opt->bench_count);
+				return -1;
+			}
+			break;
+
+		case 'Q':
+			opt->trace_sample = atoi(optarg);
+			if (opt->trace_sample < 1) {
+				fprintf(stderr, "Invalid trace sample rate: "
+					"%d\n", opt->trace_sample);
+				return -1;
+			}
+			break;
+
 		case 'u':
 			opt->flags |= OPT_FLAG_UNICODE;
 			break;
 
+		case 'b':
+			opt->flags |= OPT_FLAG_BATCH;
+			break;
+
+		case 'j':
+			opt->threads = atoi(optarg);
+			break;
+
+		case 'U':
+			opt->flags |= OPT_FLAG_UNORDERED;
+			break;
+
+		case 'P':
+			opt->parse_threads = atoi(optarg);
+			break;
+
+		case 'W':
+			opt->render_threads = atoi(optarg);
+			break;
+
+		case 'S':
+			opt->flags |= OPT_FLAG_STAGE_STATS;
+			break;
+
+		case 'L':
+			opt->socket_path = optarg;
+			break;
+
+		case 'D':
+			opt->pool_depth = atoi(optarg);
+			if (opt->pool_depth < 0) {
+				fprintf(stderr, "Invalid pool depth: %d\n",
+					opt->pool_depth);
+				return -1;
+			}
+			break;
+
+		case 'O':
+			if (opt->pool_count >= POOL_MAX) {
+				fprintf(stderr, "Too many pools\n");
+				return -1;
+			}
+			opt->pools[opt->pool_count++] = optarg;
+			break;
+
+		case 'k':
+			if (opt->worker_count >= FARM_MAX_WORKERS) {
+				fprintf(stderr, "Too many workers\n");
+				return -1;
+			}
+			opt->workers[opt->worker_count++] = optarg;
+			break;
+
+		case 'z':
+			opt->shard_size = atoi(optarg);
+			if (opt->shard_size < 1 ||
+			    opt->shard_size > SERVICE_SHARD_MAX) {
+				fprintf(stderr, "Invalid shard size: %d\n",
+					opt->shard_size);
+				return -1;
+			}
+			break;
+
+		case 'R':
+			opt->seed = strtoull(optarg, NULL, 0);
+			opt->have_seed = 1;
+			break;
+
 		case 'i':
 			opt->in_file = optarg;
 			break;
@@ -393,6 +2862,18 @@ static int parse_options(int argc, char **argv, struct options *opt)
 			opt->out_file = optarg;
 			break;
 
+		case 'F':
+			if (!strcasecmp(optarg, "text")) {
+				opt->format = FORMAT_TEXT;
+			} else if (!strcasecmp(optarg, "ndjson")) {
+				opt->format = FORMAT_NDJSON;
+			} else {
+				fprintf(stderr, "Unknown output format: %s\n",
+					optarg);
+				return -1;
+			}
+			break;
+
 		case 'V':
 			version();
 			exit(0);
@@ -416,6 +2897,9 @@ static int parse_options(int argc, char **argv, struct options *opt)
 		return -1;
 	}
 
+	opt->args = argv + 1;
+	opt->arg_count = argc - 1;
+
 	return 0;
 }
 
@@ -440,7 +2924,8 @@ int main(int argc, char **argv)
 	if (parse_options(argc, argv, &opt) < 0)
 		return -1;
 
-	srandom(get_seed());
+	if (!opt.have_seed)
+		opt.seed = get_seed();
 
 	return opt.command->func(&opt);
 }
@@ -0,0 +1,320 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "net.h"
+
+/* Longest host name accepted in a TCP address. */
+#define NET_HOST_MAX		256
+
+int net_is_tcp(const char *addr)
+{
+	return strchr(addr, ':') && !strchr(addr, '/');
+}
+
+/* Split host:port, removing brackets from an IPv6 host. Returns 0 on
+ * success or -1 if the host is too long.
+ */
+static int split_tcp(const char *addr, char *host, const char **port)
+{
+	const char *colon = strrchr(addr, ':');
+	size_t len = colon - addr;
+
+	if (len >= 2 && addr[0] == '[' && addr[len - 1] == ']') {
+		addr++;
+		len -= 2;
+	}
+
+	if (len >= NET_HOST_MAX)
+		return -1;
+
+	memcpy(host, addr, len);
+	host[len] = 0;
+	*port = colon + 1;
+	return 0;
+}
+
+static struct addrinfo *resolve(const char *addr, int passive)
+{
+	struct addrinfo hints;
+	struct addrinfo *res;
+	char host[NET_HOST_MAX];
+	const char *port;
+
+	if (split_tcp(addr, host, &port) < 0) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (passive)
+		hints.ai_flags = AI_PASSIVE;
+
+	if (getaddrinfo(host[0] ? host : NULL, port, &hints, &res)) {
+		errno = EHOSTUNREACH;
+		return NULL;
+	}
+
+	return res;
+}
+
+static int unix_address(const char *path, struct sockaddr_un *sa)
+{
+	if (strlen(path) >= sizeof(sa->sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	memset(sa, 0, sizeof(*sa));
+	sa->sun_family = AF_UNIX;
+	strcpy(sa->sun_path, path);
+	return 0;
+}
+
+static int listen_tcp(const char *addr)
+{
+	struct addrinfo *res = resolve(addr, 1);
+	struct addrinfo *ai;
+	int fd = -1;
+
+	if (!res) {
+		fprintf(stderr, "Can't resolve %s\n", addr);
+		return -1;
+	}
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		const int one = 1;
+
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (!bind(fd, ai->ai_addr, ai->ai_addrlen) && !listen(fd, 64))
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+
+	if (fd < 0)
+		fprintf(stderr, "Can't listen on %s: %s\n",
+			addr, strerror(errno));
+
+	freeaddrinfo(res);
+	return fd;
+}
+
+int net_listen(const char *addr)
+{
+	struct sockaddr_un sa;
+	struct stat st;
+	int fd;
+
+	if (net_is_tcp(addr))
+		return listen_tcp(addr);
+
+	if (unix_address(addr, &sa) < 0) {
+		fprintf(stderr, "Socket path too long: %s\n", addr);
+		return -1;
+	}
+
+	/* Replace a stale socket, but nothing else */
+	if (!lstat(addr, &st)) {
+		if (!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, "Can't listen on %s: not a socket\n",
+				addr);
+			return -1;
+		}
+
+		unlink(addr);
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		fprintf(stderr, "socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ||
+	    listen(fd, 64) < 0) {
+		fprintf(stderr, "Can't listen on %s: %s\n",
+			addr, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int net_connect(const char *addr)
+{
+	struct sockaddr_un sa;
+	struct addrinfo *res;
+	struct addrinfo *ai;
+	int fd = -1;
+
+	if (!net_is_tcp(addr)) {
+		if (unix_address(addr, &sa) < 0)
+			return -1;
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+
+		if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+			const int e = errno;
+
+			close(fd);
+			errno = e;
+			return -1;
+		}
+
+		return fd;
+	}
+
+	res = resolve(addr, 0);
+	if (!res)
+		return -1;
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		const int one = 1;
+
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		if (!connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+				   &one, sizeof(one));
+			break;
+		}
+
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(res);
+	return fd;
+}
+
+void net_unlink(const char *addr)
+{
+	struct stat st;
+
+	if (!net_is_tcp(addr) && !lstat(addr, &st) && S_ISSOCK(st.st_mode))
+		unlink(addr);
+}
+
+/* Read or write exactly len bytes. Returns 0 on success, or -1 on
+ * error or end of stream.
+ */
+static int read_all(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+
+	while (len) {
+		ssize_t r = read(fd, p, len);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return -1;
+
+		p += r;
+		len -= r;
+	}
+
+	return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len) {
+		ssize_t r = send(fd, p, len, MSG_NOSIGNAL);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return -1;
+
+		p += r;
+		len -= r;
+	}
+
+	return 0;
+}
+
+long net_read_frame(int fd, char **buf, size_t *size, size_t max)
+{
+	uint8_t hdr[4];
+	size_t len;
+
+	if (read_all(fd, hdr, 4) < 0)
+		return -1;
+
+	len = ((size_t)hdr[0] << 24) | (hdr[1] << 16) | (hdr[2] << 8) | hdr[3];
+	if (len > max)
+		return -1;
+
+	if (len + 1 > *size) {
+		char *n = realloc(*buf, len + 1);
+
+		if (!n)
+			return -1;
+
+		*buf = n;
+		*size = len + 1;
+	}
+
+	if (read_all(fd, *buf, len) < 0)
+		return -1;
+
+	(*buf)[len] = 0;
+	return len;
+}
+
+int net_write_frame(int fd, const char *text, size_t len)
+{
+	uint8_t hdr[4];
+
+	hdr[0] = len >> 24;
+	hdr[1] = len >> 16;
+	hdr[2] = len >> 8;
+	hdr[3] = len;
+
+	if (write_all(fd, hdr, 4) < 0)
+		return -1;
+
+	return write_all(fd, text, len);
+}
@@ -0,0 +1,62 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NET_H_
+#define NET_H_
+
+/* Sockets and framing shared by the server and the farm coordinator.
+ *
+ * An address is either the path of a Unix-domain socket, or host:port
+ * for TCP. An address containing a colon and no slash is taken to be
+ * TCP, and the host may be empty when listening, meaning every
+ * interface. TCP connections carry no authentication, so they should
+ * only be used on a trusted network.
+ *
+ * Frames are a 4-byte big-endian length followed by that many bytes of
+ * text.
+ */
+
+#include <stddef.h>
+
+/* Is this a TCP address? */
+int net_is_tcp(const char *addr);
+
+/* Listen on an address, replacing any existing Unix-domain socket.
+ * Anything else at the path is left alone, and is an error. Returns a
+ * file descriptor, or -1 after printing an error.
+ */
+int net_listen(const char *addr);
+
+/* Connect to an address. Returns a file descriptor, or -1 with errno
+ * set (nothing is printed, so that callers can retry quietly).
+ */
+int net_connect(const char *addr);
+
+/* Remove a Unix-domain socket after listening on it, if it's still
+ * there.
+ */
+void net_unlink(const char *addr);
+
+/* Read one frame of at most max bytes into a buffer, which is grown as
+ * necessary, and NUL-terminate it. Returns the length, or -1 on error,
+ * end of stream, or if the frame is too large.
+ */
+long net_read_frame(int fd, char **buf, size_t *size, size_t max);
+
+/* Write one frame. Returns 0 on success or -1 on error. */
+int net_write_frame(int fd, const char *text, size_t len);
+
+#endif
@@ -21,11 +21,26 @@
 #include "cdok.h"
 #include "parser.h"
 
+/* Record an error and fail. */
+static int parse_fail(struct cdok_parser *p, cdok_parse_error_t code,
+		      int x, int y, uint8_t group, int a, int b)
+{
+	p->error.code = code;
+	p->error.x = x;
+	p->error.y = y;
+	p->error.group = group;
+	p->error.a = a;
+	p->error.b = b;
+
+	return -1;
+}
+
 /* Check that all groups are single contiguous regions. On a copy of the
  * group map, flood-fill from a single member of each group. If the groups
  * are all contiguous, this should completely erase the map.
  */
-static int validate_group_map(const struct cdok_puzzle *puz)
+static int validate_group_map(struct cdok_parser *p,
+			      const struct cdok_puzzle *puz)
 {
 	uint8_t map[CDOK_CELLS];
 	int i;
@@ -42,13 +57,10 @@ static int validate_group_map(const struct cdok_puzzle *puz)
 	}
 
 	for (i = 0; i < CDOK_CELLS; i++)
-		if (map[i] != CDOK_GROUP_NONE) {
-			fprintf(stderr, "Group %c is not contiguous at "
-				"cell (%d, %d)\n",
-				cdok_group_to_char(map[i]),
-				CDOK_POS_X(i), CDOK_POS_Y(i));
-			return -1;
-		}
+		if (map[i] != CDOK_GROUP_NONE)
+			return parse_fail(p, CDOK_PARSE_NOT_CONTIGUOUS,
+					  CDOK_POS_X(i), CDOK_POS_Y(i),
+					  map[i], 0, 0);
 
 	return 0;
 }
@@ -56,39 +68,32 @@ static int validate_group_map(const struct cdok_puzzle *puz)
 /* Check that each group has a target and type and satisfies basic
  * constraints.
  */
-static int validate_groups(const struct cdok_puzzle *puz)
+static int validate_groups(struct cdok_parser *p,
+			   const struct cdok_puzzle *puz)
 {
 	int i;
 
 	for (i = 0; i < CDOK_GROUPS; i++) {
 		const struct cdok_group *g = &puz->groups[i];
-		uint8_t ch = cdok_group_to_char(i);
 
 		if (!g->size)
 			continue;
 
-		if (!g->type) {
-			fprintf(stderr, "Group %c has no type\n", ch);
-			return -1;
-		}
+		if (!g->type)
+			return parse_fail(p, CDOK_PARSE_NO_TYPE, 0, 0, i, 0, 0);
 
-		if (g->target < 0) {
-			fprintf(stderr, "Group %c has no target\n", ch);
-			return -1;
-		}
+		if (g->target < 0)
+			return parse_fail(p, CDOK_PARSE_NO_TARGET,
+					  0, 0, i, 0, 0);
 
-		if (g->size < 2) {
-			fprintf(stderr, "Group %c has only a "
-				"single member\n", ch);
-			return -1;
-		}
+		if (g->size < 2)
+			return parse_fail(p, CDOK_PARSE_SINGLE_MEMBER,
+					  0, 0, i, 0, 0);
 
 		if ((g->type == CDOK_RATIO || g->type == CDOK_PRODUCT) &&
-		    !g->target) {
-			fprintf(stderr, "Group %c is of type %c but it has "
-				"a target of 0\n", ch, g->type);
-			return -1;
-		}
+		    !g->target)
+			return parse_fail(p, CDOK_PARSE_ZERO_TARGET,
+					  0, 0, i, g->type, 0);
 	}
 
 	return 0;
@@ -111,41 +116,34 @@ static int parser_end_cell(struct cdok_parser *p, struct cdok_puzzle *puz)
 	if (p->value < 0 && p->group_name == CDOK_GROUP_NONE)
 		return 0;
 
-	if (p->x >= CDOK_SIZE || p->y >= CDOK_SIZE) {
-		fprintf(stderr, "Maximum cell coordinates exceeded: (%d, %d)\n",
-			p->x, p->y);
-		return -1;
-	}
+	if (p->x >= CDOK_SIZE || p->y >= CDOK_SIZE)
+		return parse_fail(p, CDOK_PARSE_BAD_CELL, p->x, p->y,
+				  CDOK_GROUP_NONE, 0, 0);
 
 	if (p->group_name != CDOK_GROUP_NONE) {
 		struct cdok_group *g = &puz->groups[p->group_name];
 
-		if (g->size >= CDOK_GROUP_SIZE) {
-			fprintf(stderr, "Maximum group size exceeded: (%d, %d) "
-				"(group %c)\n", p->x, p->y, p->group_name);
-			return -1;
-		}
+		if (g->size >= CDOK_GROUP_SIZE)
+			return parse_fail(p, CDOK_PARSE_GROUP_TOO_BIG,
+					  p->x, p->y, p->group_name, 0, 0);
 
 		g->members[g->size++] = CDOK_POS(p->x, p->y);
 
 		if (p->value >= 0) {
-			if (g->target >= 0 && p->value != g->target) {
-				fprintf(stderr, "Group %c has two conflicting "
-					"targets: %d vs %d\n",
-					p->group_name, p->value, g->target);
-				return -1;
-			}
+			if (g->target >= 0 && p->value != g->target)
+				return parse_fail(p,
+						  CDOK_PARSE_TARGET_CONFLICT,
+						  p->x, p->y, p->group_name,
+						  p->value, g->target);
 
 			g->target = p->value;
 		}
 
 		if (p->group_type) {
-			if (g->type && g->type != p->group_type) {
-				fprintf(stderr, "Group %c has two conflicting "
-					"types: %c vs %c\n",
-					p->group_name, g->type, p->group_type);
-				return -1;
-			}
+			if (g->type && g->type != p->group_type)
+				return parse_fail(p, CDOK_PARSE_TYPE_CONFLICT,
+						  p->x, p->y, p->group_name,
+						  g->type, p->group_type);
 
 			g->type = p->group_type;
 		}
@@ -180,9 +178,9 @@ int cdok_parser_push(struct cdok_parser *p, struct cdok_puzzle *puz,
 			if (!p->y) {
 				puz->size = p->x;
 			} else if (p->x != puz->size) {
-				fprintf(stderr, "Jagged row %d (expected "
-					"%d cells)\n", p->y, puz->size);
-				return -1;
+				return parse_fail(p, CDOK_PARSE_JAGGED,
+						  p->x, p->y, CDOK_GROUP_NONE,
+						  puz->size, 0);
 			}
 
 			p->y++;
@@ -233,21 +231,105 @@ int cdok_parser_end(struct cdok_parser *p, struct cdok_puzzle *puz)
 	if (parser_end_cell(p, puz) < 0)
 		return -1;
 
-	if (!puz->size) {
-		fprintf(stderr, "No cells!\n");
+	if (!puz->size)
+		return parse_fail(p, CDOK_PARSE_NO_CELLS,
+				  0, 0, CDOK_GROUP_NONE, 0, 0);
+
+	if (p->y < puz->size)
+		return parse_fail(p, CDOK_PARSE_NOT_SQUARE,
+				  0, 0, CDOK_GROUP_NONE, puz->size, p->y);
+
+	if (validate_groups(p, puz) < 0)
 		return -1;
-	}
 
-	if (p->y < puz->size) {
-		fprintf(stderr, "Grid is not square (width = %d, "
-			"height = %d)\n", puz->size, p->y);
+	build_group_map(puz);
+
+	return validate_group_map(p, puz);
+}
+
+int cdok_parse_spec(struct cdok_puzzle *puz, const char *text, int len,
+		    struct cdok_parse_error *err)
+{
+	struct cdok_parser p;
+
+	cdok_parser_init(&p, puz);
+	if (cdok_parser_push(&p, puz, text, len) < 0 ||
+	    cdok_parser_end(&p, puz) < 0) {
+		if (err)
+			*err = p.error;
 		return -1;
 	}
 
-	if (validate_groups(puz) < 0)
-		return -1;
+	return 0;
+}
 
-	build_group_map(puz);
+const char *cdok_parse_error_text(const struct cdok_parse_error *e,
+				  char *buf, int max)
+{
+	const int g = e->group != CDOK_GROUP_NONE ?
+		cdok_group_to_char(e->group) : '?';
+
+	switch (e->code) {
+	case CDOK_PARSE_OK:
+		snprintf(buf, max, "No error");
+		break;
+
+	case CDOK_PARSE_BAD_CELL:
+		snprintf(buf, max, "Maximum cell coordinates exceeded: "
+			 "(%d, %d)", e->x, e->y);
+		break;
+
+	case CDOK_PARSE_GROUP_TOO_BIG:
+		snprintf(buf, max, "Maximum group size exceeded: (%d, %d) "
+			 "(group %c)", e->x, e->y, g);
+		break;
+
+	case CDOK_PARSE_TARGET_CONFLICT:
+		snprintf(buf, max, "Group %c has two conflicting "
+			 "targets: %d vs %d", g, e->a, e->b);
+		break;
+
+	case CDOK_PARSE_TYPE_CONFLICT:
+		snprintf(buf, max, "Group %c has two conflicting "
+			 "types: %c vs %c", g, e->a, e->b);
+		break;
+
+	case CDOK_PARSE_JAGGED:
+		snprintf(buf, max, "Jagged row %d (expected %d cells)",
+			 e->y, e->a);
+		break;
+
+	case CDOK_PARSE_NO_CELLS:
+		snprintf(buf, max, "No cells!");
+		break;
+
+	case CDOK_PARSE_NOT_SQUARE:
+		snprintf(buf, max, "Grid is not square (width = %d, "
+			 "height = %d)", e->a, e->b);
+		break;
+
+	case CDOK_PARSE_NO_TYPE:
+		snprintf(buf, max, "Group %c has no type", g);
+		break;
+
+	case CDOK_PARSE_NO_TARGET:
+		snprintf(buf, max, "Group %c has no target", g);
+		break;
+
+	case CDOK_PARSE_SINGLE_MEMBER:
+		snprintf(buf, max, "Group %c has only a single member", g);
+		break;
+
+	case CDOK_PARSE_ZERO_TARGET:
+		snprintf(buf, max, "Group %c is of type %c but it has "
+			 "a target of 0", g, e->a);
+		break;
+
+	case CDOK_PARSE_NOT_CONTIGUOUS:
+		snprintf(buf, max, "Group %c is not contiguous at "
+			 "cell (%d, %d)", g, e->x, e->y);
+		break;
+	}
 
-	return validate_group_map(puz);
+	return buf;
 }
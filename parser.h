@@ -19,15 +19,47 @@
 
 #include "cdok.h"
 
-/* Parser state. */
+/* Parse errors. When parsing fails, the parser records the reason,
+ * along with the cell, group and values involved, where they apply.
+ */
+typedef enum {
+	CDOK_PARSE_OK = 0,
+	CDOK_PARSE_BAD_CELL,		/* x, y */
+	CDOK_PARSE_GROUP_TOO_BIG,	/* x, y, group */
+	CDOK_PARSE_TARGET_CONFLICT,	/* group, a, b */
+	CDOK_PARSE_TYPE_CONFLICT,	/* group, a, b */
+	CDOK_PARSE_JAGGED,		/* y, a */
+	CDOK_PARSE_NO_CELLS,
+	CDOK_PARSE_NOT_SQUARE,		/* a, b */
+	CDOK_PARSE_NO_TYPE,		/* group */
+	CDOK_PARSE_NO_TARGET,		/* group */
+	CDOK_PARSE_SINGLE_MEMBER,	/* group */
+	CDOK_PARSE_ZERO_TARGET,		/* group, a */
+	CDOK_PARSE_NOT_CONTIGUOUS	/* x, y, group */
+} cdok_parse_error_t;
+
+struct cdok_parse_error {
+	cdok_parse_error_t	code;
+	int			x;
+	int			y;
+	uint8_t			group;
+	int			a;
+	int			b;
+};
+
+/* Parser state. The parser never writes to stderr: errors are left in
+ * the error field. It has no state outside this structure, so any
+ * number of parsers may be used at once from different threads.
+ */
 struct cdok_parser {
-	unsigned int	eof;
-	unsigned int	x;
-	unsigned int	y;
-	unsigned int	max_x;
-	int		value;
-	unsigned int	group_name;
-	cdok_gtype_t	group_type;
+	unsigned int		eof;
+	unsigned int		x;
+	unsigned int		y;
+	unsigned int		max_x;
+	int			value;
+	unsigned int		group_name;
+	cdok_gtype_t		group_type;
+	struct cdok_parse_error	error;
 };
 
 /* Create a new parser and clear the given puzzle grid. */
@@ -46,4 +78,17 @@ int cdok_parser_push(struct cdok_parser *p, struct cdok_puzzle *puz,
  */
 int cdok_parser_end(struct cdok_parser *p, struct cdok_puzzle *puz);
 
+/* Parse a complete puzzle spec held in memory, as for the functions
+ * above. Returns 0 on success, or -1 with the reason in err (if
+ * non-NULL).
+ */
+int cdok_parse_spec(struct cdok_puzzle *puz, const char *text, int len,
+		    struct cdok_parse_error *err);
+
+/* Describe a parse error in words. The message is truncated if the
+ * buffer is too small. Returns the buffer.
+ */
+const char *cdok_parse_error_text(const struct cdok_parse_error *e,
+				  char *buf, int max);
+
 #endif
@@ -0,0 +1,210 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+
+int pool_set_init(struct pool_set *ps, unsigned int depth, int max_refills)
+{
+	memset(ps, 0, sizeof(*ps));
+	ps->depth = depth;
+	ps->max_refills = max_refills > 0 ? max_refills : 1;
+
+	if (pthread_mutex_init(&ps->lock, NULL))
+		return -1;
+
+	return 0;
+}
+
+void pool_set_destroy(struct pool_set *ps)
+{
+	int i;
+
+	for (i = 0; i < ps->count; i++)
+		free(ps->pools[i].entries);
+
+	pthread_mutex_destroy(&ps->lock);
+}
+
+static int key_equal(const struct pool_key *a, const struct pool_key *b)
+{
+	return a->size == b->size &&
+		a->iterations == b->iterations &&
+		a->limit == b->limit &&
+		a->target == b->target &&
+		a->flags == b->flags;
+}
+
+/* Find the pool with the given key, optionally creating it. Must be
+ * called with the lock held.
+ */
+static struct pool *find_pool(struct pool_set *ps, const struct pool_key *key,
+			      int create)
+{
+	struct pool *p;
+	int i;
+
+	for (i = 0; i < ps->count; i++)
+		if (key_equal(&ps->pools[i].key, key))
+			return &ps->pools[i];
+
+	if (!create || ps->count >= POOL_MAX)
+		return NULL;
+
+	p = &ps->pools[ps->count];
+	memset(p, 0, sizeof(*p));
+	p->entries = malloc(ps->depth * sizeof(p->entries[0]));
+	if (!p->entries)
+		return NULL;
+
+	p->key = *key;
+	ps->count++;
+
+	return p;
+}
+
+int pool_add(struct pool_set *ps, const struct pool_key *key)
+{
+	struct pool *p;
+
+	pthread_mutex_lock(&ps->lock);
+	p = find_pool(ps, key, 1);
+	pthread_mutex_unlock(&ps->lock);
+
+	return p ? 0 : -1;
+}
+
+int pool_take(struct pool_set *ps, const struct pool_key *key, int create,
+	      struct pool_entry *out)
+{
+	struct pool *p;
+	int ret = -1;
+
+	pthread_mutex_lock(&ps->lock);
+	p = find_pool(ps, key, create);
+
+	if (p && p->count) {
+		memcpy(out, &p->entries[p->head], sizeof(*out));
+		p->head = (p->head + 1) % ps->depth;
+		p->count--;
+		p->hits++;
+		ret = 0;
+	} else if (p) {
+		p->misses++;
+	}
+
+	pthread_mutex_unlock(&ps->lock);
+	return ret;
+}
+
+/* Choose the pool with the lowest fill ratio, counting puzzles which
+ * are being generated. Must be called with the lock held.
+ */
+static struct pool *emptiest_pool(struct pool_set *ps)
+{
+	struct pool *best = NULL;
+	unsigned int best_fill = 0;
+	int i;
+
+	for (i = 0; i < ps->count; i++) {
+		struct pool *p = &ps->pools[i];
+		unsigned int fill = p->count + p->pending;
+
+		if (fill < ps->depth && (!best || fill < best_fill)) {
+			best = p;
+			best_fill = fill;
+		}
+	}
+
+	return best;
+}
+
+int pool_refill(struct pool_set *ps, struct cdok_gen *gen, int *more_out)
+{
+	struct pool_entry *e;
+	struct pool_key key;
+	struct pool *p;
+
+	e = malloc(sizeof(*e));
+	if (!e)
+		return 0;
+
+	pthread_mutex_lock(&ps->lock);
+
+	p = (ps->refilling < ps->max_refills) ? emptiest_pool(ps) : NULL;
+	if (!p) {
+		pthread_mutex_unlock(&ps->lock);
+		free(e);
+		return 0;
+	}
+
+	key = p->key;
+	p->pending++;
+	ps->refilling++;
+
+	if (more_out)
+		*more_out = ps->refilling < ps->max_refills &&
+			emptiest_pool(ps);
+
+	pthread_mutex_unlock(&ps->lock);
+
+	cdok_generate_grid(gen, e->solution, key.size);
+	e->diff = cdok_generate(gen, &e->puz, e->solution, key.size,
+				key.flags, key.iterations, key.limit,
+				key.target);
+
+	/* Pools are never removed, so p is still valid */
+	pthread_mutex_lock(&ps->lock);
+	memcpy(&p->entries[(p->head + p->count) % ps->depth], e, sizeof(*e));
+	p->count++;
+	p->pending--;
+	ps->refilling--;
+	pthread_mutex_unlock(&ps->lock);
+
+	free(e);
+	return 1;
+}
+
+void pool_report(struct pool_set *ps, struct cdok_json *j, const char *key)
+{
+	int i;
+
+	pthread_mutex_lock(&ps->lock);
+	cdok_json_begin_array(j, key);
+
+	for (i = 0; i < ps->count; i++) {
+		const struct pool *p = &ps->pools[i];
+
+		cdok_json_begin_object(j, NULL);
+		cdok_json_int(j, "size", p->key.size);
+		cdok_json_bool(j, "two_cell",
+			       p->key.flags & CDOK_FLAGS_TWO_CELL);
+		cdok_json_int(j, "iterations", p->key.iterations);
+		cdok_json_int(j, "limit", p->key.limit);
+		cdok_json_int(j, "target", p->key.target);
+		cdok_json_int(j, "depth", p->count);
+		cdok_json_int(j, "capacity", ps->depth);
+		cdok_json_int(j, "pending", p->pending);
+		cdok_json_int(j, "hits", p->hits);
+		cdok_json_int(j, "misses", p->misses);
+		cdok_json_end_object(j);
+	}
+
+	cdok_json_end_array(j);
+	pthread_mutex_unlock(&ps->lock);
+}
@@ -0,0 +1,106 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef POOL_H_
+#define POOL_H_
+
+/* Pools of pre-generated puzzles. Each pool holds puzzles made with
+ * one set of generator parameters: size, two-cell flag and difficulty
+ * band (iteration count, limit and target). A generate request with
+ * matching parameters takes a puzzle from the pool, if one is ready,
+ * instead of generating it on the spot.
+ *
+ * Pools are refilled by idle server workers. Each refill generates a
+ * single puzzle for whichever pool is emptiest relative to its
+ * capacity, so that a burst of requests for one band doesn't starve
+ * the others.
+ */
+
+#include <pthread.h>
+#include "cdok.h"
+#include "generator.h"
+#include "json.h"
+
+/* Maximum number of distinct pools. */
+#define POOL_MAX		64
+
+struct pool_key {
+	int		size;
+	int		iterations;
+	int		limit;
+	int		target;
+	cdok_flags_t	flags;
+};
+
+struct pool_entry {
+	struct cdok_puzzle	puz;
+	uint8_t			solution[CDOK_CELLS];
+	int			diff;
+};
+
+struct pool {
+	struct pool_key		key;
+	struct pool_entry	*entries;
+	unsigned int		head;
+	unsigned int		count;
+	unsigned int		pending;
+	unsigned long		hits;
+	unsigned long		misses;
+};
+
+/* A set of pools, all of the same capacity. At most max_refills
+ * puzzles (but at least one) are generated at once, so that some
+ * workers are left to answer requests.
+ */
+struct pool_set {
+	pthread_mutex_t		lock;
+	unsigned int		depth;
+	int			max_refills;
+	int			refilling;
+	int			count;
+	struct pool		pools[POOL_MAX];
+};
+
+/* Set up an empty set of pools. Returns 0 on success or -1 on
+ * error.
+ */
+int pool_set_init(struct pool_set *ps, unsigned int depth, int max_refills);
+void pool_set_destroy(struct pool_set *ps);
+
+/* Declare a pool in advance, so that it's filled before the first
+ * request for it arrives. Returns 0 on success or -1 if there are too
+ * many pools.
+ */
+int pool_add(struct pool_set *ps, const struct pool_key *key);
+
+/* Take a puzzle from the pool with the given key. If there's no such
+ * pool, one is created only if create is set, so that callers can keep
+ * clients from making idle workers fill pools nobody else wants.
+ * Returns 0 on success or -1 if no puzzle is ready.
+ */
+int pool_take(struct pool_set *ps, const struct pool_key *key, int create,
+	      struct pool_entry *out);
+
+/* Generate one puzzle for the emptiest pool. Returns 1 if a puzzle was
+ * generated and 0 if there was nothing to do. If more_out is given, it
+ * is set if other pools could usefully be refilled at the same time.
+ */
+int pool_refill(struct pool_set *ps, struct cdok_gen *gen, int *more_out);
+
+/* Write pool statistics as a JSON array under the given key. */
+void pool_report(struct pool_set *ps, struct cdok_json *j, const char *key);
+
+#endif
@@ -14,42 +14,108 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <string.h>
+
 #include "cdok.h"
 #include "printer.h"
 
-/* Print a puzzle spec that can be read by the parser. */
-void cdok_print_puzzle(const struct cdok_puzzle *puz,
-		       const uint8_t *values, FILE *out)
+/* Write a decimal integer to the given buffer and return the number of
+ * characters written. The buffer must have room for at least 11
+ * characters. No terminator is written.
+ */
+static int format_int(char *text, int v)
+{
+	char tmp[10];
+	unsigned int u = v;
+	int len = 0;
+	int n = 0;
+
+	if (v < 0) {
+		text[len++] = '-';
+		u = -u;
+	}
+
+	do {
+		tmp[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u);
+
+	while (n)
+		text[len++] = tmp[--n];
+
+	return len;
+}
+
+/* Number of characters that format_int() would write for v. */
+static int int_width(int v)
+{
+	unsigned int u = v;
+	int len = 1;
+
+	if (v < 0) {
+		len++;
+		u = -u;
+	}
+
+	while (u >= 10) {
+		u /= 10;
+		len++;
+	}
+
+	return len;
+}
+
+/* Render a puzzle spec that can be read by the parser. */
+int cdok_render_spec(const struct cdok_puzzle *puz, const uint8_t *values,
+		     char *buf, int max_len)
 {
+	char *out = buf;
 	int y;
 
 	for (y = 0; y < puz->size; y++) {
 		int x;
 
+		if (buf + max_len - out < CDOK_SPEC_LINE_MAX)
+			return -1;
+
 		for (x = 0; x < puz->size; x++) {
 			cdok_pos_t c = CDOK_POS(x, y);
 
 			if (x)
-				fprintf(out, "\t");
+				*(out++) = '\t';
 
 			if (values[c]) {
-				fprintf(out, "%d", values[c]);
+				out += format_int(out, values[c]);
 			} else if (puz->group_map[c] != CDOK_GROUP_NONE) {
 				const struct cdok_group *g =
 					&puz->groups[puz->group_map[c]];
 
-				fprintf(out, "%c",
-					cdok_group_to_char(puz->group_map[c]));
-				if (g->members[0] == c)
-					fprintf(out, "%c%d",
-						g->type, g->target);
+				*(out++) = cdok_group_to_char(puz->group_map[c]);
+				if (g->members[0] == c) {
+					*(out++) = g->type;
+					out += format_int(out, g->target);
+				}
 			}
 		}
 
-		fprintf(out, "\n");
+		*(out++) = '\n';
 	}
+
+	return out - buf;
+}
+
+/* Print a puzzle spec that can be read by the parser. */
+void cdok_print_puzzle(const struct cdok_puzzle *puz,
+		       const uint8_t *values, FILE *out)
+{
+	char buf[CDOK_SPEC_MAX];
+	int len = cdok_render_spec(puz, values, buf, sizeof(buf));
+
+	if (len > 0)
+		fwrite(buf, 1, len, out);
 }
 
+
 const struct cdok_template cdok_template_unicode = {
 	.top = {
 		.start		= 0x2554,
@@ -124,63 +190,93 @@ const struct cdok_template cdok_template_ascii = {
 	}
 };
 
-/* Print the given Unicode character <count> times, in UTF-8 */
-static void print_char(uint16_t ch, int count, FILE *out)
+/* Encode a single Unicode character in UTF-8. */
+static void encode_glyph(struct cdok_glyph *g, uint16_t ch)
 {
-	char text[6];
+	memset(g, 0, sizeof(*g));
 
 	if (ch < 0x80) {
-		text[0] = ch;
-		text[1] = 0;
+		g->text[0] = ch;
+		g->len = 1;
 	} else if (ch < 0x800) {
-		text[0] = 0xc0 | (ch >> 6);
-		text[1] = 0x80 | (ch & 0x3f);
-		text[2] = 0;
+		g->text[0] = 0xc0 | (ch >> 6);
+		g->text[1] = 0x80 | (ch & 0x3f);
+		g->len = 2;
 	} else {
-		text[0] = 0xe0 | (ch >> 12);
-		text[1] = 0x80 | ((ch >> 6) & 0x3f);
-		text[2] = 0x80 | (ch & 0x3f);
-		text[3] = 0;
+		g->text[0] = 0xe0 | (ch >> 12);
+		g->text[1] = 0x80 | ((ch >> 6) & 0x3f);
+		g->text[2] = 0x80 | (ch & 0x3f);
+		g->len = 3;
 	}
+}
+
+static void encode_hborder(struct cdok_glyph_hborder *g,
+			   const struct cdok_template_hborder *b)
+{
+	encode_glyph(&g->start, b->start);
+	encode_glyph(&g->end, b->end);
+	encode_glyph(&g->tee_major, b->tee_major);
+	encode_glyph(&g->tee_minor, b->tee_minor);
+}
+
+/* Encode every character of a template, ready for rendering. */
+void cdok_glyphs_init(struct cdok_glyphs *g, const struct cdok_template *templ)
+{
+	int i;
+
+	encode_hborder(&g->top, &templ->top);
+	encode_hborder(&g->bottom, &templ->bottom);
+	encode_glyph(&g->hline_major, templ->hline_major);
+	encode_glyph(&g->hline_minor, templ->hline_minor);
+	encode_glyph(&g->vline_major, templ->vline_major);
+	encode_glyph(&g->vline_minor, templ->vline_minor);
+	encode_glyph(&g->tee_left_major, templ->tee_left_major);
+	encode_glyph(&g->tee_left_minor, templ->tee_left_minor);
+	encode_glyph(&g->tee_right_major, templ->tee_right_major);
+	encode_glyph(&g->tee_right_minor, templ->tee_right_minor);
+
+	for (i = 0; i < 16; i++)
+		encode_glyph(&g->inners[i], templ->inners[i]);
+}
 
+/* Write the given glyph <count> times. We always copy the full three
+ * bytes of text and advance only by the encoded length, so the output
+ * buffer must allow for three bytes per glyph.
+ */
+static char *put_glyph(char *out, const struct cdok_glyph *g, int count)
+{
 	while (count > 0) {
-		fputs(text, out);
+		memcpy(out, g->text, sizeof(g->text));
+		out += g->len;
 		count--;
 	}
+
+	return out;
 }
 
-/* Write a value, if valid, in the given text buffer and return the
- * length.
- */
-static int format_value(char *text, int max_len, uint8_t value)
+/* Write <count> spaces. */
+static char *put_spaces(char *out, int count)
 {
-	if (!value) {
-		text[0] = 0;
-		return 0;
+	if (count > 0) {
+		memset(out, ' ', count);
+		out += count;
 	}
 
-	return snprintf(text, max_len, "%d", value);
+	return out;
 }
 
-/* Format a clue for a cell, if the given cell is part of a group. Returns
- * the number of characters written to the text buffer.
- */
-static int format_clue(char *text, int max_len,
-		       const struct cdok_puzzle *puz,
-		       cdok_pos_t c)
+/* Length of the clue shown in the given cell, if any. */
+static int clue_width(const struct cdok_puzzle *puz, cdok_pos_t c)
 {
 	const struct cdok_group *g;
 
-	if (puz->group_map[c] == CDOK_GROUP_NONE) {
-		text[0] = 0;
+	if (puz->group_map[c] == CDOK_GROUP_NONE)
 		return 0;
-	}
 
 	g = &puz->groups[puz->group_map[c]];
 	if (g->members[0] == c)
-		return snprintf(text, max_len, "%d%c", g->target, g->type);
+		return int_width(g->target) + 1;
 
-	text[0] = 0;
 	return 0;
 }
 
@@ -227,25 +323,27 @@ static cdok_set_t format_vjoins(const struct cdok_puzzle *puz, int y)
 /* Draw a top or bottom border. The joins bitmask tells us which of the
  * vertical gridlines touching this border are minor lines.
  */
-static void format_border(const struct cdok_template *templ,
-			  const struct cdok_template_hborder *border,
-			  int size, int cell_width, cdok_set_t joins,
-			  FILE *out)
+static char *format_border(const struct cdok_glyphs *g,
+			   const struct cdok_glyph_hborder *border,
+			   int size, int cell_width, cdok_set_t joins,
+			   char *out)
 {
 	int x;
 
-	print_char(border->start, 1, out);
+	out = put_glyph(out, &border->start, 1);
 
 	for (x = 0; x < size; x++) {
-		print_char(templ->hline_major, cell_width, out);
+		out = put_glyph(out, &g->hline_major, cell_width);
 		if (x + 1 < size)
-			print_char((joins & (1 << x)) ?
-				   border->tee_minor :
-				   border->tee_major, 1, out);
+			out = put_glyph(out, (joins & (1 << x)) ?
+					&border->tee_minor :
+					&border->tee_major, 1);
 	}
 
-	print_char(border->end, 1, out);
-	fprintf(out, "\n");
+	out = put_glyph(out, &border->end, 1);
+	*(out++) = '\n';
+
+	return out;
 }
 
 /* Format a horizontal row containing horizontal gridlines and
@@ -258,21 +356,21 @@ static void format_border(const struct cdok_template *templ,
  *     joins_below: the Xth joiner joins below with a minor vertical
  *                  gridline
  */
-static void format_hline(const struct cdok_template *templ,
-			 int size, int cell_width,
-			 cdok_set_t joins_above,
-			 cdok_set_t joins,
-			 cdok_set_t joins_below, FILE *out)
+static char *format_hline(const struct cdok_glyphs *g,
+			  int size, int cell_width,
+			  cdok_set_t joins_above,
+			  cdok_set_t joins,
+			  cdok_set_t joins_below, char *out)
 {
 	int x;
 
-	print_char((joins & 1) ?
-		   templ->tee_left_minor : templ->tee_left_major, 1, out);
+	out = put_glyph(out, (joins & 1) ?
+			&g->tee_left_minor : &g->tee_left_major, 1);
 
 	for (x = 0; x < size; x++) {
-		print_char((joins & (1 << x)) ?
-			   templ->hline_minor : templ->hline_major,
-			   cell_width, out);
+		out = put_glyph(out, (joins & (1 << x)) ?
+				&g->hline_minor : &g->hline_major,
+				cell_width);
 
 		if (x + 1 < size) {
 			int inner = CDOK_TIN_BTLR;
@@ -286,14 +384,15 @@ static void format_hline(const struct cdok_template *templ,
 			if (joins_below & (1 << x))
 				inner &= ~CDOK_TIN_B;
 
-			print_char(templ->inners[inner], 1, out);
+			out = put_glyph(out, &g->inners[inner], 1);
 		}
 	}
 
-	print_char((joins & (1 << (size - 1))) ?
-		   templ->tee_right_minor : templ->tee_right_major,
-		   1, out);
-	fprintf(out, "\n");
+	out = put_glyph(out, (joins & (1 << (size - 1))) ?
+			&g->tee_right_minor : &g->tee_right_major, 1);
+	*(out++) = '\n';
+
+	return out;
 }
 
 /* Format a row containing vertical gridlines and cells, optionally
@@ -303,51 +402,59 @@ static void format_hline(const struct cdok_template *templ,
  * Bit X is set if the vertical gridline to the immediate right of cell
  * X is a minor gridline.
  */
-static void format_row(const struct cdok_template *templ,
-		       const struct cdok_puzzle *puz,
-		       int cell_width, int y, cdok_set_t joins,
-		       const uint8_t *values, int clues,
-		       FILE *out)
+static char *format_row(const struct cdok_glyphs *g,
+			const struct cdok_puzzle *puz,
+			int cell_width, int y, cdok_set_t joins,
+			const uint8_t *values, int clues,
+			char *out)
 {
 	int x;
 
-	print_char(templ->vline_major, 1, out);
+	out = put_glyph(out, &g->vline_major, 1);
 
 	for (x = 0; x < puz->size; x++) {
 		const cdok_pos_t c = CDOK_POS(x, y);
-		char text[16];
 
 		if (values) {
-			int len = format_value(text, sizeof(text), values[c]);
-
-			print_char(' ', (cell_width - len) / 2, out);
-			fputs(text, out);
-			print_char(' ', (cell_width - len + 1) / 2, out);
-		} else if (clues) {
-			int len = format_clue(text, sizeof(text), puz, c);
-
-			fputs(text, out);
-			print_char(' ', cell_width - len, out);
+			int len = values[c] ? int_width(values[c]) : 0;
+
+			out = put_spaces(out, (cell_width - len) / 2);
+			if (len)
+				out += format_int(out, values[c]);
+			out = put_spaces(out, (cell_width - len + 1) / 2);
+		} else if (clues && clue_width(puz, c)) {
+			const struct cdok_group *grp =
+				&puz->groups[puz->group_map[c]];
+			int len = format_int(out, grp->target);
+
+			out += len;
+			*(out++) = grp->type;
+			out = put_spaces(out, cell_width - len - 1);
 		} else {
-			print_char(' ', cell_width, out);
+			out = put_spaces(out, cell_width);
 		}
 
 		if (x + 1 < puz->size)
-			print_char((joins & (1 << x)) ?
-				   templ->vline_minor :
-				   templ->vline_major, 1, out);
+			out = put_glyph(out, (joins & (1 << x)) ?
+					&g->vline_minor :
+					&g->vline_major, 1);
 	}
 
-	print_char(templ->vline_major, 1, out);
-	fprintf(out, "\n");
+	out = put_glyph(out, &g->vline_major, 1);
+	*(out++) = '\n';
+
+	return out;
 }
 
-/* Render a puzzle using the given template. */
-void cdok_format_puzzle(const struct cdok_template *templ,
-			const struct cdok_puzzle *puz,
-			const uint8_t *values, FILE *out)
+/* Render a puzzle using the given pre-encoded template. */
+int cdok_render_puzzle(const struct cdok_glyphs *g,
+		       const struct cdok_puzzle *puz,
+		       const uint8_t *values, char *buf, int max_len)
 {
+	const char *end = buf + max_len;
+	char *out = buf;
 	int cell_width = 5;
+	int line_max;
 	int x, y;
 
 	/* Calculate a sufficient cell width to hold the longest
@@ -356,40 +463,70 @@ void cdok_format_puzzle(const struct cdok_template *templ,
 	for (y = 0; y < puz->size; y++)
 		for (x = 0; x < puz->size; x++) {
 			const cdok_pos_t c = CDOK_POS(x, y);
-			char text[16];
-			int len = format_clue(text, sizeof(text), puz, c);
+			int len = clue_width(puz, c);
 
 			if (len > cell_width)
 				cell_width = len;
 
-			len = format_value(text, sizeof(text), values[c]);
-			if (len > cell_width)
-				cell_width = len;
+			if (values[c]) {
+				len = int_width(values[c]);
+				if (len > cell_width)
+					cell_width = len;
+			}
 		}
 
+	/* Every line consists of size * (cell_width + 1) + 1 glyphs of
+	 * up to three bytes each, plus a newline.
+	 */
+	line_max = (puz->size * (cell_width + 1) + 1) * 3 + 1;
+
 	/* Top border */
-	format_border(templ, &templ->top,
-		      puz->size, cell_width, format_hjoins(puz, 0), out);
+	if (end - out < line_max)
+		return -1;
+	out = format_border(g, &g->top, puz->size, cell_width,
+			    format_hjoins(puz, 0), out);
 
 	for (y = 0; y < puz->size; y++) {
 		cdok_set_t h = format_hjoins(puz, y);
 
+		if (end - out < line_max * 4)
+			return -1;
+
 		/* Cells occupy three rows. Clues go in the top row, values
 		 * in the second, and the third is blank.
 		 */
-		format_row(templ, puz, cell_width, y, h, NULL, 1, out);
-		format_row(templ, puz, cell_width, y, h, values, 0, out);
-		format_row(templ, puz, cell_width, y, h, NULL, 0, out);
+		out = format_row(g, puz, cell_width, y, h, NULL, 1, out);
+		out = format_row(g, puz, cell_width, y, h, values, 0, out);
+		out = format_row(g, puz, cell_width, y, h, NULL, 0, out);
 
 		/* Horizontal gridlines between cells */
 		if (y + 1 < puz->size)
-			format_hline(templ, puz->size, cell_width, h,
-				     format_vjoins(puz, y),
-				     format_hjoins(puz, y + 1), out);
+			out = format_hline(g, puz->size, cell_width, h,
+					   format_vjoins(puz, y),
+					   format_hjoins(puz, y + 1), out);
 	}
 
 	/* Bottom border */
-	format_border(templ, &templ->bottom,
-		      puz->size, cell_width,
-		      format_hjoins(puz, puz->size - 1), out);
+	if (end - out < line_max)
+		return -1;
+	out = format_border(g, &g->bottom, puz->size, cell_width,
+			    format_hjoins(puz, puz->size - 1), out);
+
+	return out - buf;
+}
+
+/* Render a puzzle using the given template. */
+void cdok_format_puzzle(const struct cdok_template *templ,
+			const struct cdok_puzzle *puz,
+			const uint8_t *values, FILE *out)
+{
+	struct cdok_glyphs g;
+	char buf[CDOK_FORMAT_MAX];
+	int len;
+
+	cdok_glyphs_init(&g, templ);
+	len = cdok_render_puzzle(&g, puz, values, buf, sizeof(buf));
+
+	if (len > 0)
+		fwrite(buf, 1, len, out);
 }
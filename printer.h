@@ -100,8 +100,64 @@ extern const struct cdok_template cdok_template_ascii;
 /* Template using Unicode line-drawing characters. */
 extern const struct cdok_template cdok_template_unicode;
 
+/* A single template character, pre-encoded in UTF-8. */
+struct cdok_glyph {
+	uint8_t		len;
+	char		text[3];
+};
+
+/* Pre-encoded forms of the template structures above. Encoding a
+ * template is cheap, but it's worth doing only once if many puzzles
+ * are to be rendered with it.
+ */
+struct cdok_glyph_hborder {
+	struct cdok_glyph	start;
+	struct cdok_glyph	end;
+	struct cdok_glyph	tee_major;
+	struct cdok_glyph	tee_minor;
+};
+
+struct cdok_glyphs {
+	struct cdok_glyph_hborder	top;
+	struct cdok_glyph_hborder	bottom;
+	struct cdok_glyph		hline_major;
+	struct cdok_glyph		hline_minor;
+	struct cdok_glyph		vline_major;
+	struct cdok_glyph		vline_minor;
+	struct cdok_glyph		tee_left_major;
+	struct cdok_glyph		tee_left_minor;
+	struct cdok_glyph		tee_right_major;
+	struct cdok_glyph		tee_right_minor;
+	struct cdok_glyph		inners[16];
+};
+
+void cdok_glyphs_init(struct cdok_glyphs *g, const struct cdok_template *templ);
+
+/* Buffer sizes which are always sufficient for a rendered puzzle and a
+ * rendered puzzle spec respectively.
+ */
+#define CDOK_FORMAT_MAX		45056
+#define CDOK_SPEC_LINE_MAX	(CDOK_SIZE * 14 + 1)
+#define CDOK_SPEC_MAX		(CDOK_SIZE * CDOK_SPEC_LINE_MAX)
+
+/* Render a puzzle structure with the given values filled in, using the
+ * specified pre-encoded template. The text is written to the given
+ * buffer (without a terminator) and its length is returned. If the
+ * buffer is too small, -1 is returned.
+ */
+int cdok_render_puzzle(const struct cdok_glyphs *g,
+		       const struct cdok_puzzle *puz,
+		       const uint8_t *values, char *buf, int max_len);
+
+/* Render a puzzle spec that can be read by the parser. Returns the
+ * length of the text, or -1 if the buffer is too small.
+ */
+int cdok_render_spec(const struct cdok_puzzle *puz, const uint8_t *values,
+		     char *buf, int max_len);
+
 /* Print a puzzle structure with the given values filled in, using the
- * specified template.
+ * specified template. The puzzle is rendered in full before being
+ * written with a single call.
  */
 void cdok_format_puzzle(const struct cdok_template *templ,
 			const struct cdok_puzzle *puz,
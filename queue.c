@@ -0,0 +1,157 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <sched.h>
+
+#include "queue.h"
+
+int queue_init(struct queue *q, unsigned int capacity)
+{
+	unsigned long size = 2;
+	unsigned long i;
+
+	while (size < capacity)
+		size <<= 1;
+
+	q->slots = malloc(size * sizeof(q->slots[0]));
+	if (!q->slots)
+		return -1;
+
+	for (i = 0; i < size; i++) {
+		q->slots[i].seq = i;
+		q->slots[i].data = NULL;
+	}
+
+	q->mask = size - 1;
+	q->head = 0;
+	q->tail = 0;
+	sem_init(&q->items, 0, 0);
+	sem_init(&q->space, 0, size);
+
+	return 0;
+}
+
+void queue_destroy(struct queue *q)
+{
+	sem_destroy(&q->items);
+	sem_destroy(&q->space);
+	free(q->slots);
+}
+
+/* Claim the slot at the head and fill it. The caller must already have
+ * reserved space, so a free slot exists -- but it may not yet have
+ * been released by the consumer which is emptying it, in which case
+ * we yield and retry.
+ */
+static void push_reserved(struct queue *q, void *data)
+{
+	struct queue_slot *s;
+	unsigned long pos;
+
+	pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+
+	for (;;) {
+		long diff;
+
+		s = &q->slots[pos & q->mask];
+		diff = (long)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) -
+			      pos);
+
+		if (!diff) {
+			if (__atomic_compare_exchange_n(&q->head, &pos,
+					pos + 1, 1, __ATOMIC_RELAXED,
+					__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			sched_yield();
+			pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+		} else {
+			pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	s->data = data;
+	__atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+	sem_post(&q->items);
+}
+
+void queue_push(struct queue *q, void *data)
+{
+	while (sem_wait(&q->space) < 0)
+		;
+
+	push_reserved(q, data);
+}
+
+int queue_try_push(struct queue *q, void *data)
+{
+	if (sem_trywait(&q->space) < 0)
+		return -1;
+
+	push_reserved(q, data);
+	return 0;
+}
+
+int queue_pending(struct queue *q)
+{
+	int n = 0;
+
+	sem_getvalue(&q->items, &n);
+	return n;
+}
+
+/* Claim the slot at the tail and empty it. As above, the item we've
+ * been promised might belong to a producer which hasn't finished
+ * publishing it yet.
+ */
+void *queue_pop(struct queue *q)
+{
+	struct queue_slot *s;
+	unsigned long pos;
+	void *data;
+
+	while (sem_wait(&q->items) < 0)
+		;
+
+	pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+
+	for (;;) {
+		long diff;
+
+		s = &q->slots[pos & q->mask];
+		diff = (long)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) -
+			      (pos + 1));
+
+		if (!diff) {
+			if (__atomic_compare_exchange_n(&q->tail, &pos,
+					pos + 1, 1, __ATOMIC_RELAXED,
+					__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			sched_yield();
+			pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+		} else {
+			pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	data = s->data;
+	__atomic_store_n(&s->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+	sem_post(&q->space);
+
+	return data;
+}
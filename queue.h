@@ -0,0 +1,68 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef QUEUE_H_
+#define QUEUE_H_
+
+/* Bounded multi-producer, multi-consumer queue of pointers.
+ *
+ * The queue itself is lock-free: each slot carries a sequence number,
+ * and producers and consumers claim slots with a compare-and-swap on
+ * the head or tail counter. A pair of counting semaphores provides
+ * blocking, so a producer waits while the queue is full and a consumer
+ * waits while it's empty. This gives backpressure between pipeline
+ * stages without any thread holding a lock while it works.
+ */
+
+#include <semaphore.h>
+
+struct queue_slot {
+	unsigned long		seq;
+	void			*data;
+};
+
+struct queue {
+	struct queue_slot	*slots;
+	unsigned long		mask;
+	unsigned long		head;
+	unsigned long		tail;
+	sem_t			items;
+	sem_t			space;
+};
+
+/* Create a queue with room for at least the given number of items.
+ * Returns 0 on success or -1 if memory couldn't be allocated.
+ */
+int queue_init(struct queue *q, unsigned int capacity);
+void queue_destroy(struct queue *q);
+
+/* Add an item, waiting for space if necessary. */
+void queue_push(struct queue *q, void *data);
+
+/* Remove an item, waiting until one is available. */
+void *queue_pop(struct queue *q);
+
+/* Add an item if there's space. Returns 0 on success or -1 if the
+ * queue is full.
+ */
+int queue_try_push(struct queue *q, void *data);
+
+/* Return the number of items currently waiting. This is only a hint,
+ * since other threads may change it at any time.
+ */
+int queue_pending(struct queue *q);
+
+#endif
@@ -0,0 +1,619 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "cage.h"
+#include "rating.h"
+
+/* Largest number of ways of filling a group that the combination
+ * technique will try. Groups with more are left until their cells have
+ * fewer candidates.
+ */
+#define RATING_COMBINATIONS_MAX	65536
+
+struct rater {
+	const struct cdok_puzzle	*puzzle;
+	int				size;
+	uint8_t				values[CDOK_CELLS];
+	cdok_set_t			cand[CDOK_CELLS];
+	cdok_set_t			rows[CDOK_SIZE];
+	cdok_set_t			cols[CDOK_SIZE];
+};
+
+static const char *const technique_names[CDOK_TECHNIQUES] = {
+	[CDOK_TECH_NONE]	= "none",
+	[CDOK_TECH_SINGLE]	= "single",
+	[CDOK_TECH_HIDDEN]	= "hidden",
+	[CDOK_TECH_CAGE]	= "cage",
+	[CDOK_TECH_PAIR]	= "pair",
+	[CDOK_TECH_COMBINATION]	= "combination",
+	[CDOK_TECH_LINE_SUM]	= "line-sum",
+	[CDOK_TECH_GUESS]	= "guess"
+};
+
+const char *cdok_technique_name(cdok_technique_t t)
+{
+	if (t < 0 || t >= CDOK_TECHNIQUES)
+		return "unknown";
+
+	return technique_names[t];
+}
+
+/************************************************************************
+ * Bitboards
+ */
+
+/* Place a value, ruling it out for the rest of its row and column.
+ * Returns -1 if it's already placed in either.
+ */
+static int place(struct rater *rt, cdok_pos_t c, int v)
+{
+	const cdok_set_t s = CDOK_SET_SINGLE(v);
+	const int x = CDOK_POS_X(c);
+	const int y = CDOK_POS_Y(c);
+	int i;
+
+	if ((rt->rows[y] | rt->cols[x]) & s)
+		return -1;
+
+	rt->values[c] = v;
+	rt->rows[y] |= s;
+	rt->cols[x] |= s;
+
+	for (i = 0; i < rt->size; i++) {
+		rt->cand[CDOK_POS(i, y)] &= ~s;
+		rt->cand[CDOK_POS(x, i)] &= ~s;
+	}
+
+	rt->cand[c] = s;
+	return 0;
+}
+
+/* Place a value found by a technique, which must still be a candidate.
+ * Returns 1, or -1 if it isn't.
+ */
+static int fix(struct rater *rt, cdok_pos_t c, int v)
+{
+	if (v < 1 || v > rt->size || !(rt->cand[c] & CDOK_SET_SINGLE(v)))
+		return -1;
+
+	return place(rt, c, v) < 0 ? -1 : 1;
+}
+
+/* Narrow the candidates of an empty cell. Returns 1 if anything was
+ * ruled out.
+ */
+static int narrow(struct rater *rt, cdok_pos_t c, cdok_set_t s)
+{
+	if (rt->values[c] || !(rt->cand[c] & ~s))
+		return 0;
+
+	rt->cand[c] &= s;
+	return 1;
+}
+
+static int count_empty(const struct rater *rt)
+{
+	int count = 0;
+	int x, y;
+
+	for (y = 0; y < rt->size; y++)
+		for (x = 0; x < rt->size; x++)
+			if (!rt->values[CDOK_POS(x, y)])
+				count++;
+
+	return count;
+}
+
+/************************************************************************
+ * Techniques
+ *
+ * Each technique makes at most one step, and returns 1 if it made
+ * progress, 0 if it found nothing to do, or -1 if it found that the
+ * puzzle has no solution.
+ */
+
+static int tech_single(struct rater *rt)
+{
+	int x, y;
+
+	for (y = 0; y < rt->size; y++)
+		for (x = 0; x < rt->size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+			const cdok_set_t s = rt->cand[c];
+
+			if (rt->values[c])
+				continue;
+
+			if (!s)
+				return -1;
+
+			if (!(s & (s - 1)))
+				return fix(rt, c, __builtin_ctz(s) + 1);
+		}
+
+	return 0;
+}
+
+/* Check a line, given its first cell, the step between cells and the
+ * values already placed in it. The places each value may go are
+ * collected as a bitboard of positions along the line.
+ */
+static int hidden_line(struct rater *rt, cdok_pos_t start, int step,
+		       cdok_set_t placed)
+{
+	cdok_set_t places[CDOK_SIZE] = {0};
+	int i;
+
+	for (i = 0; i < rt->size; i++) {
+		const cdok_pos_t c = start + i * step;
+		cdok_set_t s;
+
+		if (rt->values[c])
+			continue;
+
+		for (s = rt->cand[c]; s; s &= s - 1)
+			places[__builtin_ctz(s)] |= 1 << i;
+	}
+
+	for (i = 0; i < rt->size; i++) {
+		const cdok_set_t p = places[i];
+
+		if (placed & (1 << i))
+			continue;
+
+		if (!p)
+			return -1;
+
+		if (!(p & (p - 1)))
+			return fix(rt, start + __builtin_ctz(p) * step, i + 1);
+	}
+
+	return 0;
+}
+
+static int tech_hidden(struct rater *rt)
+{
+	int i;
+
+	for (i = 0; i < rt->size; i++) {
+		int r = hidden_line(rt, CDOK_POS(0, i), CDOK_POS(1, 0),
+				    rt->rows[i]);
+
+		if (!r)
+			r = hidden_line(rt, CDOK_POS(i, 0), CDOK_POS(0, 1),
+					rt->cols[i]);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+static int group_is_open(const struct cdok_group *g, const uint8_t *values)
+{
+	int i;
+
+	for (i = 0; i < g->size; i++)
+		if (!values[g->members[i]])
+			return 1;
+
+	return 0;
+}
+
+static int tech_cage(struct rater *rt)
+{
+	int i;
+
+	for (i = 0; i < CDOK_GROUPS; i++) {
+		const struct cdok_group *g = &rt->puzzle->groups[i];
+		cdok_set_t s;
+		int changed = 0;
+		int j;
+
+		if (!g->size)
+			continue;
+
+		if (!group_is_open(g, rt->values)) {
+			if (!cdok_group_satisfied(g, rt->values))
+				return -1;
+			continue;
+		}
+
+		s = cdok_group_candidates(g, rt->values, rt->size);
+		for (j = 0; j < g->size; j++)
+			changed |= narrow(rt, g->members[j], s);
+
+		if (changed)
+			return 1;
+	}
+
+	return 0;
+}
+
+static int pair_line(struct rater *rt, cdok_pos_t start, int step)
+{
+	int i, j, k;
+
+	for (i = 0; i < rt->size; i++) {
+		const cdok_pos_t a = start + i * step;
+		const cdok_set_t s = rt->cand[a];
+
+		if (rt->values[a] || __builtin_popcount(s) != 2)
+			continue;
+
+		for (j = i + 1; j < rt->size; j++) {
+			const cdok_pos_t b = start + j * step;
+			int changed = 0;
+
+			if (rt->values[b] || rt->cand[b] != s)
+				continue;
+
+			for (k = 0; k < rt->size; k++)
+				if (k != i && k != j)
+					changed |= narrow(rt, start + k * step,
+							  ~s);
+
+			if (changed)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int tech_pair(struct rater *rt)
+{
+	int i;
+
+	for (i = 0; i < rt->size; i++)
+		if (pair_line(rt, CDOK_POS(0, i), CDOK_POS(1, 0)) ||
+		    pair_line(rt, CDOK_POS(i, 0), CDOK_POS(0, 1)))
+			return 1;
+
+	return 0;
+}
+
+/* Combinations: every filling of a group's empty cells from their
+ * candidates, with no value repeated in a row or column, is checked
+ * against the target.
+ */
+struct combination {
+	const struct rater		*rater;
+	const struct cdok_group		*group;
+	cdok_pos_t			cells[CDOK_GROUP_SIZE];
+	int				count;
+	cdok_set_t			seen[CDOK_GROUP_SIZE];
+	uint8_t				values[CDOK_CELLS];
+};
+
+static void combination_fill(struct combination *cb, int i, int sum)
+{
+	const struct cdok_group *g = cb->group;
+	cdok_pos_t c;
+	cdok_set_t s;
+
+	if (i == cb->count) {
+		int k;
+
+		if (!cdok_group_satisfied(g, cb->values))
+			return;
+
+		for (k = 0; k < cb->count; k++) {
+			c = cb->cells[k];
+			cb->seen[k] |= CDOK_SET_SINGLE(cb->values[c]);
+		}
+		return;
+	}
+
+	c = cb->cells[i];
+
+	for (s = cb->rater->cand[c]; s; s &= s - 1) {
+		const int v = __builtin_ctz(s) + 1;
+		int k;
+
+		/* Each cell still to be filled needs at least 1 */
+		if (g->type == CDOK_SUM &&
+		    sum + v + (cb->count - i - 1) > g->target)
+			break;
+
+		for (k = 0; k < i; k++) {
+			const cdok_pos_t o = cb->cells[k];
+
+			if (cb->values[o] == v &&
+			    (CDOK_POS_X(o) == CDOK_POS_X(c) ||
+			     CDOK_POS_Y(o) == CDOK_POS_Y(c)))
+				break;
+		}
+
+		if (k < i)
+			continue;
+
+		cb->values[c] = v;
+		combination_fill(cb, i + 1, sum + v);
+	}
+
+	cb->values[c] = 0;
+}
+
+static int combination_group(struct rater *rt, const struct cdok_group *g)
+{
+	struct combination cb;
+	long ways = 1;
+	int changed = 0;
+	int sum = 0;
+	int i;
+
+	cb.rater = rt;
+	cb.group = g;
+	cb.count = 0;
+
+	for (i = 0; i < g->size; i++) {
+		const cdok_pos_t c = g->members[i];
+
+		if (rt->values[c]) {
+			sum += rt->values[c];
+			continue;
+		}
+
+		ways *= __builtin_popcount(rt->cand[c]);
+		if (ways > RATING_COMBINATIONS_MAX)
+			return 0;
+
+		cb.seen[cb.count] = 0;
+		cb.cells[cb.count++] = c;
+	}
+
+	if (!cb.count)
+		return 0;
+
+	memcpy(cb.values, rt->values, sizeof(cb.values));
+	combination_fill(&cb, 0, sum);
+
+	for (i = 0; i < cb.count; i++) {
+		if (!cb.seen[i])
+			return -1;
+
+		changed |= narrow(rt, cb.cells[i], cb.seen[i]);
+	}
+
+	return changed;
+}
+
+static int tech_combination(struct rater *rt)
+{
+	int i;
+
+	for (i = 0; i < CDOK_GROUPS; i++) {
+		const struct cdok_group *g = &rt->puzzle->groups[i];
+		int r;
+
+		if (!g->size)
+			continue;
+
+		r = combination_group(rt, g);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+/* Line sums. The cells of a band of whole rows (or columns) hold each
+ * value once per line. If the sum groups lying wholly inside the band
+ * cover all of its empty cells but one, that one is fixed by what's
+ * left of the total (an "innie"). If the sum groups which stick out of
+ * the band cover the rest, the cells sticking out add up to a known
+ * amount, which fixes the last of them (an "outie").
+ */
+static int in_band(cdok_pos_t c, int vertical, int lo, int hi)
+{
+	const int k = vertical ? CDOK_POS_X(c) : CDOK_POS_Y(c);
+
+	return k >= lo && k < hi;
+}
+
+static int band_sum(struct rater *rt, int vertical, int lo, int hi)
+{
+	const struct cdok_puzzle *puz = rt->puzzle;
+	const int size = rt->size;
+	const int total = (hi - lo) * size * (size + 1) / 2;
+	uint64_t inside = 0;
+	uint64_t partial = 0;
+	int inside_sum = 0;
+	int partial_sum = 0;
+	int known = 0;
+	int other = 0;
+	int covered = 1;
+	int empty = 0;
+	int outside;
+	cdok_pos_t last = -1;
+	int i, j;
+
+	for (i = 0; i < CDOK_GROUPS; i++) {
+		const struct cdok_group *g = &puz->groups[i];
+		int n = 0;
+
+		if (!g->size || g->type != CDOK_SUM)
+			continue;
+
+		for (j = 0; j < g->size; j++)
+			n += in_band(g->members[j], vertical, lo, hi);
+
+		if (n == g->size) {
+			inside |= 1ULL << i;
+			inside_sum += g->target;
+		} else if (n) {
+			partial |= 1ULL << i;
+			partial_sum += g->target;
+		}
+	}
+
+	for (i = 0; i < size; i++)
+		for (j = lo; j < hi; j++) {
+			const cdok_pos_t c = vertical ?
+				CDOK_POS(j, i) : CDOK_POS(i, j);
+			const uint8_t g = puz->group_map[c];
+			const int sticks_out = g != CDOK_GROUP_NONE &&
+				(partial & (1ULL << g));
+
+			if (g != CDOK_GROUP_NONE && (inside & (1ULL << g)))
+				continue;
+
+			if (rt->values[c]) {
+				known += rt->values[c];
+				if (!sticks_out)
+					other += rt->values[c];
+			} else {
+				empty++;
+				last = c;
+				if (!sticks_out)
+					covered = 0;
+			}
+		}
+
+	if (empty == 1)
+		return fix(rt, last, total - inside_sum - known);
+
+	/* Every empty cell left must be in a group sticking out */
+	if (!partial || !covered)
+		return 0;
+
+	outside = partial_sum - total + inside_sum + other;
+	empty = 0;
+
+	for (i = 0; i < CDOK_GROUPS; i++) {
+		const struct cdok_group *g = &puz->groups[i];
+
+		if (!(partial & (1ULL << i)))
+			continue;
+
+		for (j = 0; j < g->size; j++) {
+			const cdok_pos_t c = g->members[j];
+
+			if (in_band(c, vertical, lo, hi))
+				continue;
+
+			if (rt->values[c]) {
+				outside -= rt->values[c];
+			} else {
+				empty++;
+				last = c;
+			}
+		}
+	}
+
+	if (empty == 1)
+		return fix(rt, last, outside);
+
+	return 0;
+}
+
+static int tech_line_sum(struct rater *rt)
+{
+	int vertical, lo, hi;
+
+	for (vertical = 0; vertical < 2; vertical++)
+		for (lo = 0; lo < rt->size; lo++)
+			for (hi = lo + 1; hi <= rt->size; hi++) {
+				const int r = band_sum(rt, vertical, lo, hi);
+
+				if (r)
+					return r;
+			}
+
+	return 0;
+}
+
+/************************************************************************
+ * Rating
+ */
+
+typedef int (*technique_fn)(struct rater *rt);
+
+static const technique_fn techniques[CDOK_TECHNIQUES] = {
+	[CDOK_TECH_SINGLE]	= tech_single,
+	[CDOK_TECH_HIDDEN]	= tech_hidden,
+	[CDOK_TECH_CAGE]	= tech_cage,
+	[CDOK_TECH_PAIR]	= tech_pair,
+	[CDOK_TECH_COMBINATION]	= tech_combination,
+	[CDOK_TECH_LINE_SUM]	= tech_line_sum
+};
+
+int cdok_rate(const struct cdok_puzzle *puz, struct cdok_rating *r)
+{
+	struct rater rt;
+	int x, y;
+	int i;
+
+	memset(r, 0, sizeof(*r));
+	memset(&rt, 0, sizeof(rt));
+	rt.puzzle = puz;
+	rt.size = puz->size;
+
+	for (y = 0; y < rt.size; y++)
+		for (x = 0; x < rt.size; x++)
+			rt.cand[CDOK_POS(x, y)] = CDOK_SET_ONES(rt.size);
+
+	for (y = 0; y < rt.size; y++)
+		for (x = 0; x < rt.size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+
+			if (puz->values[c] && place(&rt, c, puz->values[c]) < 0)
+				return -1;
+		}
+
+	for (;;) {
+		cdok_technique_t t;
+		int res = 0;
+
+		r->unsolved = count_empty(&rt);
+		if (!r->unsolved)
+			break;
+
+		for (t = CDOK_TECH_SINGLE; t < CDOK_TECH_GUESS; t++) {
+			res = techniques[t](&rt);
+			if (res)
+				break;
+		}
+
+		if (res < 0)
+			return -1;
+
+		if (t == CDOK_TECH_GUESS) {
+			r->hardest = CDOK_TECH_GUESS;
+			return 1;
+		}
+
+		r->steps++;
+		r->uses[t]++;
+		if (t > r->hardest)
+			r->hardest = t;
+	}
+
+	/* Every step was forced, so the full grid is the only possible
+	 * solution. It still has to satisfy every group.
+	 */
+	for (i = 0; i < CDOK_GROUPS; i++) {
+		const struct cdok_group *g = &puz->groups[i];
+
+		if (g->size && !cdok_group_satisfied(g, rt.values))
+			return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef RATING_H_
+#define RATING_H_
+
+/* Technique ratings. The solver's difficulty score comes from the
+ * shape of a backtracking search, so it needs a full search and
+ * depends on the order values are tried in. A rating instead solves
+ * the puzzle the way a person would, applying the easiest technique
+ * on the ladder below which makes progress, and starting again from
+ * the bottom after every step. The puzzle is rated by the hardest
+ * technique it needed and the number of steps taken.
+ *
+ * The techniques, from easiest to hardest, are:
+ *
+ *    single:      a cell has only one candidate left
+ *    hidden:      a value has only one place left in a row or column
+ *    cage:        a group's target rules out values for its cells,
+ *                 as in the solver's own group analysis
+ *    pair:        two cells in a row or column share the same two
+ *                 candidates, which are then ruled out for the rest
+ *    combination: every way of filling a group is tried against its
+ *                 cells' candidates, keeping only values which appear
+ *                 in some way
+ *    line-sum:    the values of a band of rows or columns add up to a
+ *                 known total, which fixes the one cell inside (or
+ *                 sticking out of) the sum groups covering it
+ *
+ * Candidates are kept as bitboards, one set of values per cell and one
+ * set of placed values per row and column, so every step is cheap. If
+ * nothing on the ladder makes progress, the puzzle needs guessing, and
+ * the rating stops there.
+ */
+
+#include "cdok.h"
+
+typedef enum {
+	CDOK_TECH_NONE,
+	CDOK_TECH_SINGLE,
+	CDOK_TECH_HIDDEN,
+	CDOK_TECH_CAGE,
+	CDOK_TECH_PAIR,
+	CDOK_TECH_COMBINATION,
+	CDOK_TECH_LINE_SUM,
+	CDOK_TECH_GUESS,
+	CDOK_TECHNIQUES
+} cdok_technique_t;
+
+/* Result of a rating:
+ *
+ *    hardest:  hardest technique needed (CDOK_TECH_NONE if the grid was
+ *              full to start with, or CDOK_TECH_GUESS if the rating got
+ *              stuck)
+ *    steps:    number of steps taken
+ *    uses:     steps taken with each technique
+ *    unsolved: empty cells left when the rating stopped
+ */
+struct cdok_rating {
+	cdok_technique_t	hardest;
+	unsigned int		steps;
+	unsigned int		uses[CDOK_TECHNIQUES];
+	unsigned int		unsolved;
+};
+
+/* Rate a puzzle. Returns 0 if it was solved without guessing, which
+ * also shows that the solution is unique, 1 if it needs guessing, or
+ * -1 if a contradiction was found, so that it has no solution.
+ */
+int cdok_rate(const struct cdok_puzzle *puz, struct cdok_rating *r);
+
+/* Name of a technique, as listed above ("none" and "guess" for the
+ * ends of the ladder).
+ */
+const char *cdok_technique_name(cdok_technique_t t);
+
+#endif
@@ -0,0 +1,268 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "report.h"
+#include "backbone.h"
+
+uint64_t report_time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void report_begin(struct cdok_json *j, FILE *out,
+		  const char *command, int size)
+{
+	cdok_json_init(j, out);
+	cdok_json_begin_object(j, NULL);
+	cdok_json_string(j, "command", command, strlen(command));
+	cdok_json_int(j, "size", size);
+}
+
+void report_end(struct cdok_json *j, uint64_t elapsed)
+{
+	cdok_json_int(j, "time_us", elapsed);
+	cdok_json_end_object(j);
+	cdok_json_end_record(j);
+}
+
+void report_stats(struct cdok_json *j, const char *key,
+		  const struct cdok_solve_stats *st)
+{
+	static const char *const group_names[CDOK_STATS_GROUP_TYPES] = {
+		[CDOK_STATS_SUM]	= "sum",
+		[CDOK_STATS_DIFFERENCE]	= "difference",
+		[CDOK_STATS_PRODUCT]	= "product",
+		[CDOK_STATS_RATIO]	= "ratio"
+	};
+	int max_branch = CDOK_SIZE;
+	int i;
+
+	while (max_branch > 0 && !st->branches[max_branch])
+		max_branch--;
+
+	cdok_json_begin_object(j, key);
+	cdok_json_int(j, "nodes", st->nodes);
+	cdok_json_int(j, "backtracks", st->backtracks);
+	cdok_json_int(j, "max_depth", st->max_depth);
+
+	/* Indexed by branching factor */
+	cdok_json_begin_array(j, "branching");
+	for (i = 0; i <= max_branch; i++)
+		cdok_json_int(j, NULL, st->branches[i]);
+	cdok_json_end_array(j);
+
+	cdok_json_begin_object(j, "groups");
+	for (i = 0; i < CDOK_STATS_GROUP_TYPES; i++) {
+		cdok_json_begin_object(j, group_names[i]);
+		cdok_json_int(j, "calls", st->group_calls[i]);
+		cdok_json_int(j, "time_ns", st->group_ns[i]);
+		cdok_json_end_object(j);
+	}
+	cdok_json_end_object(j);
+
+	cdok_json_int(j, "propagate_ns", st->propagate_ns);
+	cdok_json_int(j, "search_ns", st->search_ns);
+	cdok_json_end_object(j);
+}
+
+void report_solve(FILE *out, const char *command, long index,
+		  const struct cdok_puzzle *puz, const uint8_t *solution,
+		  const struct cdok_solve_stats *stats,
+		  int r, int diff, uint64_t elapsed)
+{
+	struct cdok_json j;
+
+	report_begin(&j, out, command, puz->size);
+	if (index >= 0)
+		cdok_json_int(&j, "index", index);
+	cdok_json_spec(&j, "spec", puz);
+	cdok_json_bool(&j, "solvable", r >= 0);
+
+	if (r >= 0) {
+		cdok_json_bool(&j, "unique", !r);
+		cdok_json_int(&j, "difficulty", diff);
+		if (solution)
+			cdok_json_grid(&j, "solution", puz->size, solution);
+	}
+
+	if (stats)
+		report_stats(&j, "stats", stats);
+
+	report_end(&j, elapsed);
+}
+
+void report_solution(FILE *out, const char *command, int size,
+		     uint64_t number, const uint8_t *solution,
+		     uint64_t elapsed)
+{
+	struct cdok_json j;
+
+	report_begin(&j, out, command, size);
+	cdok_json_int(&j, "number", number);
+	cdok_json_grid(&j, "solution", size, solution);
+	report_end(&j, elapsed);
+}
+
+void report_solutions(FILE *out, const char *command, long index,
+		      const struct cdok_puzzle *puz, uint64_t count,
+		      int complete, uint64_t elapsed)
+{
+	struct cdok_json j;
+
+	report_begin(&j, out, command, puz->size);
+	if (index >= 0)
+		cdok_json_int(&j, "index", index);
+	cdok_json_spec(&j, "spec", puz);
+	cdok_json_bool(&j, "solvable", count > 0);
+	cdok_json_int(&j, "solutions", count > INT64_MAX ? INT64_MAX : count);
+	cdok_json_bool(&j, "complete", complete);
+	report_end(&j, elapsed);
+}
+
+void report_backbone(FILE *out, const char *command, long index,
+		     const struct cdok_puzzle *puz, const cdok_set_t *possible,
+		     int r, uint64_t elapsed)
+{
+	struct cdok_json j;
+	int x, y;
+
+	report_begin(&j, out, command, puz->size);
+	if (index >= 0)
+		cdok_json_int(&j, "index", index);
+	cdok_json_spec(&j, "spec", puz);
+	cdok_json_bool(&j, "solvable", r >= 0);
+
+	if (r >= 0) {
+		cdok_json_int(&j, "forced",
+			      cdok_backbone_forced(puz, possible));
+
+		cdok_json_begin_array(&j, "backbone");
+		for (y = 0; y < puz->size; y++) {
+			cdok_json_begin_array(&j, NULL);
+			for (x = 0; x < puz->size; x++) {
+				cdok_set_t s = possible[CDOK_POS(x, y)];
+
+				cdok_json_begin_array(&j, NULL);
+				for (; s; s &= s - 1)
+					cdok_json_int(&j, NULL,
+						      __builtin_ctz(s) + 1);
+				cdok_json_end_array(&j);
+			}
+			cdok_json_end_array(&j);
+		}
+		cdok_json_end_array(&j);
+	}
+
+	report_end(&j, elapsed);
+}
+
+void report_rating(FILE *out, const char *command, long index,
+		   const struct cdok_puzzle *puz,
+		   const struct cdok_rating *rating, int r, uint64_t elapsed)
+{
+	const char *name = cdok_technique_name(rating->hardest);
+	struct cdok_json j;
+	int i;
+
+	report_begin(&j, out, command, puz->size);
+	if (index >= 0)
+		cdok_json_int(&j, "index", index);
+	cdok_json_spec(&j, "spec", puz);
+
+	if (r <= 0)
+		cdok_json_bool(&j, "solvable", !r);
+
+	if (r >= 0) {
+		cdok_json_string(&j, "technique", name, strlen(name));
+		cdok_json_int(&j, "steps", rating->steps);
+
+		cdok_json_begin_object(&j, "uses");
+		for (i = CDOK_TECH_SINGLE; i < CDOK_TECH_GUESS; i++)
+			cdok_json_int(&j, cdok_technique_name(i),
+				      rating->uses[i]);
+		cdok_json_end_object(&j);
+
+		if (r)
+			cdok_json_int(&j, "unsolved", rating->unsolved);
+	}
+
+	report_end(&j, elapsed);
+}
+
+void report_verify(FILE *out, const char *command, long index,
+		   const struct cdok_puzzle *puz,
+		   const struct cdok_violation *v, uint64_t elapsed)
+{
+	const char *name = cdok_verify_name(v->rule);
+	struct cdok_json j;
+
+	report_begin(&j, out, command, puz->size);
+	if (index >= 0)
+		cdok_json_int(&j, "index", index);
+	cdok_json_bool(&j, "correct", v->rule == CDOK_VERIFY_OK);
+
+	if (v->rule != CDOK_VERIFY_OK) {
+		cdok_json_begin_object(&j, "violation");
+		cdok_json_string(&j, "rule", name, strlen(name));
+		cdok_json_int(&j, "x", CDOK_POS_X(v->cell));
+		cdok_json_int(&j, "y", CDOK_POS_Y(v->cell));
+
+		if (v->group != CDOK_GROUP_NONE) {
+			const char g = cdok_group_to_char(v->group);
+
+			cdok_json_string(&j, "group", &g, 1);
+		}
+
+		cdok_json_end_object(&j);
+	}
+
+	report_end(&j, elapsed);
+}
+
+void report_generate(FILE *out, const char *command,
+		     const struct cdok_puzzle *puz, const uint8_t *solution,
+		     int diff, uint64_t elapsed)
+{
+	struct cdok_json j;
+
+	report_begin(&j, out, command, puz->size);
+	cdok_json_spec(&j, "spec", puz);
+	cdok_json_grid(&j, "solution", puz->size, solution);
+	cdok_json_int(&j, "difficulty", diff);
+	report_end(&j, elapsed);
+}
+
+void report_error(FILE *out, const char *command, long index,
+		  const char *message)
+{
+	struct cdok_json j;
+
+	cdok_json_init(&j, out);
+	cdok_json_begin_object(&j, NULL);
+	if (command)
+		cdok_json_string(&j, "command", command, strlen(command));
+	if (index >= 0)
+		cdok_json_int(&j, "index", index);
+	cdok_json_string(&j, "error", message, strlen(message));
+	cdok_json_end_object(&j);
+	cdok_json_end_record(&j);
+}
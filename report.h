@@ -0,0 +1,138 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef REPORT_H_
+#define REPORT_H_
+
+/* Machine-readable result records. Every command which produces
+ * NDJSON output, and every reply from the server and co-process modes,
+ * is a single JSON object built with these functions, so that all
+ * consumers see the same schema:
+ *
+ *    command:    the command which produced the record
+ *    index:      position of the puzzle in a batch (batch mode only)
+ *    size:       grid size
+ *    spec:       puzzle spec, in the format accepted by the parser
+ *    solvable:   whether any solution exists
+ *    unique:     whether the solution is unique
+ *    difficulty: difficulty score
+ *    solution:   solution grid, as an array of rows
+ *    count:      number of puzzles a shard request generated
+ *    puzzles:    the puzzles of a shard which were kept, each with its
+ *                number, spec, solution and difficulty
+ *    number:     position of a solution in an enumeration, from 1, or
+ *                of a puzzle in a shard, from 0
+ *    solutions:  number of solutions an enumeration found, or the
+ *                number counted (examine --count-solutions)
+ *    complete:   whether that's every solution, rather than stopping
+ *                at a limit, or too many to count
+ *    forced:     number of empty cells with only one possible value
+ *    backbone:   values each cell takes in some solution, as an array
+ *                of rows of arrays (examine --backbone)
+ *    technique:  hardest technique a rating needed (see rating.h)
+ *    steps:      number of steps a rating took
+ *    uses:       steps taken with each technique, by name
+ *    unsolved:   empty cells left when a rating needed guessing
+ *    correct:    whether an answer grid solves the puzzle (verify)
+ *    violation:  the first rule an answer breaks (see verify.h): an
+ *                object with the rule name, and the cell (x and y) and
+ *                group involved, where they apply
+ *    stats:      solver search statistics (see solver.h), if asked for
+ *    bench:      timings for one benchmarked operation (see bench.h)
+ *    time_us:    time spent on the command, in microseconds
+ *    error:      error message, if the command failed
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "cdok.h"
+#include "solver.h"
+#include "verify.h"
+#include "rating.h"
+#include "json.h"
+
+/* Monotonic clock, in microseconds. */
+uint64_t report_time_us(void);
+
+/* Open a record and write the command and size. Further fields may be
+ * added before the record is closed by report_end().
+ */
+void report_begin(struct cdok_json *j, FILE *out,
+		  const char *command, int size);
+
+/* Write the elapsed time and close the record. */
+void report_end(struct cdok_json *j, uint64_t elapsed);
+
+/* Write the result of solving or examining a puzzle. The solution and
+ * stats may be NULL if they're not wanted, and the index is omitted if
+ * negative.
+ */
+void report_solve(FILE *out, const char *command, long index,
+		  const struct cdok_puzzle *puz, const uint8_t *solution,
+		  const struct cdok_solve_stats *stats,
+		  int r, int diff, uint64_t elapsed);
+
+/* Write one solution found by enumeration (solve --all). The elapsed
+ * time is from the start of the enumeration.
+ */
+void report_solution(FILE *out, const char *command, int size,
+		     uint64_t number, const uint8_t *solution,
+		     uint64_t elapsed);
+
+/* Write the number of solutions found by enumerating or counting
+ * them, and whether that's all of them. The index is omitted if
+ * negative.
+ */
+void report_solutions(FILE *out, const char *command, long index,
+		      const struct cdok_puzzle *puz, uint64_t count,
+		      int complete, uint64_t elapsed);
+
+/* Write the backbone of a puzzle (see backbone.h). The index is
+ * omitted if negative.
+ */
+void report_backbone(FILE *out, const char *command, long index,
+		     const struct cdok_puzzle *puz, const cdok_set_t *possible,
+		     int r, uint64_t elapsed);
+
+/* Write the rating of a puzzle, as returned by cdok_rate(). The puzzle
+ * is only known to be solvable if it was solved without guessing. The
+ * index is omitted if negative.
+ */
+void report_rating(FILE *out, const char *command, long index,
+		   const struct cdok_puzzle *puz,
+		   const struct cdok_rating *rating, int r, uint64_t elapsed);
+
+/* Write the result of verifying an answer grid. The index is omitted
+ * if negative.
+ */
+void report_verify(FILE *out, const char *command, long index,
+		   const struct cdok_puzzle *puz,
+		   const struct cdok_violation *v, uint64_t elapsed);
+
+/* Write solver statistics as an object under the given key. */
+void report_stats(struct cdok_json *j, const char *key,
+		  const struct cdok_solve_stats *st);
+
+/* Write a generated puzzle and its solution. */
+void report_generate(FILE *out, const char *command,
+		     const struct cdok_puzzle *puz, const uint8_t *solution,
+		     int diff, uint64_t elapsed);
+
+/* Write an error record. The index is omitted if negative. */
+void report_error(FILE *out, const char *command, long index,
+		  const char *message);
+
+#endif
@@ -0,0 +1,415 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "queue.h"
+#include "net.h"
+#include "pool.h"
+#include "server.h"
+
+/* A request in flight. Each connection owns one of these and reuses
+ * it for every request it carries. The reply is rendered into a memory
+ * stream, and the done semaphore is posted when it's ready.
+ */
+struct request {
+	char			*text;
+	size_t			text_size;
+
+	FILE			*out;
+	char			*out_buf;
+	size_t			out_size;
+	size_t			out_len;
+
+	sem_t			done;
+};
+
+/* Open connections are kept on a list, so that they can be shut down
+ * when the server stops. The list and count are protected by the lock.
+ */
+struct connection;
+struct worker;
+
+struct server {
+	const struct service_params	*defaults;
+	struct pool_set			*pools;
+	struct cache			*cache;
+	struct cdok_trace		*trace;
+	unsigned int			trace_sample;
+	struct queue			work;
+
+	struct worker			*workers;
+	int				worker_count;
+	int				stopping;
+
+	pthread_mutex_t			lock;
+	pthread_cond_t			closed;
+	struct connection		*connections;
+	int				connection_count;
+};
+
+struct connection {
+	struct server		*srv;
+	int			fd;
+	struct connection	*prev;
+	struct connection	*next;
+};
+
+struct worker {
+	struct server		*srv;
+	struct service_worker	state;
+	pthread_t		tid;
+};
+
+static volatile sig_atomic_t want_exit;
+
+static void on_signal(int sig)
+{
+	want_exit = 1;
+}
+
+/* Refill puzzle pools until a request arrives or there's nothing left
+ * to do. If other pools could be refilled at the same time, wake
+ * another worker to help. The wakeup is a NULL request.
+ */
+static void refill_pools(struct worker *w)
+{
+	int more = 0;
+
+	while (!queue_pending(&w->srv->work) &&
+	       !__atomic_load_n(&w->srv->stopping, __ATOMIC_ACQUIRE) &&
+	       pool_refill(w->srv->pools, &w->state.gen, &more))
+		if (more)
+			queue_try_push(&w->srv->work, NULL);
+}
+
+static void *worker_main(void *arg)
+{
+	struct worker *w = arg;
+
+	for (;;) {
+		struct request *req;
+
+		if (w->srv->pools)
+			refill_pools(w);
+
+		/* A NULL request is a wakeup, or a signal to stop */
+		req = queue_pop(&w->srv->work);
+		if (!req) {
+			if (__atomic_load_n(&w->srv->stopping,
+					    __ATOMIC_ACQUIRE))
+				break;
+			continue;
+		}
+
+		fseeko(req->out, 0, SEEK_SET);
+		service_handle(w->srv->defaults, &w->state, req->text,
+			       req->out);
+		fflush(req->out);
+		req->out_len = ftello(req->out);
+
+		sem_post(&req->done);
+	}
+
+	return NULL;
+}
+
+/* Start a thread with SIGINT and SIGTERM blocked, so that they're
+ * always delivered to the accepting thread and interrupt accept().
+ */
+static int start_thread(pthread_t *tid, void *(*func)(void *), void *arg)
+{
+	sigset_t set;
+	sigset_t old;
+	int r;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &set, &old);
+	r = pthread_create(tid, NULL, func, arg);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	return r;
+}
+
+/* Remove a connection from the list. Called with the lock held. */
+static void unlink_connection(struct connection *c)
+{
+	struct server *srv = c->srv;
+
+	if (c->prev)
+		c->prev->next = c->next;
+	else
+		srv->connections = c->next;
+
+	if (c->next)
+		c->next->prev = c->prev;
+
+	srv->connection_count--;
+}
+
+/* Connection threads do nothing but move frames between the socket
+ * and the worker pool.
+ */
+static void *connection_main(void *arg)
+{
+	struct connection *c = arg;
+	struct request req;
+
+	memset(&req, 0, sizeof(req));
+	sem_init(&req.done, 0, 0);
+	req.out = open_memstream(&req.out_buf, &req.out_size);
+
+	while (req.out && net_read_frame(c->fd, &req.text, &req.text_size,
+					 SERVER_MAX_FRAME) >= 0) {
+		queue_push(&c->srv->work, &req);
+		while (sem_wait(&req.done) < 0)
+			;
+
+		if (net_write_frame(c->fd, req.out_buf, req.out_len) < 0)
+			break;
+	}
+
+	if (req.out)
+		fclose(req.out);
+	free(req.out_buf);
+	free(req.text);
+	sem_destroy(&req.done);
+
+	pthread_mutex_lock(&c->srv->lock);
+	unlink_connection(c);
+	pthread_cond_signal(&c->srv->closed);
+	pthread_mutex_unlock(&c->srv->lock);
+
+	close(c->fd);
+	free(c);
+
+	return NULL;
+}
+
+static void stop_workers(struct server *srv)
+{
+	int i;
+
+	__atomic_store_n(&srv->stopping, 1, __ATOMIC_RELEASE);
+
+	for (i = 0; i < srv->worker_count; i++)
+		queue_push(&srv->work, NULL);
+
+	for (i = 0; i < srv->worker_count; i++)
+		pthread_join(srv->workers[i].tid, NULL);
+
+	free(srv->workers);
+	srv->workers = NULL;
+	srv->worker_count = 0;
+}
+
+static int start_workers(struct server *srv, int threads, uint64_t seed)
+{
+	int i;
+
+	srv->workers = malloc(threads * sizeof(srv->workers[0]));
+	if (!srv->workers)
+		return -1;
+
+	for (i = 0; i < threads; i++) {
+		struct worker *w = &srv->workers[i];
+
+		w->srv = srv;
+		w->state.pools = srv->pools;
+		w->state.cache = srv->cache;
+		w->state.trace = srv->trace;
+		w->state.trace_sample = srv->trace_sample;
+		w->state.trace_count = 0;
+		cdok_gen_init(&w->state.gen,
+			      seed + i * 0x9e3779b97f4a7c15ULL);
+
+		if (start_thread(&w->tid, worker_main, w)) {
+			stop_workers(srv);
+			return -1;
+		}
+
+		srv->worker_count++;
+	}
+
+	return 0;
+}
+
+/* Accept connections until we're interrupted, starting a detached
+ * thread for each one.
+ */
+static void accept_loop(struct server *srv, int lfd)
+{
+	while (!want_exit) {
+		struct connection *c;
+		pthread_t tid;
+		int fd = accept(lfd, NULL, NULL);
+
+		if (fd < 0) {
+			if (errno != EINTR && errno != ECONNABORTED)
+				fprintf(stderr, "accept: %s\n",
+					strerror(errno));
+			continue;
+		}
+
+		c = malloc(sizeof(*c));
+		if (!c) {
+			close(fd);
+			continue;
+		}
+
+		c->srv = srv;
+		c->fd = fd;
+		c->prev = NULL;
+
+		pthread_mutex_lock(&srv->lock);
+		c->next = srv->connections;
+		if (c->next)
+			c->next->prev = c;
+		srv->connections = c;
+		srv->connection_count++;
+
+		if (start_thread(&tid, connection_main, c)) {
+			unlink_connection(c);
+			close(fd);
+			free(c);
+		} else {
+			pthread_detach(tid);
+		}
+
+		pthread_mutex_unlock(&srv->lock);
+	}
+}
+
+/* Stop reading from every connection, and wait for them to close.
+ * Requests already in progress are answered first.
+ */
+static void close_connections(struct server *srv)
+{
+	struct connection *c;
+
+	pthread_mutex_lock(&srv->lock);
+
+	for (c = srv->connections; c; c = c->next)
+		shutdown(c->fd, SHUT_RD);
+
+	while (srv->connection_count)
+		pthread_cond_wait(&srv->closed, &srv->lock);
+
+	pthread_mutex_unlock(&srv->lock);
+}
+
+int server_run(const struct server_config *cfg)
+{
+	struct server srv;
+	struct pool_set pools;
+	int threads = cfg->threads;
+	struct sigaction sa;
+	int lfd;
+	int r = -1;
+	int i;
+
+	if (threads <= 0) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+		threads = n > 0 ? n : 1;
+	}
+
+	memset(&srv, 0, sizeof(srv));
+	srv.defaults = cfg->defaults;
+	srv.cache = cfg->cache;
+	srv.trace = cfg->trace;
+	srv.trace_sample = cfg->trace_sample;
+	if (queue_init(&srv.work, 256) < 0) {
+		fprintf(stderr, "server: out of memory\n");
+		return -1;
+	}
+
+	pthread_mutex_init(&srv.lock, NULL);
+	pthread_cond_init(&srv.closed, NULL);
+
+	if (cfg->pool_depth && threads < 2 && cfg->pool_count)
+		fprintf(stderr, "warning: pools need at least two workers\n");
+
+	if (cfg->pool_depth && threads >= 2) {
+		if (pool_set_init(&pools, cfg->pool_depth, threads - 1) < 0) {
+			fprintf(stderr, "server: can't create pools\n");
+			goto fail;
+		}
+
+		srv.pools = &pools;
+
+		for (i = 0; i < cfg->pool_count; i++) {
+			struct pool_key key;
+
+			service_pool_key(&cfg->pool_params[i], &key);
+			if (pool_add(&pools, &key) < 0) {
+				fprintf(stderr, "server: too many pools\n");
+				goto fail;
+			}
+		}
+	}
+
+	lfd = net_listen(cfg->path);
+	if (lfd < 0)
+		goto fail;
+
+	if (start_workers(&srv, threads, cfg->seed) < 0) {
+		fprintf(stderr, "server: can't start worker threads\n");
+		close(lfd);
+		net_unlink(cfg->path);
+		goto fail;
+	}
+
+	/* No SA_RESTART, so that accept() is interrupted */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	accept_loop(&srv, lfd);
+
+	close(lfd);
+	net_unlink(cfg->path);
+
+	/* Connections go first, since they may be waiting on workers.
+	 * Once this returns, nothing is using the cache, the trace or
+	 * the request defaults.
+	 */
+	close_connections(&srv);
+	stop_workers(&srv);
+	r = 0;
+
+fail:
+	if (srv.pools)
+		pool_set_destroy(srv.pools);
+	pthread_cond_destroy(&srv.closed);
+	pthread_mutex_destroy(&srv.lock);
+	queue_destroy(&srv.work);
+
+	return r;
+}
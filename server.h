@@ -0,0 +1,82 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SERVER_H_
+#define SERVER_H_
+
+/* Long-lived server mode. The server listens on a Unix-domain socket,
+ * or a TCP port (see net.h), and accepts any number of concurrent
+ * connections. Each connection carries a sequence of requests, and
+ * each request gets one reply, in the same order.
+ *
+ * Requests and replies are framed as a 4-byte big-endian length
+ * followed by that many bytes of text. The request text is described
+ * in service.h, and the reply text is a single JSON object.
+ *
+ * Requests are carried out by a fixed pool of worker threads which
+ * live as long as the server, each with its own generator state.
+ * Workers which have nothing else to do keep pools of pre-generated
+ * puzzles topped up (see pool.h).
+ */
+
+#include <stdint.h>
+#include "service.h"
+
+/* Largest request accepted. Connections sending larger frames are
+ * closed.
+ */
+#define SERVER_MAX_FRAME	(1 << 20)
+
+/* Server configuration:
+ *
+ *     path:        address to listen on
+ *     threads:     number of workers, or 0 for one per online CPU
+ *     seed:        seed from which worker generator states are derived
+ *     defaults:    generator parameters for requests which omit them
+ *     pool_depth:  capacity of each puzzle pool, or 0 for no pools
+ *     pool_params: pools to create and fill at startup
+ *     pool_count:  number of entries in pool_params
+ *     cache:       result cache shared by all workers, or NULL
+ *     trace:       timeline trace for generate requests, or NULL
+ *     trace_sample: trace one in this many requests per worker
+ *
+ * Besides the pools given in pool_params, a pool for the default
+ * parameters is created on the first request for them. Requests with
+ * other parameters aren't pooled. Pools are only kept with two or more
+ * workers, so that a refill never holds up a request for the only one.
+ */
+struct server_config {
+	const char			*path;
+	int				threads;
+	uint64_t			seed;
+	const struct service_params	*defaults;
+	unsigned int			pool_depth;
+	const struct service_params	*pool_params;
+	int				pool_count;
+	struct cache			*cache;
+	struct cdok_trace		*trace;
+	unsigned int			trace_sample;
+};
+
+/* Run the server until interrupted. On shutdown, requests in progress
+ * are answered, connections are closed and every thread has finished
+ * before this returns, so that the cache and trace may then be freed.
+ * Returns 0 on a clean shutdown or -1 if the server couldn't be
+ * started.
+ */
+int server_run(const struct server_config *cfg);
+
+#endif
@@ -0,0 +1,420 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "parser.h"
+#include "printer.h"
+#include "solver.h"
+#include "report.h"
+#include "pool.h"
+#include "cache.h"
+#include "service.h"
+
+/* Maximum length of a command name or parameter. */
+#define MAX_WORD		80
+
+/* Extract the next whitespace-delimited word from the command line.
+ * Returns the length, or -1 if the word is too long.
+ */
+static int next_word(const char **text, char *word)
+{
+	const char *t = *text;
+	int len = 0;
+
+	while (*t && *t != '\n' && isspace(*t))
+		t++;
+
+	while (*t && !isspace(*t)) {
+		if (len + 1 >= MAX_WORD)
+			return -1;
+
+		word[len++] = *(t++);
+	}
+
+	word[len] = 0;
+	*text = t;
+
+	return len;
+}
+
+/* Apply a key=value parameter. Returns 0 on success or -1 if it's not
+ * recognized or invalid.
+ */
+static int set_param(struct service_params *p, const char *word)
+{
+	const char *eq = strchr(word, '=');
+	char *end;
+	long v;
+
+	if (!eq)
+		return -1;
+
+	if (!strncmp(word, "strategy=", 9))
+		return cdok_strategy_parse(&p->strategy, eq + 1);
+
+	if (!strncmp(word, "seed=", 5)) {
+		p->seed = strtoull(eq + 1, &end, 0);
+		p->have_seed = 1;
+		return (*end || end == eq + 1) ? -1 : 0;
+	}
+
+	v = strtol(eq + 1, &end, 10);
+	if (*end || end == eq + 1)
+		return -1;
+
+	if (!strncmp(word, "size=", 5)) {
+		if (v < 2 || v > CDOK_SIZE)
+			return -1;
+		p->size = v;
+	} else if (!strncmp(word, "iterations=", 11)) {
+		if (v < 0 || v > SERVICE_ITERATIONS_MAX)
+			return -1;
+		p->iterations = v;
+	} else if (!strncmp(word, "limit=", 6)) {
+		p->limit = v;
+	} else if (!strncmp(word, "target=", 7)) {
+		p->target = v;
+	} else if (!strncmp(word, "count=", 6)) {
+		if (v < 1 || v > SERVICE_SHARD_MAX)
+			return -1;
+		p->count = v;
+	} else if (!strncmp(word, "min-diff=", 9)) {
+		p->min_diff = v;
+	} else if (!strncmp(word, "two-cell=", 9)) {
+		if (v)
+			p->flags |= CDOK_FLAGS_TWO_CELL;
+		else
+			p->flags &= ~CDOK_FLAGS_TWO_CELL;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+int service_parse_params(struct service_params *p, const char *text)
+{
+	char word[MAX_WORD];
+
+	while (*text) {
+		int len = 0;
+
+		while (*text == ',' || isspace(*text))
+			text++;
+
+		while (*text && *text != ',' && !isspace(*text)) {
+			if (len + 1 >= MAX_WORD)
+				return -1;
+
+			word[len++] = *(text++);
+		}
+
+		word[len] = 0;
+		if (len && set_param(p, word) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+void service_pool_key(const struct service_params *p, struct pool_key *key)
+{
+	memset(key, 0, sizeof(*key));
+	key->size = p->size;
+	key->iterations = p->iterations;
+	key->limit = p->limit;
+	key->target = p->target;
+	key->flags = p->flags;
+}
+
+static int handle_solve(struct service_worker *w,
+			const struct service_params *p, const char *command,
+			const char *spec, int want_solution, FILE *out)
+{
+	struct cdok_puzzle puz;
+	uint8_t solution[CDOK_CELLS];
+	uint64_t start;
+	int diff = 0;
+	int r;
+
+	if (cdok_parse_spec(&puz, spec, strlen(spec), NULL) < 0) {
+		report_error(out, command, -1, "invalid puzzle spec");
+		return -1;
+	}
+
+	/* Difficulty depends on the strategy, so only the default
+	 * strategy's results are cached.
+	 */
+	start = report_time_us();
+	if (cdok_strategy_is_default(&p->strategy))
+		r = cache_solve(w->cache, &puz,
+				want_solution ? solution : NULL, &diff);
+	else
+		r = cdok_solve_strategy(&puz, &p->strategy,
+					want_solution ? solution : NULL,
+					&diff, NULL);
+	report_solve(out, command, -1, &puz,
+		     want_solution ? solution : NULL, NULL, r, diff,
+		     report_time_us() - start);
+
+	return 0;
+}
+
+/* Find the generator to use for a request: the worker's own, or a
+ * fresh one if the request gave a seed.
+ */
+static struct cdok_gen *request_gen(struct service_worker *w,
+				    const struct service_params *p,
+				    struct cdok_gen *seeded)
+{
+	if (!p->have_seed)
+		return &w->gen;
+
+	cdok_gen_init(seeded, p->seed);
+	return seeded;
+}
+
+/* Generate requests are answered from a pool if one is ready, unless
+ * they give a seed. Pools are created on demand only for the default
+ * parameters, and otherwise must be declared when the server starts
+ * (--pool).
+ */
+static int handle_generate(struct service_worker *w,
+			   const struct service_params *defaults,
+			   const struct service_params *p, FILE *out)
+{
+	struct cdok_puzzle puz;
+	uint8_t solution[CDOK_CELLS];
+	uint64_t start = report_time_us();
+	struct cdok_gen seeded;
+	struct cdok_gen *gen;
+	int diff;
+
+	if (w->pools && !p->have_seed) {
+		struct pool_entry e;
+		struct pool_key key;
+		struct pool_key def;
+
+		service_pool_key(p, &key);
+		service_pool_key(defaults, &def);
+		if (!pool_take(w->pools, &key, !memcmp(&key, &def, sizeof(key)),
+			       &e)) {
+			report_generate(out, "generate", &e.puz, e.solution,
+					e.diff, report_time_us() - start);
+			return 0;
+		}
+	}
+
+	gen = request_gen(w, p, &seeded);
+	if (w->trace && (w->trace_sample <= 1 ||
+			 !(w->trace_count++ % w->trace_sample)))
+		gen->trace = w->trace;
+
+	cdok_generate_grid(gen, solution, p->size);
+	diff = cdok_generate(gen, &puz, solution, p->size, p->flags,
+			     p->iterations, p->limit, p->target);
+	gen->trace = NULL;
+
+	report_generate(out, "generate", &puz, solution, diff,
+			report_time_us() - start);
+
+	return 0;
+}
+
+static int handle_gen_grid(struct service_worker *w,
+			   const struct service_params *p, FILE *out)
+{
+	struct cdok_json j;
+	uint8_t grid[CDOK_CELLS];
+	uint64_t start = report_time_us();
+	struct cdok_gen seeded;
+
+	cdok_generate_grid(request_gen(w, p, &seeded), grid, p->size);
+	report_begin(&j, out, "gen-grid", p->size);
+	cdok_json_grid(&j, "solution", p->size, grid);
+	report_end(&j, report_time_us() - start);
+
+	return 0;
+}
+
+static int handle_shard(const struct service_params *p, FILE *out)
+{
+	struct cdok_json j;
+	uint64_t start = report_time_us();
+	int k;
+
+	report_begin(&j, out, "shard", p->size);
+	cdok_json_int(&j, "count", p->count);
+	cdok_json_begin_array(&j, "puzzles");
+
+	for (k = 0; k < p->count; k++) {
+		struct cdok_gen gen;
+		struct cdok_puzzle puz;
+		uint8_t solution[CDOK_CELLS];
+		int diff;
+
+		cdok_gen_init(&gen, p->seed + k * SERVICE_SEED_STEP);
+		cdok_generate_grid(&gen, solution, p->size);
+		diff = cdok_generate(&gen, &puz, solution, p->size, p->flags,
+				     p->iterations, p->limit, p->target);
+		if (diff < p->min_diff)
+			continue;
+
+		cdok_json_begin_object(&j, NULL);
+		cdok_json_int(&j, "number", k);
+		cdok_json_spec(&j, "spec", &puz);
+		cdok_json_grid(&j, "solution", p->size, solution);
+		cdok_json_int(&j, "difficulty", diff);
+		cdok_json_end_object(&j);
+	}
+
+	cdok_json_end_array(&j);
+	report_end(&j, report_time_us() - start);
+
+	return 0;
+}
+
+static int handle_stats(struct service_worker *w, FILE *out)
+{
+	struct cdok_json j;
+
+	cdok_json_init(&j, out);
+	cdok_json_begin_object(&j, NULL);
+	cdok_json_string(&j, "command", "stats", 5);
+
+	if (w->pools)
+		pool_report(w->pools, &j, "pools");
+
+	if (w->cache)
+		cache_report(w->cache, &j, "cache");
+
+	cdok_json_end_object(&j);
+	cdok_json_end_record(&j);
+
+	return 0;
+}
+
+int service_handle(const struct service_params *defaults,
+		   struct service_worker *w, const char *req, FILE *out)
+{
+	struct service_params p = *defaults;
+	char command[MAX_WORD];
+	char word[MAX_WORD];
+	int len;
+
+	if (next_word(&req, command) <= 0) {
+		report_error(out, NULL, -1, "missing command");
+		return -1;
+	}
+
+	while ((len = next_word(&req, word)) != 0) {
+		if (len < 0 || set_param(&p, word) < 0) {
+			report_error(out, command, -1, "invalid parameter");
+			return -1;
+		}
+	}
+
+	if (*req == '\n')
+		req++;
+
+	if (!strcmp(command, "solve"))
+		return handle_solve(w, &p, command, req, 1, out);
+
+	if (!strcmp(command, "examine"))
+		return handle_solve(w, &p, command, req, 0, out);
+
+	if (!strcmp(command, "generate"))
+		return handle_generate(w, defaults, &p, out);
+
+	if (!strcmp(command, "gen-grid"))
+		return handle_gen_grid(w, &p, out);
+
+	if (!strcmp(command, "shard"))
+		return handle_shard(&p, out);
+
+	if (!strcmp(command, "stats"))
+		return handle_stats(w, out);
+
+	if (!strcmp(command, "ping")) {
+		struct cdok_json j;
+
+		cdok_json_init(&j, out);
+		cdok_json_begin_object(&j, NULL);
+		cdok_json_string(&j, "command", command, strlen(command));
+		cdok_json_end_object(&j);
+		cdok_json_end_record(&j);
+		return 0;
+	}
+
+	report_error(out, command, -1, "unknown command");
+	return -1;
+}
+
+/* Convert a single-line request into the usual form: everything up to
+ * the first word which isn't a parameter is kept as the command line,
+ * and the rest of the line becomes the spec.
+ */
+int service_handle_line(const struct service_params *defaults,
+			struct service_worker *w, const char *line,
+			size_t len, FILE *out)
+{
+	char req[CDOK_SPEC_MAX + 256];
+	size_t i = 0;
+	size_t n = 0;
+	int words = 0;
+
+	while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+		len--;
+
+	if (len + 3 > sizeof(req)) {
+		report_error(out, NULL, -1, "request too long");
+		return -1;
+	}
+
+	/* Copy the command and any parameters */
+	for (;;) {
+		size_t start;
+
+		while (i < len && isspace(line[i]))
+			req[n++] = line[i++];
+
+		start = i;
+		while (i < len && !isspace(line[i]))
+			i++;
+
+		if (i == start ||
+		    (words && !memchr(line + start, '=', i - start))) {
+			i = start;
+			break;
+		}
+
+		memcpy(req + n, line + start, i - start);
+		n += i - start;
+		words++;
+	}
+
+	/* The remainder is the spec */
+	req[n++] = '\n';
+	for (; i < len; i++)
+		req[n++] = (line[i] == '|') ? '\n' : line[i];
+	req[n++] = '\n';
+	req[n] = 0;
+
+	return service_handle(defaults, w, req, out);
+}
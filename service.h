@@ -0,0 +1,133 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SERVICE_H_
+#define SERVICE_H_
+
+/* Request handling for the long-lived server mode. A request is a
+ * single piece of text: a command line, optionally followed by a
+ * puzzle spec on the following lines. For example:
+ *
+ *    generate size=8 iterations=50 target=2000 two-cell=1
+ *
+ *    solve
+ *    J+12    F/4     5       2       E*3     E
+ *    ...
+ *
+ * Available commands are "solve", "examine", "generate", "gen-grid",
+ * "shard", "stats" and "ping". Parameters not given in the request take the
+ * values given on the cdok command line. Solve and examine requests
+ * accept a solver strategy (see solver.h), with components separated
+ * by '+', as in:
+ *
+ *    examine strategy=rc-hidden+first
+ *
+ * A shard request generates a run of puzzles for the farm coordinator
+ * (see farm.h). Puzzle k of the shard is generated from its own seed,
+ * seed + k * SERVICE_SEED_STEP, so the results don't depend on which
+ * worker runs the shard. Puzzles easier than min-diff are left out:
+ *
+ *    shard size=16 iterations=50 seed=12345 count=8 min-diff=2000
+ *
+ * Generate and gen-grid requests may also give a seed, in which case
+ * the same request always gets the same reply.
+ *
+ * Each request produces exactly one reply: a JSON object (see
+ * report.h) terminated by a newline.
+ *
+ * Requests may also be given as a single line, for use as a line
+ * protocol. The command and parameters are followed directly by the
+ * puzzle spec, with rows separated by '|'. For example:
+ *
+ *    examine A+3 A 3 | B*6 B 1 | 3 1 2
+ */
+
+#include <stdio.h>
+#include "cdok.h"
+#include "generator.h"
+#include "solver.h"
+
+/* Request parameters: generator parameters, the solver strategy, and
+ * the first seed, number of puzzles and minimum difficulty of a shard.
+ * A seed given in a generate or gen-grid request (have_seed is set)
+ * makes the reply reproducible: it's generated from that seed rather
+ * than from the worker's generator state, and never from a pool.
+ * Iterations are limited to SERVICE_ITERATIONS_MAX per puzzle, and
+ * shards to SERVICE_SHARD_MAX puzzles.
+ */
+#define SERVICE_SEED_STEP	0x9e3779b97f4a7c15ULL
+#define SERVICE_SHARD_MAX	4096
+#define SERVICE_ITERATIONS_MAX	1000
+
+struct service_params {
+	int			size;
+	int			iterations;
+	int			limit;
+	int			target;
+	cdok_flags_t		flags;
+	struct cdok_strategy	strategy;
+	uint64_t		seed;
+	int			have_seed;
+	int			count;
+	int			min_diff;
+};
+
+/* Parse a list of key=value request parameters, separated by commas
+ * or whitespace, as they would appear in a request. Returns 0 on
+ * success or -1 if a parameter isn't valid.
+ */
+int service_parse_params(struct service_params *p, const char *text);
+
+/* Find the pool key for generator requests with these parameters. */
+struct pool_key;
+
+void service_pool_key(const struct service_params *p, struct pool_key *key);
+
+/* Per-thread state. Each worker thread keeps its own generator state
+ * for the lifetime of the server. If pools is non-NULL, generate
+ * requests are answered from it where possible (see pool.h). If cache
+ * is non-NULL, solve and examine results are cached (see cache.h).
+ * If trace is non-NULL, one in every trace_sample generate requests
+ * (or every request, if trace_sample is 0) is recorded to it. Pools,
+ * caches and traces may be shared between workers.
+ */
+struct pool_set;
+struct cache;
+
+struct service_worker {
+	struct cdok_gen		gen;
+	struct pool_set		*pools;
+	struct cache		*cache;
+	struct cdok_trace	*trace;
+	unsigned int		trace_sample;
+	unsigned int		trace_count;
+};
+
+/* Handle a request, given as a NUL-terminated string, and write the
+ * reply to the given stream. Returns 0 on success or -1 if the request
+ * failed (an error reply is still written).
+ */
+int service_handle(const struct service_params *defaults,
+		   struct service_worker *w, const char *req, FILE *out);
+
+/* Handle a single-line request. The line needn't be NUL-terminated
+ * and may include the trailing newline.
+ */
+int service_handle_line(const struct service_params *defaults,
+			struct service_worker *w, const char *line,
+			size_t len, FILE *out);
+
+#endif
@@ -0,0 +1,569 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "solver.h"
+#include "cage.h"
+#include "session.h"
+
+/************************************************************************
+ * Counters
+ */
+
+/* Count a value entered at a cell. */
+static void add_value(struct cdok_session *s, cdok_pos_t c, int v)
+{
+	const int x = CDOK_POS_X(c);
+	const int y = CDOK_POS_Y(c);
+	const uint8_t g = s->puzzle.group_map[c];
+
+	if (s->row_count[y][v]++)
+		s->conflicts++;
+	else
+		s->row_used[y] |= CDOK_SET_SINGLE(v);
+
+	if (s->col_count[x][v]++)
+		s->conflicts++;
+	else
+		s->col_used[x] |= CDOK_SET_SINGLE(v);
+
+	if (g != CDOK_GROUP_NONE)
+		s->group_filled[g]++;
+
+	if (v != s->solution[c])
+		s->wrong++;
+
+	s->values[c] = v;
+	s->filled++;
+}
+
+/* Remove the value at a cell from the counts. */
+static void remove_value(struct cdok_session *s, cdok_pos_t c)
+{
+	const int x = CDOK_POS_X(c);
+	const int y = CDOK_POS_Y(c);
+	const uint8_t g = s->puzzle.group_map[c];
+	const int v = s->values[c];
+
+	if (--s->row_count[y][v])
+		s->conflicts--;
+	else
+		s->row_used[y] &= ~CDOK_SET_SINGLE(v);
+
+	if (--s->col_count[x][v])
+		s->conflicts--;
+	else
+		s->col_used[x] &= ~CDOK_SET_SINGLE(v);
+
+	if (g != CDOK_GROUP_NONE)
+		s->group_filled[g]--;
+
+	if (v != s->solution[c])
+		s->wrong--;
+
+	s->values[c] = 0;
+	s->filled--;
+}
+
+/* Set up the counters for the puzzle's given values. */
+static void start(struct cdok_session *s)
+{
+	const int size = s->puzzle.size;
+	int x, y;
+
+	memset(s->values, 0, sizeof(s->values));
+	memset(s->row_count, 0, sizeof(s->row_count));
+	memset(s->col_count, 0, sizeof(s->col_count));
+	memset(s->row_used, 0, sizeof(s->row_used));
+	memset(s->col_used, 0, sizeof(s->col_used));
+	memset(s->group_filled, 0, sizeof(s->group_filled));
+	s->filled = 0;
+	s->conflicts = 0;
+	s->wrong = 0;
+	s->moves = 0;
+
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+
+			if (s->puzzle.values[c])
+				add_value(s, c, s->puzzle.values[c]);
+		}
+}
+
+int cdok_session_init(struct cdok_session *s, const struct cdok_puzzle *puz,
+		      const uint8_t *solution)
+{
+	memcpy(&s->puzzle, puz, sizeof(s->puzzle));
+
+	if (solution)
+		memcpy(s->solution, solution, sizeof(s->solution));
+	else if (cdok_solve(puz, s->solution, NULL))
+		return -1;
+
+	start(s);
+	return 0;
+}
+
+/************************************************************************
+ * Moves
+ */
+
+static int editable(const struct cdok_session *s, cdok_pos_t c)
+{
+	return c >= 0 && c < CDOK_CELLS &&
+		CDOK_POS_X(c) < s->puzzle.size &&
+		CDOK_POS_Y(c) < s->puzzle.size &&
+		!s->puzzle.values[c];
+}
+
+int cdok_session_set(struct cdok_session *s, cdok_pos_t c, int value)
+{
+	int flags = 0;
+	uint8_t g;
+
+	if (!editable(s, c) || value < 1 || value > s->puzzle.size)
+		return -1;
+
+	if (s->values[c])
+		remove_value(s, c);
+
+	add_value(s, c, value);
+	s->moves++;
+
+	if (s->row_count[CDOK_POS_Y(c)][value] > 1)
+		flags |= CDOK_MOVE_ROW_CONFLICT;
+	if (s->col_count[CDOK_POS_X(c)][value] > 1)
+		flags |= CDOK_MOVE_COL_CONFLICT;
+	if (value != s->solution[c])
+		flags |= CDOK_MOVE_WRONG;
+
+	g = s->puzzle.group_map[c];
+	if (g != CDOK_GROUP_NONE &&
+	    s->group_filled[g] == s->puzzle.groups[g].size) {
+		flags |= CDOK_MOVE_CAGE_DONE;
+		if (!cdok_group_satisfied(&s->puzzle.groups[g], s->values))
+			flags |= CDOK_MOVE_CAGE_WRONG;
+	}
+
+	if (cdok_session_solved(s))
+		flags |= CDOK_MOVE_SOLVED;
+
+	return flags;
+}
+
+int cdok_session_clear(struct cdok_session *s, cdok_pos_t c)
+{
+	if (!editable(s, c))
+		return -1;
+
+	if (s->values[c]) {
+		remove_value(s, c);
+		s->moves++;
+	}
+
+	return 0;
+}
+
+int cdok_session_solved(const struct cdok_session *s)
+{
+	return s->filled == s->puzzle.size * s->puzzle.size && !s->wrong;
+}
+
+/************************************************************************
+ * Hints
+ */
+
+/* Set size */
+static int count_bits(cdok_set_t s)
+{
+	int count = 0;
+
+	while (s) {
+		s &= (s - 1);
+		count++;
+	}
+
+	return count;
+}
+
+/* Find the lowest value in a set. */
+static int first_value(cdok_set_t s)
+{
+	int v = 1;
+
+	while (!(s & 1)) {
+		s >>= 1;
+		v++;
+	}
+
+	return v;
+}
+
+/* Look for a value with only one place in a line of cells, given by its
+ * first cell and the step between cells.
+ */
+static cdok_pos_t hidden_single(const struct cdok_session *s,
+				const cdok_set_t *candidates,
+				cdok_pos_t start, int step, uint8_t *value)
+{
+	cdok_set_t once = 0;
+	cdok_set_t twice = 0;
+	cdok_set_t single;
+	int i;
+
+	for (i = 0; i < s->puzzle.size; i++) {
+		const cdok_pos_t c = start + i * step;
+
+		if (!s->values[c]) {
+			twice |= once & candidates[c];
+			once |= candidates[c];
+		}
+	}
+
+	single = once & ~twice;
+	if (!single)
+		return -1;
+
+	*value = first_value(single);
+	for (i = 0; i < s->puzzle.size; i++) {
+		const cdok_pos_t c = start + i * step;
+
+		if (!s->values[c] && (candidates[c] & single & -single))
+			return c;
+	}
+
+	return -1;
+}
+
+static void set_hint(struct cdok_hint *h, cdok_hint_t reason,
+		     cdok_pos_t c, uint8_t value)
+{
+	h->reason = reason;
+	h->cell = c;
+	h->value = value;
+}
+
+int cdok_session_hint(const struct cdok_session *s, struct cdok_hint *h)
+{
+	const struct cdok_puzzle *puz = &s->puzzle;
+	const int size = puz->size;
+	cdok_set_t group_cand[CDOK_GROUPS];
+	cdok_set_t candidates[CDOK_CELLS];
+	cdok_pos_t best = -1;
+	int best_count = 0;
+	uint8_t v;
+	int i;
+	int x, y;
+
+	/* Deductions are only sound once mistakes are corrected */
+	if (s->wrong) {
+		for (y = 0; y < size; y++)
+			for (x = 0; x < size; x++) {
+				const cdok_pos_t c = CDOK_POS(x, y);
+
+				if (s->values[c] &&
+				    s->values[c] != s->solution[c]) {
+					set_hint(h, CDOK_HINT_MISTAKE, c,
+						 s->solution[c]);
+					return 0;
+				}
+			}
+	}
+
+	if (cdok_session_solved(s))
+		return -1;
+
+	for (i = 0; i < CDOK_GROUPS; i++)
+		if (puz->groups[i].size)
+			group_cand[i] = cdok_group_candidates(&puz->groups[i],
+							      s->values, size);
+
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+			const uint8_t g = puz->group_map[c];
+			int n;
+
+			if (s->values[c])
+				continue;
+
+			candidates[c] = CDOK_SET_ONES(size) &
+				~(s->row_used[y] | s->col_used[x]);
+			if (g != CDOK_GROUP_NONE)
+				candidates[c] &= group_cand[g];
+
+			n = count_bits(candidates[c]);
+			if (n == 1) {
+				set_hint(h, CDOK_HINT_SINGLE, c,
+					 first_value(candidates[c]));
+				return 0;
+			}
+
+			if (best < 0 || n < best_count) {
+				best = c;
+				best_count = n;
+			}
+		}
+
+	for (i = 0; i < size; i++) {
+		cdok_pos_t c = hidden_single(s, candidates, CDOK_POS(0, i),
+					     CDOK_POS(1, 0), &v);
+
+		if (c >= 0) {
+			set_hint(h, CDOK_HINT_HIDDEN_ROW, c, v);
+			return 0;
+		}
+
+		c = hidden_single(s, candidates, CDOK_POS(i, 0),
+				  CDOK_POS(0, 1), &v);
+		if (c >= 0) {
+			set_hint(h, CDOK_HINT_HIDDEN_COLUMN, c, v);
+			return 0;
+		}
+	}
+
+	set_hint(h, CDOK_HINT_REVEAL, best, s->solution[best]);
+	return 0;
+}
+
+/************************************************************************
+ * Saving and loading
+ *
+ * A saved session is a sequence of bytes:
+ *
+ *    "CDS", version (1), size
+ *    number of moves (varint)
+ *    for each cell: group index, or CDOK_GROUP_NONE
+ *    for each group in use, in index order: type, target (varint)
+ *    for each cell: 0x80 if given, plus the current value; then the
+ *    solution value
+ *
+ * Cells are in row order and only cover the puzzle. Varints are written
+ * seven bits at a time, least significant first, with the top bit set
+ * on all but the last byte.
+ */
+
+#define SESSION_VERSION		1
+#define SESSION_GIVEN		0x80
+
+struct writer {
+	uint8_t		*buf;
+	size_t		max;
+	size_t		len;
+};
+
+static void put_byte(struct writer *w, uint8_t b)
+{
+	if (w->len < w->max)
+		w->buf[w->len] = b;
+
+	w->len++;
+}
+
+static void put_varint(struct writer *w, uint32_t v)
+{
+	while (v >= 0x80) {
+		put_byte(w, (v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+
+	put_byte(w, v);
+}
+
+size_t cdok_session_save(const struct cdok_session *s,
+			 uint8_t *buf, size_t max)
+{
+	const struct cdok_puzzle *puz = &s->puzzle;
+	struct writer w = {buf, max, 0};
+	uint8_t used[CDOK_GROUPS] = {0};
+	int i;
+	int x, y;
+
+	put_byte(&w, 'C');
+	put_byte(&w, 'D');
+	put_byte(&w, 'S');
+	put_byte(&w, SESSION_VERSION);
+	put_byte(&w, puz->size);
+	put_varint(&w, s->moves);
+
+	for (y = 0; y < puz->size; y++)
+		for (x = 0; x < puz->size; x++) {
+			const uint8_t g = puz->group_map[CDOK_POS(x, y)];
+
+			put_byte(&w, g);
+			if (g != CDOK_GROUP_NONE)
+				used[g] = 1;
+		}
+
+	for (i = 0; i < CDOK_GROUPS; i++)
+		if (used[i]) {
+			put_byte(&w, puz->groups[i].type);
+			put_varint(&w, puz->groups[i].target);
+		}
+
+	for (y = 0; y < puz->size; y++)
+		for (x = 0; x < puz->size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+
+			put_byte(&w, s->values[c] |
+				 (puz->values[c] ? SESSION_GIVEN : 0));
+			put_byte(&w, s->solution[c]);
+		}
+
+	return w.len <= max ? w.len : 0;
+}
+
+struct reader {
+	const uint8_t	*buf;
+	size_t		len;
+	size_t		pos;
+	int		error;
+};
+
+static uint8_t get_byte(struct reader *r)
+{
+	if (r->pos >= r->len) {
+		r->error = 1;
+		return 0;
+	}
+
+	return r->buf[r->pos++];
+}
+
+static uint32_t get_varint(struct reader *r)
+{
+	uint32_t v = 0;
+	int shift;
+
+	for (shift = 0; shift < 35; shift += 7) {
+		const uint8_t b = get_byte(r);
+
+		v |= (uint32_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return v;
+	}
+
+	r->error = 1;
+	return 0;
+}
+
+static int valid_type(uint8_t t)
+{
+	return t == CDOK_SUM || t == CDOK_DIFFERENCE ||
+		t == CDOK_PRODUCT || t == CDOK_RATIO;
+}
+
+int cdok_session_load(struct cdok_session *s, const uint8_t *buf,
+		      size_t len)
+{
+	struct cdok_puzzle *puz = &s->puzzle;
+	struct reader r = {buf, len, 0, 0};
+	uint8_t entered[CDOK_CELLS] = {0};
+	cdok_set_t rows[CDOK_SIZE] = {0};
+	cdok_set_t cols[CDOK_SIZE] = {0};
+	unsigned int moves;
+	int size;
+	int i;
+	int x, y;
+
+	if (get_byte(&r) != 'C' || get_byte(&r) != 'D' ||
+	    get_byte(&r) != 'S' || get_byte(&r) != SESSION_VERSION)
+		return -1;
+
+	size = get_byte(&r);
+	if (size < 1 || size > CDOK_SIZE)
+		return -1;
+
+	moves = get_varint(&r);
+	cdok_init_puzzle(puz, size);
+	memset(s->solution, 0, sizeof(s->solution));
+
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+			const uint8_t g = get_byte(&r);
+
+			if (g == CDOK_GROUP_NONE)
+				continue;
+
+			if (g >= CDOK_GROUPS ||
+			    puz->groups[g].size >= CDOK_GROUP_SIZE)
+				return -1;
+
+			puz->groups[g].members[puz->groups[g].size++] = c;
+			puz->group_map[c] = g;
+		}
+
+	for (i = 0; i < CDOK_GROUPS; i++) {
+		struct cdok_group *g = &puz->groups[i];
+
+		if (!g->size)
+			continue;
+
+		g->type = get_byte(&r);
+		g->target = get_varint(&r);
+		if (g->size < 2 || !valid_type(g->type) || g->target < 0)
+			return -1;
+	}
+
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+			const uint8_t v = get_byte(&r);
+			const uint8_t value = v & ~SESSION_GIVEN;
+
+			s->solution[c] = get_byte(&r);
+			if (value > size || s->solution[c] < 1 ||
+			    s->solution[c] > size)
+				return -1;
+
+			if (v & SESSION_GIVEN) {
+				if (value != s->solution[c])
+					return -1;
+				puz->values[c] = value;
+			} else {
+				entered[c] = value;
+			}
+		}
+
+	if (r.error || r.pos != len)
+		return -1;
+
+	/* Rebuild the counters from the givens, then replay the entered
+	 * values, checking that the solution is a Latin square.
+	 */
+	start(s);
+
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+			const cdok_set_t b = CDOK_SET_SINGLE(s->solution[c]);
+
+			if ((rows[y] | cols[x]) & b)
+				return -1;
+
+			rows[y] |= b;
+			cols[x] |= b;
+
+			if (entered[c])
+				add_value(s, c, entered[c]);
+		}
+
+	s->moves = moves;
+	return 0;
+}
@@ -0,0 +1,131 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SESSION_H_
+#define SESSION_H_
+
+/* Play sessions. A session holds a puzzle with a unique solution and
+ * the values a player has entered so far. It keeps counts of each value
+ * in every row and column and of the filled cells in every group, so
+ * that each move is checked in constant time, without looking at the
+ * rest of the grid.
+ *
+ * A session is a self-contained structure with no pointers, and may be
+ * copied freely. It can also be saved to a compact, portable byte
+ * string and loaded again, possibly on another machine.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cdok.h"
+
+struct cdok_session {
+	struct cdok_puzzle	puzzle;
+	uint8_t			solution[CDOK_CELLS];
+	uint8_t			values[CDOK_CELLS];
+	uint8_t			row_count[CDOK_SIZE][CDOK_SIZE + 1];
+	uint8_t			col_count[CDOK_SIZE][CDOK_SIZE + 1];
+	cdok_set_t		row_used[CDOK_SIZE];
+	cdok_set_t		col_used[CDOK_SIZE];
+	uint8_t			group_filled[CDOK_GROUPS];
+	unsigned int		filled;
+	unsigned int		conflicts;
+	unsigned int		wrong;
+	unsigned int		moves;
+};
+
+/* Start a session. The puzzle's given values are filled in, and can't
+ * be changed. If solution is NULL, the puzzle is solved. Returns 0 on
+ * success, or -1 if the puzzle doesn't have a unique solution.
+ */
+int cdok_session_init(struct cdok_session *s, const struct cdok_puzzle *puz,
+		      const uint8_t *solution);
+
+/* Results of a move. Conflicts are with other cells in the same row or
+ * column holding the same value. When a move fills the last cell of a
+ * group, CDOK_MOVE_CAGE_DONE is set, along with CDOK_MOVE_CAGE_WRONG if
+ * the group's values don't meet its target.
+ */
+#define CDOK_MOVE_ROW_CONFLICT	0x01
+#define CDOK_MOVE_COL_CONFLICT	0x02
+#define CDOK_MOVE_CAGE_DONE	0x04
+#define CDOK_MOVE_CAGE_WRONG	0x08
+#define CDOK_MOVE_WRONG		0x10
+#define CDOK_MOVE_SOLVED	0x20
+
+/* Enter a value (1 to the puzzle size) in a cell, replacing any value
+ * already there. Returns a combination of CDOK_MOVE_* flags, or -1 if
+ * the cell is outside the grid or given, or the value is out of range.
+ * CDOK_MOVE_WRONG means that the value differs from the solution.
+ */
+int cdok_session_set(struct cdok_session *s, cdok_pos_t c, int value);
+
+/* Clear a cell. Returns 0 on success, or -1 if the cell is outside the
+ * grid or given.
+ */
+int cdok_session_clear(struct cdok_session *s, cdok_pos_t c);
+
+/* Has the puzzle been solved? */
+int cdok_session_solved(const struct cdok_session *s);
+
+/* Hints. A hint gives a cell and its value, and the reason:
+ *
+ *    MISTAKE:       the cell holds a wrong value (the first, in scan
+ *                   order, is given)
+ *    SINGLE:        the value is the cell's only candidate, given its
+ *                   row, column and group
+ *    HIDDEN_ROW:    the cell is the only place for the value in its row
+ *    HIDDEN_COLUMN: the cell is the only place for the value in its
+ *                   column
+ *    REVEAL:        none of the above applies, so a value is revealed
+ *                   from the solution, at the cell with the fewest
+ *                   candidates
+ *
+ * Hints are found by looking at candidates for each cell, without any
+ * search.
+ */
+typedef enum {
+	CDOK_HINT_MISTAKE,
+	CDOK_HINT_SINGLE,
+	CDOK_HINT_HIDDEN_ROW,
+	CDOK_HINT_HIDDEN_COLUMN,
+	CDOK_HINT_REVEAL
+} cdok_hint_t;
+
+struct cdok_hint {
+	cdok_hint_t	reason;
+	cdok_pos_t	cell;
+	uint8_t		value;
+};
+
+/* Find a hint. Returns 0 on success, or -1 if the puzzle is solved. */
+int cdok_session_hint(const struct cdok_session *s, struct cdok_hint *h);
+
+/* Save a session. Returns the number of bytes written, or 0 if the
+ * buffer is too small. CDOK_SESSION_SAVE_MAX bytes are always enough.
+ */
+#define CDOK_SESSION_SAVE_MAX	(16 + CDOK_GROUPS * 6 + CDOK_CELLS * 3)
+
+size_t cdok_session_save(const struct cdok_session *s,
+			 uint8_t *buf, size_t max);
+
+/* Load a saved session. Returns 0 on success, or -1 if the data isn't
+ * a valid saved session.
+ */
+int cdok_session_load(struct cdok_session *s, const uint8_t *buf,
+		      size_t len);
+
+#endif
@@ -14,373 +14,504 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "solver.h"
+#include "cage.h"
 
 /************************************************************************
- * Group analysis
- *
- * Value sets are bitmasks of possible values. Bit n indicates the presence
- * of the value (n+1) in the set.
+ * Row/column analysis
  */
 
-/* If N addends in the range [1..max] are used to make the target sum,
- * what is the set of possible addends?
+/* Examine the given grid of values and determine, for each cell, which
+ * values have not yet been used in the same row/column.
  */
-static cdok_set_t addends_for(int target, int n, int max)
+static void build_rc_candidates(const uint8_t *values, cdok_set_t *candidates,
+				int max)
 {
-	int a_min;
-	int a_max;
+	cdok_set_t rows[CDOK_SIZE] = {0};
+	cdok_set_t cols[CDOK_SIZE] = {0};
+	int i;
 
-	if (target < 1 || n < 1)
-		return 0;
+	/* Collect the sets of values found in each row/column */
+	for (i = 0; i < CDOK_CELLS; i++) {
+		uint8_t v = values[i];
 
-	if (n == 1) {
-		if (target >= 1 && target <= max)
-			return CDOK_SET_SINGLE(target);
+		if (v) {
+			cdok_set_t s = CDOK_SET_SINGLE(v);
 
-		return 0;
+			rows[CDOK_POS_Y(i)] |= s;
+			cols[CDOK_POS_X(i)] |= s;
+		}
 	}
 
-	a_min = target - max * (n - 1);
-	if (a_min < 1)
-		a_min = 1;
+	/* Mark each cell with the values not found in that row/column */
+	for (i = 0; i < CDOK_CELLS; i++)
+		candidates[i] =
+			CDOK_SET_ONES(max) ^
+			(rows[CDOK_POS_Y(i)] | cols[CDOK_POS_X(i)]);
+}
 
-	a_max = target - (n - 1);
-	if (a_max > max)
-		a_max = max;
+/* Set size */
+static int count_bits(cdok_set_t s)
+{
+	int count = 0;
 
-	if (a_min > a_max)
-		return 0;
+	while (s) {
+		s &= (s - 1);
+		count++;
+	}
 
-	return CDOK_SET_RANGE(a_min, a_max);
+	return count;
 }
 
-/* If N factors in the range [1..max] are used to make the target
- * product, what is the set of possible factors?
- */
-static cdok_set_t factors_for(int target, int n, int max)
+static uint64_t now_ns(void)
 {
-	cdok_set_t out = 0;
-	int i;
+	struct timespec ts;
 
-	if (target < 1 || n < 1)
-		return 0;
-
-	if (n == 1) {
-		if (target >= 1 || target <= max)
-			return CDOK_SET_SINGLE(target);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
-		return 0;
-	}
+static int stats_group_type(cdok_gtype_t t)
+{
+	switch (t) {
+	case CDOK_DIFFERENCE:
+		return CDOK_STATS_DIFFERENCE;
 
-	for (i = 1; i * i < target && i <= max; i++)
-		if (!(target % i)) {
-			int j = target / i;
+	case CDOK_PRODUCT:
+		return CDOK_STATS_PRODUCT;
 
-			out |= CDOK_SET_SINGLE(i);
-			if (j <= max)
-				out |= CDOK_SET_SINGLE(j);
-		}
+	case CDOK_RATIO:
+		return CDOK_STATS_RATIO;
 
-	return out;
+	default:
+		return CDOK_STATS_SUM;
+	}
 }
 
-/* Find the set of possible missing values in the partially-filled sum
- * group.
- */
-static cdok_set_t sum_candidates(int target, int size,
-			     const uint8_t *members, int nm, int max)
+/* Is there an empty cell in the given group? */
+static int group_is_open(const struct cdok_group *g, const uint8_t *values)
 {
-	int partial_sum = 0;
 	int i;
 
-	for (i = 0; i < nm; i++)
-		partial_sum += members[i];
+	for (i = 0; i < g->size; i++)
+		if (!values[g->members[i]])
+			return 1;
 
-	return addends_for(target - partial_sum, size - nm, max);
+	return 0;
 }
 
-/* Find the set of possible missing values in the partially-filled
- * difference group.
+/* Take a map of candidate values and eliminate candidates for each cell
+ * which can't be used to fill the group they belong to. If open_only is
+ * set, groups which are already full are skipped.
  */
-static cdok_set_t difference_candidates(int target, int size,
-				    const uint8_t *members, int nm, int max)
+static void constrain_by_groups(const struct cdok_puzzle *puz,
+				const uint8_t *values,
+				cdok_set_t *candidates, int open_only)
 {
-	cdok_set_t out = 0;
-	int partial_sum = 0;
-	int max_m = -1;
 	int i;
 
-	for (i = 0; i < nm; i++) {
-		if (members[i] > max_m)
-			max_m = members[i];
+	for (i = 0; i < CDOK_GROUPS; i++) {
+		const struct cdok_group *g = &puz->groups[i];
 
-		partial_sum += members[i];
-	}
+		if (g->size && (!open_only || group_is_open(g, values))) {
+			cdok_set_t c = cdok_group_candidates(g, values, puz->size);
+			int j;
 
-	/* It may be that the sum is already present, and we have only
-	 * to fill the box with addends.
-	 */
-	if (nm >= 1)
-		out |= addends_for(max_m * 2 - partial_sum - target,
-				   size - nm, max);
-
-	/* Or perhaps the sum is missing. Then we need to consider two
-	 * sub-cases: where *only* the sum is missing, or a sum and one
-	 * or more addends.
-	 */
-	if (nm + 1 == size) {
-		int sum = target + partial_sum;
-
-		if (sum <= max)
-			out |= CDOK_SET_SINGLE(sum);
-	} else {
-		int min_sum = target + partial_sum + (size - nm - 1);
-		int i;
-
-		for (i = min_sum; i <= max; i++) {
-			cdok_set_t terms_for_sum =
-				addends_for(i - partial_sum - target,
-					    size - nm - 1, max);
-
-			if (terms_for_sum)
-				out |= terms_for_sum | CDOK_SET_SINGLE(i);
+			for (j = 0; j < g->size; j++)
+				candidates[g->members[j]] &= c;
 		}
 	}
-
-	return out;
 }
 
-/* Find the set of possible missing values in the partially-filled
- * product group.
- */
-static cdok_set_t product_candidates(int target, int size,
-				 const uint8_t *members, int nm, int max)
+/* As above, but count and time each group analysis. */
+static void constrain_by_groups_timed(const struct cdok_puzzle *puz,
+				      const uint8_t *values,
+				      cdok_set_t *candidates, int open_only,
+				      struct cdok_solve_stats *stats)
 {
-	int partial_product = 1;
 	int i;
 
-	for (i = 0; i < nm; i++)
-		partial_product *= members[i];
+	for (i = 0; i < CDOK_GROUPS; i++) {
+		const struct cdok_group *g = &puz->groups[i];
 
-	if (target % partial_product)
-		return 0;
+		if (g->size && (!open_only || group_is_open(g, values))) {
+			const int t = stats_group_type(g->type);
+			const uint64_t start = now_ns();
+			cdok_set_t c = cdok_group_candidates(g, values, puz->size);
+			int j;
 
-	return factors_for(target / partial_product, size - nm, max);
+			stats->group_ns[t] += now_ns() - start;
+			stats->group_calls[t]++;
+
+			for (j = 0; j < g->size; j++)
+				candidates[g->members[j]] &= c;
+		}
+	}
 }
 
-/* Find the set of possible missing values in the partiall-filled
- * ratio group.
+/* Find the empty cell in the map of candidate values which has the fewest
+ * number of possible values. Returns -1 if there are no empty cells in the
+ * grid.
  */
-static cdok_set_t ratio_candidates(int target, int size,
-			       const uint8_t *members, int nm, int max)
+static cdok_pos_t search_least_free(const uint8_t *values,
+				    const cdok_set_t *candidates,
+				    int max)
 {
-	cdok_set_t out = 0;
-	int partial_product = 1;
-	int max_m = -1;
-	int i;
+	cdok_pos_t best = -1;
+	int best_count = 0;
+	int y;
 
-	for (i = 0; i < nm; i++) {
-		partial_product *= members[i];
+	for (y = 0; y < max; y++) {
+		int x;
 
-		if (members[i] > max_m)
-			max_m = members[i];
-	}
+		for (x = 0; x < max; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
 
-	/* Perhaps we're missing only factors, and the product is already
-	 * present.
-	 */
-	if (nm >= 1 && !((max_m * max_m) % (partial_product * target)))
-		out |= factors_for((max_m * max_m) / (partial_product * target),
-				   size - nm, max);
-
-	/* Perhaps the product is missing. Then there are two sub-cases: only
-	 * the product is missing, or the product and one or more factors.
-	 */
-	if (nm + 1 == size) {
-		int product = partial_product * target;
-
-		if (product <= max)
-			out |= CDOK_SET_SINGLE(product);
-	} else {
-		int min_product = partial_product * target;
-		int i;
-
-		for (i = 1; i * min_product <= max; i++) {
-			cdok_set_t terms_for_product =
-				factors_for(i, size - nm - 1, max);
-
-			if (terms_for_product)
-				out |= terms_for_product |
-					CDOK_SET_SINGLE(i * min_product);
+			if (!values[c]) {
+				int count = count_bits(candidates[c]);
+
+				if (best < 0 || count < best_count) {
+					best = c;
+					best_count = count;
+				}
+			}
 		}
 	}
 
-	return out;
+	return best;
+}
+
+/************************************************************************
+ * Strategy components
+ */
+
+static int rows_rc(const uint8_t *values, cdok_set_t *candidates, int size)
+{
+	build_rc_candidates(values, candidates, size);
+	return 0;
 }
 
-/* Examine the given group with the current set of grid values and
- * determine the set of values which might fill the remaining empty
- * cells.
+/* Check a single row or column, given its first cell and the step
+ * between cells. Every missing value must have a place in the line, and
+ * a value with only one place is fixed there.
  */
-static cdok_set_t group_candidates(const struct cdok_group *g,
-				   const uint8_t *values, int max)
+static int hidden_singles(const uint8_t *values, cdok_set_t *candidates,
+			  int size, cdok_pos_t start, int step)
 {
-	uint8_t members[CDOK_GROUP_SIZE];
-	unsigned int count = 0;
+	cdok_set_t once = 0;
+	cdok_set_t twice = 0;
+	cdok_set_t single;
 	int i;
 
-	for (i = 0; i < g->size; i++) {
-		uint8_t v = values[g->members[i]];
+	for (i = 0; i < size; i++) {
+		const cdok_pos_t c = start + i * step;
 
-		if (v)
-			members[count++] = v;
+		if (values[c]) {
+			once |= CDOK_SET_SINGLE(values[c]);
+		} else {
+			twice |= once & candidates[c];
+			once |= candidates[c];
+		}
 	}
 
-	switch (g->type) {
-	case CDOK_SUM:
-		return sum_candidates(g->target, g->size,
-				      members, count, max);
+	if (once != CDOK_SET_ONES(size))
+		return -1;
 
-	case CDOK_DIFFERENCE:
-		return difference_candidates(g->target, g->size,
-					     members, count, max);
+	single = once & ~twice;
+	if (!single)
+		return 0;
 
-	case CDOK_PRODUCT:
-		return product_candidates(g->target, g->size,
-					  members, count, max);
+	for (i = 0; i < size; i++) {
+		const cdok_pos_t c = start + i * step;
 
-	case CDOK_RATIO:
-		return ratio_candidates(g->target, g->size,
-					members, count, max);
+		if (!values[c] && (candidates[c] & single))
+			candidates[c] &= single;
 	}
 
 	return 0;
 }
 
-/************************************************************************
- * Row/column analysis
- */
-
-/* Examine the given grid of values and determine, for each cell, which
- * values have not yet been used in the same row/column.
- */
-static void build_rc_candidates(const uint8_t *values, cdok_set_t *candidates,
-				int max)
+static int rows_hidden(const uint8_t *values, cdok_set_t *candidates,
+		       int size)
 {
-	cdok_set_t rows[CDOK_SIZE] = {0};
-	cdok_set_t cols[CDOK_SIZE] = {0};
 	int i;
 
-	/* Collect the sets of values found in each row/column */
-	for (i = 0; i < CDOK_CELLS; i++) {
-		uint8_t v = values[i];
+	build_rc_candidates(values, candidates, size);
 
-		if (v) {
-			cdok_set_t s = CDOK_SET_SINGLE(v);
+	for (i = 0; i < size; i++) {
+		if (hidden_singles(values, candidates, size,
+				   CDOK_POS(0, i), CDOK_POS(1, 0)) < 0 ||
+		    hidden_singles(values, candidates, size,
+				   CDOK_POS(i, 0), CDOK_POS(0, 1)) < 0)
+			return -1;
+	}
 
-			rows[CDOK_POS_Y(i)] |= s;
-			cols[CDOK_POS_X(i)] |= s;
-		}
+	return 0;
+}
+
+static int cages_all(const struct cdok_puzzle *puz, const uint8_t *values,
+		     cdok_set_t *candidates, struct cdok_solve_stats *stats)
+{
+	if (stats)
+		constrain_by_groups_timed(puz, values, candidates, 0, stats);
+	else
+		constrain_by_groups(puz, values, candidates, 0);
+
+	return 0;
+}
+
+static int cages_open(const struct cdok_puzzle *puz, const uint8_t *values,
+		      cdok_set_t *candidates, struct cdok_solve_stats *stats)
+{
+	if (stats)
+		constrain_by_groups_timed(puz, values, candidates, 1, stats);
+	else
+		constrain_by_groups(puz, values, candidates, 1);
+
+	return 0;
+}
+
+static cdok_pos_t select_first(const uint8_t *values,
+			       const cdok_set_t *candidates, int size)
+{
+	int y;
+
+	for (y = 0; y < size; y++) {
+		int x;
+
+		for (x = 0; x < size; x++)
+			if (!values[CDOK_POS(x, y)])
+				return CDOK_POS(x, y);
 	}
 
-	/* Mark each cell with the values not found in that row/column */
-	for (i = 0; i < CDOK_CELLS; i++)
-		candidates[i] =
-			CDOK_SET_ONES(max) ^
-			(rows[CDOK_POS_Y(i)] | cols[CDOK_POS_X(i)]);
+	return -1;
 }
 
-/* Set size */
-static int count_bits(cdok_set_t s)
+static int order_asc(cdok_set_t candidates, int size, uint8_t *order)
 {
 	int count = 0;
+	int i;
 
-	while (s) {
-		s &= (s - 1);
-		count++;
-	}
+	for (i = 1; i <= size; i++)
+		if (candidates & CDOK_SET_SINGLE(i))
+			order[count++] = i;
 
 	return count;
 }
 
-/* Take a map of candidate values and eliminate candidates for each cell
- * which can't be used to fill the group they belong to.
+static int order_desc(cdok_set_t candidates, int size, uint8_t *order)
+{
+	int count = 0;
+	int i;
+
+	for (i = size; i >= 1; i--)
+		if (candidates & CDOK_SET_SINGLE(i))
+			order[count++] = i;
+
+	return count;
+}
+
+const struct cdok_component cdok_components[] = {
+	{
+		.step = CDOK_STEP_ROWS,
+		.name = "rc",
+		.description = "Exclude values used in the same row/column",
+		.fn.rows = rows_rc
+	},
+	{
+		.step = CDOK_STEP_ROWS,
+		.name = "rc-hidden",
+		.description = "As rc, then also place hidden singles",
+		.fn.rows = rows_hidden
+	},
+	{
+		.step = CDOK_STEP_CAGES,
+		.name = "cage",
+		.description = "Analyze every group",
+		.fn.cages = cages_all
+	},
+	{
+		.step = CDOK_STEP_CAGES,
+		.name = "cage-open",
+		.description = "Analyze only groups with empty cells",
+		.fn.cages = cages_open
+	},
+	{
+		.step = CDOK_STEP_SELECT,
+		.name = "mrv",
+		.description = "Branch on the cell with fewest candidates",
+		.fn.select = search_least_free
+	},
+	{
+		.step = CDOK_STEP_SELECT,
+		.name = "first",
+		.description = "Branch on the first empty cell",
+		.fn.select = select_first
+	},
+	{
+		.step = CDOK_STEP_ORDER,
+		.name = "asc",
+		.description = "Try candidates in ascending order",
+		.fn.order = order_asc
+	},
+	{
+		.step = CDOK_STEP_ORDER,
+		.name = "desc",
+		.description = "Try candidates in descending order",
+		.fn.order = order_desc
+	},
+	{
+		.name = NULL
+	}
+};
+
+/************************************************************************
+ * Strategies
  */
-static void constrain_by_groups(const struct cdok_puzzle *puz,
-				const uint8_t *values,
-				cdok_set_t *candidates)
+
+void cdok_strategy_init(struct cdok_strategy *s)
 {
+	const struct cdok_component *c;
 	int i;
 
-	for (i = 0; i < CDOK_GROUPS; i++) {
-		const struct cdok_group *g = &puz->groups[i];
+	for (i = 0; i < CDOK_STEPS; i++)
+		s->steps[i] = NULL;
 
-		if (g->size) {
-			cdok_set_t c = group_candidates(g, values, puz->size);
-			int j;
+	for (c = cdok_components; c->name; c++)
+		if (!s->steps[c->step])
+			s->steps[c->step] = c;
+}
 
-			for (j = 0; j < g->size; j++)
-				candidates[g->members[j]] &= c;
-		}
+static const struct cdok_component *find_component(const char *name, int len)
+{
+	const struct cdok_component *c;
+
+	for (c = cdok_components; c->name; c++)
+		if (!strncmp(c->name, name, len) && !c->name[len])
+			return c;
+
+	return NULL;
+}
+
+int cdok_strategy_parse(struct cdok_strategy *s, const char *text)
+{
+	int given[CDOK_STEPS] = {0};
+
+	cdok_strategy_init(s);
+
+	if (!strcmp(text, "default"))
+		return 0;
+
+	for (;;) {
+		const int len = strcspn(text, "+,");
+		const struct cdok_component *c = find_component(text, len);
+
+		if (!c || given[c->step])
+			return -1;
+
+		given[c->step] = 1;
+		s->steps[c->step] = c;
+
+		if (!text[len])
+			break;
+
+		text += len + 1;
 	}
+
+	return 0;
 }
 
-/* Find the empty cell in the map of candidate values which has the fewest
- * number of possible values. Returns -1 if there are no empty cells in the
- * grid.
- */
-static cdok_pos_t search_least_free(const uint8_t *values,
-				    const cdok_set_t *candidates,
-				    int max)
+int cdok_strategy_is_default(const struct cdok_strategy *s)
 {
-	cdok_pos_t best = -1;
-	int best_count = 0;
-	int y;
+	struct cdok_strategy def;
 
-	for (y = 0; y < max; y++) {
-		int x;
+	cdok_strategy_init(&def);
+	return !memcmp(s->steps, def.steps, sizeof(def.steps));
+}
 
-		for (x = 0; x < max; x++) {
-			const cdok_pos_t c = CDOK_POS(x, y);
+int cdok_strategy_name(const struct cdok_strategy *s, char *buf, int max)
+{
+	int len = 0;
+	int i;
 
-			if (!values[c]) {
-				int count = count_bits(candidates[c]);
+	for (i = 0; i < CDOK_STEPS; i++) {
+		const char *name = s->steps[i]->name;
+		const int n = strlen(name);
 
-				if (best < 0 || count < best_count) {
-					best = c;
-					best_count = count;
-				}
-			}
-		}
+		if (len + n + 1 > max)
+			return -1;
+
+		if (i)
+			buf[len++] = '+';
+
+		memcpy(buf + len, name, n);
+		len += n;
 	}
 
-	return best;
+	buf[len] = 0;
+	return len;
 }
 
 /************************************************************************
  * Solver
  */
 
-/* Analyze the puzzle and current set of values. Find an empty cell, if
- * one exists, with the fewest number of possible values that can be
- * filled, and also return the set of candidate values for that cell.
+/* Returned by find_candidates() when a propagator finds a contradiction. */
+#define DEAD_END	(-2)
+
+/* Run the strategy's propagators, limiting the candidates of each empty
+ * cell to the allowed set (if given) before looking at the groups.
+ */
+static int propagate(const struct cdok_puzzle *puz,
+		     const struct cdok_strategy *strategy,
+		     const uint8_t *values, const cdok_set_t *allowed,
+		     cdok_set_t *candidates, struct cdok_solve_stats *stats)
+{
+	if (strategy->steps[CDOK_STEP_ROWS]->fn.rows
+		(values, candidates, puz->size) < 0)
+		return -1;
+
+	if (allowed) {
+		int x, y;
+
+		for (y = 0; y < puz->size; y++)
+			for (x = 0; x < puz->size; x++) {
+				const cdok_pos_t c = CDOK_POS(x, y);
+
+				if (!values[c])
+					candidates[c] &= allowed[c];
+			}
+	}
+
+	return strategy->steps[CDOK_STEP_CAGES]->fn.cages
+		(puz, values, candidates, stats);
+}
+
+/* Analyze the puzzle and current set of values. Choose an empty cell to
+ * branch on, if one exists, and also return the set of candidate values
+ * for that cell.
  *
- * Returns -1 if there are no empty cells in the grid.
+ * Returns -1 if there are no empty cells in the grid, or DEAD_END if the
+ * position has no solution.
  */
 static cdok_pos_t find_candidates(const struct cdok_puzzle *puz,
-				  const uint8_t *values, cdok_set_t *cand_out)
+				  const struct cdok_strategy *strategy,
+				  const uint8_t *values, cdok_set_t *cand_out,
+				  struct cdok_solve_stats *stats)
 {
 	cdok_set_t candidates[CDOK_CELLS];
 	cdok_pos_t c;
 
-	build_rc_candidates(values, candidates, puz->size);
-	constrain_by_groups(puz, values, candidates);
+	if (propagate(puz, strategy, values, NULL, candidates, stats) < 0)
+		return DEAD_END;
 
 	/* Choose branches for value-oriented search */
-	c = search_least_free(values, candidates, puz->size);
+	c = strategy->steps[CDOK_STEP_SELECT]->fn.select
+		(values, candidates, puz->size);
 	if (c < 0)
 		return -1;
 
@@ -390,10 +521,10 @@ static cdok_pos_t find_candidates(const struct cdok_puzzle *puz,
 
 /* Back-tracking solver.
  *
- * At each step, pick the empty cell with the fewest candidate values,
- * try filling in each candidate value and recursively solving. When a
- * solution is found, copy it to the solution grid and increment the
- * count.
+ * At each step, pick an empty cell (by default, the one with the fewest
+ * candidate values), try filling in each candidate value and recursively
+ * solving. When a solution is found, copy it to the solution grid and
+ * increment the count.
  *
  * Search stops when:
  *
@@ -413,20 +544,73 @@ static cdok_pos_t find_candidates(const struct cdok_puzzle *puz,
  */
 struct solver_context {
 	const struct cdok_puzzle	*puzzle;
+	const struct cdok_strategy	*strategy;
 	uint8_t				*solution;
 	uint8_t				values[CDOK_CELLS];
-	unsigned int			count;
+	uint64_t			count;
+	uint64_t			limit;
 	unsigned int			branch_diff;
+	struct cdok_solve_stats		*stats;
+	cdok_solution_fn		found;
+	cdok_cancel_fn			cancel;
+	void				*arg;
+	int				stop;
 };
 
-static void solve_recurse(struct solver_context *ctx, int branch_diff)
+/* Find candidates, keeping statistics if asked to. */
+static cdok_pos_t visit(struct solver_context *ctx, cdok_set_t *candidates,
+			unsigned int depth)
+{
+	struct cdok_solve_stats *st = ctx->stats;
+	uint64_t start;
+	cdok_pos_t cell;
+	int n;
+
+	if (!st)
+		return find_candidates(ctx->puzzle, ctx->strategy,
+				       ctx->values, candidates, NULL);
+
+	start = now_ns();
+	cell = find_candidates(ctx->puzzle, ctx->strategy,
+			       ctx->values, candidates, st);
+	st->propagate_ns += now_ns() - start;
+
+	st->nodes++;
+	if (depth > st->max_depth)
+		st->max_depth = depth;
+
+	if (cell >= 0) {
+		n = count_bits(*candidates);
+		st->branches[n]++;
+		if (!n)
+			st->backtracks++;
+	} else if (cell == DEAD_END) {
+		st->backtracks++;
+	}
+
+	return cell;
+}
+
+static void solve_recurse(struct solver_context *ctx, int branch_diff,
+			  unsigned int depth)
 {
 	cdok_pos_t cell;
 	cdok_set_t candidates;
+	uint8_t order[CDOK_SIZE];
+	int count;
 	int i;
 	int diff;
 
-	cell = find_candidates(ctx->puzzle, ctx->values, &candidates);
+	if (ctx->cancel && ctx->cancel(ctx->arg)) {
+		ctx->stop = 1;
+		return;
+	}
+
+	cell = visit(ctx, &candidates, depth);
+
+	/* Is the puzzle unsolvable? */
+	if (cell == DEAD_END)
+		return;
 
 	/* Is the puzzle solved? */
 	if (cell < 0) {
@@ -438,6 +622,8 @@ static void solve_recurse(struct solver_context *ctx, int branch_diff)
 		}
 
 		ctx->count++;
+		if (ctx->found && ctx->found(ctx->arg, ctx->values))
+			ctx->stop = 1;
 		return;
 	}
 
@@ -449,15 +635,15 @@ static void solve_recurse(struct solver_context *ctx, int branch_diff)
 	diff = count_bits(candidates) - 1;
 	diff = branch_diff + (diff * diff);
 
-	for (i = 1; i <= ctx->puzzle->size; i++) {
-		if (!(candidates & CDOK_SET_SINGLE(i)))
-			continue;
+	count = ctx->strategy->steps[CDOK_STEP_ORDER]->fn.order
+		(candidates, ctx->puzzle->size, order);
 
-		ctx->values[cell] = i;
-		solve_recurse(ctx, diff);
+	for (i = 0; i < count; i++) {
+		ctx->values[cell] = order[i];
+		solve_recurse(ctx, diff, depth + 1);
 		ctx->values[cell] = 0;
 
-		if (ctx->count >= 2)
+		if (ctx->count >= ctx->limit || ctx->stop)
 			return;
 	}
 }
@@ -474,16 +660,48 @@ static void solve_recurse(struct solver_context *ctx, int branch_diff)
  *    M is a power of 10 greater than the number of cells in the grid.
  *    E is the number of empty cells in the starting arrangement.
  */
-int cdok_solve(const struct cdok_puzzle *puz, uint8_t *solution, int *diff)
+int cdok_solve_cancellable(const struct cdok_puzzle *puz,
+			   const struct cdok_strategy *strategy,
+			   uint8_t *solution, int *diff,
+			   struct cdok_solve_stats *stats,
+			   cdok_cancel_fn cancel, void *cancel_arg)
 {
+	struct cdok_strategy def;
 	struct solver_context ctx;
+	uint64_t start = 0;
+
+	if (!strategy) {
+		cdok_strategy_init(&def);
+		strategy = &def;
+	}
 
 	ctx.puzzle = puz;
+	ctx.strategy = strategy;
 	ctx.solution = solution;
 	ctx.count = 0;
+	ctx.limit = 2;
+	ctx.stats = stats;
+	ctx.found = NULL;
+	ctx.cancel = cancel;
+	ctx.arg = cancel_arg;
+	ctx.stop = 0;
 	memcpy(ctx.values, puz->values, sizeof(ctx.values));
 
-	solve_recurse(&ctx, 0);
+	if (stats) {
+		memset(stats, 0, sizeof(*stats));
+		start = now_ns();
+	}
+
+	solve_recurse(&ctx, 0, 0);
+
+	if (stats) {
+		stats->total_ns = now_ns() - start;
+		stats->search_ns = stats->total_ns > stats->propagate_ns ?
+			stats->total_ns - stats->propagate_ns : 0;
+	}
+
+	if (ctx.stop)
+		return CDOK_SOLVE_CANCELLED;
 
 	if (!ctx.count)
 		return -1;
@@ -506,3 +724,158 @@ int cdok_solve(const struct cdok_puzzle *puz, uint8_t *solution, int *diff)
 
 	return ctx.count > 1 ? 1 : 0;
 }
+
+int cdok_solver_candidates(const struct cdok_puzzle *puz,
+			   const struct cdok_strategy *strategy,
+			   const uint8_t *values, const cdok_set_t *allowed,
+			   cdok_set_t *candidates)
+{
+	struct cdok_strategy def;
+
+	if (!strategy) {
+		cdok_strategy_init(&def);
+		strategy = &def;
+	}
+
+	return propagate(puz, strategy, values, allowed, candidates, NULL);
+}
+
+int cdok_solve_strategy(const struct cdok_puzzle *puz,
+			const struct cdok_strategy *strategy,
+			uint8_t *solution, int *diff,
+			struct cdok_solve_stats *stats)
+{
+	return cdok_solve_cancellable(puz, strategy, solution, diff, stats,
+				      NULL, NULL);
+}
+
+int cdok_solve_stats(const struct cdok_puzzle *puz, uint8_t *solution,
+		     int *diff, struct cdok_solve_stats *stats)
+{
+	return cdok_solve_strategy(puz, NULL, solution, diff, stats);
+}
+
+int cdok_solve(const struct cdok_puzzle *puz, uint8_t *solution, int *diff)
+{
+	return cdok_solve_stats(puz, solution, diff, NULL);
+}
+
+/************************************************************************
+ * Enumeration
+ */
+
+uint64_t cdok_enumerate(const struct cdok_puzzle *puz,
+			const struct cdok_strategy *strategy,
+			const uint8_t *start, uint64_t limit,
+			cdok_solution_fn found, cdok_cancel_fn cancel,
+			void *arg)
+{
+	struct cdok_strategy def;
+	struct solver_context ctx;
+
+	if (!strategy) {
+		cdok_strategy_init(&def);
+		strategy = &def;
+	}
+
+	ctx.puzzle = puz;
+	ctx.strategy = strategy;
+	ctx.solution = NULL;
+	ctx.count = 0;
+	ctx.limit = limit ? limit : UINT64_MAX;
+	ctx.stats = NULL;
+	ctx.found = found;
+	ctx.cancel = cancel;
+	ctx.arg = arg;
+	ctx.stop = 0;
+	memcpy(ctx.values, start ? start : puz->values, sizeof(ctx.values));
+
+	solve_recurse(&ctx, 0, 0);
+	return ctx.count;
+}
+
+/* Replace each position in a list by its children, in search order.
+ * Positions with no empty cells are kept, and dead ends are dropped.
+ * Returns the new number of positions, or -1 if there would be more
+ * than max, or if there's nothing left to expand.
+ */
+static int split_level(const struct cdok_puzzle *puz,
+		       const struct cdok_strategy *strategy,
+		       const uint8_t (*in)[CDOK_CELLS], int count,
+		       uint8_t (*out)[CDOK_CELLS], int max)
+{
+	int expanded = 0;
+	int n = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		cdok_set_t candidates;
+		uint8_t order[CDOK_SIZE];
+		cdok_pos_t cell = find_candidates(puz, strategy, in[i],
+						  &candidates, NULL);
+		int k;
+		int j;
+
+		if (cell == DEAD_END)
+			continue;
+
+		if (cell < 0) {
+			if (n >= max)
+				return -1;
+			memcpy(out[n++], in[i], CDOK_CELLS);
+			continue;
+		}
+
+		k = strategy->steps[CDOK_STEP_ORDER]->fn.order
+			(candidates, puz->size, order);
+		if (n + k > max)
+			return -1;
+
+		for (j = 0; j < k; j++) {
+			memcpy(out[n], in[i], CDOK_CELLS);
+			out[n++][cell] = order[j];
+		}
+
+		expanded = 1;
+	}
+
+	return expanded || !n ? n : -1;
+}
+
+int cdok_split(const struct cdok_puzzle *puz,
+	       const struct cdok_strategy *strategy,
+	       int want, uint8_t (*subtrees)[CDOK_CELLS], int max)
+{
+	struct cdok_strategy def;
+	uint8_t (*next)[CDOK_CELLS];
+	int count = 1;
+
+	if (!strategy) {
+		cdok_strategy_init(&def);
+		strategy = &def;
+	}
+
+	if (max < 1)
+		return -1;
+
+	next = malloc(max * sizeof(*next));
+	if (!next)
+		return -1;
+
+	memcpy(subtrees[0], puz->values, CDOK_CELLS);
+
+	while (count && count < want) {
+		const int n = split_level(puz, strategy,
+					  (const uint8_t (*)[CDOK_CELLS])
+					  subtrees, count, next, max);
+
+		if (n < 0)
+			break;
+
+		memcpy(subtrees, next, n * sizeof(*next));
+		count = n;
+	}
+
+	free(next);
+	return count;
+}
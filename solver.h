@@ -17,10 +17,13 @@
 #ifndef SOLVER_H_
 #define SOLVER_H_
 
+#include <stdint.h>
 #include "cdok.h"
 
 /* Attempt to solve the given puzzle, optionally producing a solution,
- * if it exists, and a difficulty score.
+ * if it exists, and a difficulty score. The solver keeps all of its
+ * state on the stack, so any number of puzzles may be solved at once
+ * from different threads.
  *
  * Return values are:
  *
@@ -30,4 +33,197 @@
  */
 int cdok_solve(const struct cdok_puzzle *puz, uint8_t *solution, int *diff);
 
+/* Search statistics. These describe the work done by the solver:
+ *
+ *    nodes:         positions visited in the search tree
+ *    backtracks:    positions abandoned because a cell had no candidates
+ *    max_depth:     deepest position visited (the root has depth 0)
+ *    branches:      histogram of the number of candidates for the chosen
+ *                   cell at each position which wasn't a solution
+ *    group_calls:   group analyses performed, by group type
+ *    group_ns:      time spent on group analysis, by group type
+ *    propagate_ns:  time spent finding candidates
+ *    search_ns:     the remainder of the time: choosing values and
+ *                   moving through the tree
+ *    total_ns:      total time spent solving
+ *
+ * Timing adds noticeable overhead, so times are useful for comparison
+ * with each other rather than with an ordinary solve.
+ */
+enum {
+	CDOK_STATS_SUM,
+	CDOK_STATS_DIFFERENCE,
+	CDOK_STATS_PRODUCT,
+	CDOK_STATS_RATIO,
+	CDOK_STATS_GROUP_TYPES
+};
+
+struct cdok_solve_stats {
+	uint64_t	nodes;
+	uint64_t	backtracks;
+	unsigned int	max_depth;
+	uint64_t	branches[CDOK_SIZE + 1];
+	uint64_t	group_calls[CDOK_STATS_GROUP_TYPES];
+	uint64_t	group_ns[CDOK_STATS_GROUP_TYPES];
+	uint64_t	propagate_ns;
+	uint64_t	search_ns;
+	uint64_t	total_ns;
+};
+
+/* Solve a puzzle as for cdok_solve(), collecting statistics if stats is
+ * non-NULL.
+ */
+int cdok_solve_stats(const struct cdok_puzzle *puz, uint8_t *solution,
+		     int *diff, struct cdok_solve_stats *stats);
+
+/* Solver strategies. At each position in the search, the solver:
+ *
+ *    rows:   finds candidates for each cell from its row and column
+ *    cages:  narrows them using the groups
+ *    select: chooses an empty cell to branch on
+ *    order:  decides the order in which to try its candidates
+ *
+ * Each step is carried out by a component chosen from the registry
+ * below, and a strategy is one choice of component for each step.
+ * Components are named uniquely, and a strategy is written as a list
+ * of names separated by '+' or ','. Steps which aren't named use the
+ * default component, so the default strategy is "rc+cage+mrv+asc",
+ * and "first" is the default strategy except for cell selection.
+ *
+ * Every strategy finds the same solutions, but the search may visit
+ * different positions. Since the difficulty score depends on the
+ * search, it's only comparable between solves using the same strategy.
+ *
+ * Propagators return 0, or -1 if they find that the position has no
+ * solution. Cell selection returns -1 if there are no empty cells.
+ */
+typedef int (*cdok_rows_fn)(const uint8_t *values, cdok_set_t *candidates,
+			    int size);
+typedef int (*cdok_cages_fn)(const struct cdok_puzzle *puz,
+			     const uint8_t *values, cdok_set_t *candidates,
+			     struct cdok_solve_stats *stats);
+typedef cdok_pos_t (*cdok_select_fn)(const uint8_t *values,
+				     const cdok_set_t *candidates, int size);
+typedef int (*cdok_order_fn)(cdok_set_t candidates, int size,
+			     uint8_t *order);
+
+typedef enum {
+	CDOK_STEP_ROWS,
+	CDOK_STEP_CAGES,
+	CDOK_STEP_SELECT,
+	CDOK_STEP_ORDER,
+	CDOK_STEPS
+} cdok_step_t;
+
+struct cdok_component {
+	cdok_step_t	step;
+	const char	*name;
+	const char	*description;
+	union {
+		cdok_rows_fn	rows;
+		cdok_cages_fn	cages;
+		cdok_select_fn	select;
+		cdok_order_fn	order;
+	} fn;
+};
+
+/* The registry, terminated by an entry with a NULL name. The first
+ * component listed for each step is its default.
+ */
+extern const struct cdok_component cdok_components[];
+
+struct cdok_strategy {
+	const struct cdok_component	*steps[CDOK_STEPS];
+};
+
+/* Set up the default strategy. */
+void cdok_strategy_init(struct cdok_strategy *s);
+
+/* Parse a strategy string, starting from the default. Returns 0 on
+ * success or -1 if a name isn't known or a step is given twice.
+ */
+int cdok_strategy_parse(struct cdok_strategy *s, const char *text);
+
+/* Is this the default strategy? */
+int cdok_strategy_is_default(const struct cdok_strategy *s);
+
+/* Write the full name of a strategy. Returns the length, or -1 if the
+ * buffer is too small.
+ */
+#define CDOK_STRATEGY_NAME_MAX	64
+
+int cdok_strategy_name(const struct cdok_strategy *s, char *buf, int max);
+
+/* Solve a puzzle as for cdok_solve_stats(), using the given strategy.
+ * A NULL strategy means the default.
+ */
+int cdok_solve_strategy(const struct cdok_puzzle *puz,
+			const struct cdok_strategy *strategy,
+			uint8_t *solution, int *diff,
+			struct cdok_solve_stats *stats);
+
+/* Find the candidates of every cell in a position, as the solver does
+ * at each step of its search, limiting the candidates of each empty
+ * cell to the allowed set first, if allowed isn't NULL. This lets other
+ * searches built on the solver (see backbone.h) rule out values which
+ * are known to be impossible. The candidates of filled cells mean
+ * nothing. Returns 0, or -1 if the position has no solution.
+ */
+int cdok_solver_candidates(const struct cdok_puzzle *puz,
+			   const struct cdok_strategy *strategy,
+			   const uint8_t *values, const cdok_set_t *allowed,
+			   cdok_set_t *candidates);
+
+/* Cancellation. The cancel function, if not NULL, is called with its
+ * argument at every position in the search, from the solving thread.
+ * If it returns non-zero, the solve is abandoned and returns
+ * CDOK_SOLVE_CANCELLED. The solution grid may then have been written,
+ * but shouldn't be used.
+ * Otherwise, this is the same as cdok_solve_strategy().
+ */
+#define CDOK_SOLVE_CANCELLED	(-2)
+
+typedef int (*cdok_cancel_fn)(void *arg);
+
+int cdok_solve_cancellable(const struct cdok_puzzle *puz,
+			   const struct cdok_strategy *strategy,
+			   uint8_t *solution, int *diff,
+			   struct cdok_solve_stats *stats,
+			   cdok_cancel_fn cancel, void *cancel_arg);
+
+/* Enumerate solutions, starting from the given values (or the puzzle's
+ * own, if start is NULL). Each solution is passed to the found
+ * function as soon as it's reached; if that returns non-zero, the
+ * search stops. At most limit solutions are found (0 for no limit),
+ * and the search can be cancelled as for cdok_solve_cancellable().
+ * Either function may be NULL, and both are given the same argument.
+ *
+ * Solutions are found in the order that cdok_solve() would find them,
+ * and nothing is kept from one to the next, so memory use doesn't
+ * depend on how many there are. Returns the number found.
+ */
+typedef int (*cdok_solution_fn)(void *arg, const uint8_t *solution);
+
+uint64_t cdok_enumerate(const struct cdok_puzzle *puz,
+			const struct cdok_strategy *strategy,
+			const uint8_t *start, uint64_t limit,
+			cdok_solution_fn found, cdok_cancel_fn cancel,
+			void *arg);
+
+/* Split the search into subtrees, so that it can be shared between
+ * threads. Each subtree is the position reached by filling some cells,
+ * and between them they hold every solution, each exactly once. The
+ * tree is expanded level by level until there are at least want
+ * subtrees, or no room for another level within max (or the search is
+ * exhausted). Subtrees are given in search order, so that enumerating
+ * each from its position in turn finds the same solutions, in the same
+ * order, as a single enumeration.
+ *
+ * Returns the number of subtrees, which is 0 if the puzzle obviously
+ * has no solution, or -1 if memory couldn't be allocated.
+ */
+int cdok_split(const struct cdok_puzzle *puz,
+	       const struct cdok_strategy *strategy,
+	       int want, uint8_t (*subtrees)[CDOK_CELLS], int max);
+
 #endif
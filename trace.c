@@ -0,0 +1,155 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "trace.h"
+
+/* Find the calling thread's track, adding it to the trace's list the
+ * first time it records an event. Must be called with the lock held. If
+ * the list can't be grown, the event goes on track 0.
+ */
+static int current_tid(struct cdok_trace *t)
+{
+	const pthread_t self = pthread_self();
+	int i;
+
+	for (i = 0; i < t->thread_count; i++)
+		if (pthread_equal(t->threads[i], self))
+			return i + 1;
+
+	if (t->thread_count >= t->thread_cap) {
+		const int cap = t->thread_cap ? t->thread_cap * 2 : 16;
+		pthread_t *threads = realloc(t->threads,
+					     cap * sizeof(threads[0]));
+
+		if (!threads)
+			return 0;
+
+		t->threads = threads;
+		t->thread_cap = cap;
+	}
+
+	t->threads[t->thread_count++] = self;
+	return t->thread_count;
+}
+
+uint64_t cdok_trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int cdok_trace_open(struct cdok_trace *t, FILE *out)
+{
+	if (pthread_mutex_init(&t->lock, NULL))
+		return -1;
+
+	t->out = out;
+	t->epoch = cdok_trace_now();
+	t->count = 0;
+	t->threads = NULL;
+	t->thread_count = 0;
+	t->thread_cap = 0;
+
+	fputs("[", out);
+	return 0;
+}
+
+void cdok_trace_close(struct cdok_trace *t)
+{
+	pthread_mutex_lock(&t->lock);
+	fputs("\n]\n", t->out);
+	fflush(t->out);
+	t->out = NULL;
+	free(t->threads);
+	t->threads = NULL;
+	t->thread_count = 0;
+	t->thread_cap = 0;
+	pthread_mutex_unlock(&t->lock);
+}
+
+/* Write the common part of an event. Must be called with the lock held.
+ * Times are given in microseconds, as the format requires.
+ */
+static void event_begin(struct cdok_trace *t, const char *name,
+			char phase, uint64_t when)
+{
+	const uint64_t rel = when > t->epoch ? when - t->epoch : 0;
+
+	fprintf(t->out, "%s\n{\"name\":\"%s\",\"ph\":\"%c\","
+		"\"pid\":1,\"tid\":%d,\"ts\":%llu.%03u",
+		t->count++ ? "," : "", name, phase, current_tid(t),
+		(unsigned long long)(rel / 1000), (unsigned int)(rel % 1000));
+}
+
+static void event_end(struct cdok_trace *t,
+		      const char *arg1, long long v1,
+		      const char *arg2, long long v2)
+{
+	if (arg1 || arg2) {
+		fputs(",\"args\":{", t->out);
+		if (arg1)
+			fprintf(t->out, "\"%s\":%lld", arg1, v1);
+		if (arg2)
+			fprintf(t->out, "%s\"%s\":%lld",
+				arg1 ? "," : "", arg2, v2);
+		fputc('}', t->out);
+	}
+
+	fputc('}', t->out);
+}
+
+void cdok_trace_span(struct cdok_trace *t, const char *name, uint64_t start,
+		     const char *arg1, long long v1,
+		     const char *arg2, long long v2)
+{
+	const uint64_t end = cdok_trace_now();
+	const uint64_t dur = end - start;
+
+	pthread_mutex_lock(&t->lock);
+	if (!t->out) {
+		pthread_mutex_unlock(&t->lock);
+		return;
+	}
+
+	event_begin(t, name, 'X', start);
+	fprintf(t->out, ",\"dur\":%llu.%03u",
+		(unsigned long long)(dur / 1000), (unsigned int)(dur % 1000));
+	event_end(t, arg1, v1, arg2, v2);
+	pthread_mutex_unlock(&t->lock);
+}
+
+void cdok_trace_instant(struct cdok_trace *t, const char *name,
+			const char *arg1, long long v1,
+			const char *arg2, long long v2)
+{
+	const uint64_t now = cdok_trace_now();
+
+	pthread_mutex_lock(&t->lock);
+	if (!t->out) {
+		pthread_mutex_unlock(&t->lock);
+		return;
+	}
+
+	event_begin(t, name, 'i', now);
+	fputs(",\"s\":\"t\"", t->out);
+	event_end(t, arg1, v1, arg2, v2);
+	pthread_mutex_unlock(&t->lock);
+}
@@ -0,0 +1,74 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+/* Timeline tracing. Events are written in the Chrome trace-event format
+ * (a JSON array of events), which can be loaded into chrome://tracing
+ * or Perfetto.
+ *
+ * Tracing is switched on by giving the generator a trace to write to
+ * (see generator.h). When no trace is given, the cost is a single
+ * pointer test per event site.
+ *
+ * A trace may be shared between threads. Each thread's events appear
+ * on their own track. Tracks are numbered from 1 in the order in which
+ * threads first record an event, and the trace keeps the list of
+ * threads it has seen.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+struct cdok_trace {
+	FILE		*out;
+	uint64_t	epoch;
+	int		count;
+	pthread_t	*threads;
+	int		thread_count;
+	int		thread_cap;
+	pthread_mutex_t	lock;
+};
+
+/* Start a trace, writing to the given stream. Returns 0 on success or
+ * -1 on error.
+ */
+int cdok_trace_open(struct cdok_trace *t, FILE *out);
+
+/* Finish the trace, freeing its list of threads. The stream isn't
+ * closed. Events recorded after this (for example, by threads which are
+ * still running) are discarded.
+ */
+void cdok_trace_close(struct cdok_trace *t);
+
+/* Current time, in nanoseconds, for the start of a span. */
+uint64_t cdok_trace_now(void);
+
+/* Record a span which began at the given time and ends now. Up to two
+ * integer arguments may be attached; a NULL name omits an argument.
+ */
+void cdok_trace_span(struct cdok_trace *t, const char *name, uint64_t start,
+		     const char *arg1, long long v1,
+		     const char *arg2, long long v2);
+
+/* Record an instantaneous event, with optional arguments as above. */
+void cdok_trace_instant(struct cdok_trace *t, const char *name,
+			const char *arg1, long long v1,
+			const char *arg2, long long v2);
+
+#endif
@@ -0,0 +1,306 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "cage.h"
+#include "verify.h"
+
+static const char *const rule_names[] = {
+	[CDOK_VERIFY_OK]	= "ok",
+	[CDOK_VERIFY_EMPTY]	= "empty",
+	[CDOK_VERIFY_GIVEN]	= "given",
+	[CDOK_VERIFY_ROW]	= "row",
+	[CDOK_VERIFY_COLUMN]	= "column",
+	[CDOK_VERIFY_CAGE]	= "cage"
+};
+
+const char *cdok_verify_name(cdok_verify_t rule)
+{
+	return rule_names[rule];
+}
+
+/* Check the values, givens, rows and columns. A value outside
+ * [1..size] has an empty mask, and so leaves a hole in its row. With
+ * every value in range, a row (or column) of size cells covers all size
+ * values only if none is repeated.
+ */
+static int latin_ok(const struct cdok_puzzle *puz, const uint8_t *grid)
+{
+	const int size = puz->size;
+	const cdok_set_t full = CDOK_SET_ONES(size);
+	cdok_set_t rows[CDOK_SIZE] = {0};
+	cdok_set_t cols[CDOK_SIZE] = {0};
+	unsigned int mismatch = 0;
+	cdok_set_t all = full;
+	int i;
+	int x, y;
+
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+			const unsigned int v = grid[c];
+			const unsigned int given = puz->values[c];
+			const cdok_set_t b = (v - 1 < (unsigned int)size) ?
+				CDOK_SET_SINGLE(v) : 0;
+
+			rows[y] |= b;
+			cols[x] |= b;
+			mismatch |= (given != 0) & (given != v);
+		}
+
+	for (i = 0; i < size; i++)
+		all &= rows[i] & cols[i];
+
+	return all == full && !mismatch;
+}
+
+static int cages_ok(const struct cdok_puzzle *puz, const uint8_t *grid)
+{
+	int ok = 1;
+	int i;
+
+	for (i = 0; i < CDOK_GROUPS; i++)
+		if (puz->groups[i].size)
+			ok &= cdok_group_satisfied(&puz->groups[i], grid);
+
+	return ok;
+}
+
+static int fail(struct cdok_violation *v, cdok_verify_t rule,
+		cdok_pos_t cell, uint8_t group)
+{
+	v->rule = rule;
+	v->cell = cell;
+	v->group = group;
+
+	return -1;
+}
+
+/* Find the first rule broken by a grid which failed the fast checks. */
+static int diagnose(const struct cdok_puzzle *puz, const uint8_t *grid,
+		    struct cdok_violation *v)
+{
+	const int size = puz->size;
+	int x, y;
+	int i;
+
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+
+			if (!grid[c] || grid[c] > size)
+				return fail(v, CDOK_VERIFY_EMPTY, c,
+					    CDOK_GROUP_NONE);
+		}
+
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+
+			if (puz->values[c] && puz->values[c] != grid[c])
+				return fail(v, CDOK_VERIFY_GIVEN, c,
+					    CDOK_GROUP_NONE);
+		}
+
+	for (y = 0; y < size; y++) {
+		cdok_set_t seen = 0;
+
+		for (x = 0; x < size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+			const cdok_set_t b = CDOK_SET_SINGLE(grid[c]);
+
+			if (seen & b)
+				return fail(v, CDOK_VERIFY_ROW, c,
+					    CDOK_GROUP_NONE);
+			seen |= b;
+		}
+	}
+
+	for (x = 0; x < size; x++) {
+		cdok_set_t seen = 0;
+
+		for (y = 0; y < size; y++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+			const cdok_set_t b = CDOK_SET_SINGLE(grid[c]);
+
+			if (seen & b)
+				return fail(v, CDOK_VERIFY_COLUMN, c,
+					    CDOK_GROUP_NONE);
+			seen |= b;
+		}
+	}
+
+	for (i = 0; i < CDOK_GROUPS; i++) {
+		const struct cdok_group *g = &puz->groups[i];
+
+		if (g->size && !cdok_group_satisfied(g, grid))
+			return fail(v, CDOK_VERIFY_CAGE, g->members[0], i);
+	}
+
+	fail(v, CDOK_VERIFY_OK, -1, CDOK_GROUP_NONE);
+	return 0;
+}
+
+int cdok_verify(const struct cdok_puzzle *puz, const uint8_t *grid,
+		struct cdok_violation *v)
+{
+	struct cdok_violation dummy;
+
+	if (latin_ok(puz, grid) && cages_ok(puz, grid)) {
+		if (v)
+			fail(v, CDOK_VERIFY_OK, -1, CDOK_GROUP_NONE);
+		return 0;
+	}
+
+	return diagnose(puz, grid, v ? v : &dummy);
+}
+
+/* Batches are checked VERIFY_LANES grids at a time, in structure-of-
+ * arrays form: for each cell, the values of every grid are gathered
+ * into one array, one byte lane per grid, and the checks of latin_ok()
+ * are then run across all lanes at once. The grids of a group must be
+ * the same size, so the batch is sorted into groups by size as it's
+ * read. Cages differ from puzzle to puzzle, so they're still checked
+ * one grid at a time.
+ *
+ * Bitmasks would need a shift by a different amount in every lane,
+ * which most vector units can't do for bytes. Instead, each line is
+ * checked for each value in turn by comparison: with size cells, a
+ * line holds every value in [1..size] only if none is repeated and
+ * none is out of range.
+ */
+#define VERIFY_LANES		16
+
+struct lanes {
+	int			index[VERIFY_LANES];
+	int			count;
+};
+
+static void latin_lanes(const struct cdok_puzzle *puz,
+			const uint8_t (*grids)[CDOK_CELLS],
+			const int *index, int size, uint8_t *ok)
+{
+	uint8_t val[CDOK_SIZE][CDOK_SIZE][VERIFY_LANES];
+	uint8_t good[VERIFY_LANES];
+	int x, y;
+	int k;
+	int l;
+
+	for (l = 0; l < VERIFY_LANES; l++)
+		good[l] = 1;
+
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++) {
+			const cdok_pos_t c = CDOK_POS(x, y);
+			uint8_t given[VERIFY_LANES];
+
+			for (l = 0; l < VERIFY_LANES; l++) {
+				val[y][x][l] = grids[index[l]][c];
+				given[l] = puz[index[l]].values[c];
+			}
+
+			for (l = 0; l < VERIFY_LANES; l++)
+				good[l] &= !given[l] | (given[l] == val[y][x][l]);
+		}
+
+	for (k = 1; k <= size; k++)
+		for (y = 0; y < size; y++) {
+			const uint8_t v = k;
+			uint8_t row[VERIFY_LANES] = {0};
+			uint8_t col[VERIFY_LANES] = {0};
+
+			for (x = 0; x < size; x++)
+				for (l = 0; l < VERIFY_LANES; l++) {
+					row[l] |= val[y][x][l] == v;
+					col[l] |= val[x][y][l] == v;
+				}
+
+			for (l = 0; l < VERIFY_LANES; l++)
+				good[l] &= row[l] & col[l];
+		}
+
+	memcpy(ok, good, sizeof(good));
+}
+
+/* Check a group of grids of one size, and empty it. Returns the number
+ * which aren't solutions.
+ */
+static int check_lanes(const struct cdok_puzzle *puz,
+		       const uint8_t (*grids)[CDOK_CELLS], struct lanes *ln,
+		       struct cdok_violation *results)
+{
+	uint8_t ok[VERIFY_LANES];
+	int failed = 0;
+	int l;
+
+	/* Unused lanes repeat the first grid */
+	for (l = ln->count; l < VERIFY_LANES; l++)
+		ln->index[l] = ln->index[0];
+
+	latin_lanes(puz, grids, ln->index, puz[ln->index[0]].size, ok);
+
+	for (l = 0; l < ln->count; l++) {
+		const int i = ln->index[l];
+		struct cdok_violation dummy;
+		struct cdok_violation *v = results ? &results[i] : &dummy;
+
+		if (ok[l] && cages_ok(&puz[i], grids[i]))
+			fail(v, CDOK_VERIFY_OK, -1, CDOK_GROUP_NONE);
+		else if (diagnose(&puz[i], grids[i], v) < 0)
+			failed++;
+	}
+
+	ln->count = 0;
+	return failed;
+}
+
+int cdok_verify_batch(const struct cdok_puzzle *puz,
+		      const uint8_t (*grids)[CDOK_CELLS], int count,
+		      struct cdok_violation *results)
+{
+	struct lanes pending[CDOK_SIZE + 1];
+	int failed = 0;
+	int i;
+
+	for (i = 0; i <= CDOK_SIZE; i++)
+		pending[i].count = 0;
+
+	for (i = 0; i < count; i++) {
+		const int size = puz[i].size;
+		struct lanes *ln;
+
+		if (size < 1 || size > CDOK_SIZE) {
+			if (cdok_verify(&puz[i], grids[i],
+					results ? &results[i] : NULL) < 0)
+				failed++;
+			continue;
+		}
+
+		ln = &pending[size];
+		ln->index[ln->count++] = i;
+		if (ln->count == VERIFY_LANES)
+			failed += check_lanes(puz, grids, ln, results);
+	}
+
+	for (i = 1; i <= CDOK_SIZE; i++)
+		if (pending[i].count)
+			failed += check_lanes(puz, grids, &pending[i],
+					      results);
+
+	return failed;
+}
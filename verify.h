@@ -0,0 +1,78 @@
+/* cdok -- Calcudoku solver/generator
+ * Copyright (C) 2012 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef VERIFY_H_
+#define VERIFY_H_
+
+/* Answer verification. Checking that a grid solves a puzzle doesn't
+ * need the solver: a grid is a solution exactly when every cell holds a
+ * value in range, it agrees with the given values, every row and column
+ * contains each value once, and every group meets its target.
+ *
+ * The row and column checks are done with bitmasks, in a single pass
+ * with no branches, over the whole grid. Only when a grid fails is it
+ * examined again to find the first rule broken, so correct answers,
+ * which are the common case, cost as little as possible.
+ */
+
+#include <stdint.h>
+#include "cdok.h"
+
+/* Rules, in the order they're checked. */
+typedef enum {
+	CDOK_VERIFY_OK = 0,
+	CDOK_VERIFY_EMPTY,		/* value missing or out of range */
+	CDOK_VERIFY_GIVEN,		/* disagrees with a given value */
+	CDOK_VERIFY_ROW,		/* value repeated in a row */
+	CDOK_VERIFY_COLUMN,		/* value repeated in a column */
+	CDOK_VERIFY_CAGE		/* group misses its target */
+} cdok_verify_t;
+
+/* The first rule a grid breaks, and where. For repeated values, the
+ * cell is the second occurrence, in row or column order. For groups,
+ * it's the group's first member, and the group index is also given
+ * (CDOK_GROUP_NONE otherwise).
+ */
+struct cdok_violation {
+	cdok_verify_t	rule;
+	cdok_pos_t	cell;
+	uint8_t		group;
+};
+
+/* Short name of a rule: "ok", "empty", "given", "row", "column" or
+ * "cage".
+ */
+const char *cdok_verify_name(cdok_verify_t rule);
+
+/* Check a grid against a puzzle. Returns 0 if the grid is a solution,
+ * or -1 if not, in which case the violation (if non-NULL) is filled in.
+ */
+int cdok_verify(const struct cdok_puzzle *puz, const uint8_t *grid,
+		struct cdok_violation *v);
+
+/* Check count grids against their puzzles. The results array (which may
+ * be NULL) receives a violation for each, with rule CDOK_VERIFY_OK for
+ * solutions. Returns the number of grids which aren't solutions.
+ *
+ * Grids of the same size are checked in groups, with the row, column
+ * and given checks done across the whole group at once in vector
+ * lanes, one per grid. Results are the same as from cdok_verify().
+ */
+int cdok_verify_batch(const struct cdok_puzzle *puz,
+		      const uint8_t (*grids)[CDOK_CELLS], int count,
+		      struct cdok_violation *results);
+
+#endif